@@ -0,0 +1,833 @@
+#include "apu.h"
+
+#include "nes.h"
+#include "utils.h"
+#include "savestate.h"
+
+#include <algorithm>
+
+const double APU::CPU_CLOCK_RATE = 21477272.0 / 12;
+const unsigned int APU::DEFAULT_SAMPLE_RATE = 48000;
+
+static const uint8_t LENGTH_TABLE[32] = {
+    10, 254, 20, 2, 40, 4, 80, 6, 160, 8, 60, 10, 14, 12, 26, 14,
+    12, 16, 24, 18, 48, 20, 96, 22, 192, 24, 72, 26, 16, 28, 32, 30
+};
+
+static const uint8_t DUTY_TABLE[4][8] = {
+    { 0, 1, 0, 0, 0, 0, 0, 0 },
+    { 0, 1, 1, 0, 0, 0, 0, 0 },
+    { 0, 1, 1, 1, 1, 0, 0, 0 },
+    { 1, 0, 0, 1, 1, 1, 1, 1 }
+};
+
+static const uint8_t TRIANGLE_TABLE[32] = {
+    15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0,
+    0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15
+};
+
+// In CPU cycles.
+static const uint16_t NOISE_PERIODS[16] = {
+    4, 8, 16, 32, 64, 96, 128, 160, 202, 254, 380, 508, 762, 1016, 2034, 4068
+};
+
+static const uint16_t DMC_RATES[16] = {
+    428, 380, 340, 320, 286, 254, 226, 214, 190, 160, 142, 128, 106, 84, 72, 54
+};
+
+// When the frame counter's steps happen, in CPU cycles after its sequence was restarted, and after how many cycles
+// the sequence starts over.
+static const uint64_t FOUR_STEP_CYCLES[4] = { 7457, 14913, 22371, 29829 };
+static const uint64_t FOUR_STEP_PERIOD = 29830;
+static const uint64_t FIVE_STEP_CYCLES[5] = { 7457, 14913, 22371, 29829, 37281 };
+static const uint64_t FIVE_STEP_PERIOD = 37282;
+
+// The mixer, linearised: how much one unit of each channel's output moves the signal, where 32768 is full scale.
+static const int PULSE_WEIGHT = 246;
+static const int TRIANGLE_WEIGHT = 279;
+static const int NOISE_WEIGHT = 162;
+static const int DMC_WEIGHT = 110;
+
+// A DMC sample fetch takes the bus away from the CPU for this many cycles.
+static const unsigned int DMC_FETCH_STALL = 4;
+
+APU::APU(NES *nes)
+    : nes(nes),
+      pulses(),
+      triangle(),
+      noise(),
+      dmc(),
+      fiveStepMode(false),
+      irqInhibit(false),
+      frameIRQ(false),
+      dmcIRQ(false),
+      frameCounterStart(0),
+      frameStep(0),
+      syncCycle(0),
+      blip(CPU_CLOCK_RATE, DEFAULT_SAMPLE_RATE, DEFAULT_SAMPLE_RATE / 10),
+      blipFrameStart(0),
+      blipLevel(0),
+      synthesizing(false)
+{
+    powerOn();
+}
+
+void APU::powerOn() {
+    pulses[0] = Pulse();
+    pulses[1] = Pulse();
+    triangle = Triangle();
+    noise = Noise();
+    dmc = DMC();
+
+    noise.shift = 1;
+    dmc.bitsRemaining = 8;
+    dmc.silence = true;
+    dmc.sampleAddress = 0xC000;
+    dmc.sampleLength = 1;
+
+    fiveStepMode = false;
+    irqInhibit = false;
+    frameIRQ = false;
+    dmcIRQ = false;
+    frameCounterStart = 0;
+    frameStep = 0;
+
+    syncCycle = 0;
+    blipFrameStart = 0;
+    blipLevel = 0;
+    blip.clear();
+
+    // The power-on state is silence, which needs no steps.
+    updateIRQLines();
+    scheduleEvent();
+}
+
+void APU::reset() {
+    sync();
+
+    writeRegister(0x4015, 0x00);
+    writeRegister(0x4017, (uint8_t)((fiveStepMode ? 0x80 : 0x00) | (irqInhibit ? 0x40 : 0x00)));
+
+    frameIRQ = false;
+    updateIRQLines();
+    scheduleEvent();
+}
+
+void APU::writeRegister(Address address, uint8_t value) {
+    sync();
+
+    const uint64_t now = syncCycle;
+
+    if (address <= 0x4007) {
+        Pulse &pulse = pulses[(address - 0x4000) / 4];
+
+        switch (address & 0x3) {
+            case 0:
+                pulse.duty = (uint8_t)(value >> 6);
+                pulse.envelope.loop = Utils::isBitSet(value, 5);
+                pulse.envelope.constant = Utils::isBitSet(value, 4);
+                pulse.envelope.volume = (uint8_t)(value & 0x0F);
+                break;
+
+            case 1:
+                pulse.sweepEnabled = Utils::isBitSet(value, 7);
+                pulse.sweepPeriod = (uint8_t)((value >> 4) & 0x07);
+                pulse.sweepNegate = Utils::isBitSet(value, 3);
+                pulse.sweepShift = (uint8_t)(value & 0x07);
+                pulse.sweepReload = true;
+                break;
+
+            case 2:
+                pulse.period = (uint16_t)((pulse.period & 0x0700) | value);
+                break;
+
+            case 3:
+                pulse.period = (uint16_t)((pulse.period & 0x00FF) | ((value & 0x07) << 8));
+                pulse.sequence = 0;
+                pulse.envelope.start = true;
+
+                if (pulse.enabled) {
+                    pulse.length = LENGTH_TABLE[value >> 3];
+                }
+                break;
+        }
+    } else if (address == 0x4008) {
+        triangle.control = Utils::isBitSet(value, 7);
+        triangle.linearReload = (uint8_t)(value & 0x7F);
+    } else if (address == 0x400A) {
+        triangle.period = (uint16_t)((triangle.period & 0x0700) | value);
+    } else if (address == 0x400B) {
+        triangle.period = (uint16_t)((triangle.period & 0x00FF) | ((value & 0x07) << 8));
+        triangle.linearReloadFlag = true;
+
+        if (triangle.enabled) {
+            triangle.length = LENGTH_TABLE[value >> 3];
+        }
+    } else if (address == 0x400C) {
+        noise.envelope.loop = Utils::isBitSet(value, 5);
+        noise.envelope.constant = Utils::isBitSet(value, 4);
+        noise.envelope.volume = (uint8_t)(value & 0x0F);
+    } else if (address == 0x400E) {
+        noise.mode = Utils::isBitSet(value, 7);
+        noise.periodIndex = (uint8_t)(value & 0x0F);
+    } else if (address == 0x400F) {
+        noise.envelope.start = true;
+
+        if (noise.enabled) {
+            noise.length = LENGTH_TABLE[value >> 3];
+        }
+    } else if (address == 0x4010) {
+        dmc.irqEnabled = Utils::isBitSet(value, 7);
+        dmc.loop = Utils::isBitSet(value, 6);
+        dmc.rateIndex = (uint8_t)(value & 0x0F);
+
+        if (!dmc.irqEnabled) {
+            dmcIRQ = false;
+        }
+    } else if (address == 0x4011) {
+        dmc.level = (uint8_t)(value & 0x7F);
+    } else if (address == 0x4012) {
+        dmc.sampleAddress = (uint16_t)(0xC000 + value * 64);
+    } else if (address == 0x4013) {
+        dmc.sampleLength = (uint16_t)(value * 16 + 1);
+    } else if (address == 0x4015) {
+        pulses[0].enabled = Utils::isBitSet(value, 0);
+        pulses[1].enabled = Utils::isBitSet(value, 1);
+        triangle.enabled = Utils::isBitSet(value, 2);
+        noise.enabled = Utils::isBitSet(value, 3);
+
+        for (Pulse &pulse : pulses) {
+            if (!pulse.enabled) {
+                pulse.length = 0;
+            }
+        }
+
+        if (!triangle.enabled) {
+            triangle.length = 0;
+        }
+
+        if (!noise.enabled) {
+            noise.length = 0;
+        }
+
+        dmcIRQ = false;
+
+        if (!Utils::isBitSet(value, 4)) {
+            dmc.bytesRemaining = 0;
+        } else if (dmc.bytesRemaining == 0) {
+            restartDMCSample();
+            fetchDMCSample();
+        }
+    } else if (address == 0x4017) {
+        fiveStepMode = Utils::isBitSet(value, 7);
+        irqInhibit = Utils::isBitSet(value, 6);
+
+        if (irqInhibit) {
+            frameIRQ = false;
+        }
+
+        // The sequence restarts three or four cycles later, depending on where in an APU cycle (two CPU cycles) the
+        // write lands.
+        frameCounterStart = now + ((now & 1) != 0 ? 4 : 3);
+        frameStep = 0;
+
+        if (fiveStepMode) {
+            clockQuarterFrame();
+            clockHalfFrame();
+        }
+    }
+
+    updateOutputs(now);
+    updateIRQLines();
+    scheduleEvent();
+}
+
+uint8_t APU::readStatus() {
+    sync();
+
+    uint8_t status = 0;
+    status |= pulses[0].length > 0 ? 0x01 : 0;
+    status |= pulses[1].length > 0 ? 0x02 : 0;
+    status |= triangle.length > 0 ? 0x04 : 0;
+    status |= noise.length > 0 ? 0x08 : 0;
+    status |= dmc.bytesRemaining > 0 ? 0x10 : 0;
+    status |= frameIRQ ? 0x40 : 0;
+    status |= dmcIRQ ? 0x80 : 0;
+
+    frameIRQ = false;
+    updateIRQLines();
+    scheduleEvent();
+
+    return status;
+}
+
+void APU::handleEvent() {
+    sync();
+    scheduleEvent();
+}
+
+void APU::endFrame() {
+    sync();
+
+    // Only frames that are seen are heard: run-ahead and other suppressed frames make no samples at all, rather than
+    // a frame of silence each.
+    if (synthesizing) {
+        blip.endFrame(syncCycle - blipFrameStart);
+    }
+
+    blipFrameStart = syncCycle;
+}
+
+void APU::setSampleRate(unsigned int sampleRate) {
+    blip = BlipBuffer(CPU_CLOCK_RATE, sampleRate, sampleRate / 10);
+    blipLevel = 0;
+}
+
+void APU::setRateAdjustment(double ratio) {
+    blip.setRateAdjustment(ratio);
+}
+
+unsigned int APU::getSampleRate() const {
+    return blip.getSampleRate();
+}
+
+size_t APU::getAvailableSamples() const {
+    return blip.getAvailableSamples();
+}
+
+size_t APU::readSamples(int16_t *outSamples, size_t count) {
+    return blip.readSamples(outSamples, count);
+}
+
+void APU::sync() {
+    synthesizing = !nes->getPPU()->isOutputSuppressed();
+
+    // The amplitudes move without steps while nothing is synthesized, and jump when a state is loaded, so the output
+    // picks up from wherever the channels are now.
+    if (synthesizing && blipLevel != getLevel()) {
+        blip.addDelta(syncCycle - blipFrameStart, getLevel() - blipLevel);
+        blipLevel = getLevel();
+    }
+
+    run(nes->getScheduler()->getTime() / PPU::DOTS_PER_CPU_CYCLE);
+}
+
+void APU::run(uint64_t cycle) {
+    // Between two steps of the frame counter, the channels only change by themselves, so each can be run on its own.
+    while (syncCycle < cycle) {
+        const uint64_t frameStepCycle = getFrameStepCycle();
+        const uint64_t end = std::min(cycle, frameStepCycle);
+
+        runPulse(pulses[0], end);
+        runPulse(pulses[1], end);
+        runTriangle(end);
+        runNoise(end);
+        runDMC(end);
+
+        syncCycle = end;
+
+        if (end == frameStepCycle) {
+            clockFrameCounter();
+            updateOutputs(end);
+        }
+    }
+
+    updateIRQLines();
+}
+
+uint64_t APU::getFrameStepCycle() const {
+    return frameCounterStart + (fiveStepMode ? FIVE_STEP_CYCLES[frameStep] : FOUR_STEP_CYCLES[frameStep]);
+}
+
+void APU::clockFrameCounter() {
+    if (fiveStepMode) {
+        // The fourth step does nothing.
+        if (frameStep != 3) {
+            clockQuarterFrame();
+        }
+
+        if (frameStep == 1 || frameStep == 4) {
+            clockHalfFrame();
+        }
+
+        if (++frameStep == 5) {
+            frameStep = 0;
+            frameCounterStart += FIVE_STEP_PERIOD;
+        }
+    } else {
+        clockQuarterFrame();
+
+        if (frameStep == 1 || frameStep == 3) {
+            clockHalfFrame();
+        }
+
+        if (frameStep == 3 && !irqInhibit) {
+            frameIRQ = true;
+        }
+
+        if (++frameStep == 4) {
+            frameStep = 0;
+            frameCounterStart += FOUR_STEP_PERIOD;
+        }
+    }
+}
+
+void APU::clockQuarterFrame() {
+    clockEnvelope(pulses[0].envelope);
+    clockEnvelope(pulses[1].envelope);
+    clockEnvelope(noise.envelope);
+
+    if (triangle.linearReloadFlag) {
+        triangle.linearCounter = triangle.linearReload;
+    } else if (triangle.linearCounter > 0) {
+        triangle.linearCounter--;
+    }
+
+    if (!triangle.control) {
+        triangle.linearReloadFlag = false;
+    }
+}
+
+void APU::clockHalfFrame() {
+    for (size_t i = 0; i < 2; i++) {
+        Pulse &pulse = pulses[i];
+
+        if (!pulse.envelope.loop && pulse.length > 0) {
+            pulse.length--;
+        }
+
+        // Pulse 1 negates with the one's complement, pulse 2 with the two's complement.
+        const uint16_t target = getSweepTarget(pulse, i == 0);
+
+        if (pulse.sweepDivider == 0 && pulse.sweepEnabled && pulse.sweepShift > 0 && pulse.period >= 8 &&
+            target <= 0x7FF) {
+            pulse.period = target;
+        }
+
+        if (pulse.sweepDivider == 0 || pulse.sweepReload) {
+            pulse.sweepDivider = pulse.sweepPeriod;
+            pulse.sweepReload = false;
+        } else {
+            pulse.sweepDivider--;
+        }
+    }
+
+    if (!triangle.control && triangle.length > 0) {
+        triangle.length--;
+    }
+
+    if (!noise.envelope.loop && noise.length > 0) {
+        noise.length--;
+    }
+}
+
+void APU::runPulse(APU::Pulse &pulse, uint64_t end) {
+    if (pulse.nextStep > end) {
+        return;
+    }
+
+    // The sequencer moves on every (period + 1) APU cycles, i.e. twice as many CPU cycles.
+    const uint64_t period = ((uint64_t)pulse.period + 1) * 2;
+
+    const bool audible = isPulseAudible(pulse);
+
+    if (!synthesizing || !audible) {
+        // Nobody hears the steps, so skip them all at once. The amplitude is part of the state though, so it still has
+        // to end up where stepping one at a time would have left it.
+        const uint64_t steps = (end - pulse.nextStep) / period + 1;
+        pulse.sequence = (uint8_t)((pulse.sequence + steps) & 0x07);
+        pulse.nextStep += steps * period;
+
+        if (audible) {
+            setAmplitude(pulse.amplitude, DUTY_TABLE[pulse.duty][pulse.sequence] * getEnvelopeVolume(pulse.envelope),
+                         PULSE_WEIGHT, pulse.nextStep - period);
+        }
+
+        return;
+    }
+
+    const int volume = getEnvelopeVolume(pulse.envelope);
+
+    do {
+        pulse.sequence = (uint8_t)((pulse.sequence + 1) & 0x07);
+        setAmplitude(pulse.amplitude, DUTY_TABLE[pulse.duty][pulse.sequence] * volume, PULSE_WEIGHT, pulse.nextStep);
+        pulse.nextStep += period;
+    } while (pulse.nextStep <= end);
+}
+
+void APU::runTriangle(uint64_t end) {
+    if (triangle.nextStep > end) {
+        return;
+    }
+
+    const uint64_t period = (uint64_t)triangle.period + 1;
+
+    // The sequencer stands still while either counter is zero. Periods this short produce ultrasonic tones, which
+    // the real thing turns into a flat level anyway, so they're kept still too rather than spending a step on every
+    // couple of cycles.
+    if (triangle.length == 0 || triangle.linearCounter == 0 || triangle.period < 2) {
+        triangle.nextStep += ((end - triangle.nextStep) / period + 1) * period;
+        return;
+    }
+
+    if (!synthesizing) {
+        const uint64_t steps = (end - triangle.nextStep) / period + 1;
+        triangle.sequence = (uint8_t)((triangle.sequence + steps) & 0x1F);
+        triangle.nextStep += steps * period;
+        triangle.amplitude = TRIANGLE_TABLE[triangle.sequence];
+        return;
+    }
+
+    do {
+        triangle.sequence = (uint8_t)((triangle.sequence + 1) & 0x1F);
+        setAmplitude(triangle.amplitude, TRIANGLE_TABLE[triangle.sequence], TRIANGLE_WEIGHT, triangle.nextStep);
+        triangle.nextStep += period;
+    } while (triangle.nextStep <= end);
+}
+
+void APU::runNoise(uint64_t end) {
+    const uint64_t period = NOISE_PERIODS[noise.periodIndex];
+    const bool audible = noise.length > 0 && getEnvelopeVolume(noise.envelope) > 0;
+    const unsigned int tap = noise.mode ? 6 : 1;
+
+    if (noise.nextStep > end) {
+        return;
+    }
+
+    // The shift register is stepped even when it can't be heard, so the noise continues the same way.
+    while (noise.nextStep <= end) {
+        const uint16_t feedback = (uint16_t)((noise.shift ^ (noise.shift >> tap)) & 1);
+        noise.shift = (uint16_t)((noise.shift >> 1) | (feedback << 14));
+
+        if (audible && synthesizing) {
+            setAmplitude(noise.amplitude, getNoiseOutput(), NOISE_WEIGHT, noise.nextStep);
+        }
+
+        noise.nextStep += period;
+    }
+
+    // Without synthesis only the last step's output is kept, as part of the state.
+    if (audible && !synthesizing) {
+        setAmplitude(noise.amplitude, getNoiseOutput(), NOISE_WEIGHT, noise.nextStep - period);
+    }
+}
+
+void APU::runDMC(uint64_t end) {
+    const uint64_t period = DMC_RATES[dmc.rateIndex];
+
+    while (dmc.nextStep <= end) {
+        if (!dmc.silence) {
+            if ((dmc.shift & 1) != 0) {
+                if (dmc.level <= 125) {
+                    dmc.level += 2;
+                }
+            } else if (dmc.level >= 2) {
+                dmc.level -= 2;
+            }
+
+            setAmplitude(dmc.amplitude, dmc.level, DMC_WEIGHT, dmc.nextStep);
+        }
+
+        dmc.shift >>= 1;
+
+        if (--dmc.bitsRemaining == 0) {
+            dmc.bitsRemaining = 8;
+            dmc.silence = !dmc.bufferFull;
+
+            if (dmc.bufferFull) {
+                dmc.shift = dmc.buffer;
+                dmc.bufferFull = false;
+                fetchDMCSample();
+            }
+        }
+
+        dmc.nextStep += period;
+
+        if (dmc.silence && !dmc.bufferFull && dmc.bytesRemaining == 0) {
+            // Nothing will happen until the CPU starts a sample; let the output unit idle ahead in one go.
+            if (dmc.nextStep <= end) {
+                const uint64_t steps = (end - dmc.nextStep) / period + 1;
+                dmc.bitsRemaining = (uint8_t)(8 - (8 - dmc.bitsRemaining + steps) % 8);
+                dmc.shift = 0;
+                dmc.nextStep += steps * period;
+            }
+        }
+    }
+}
+
+void APU::fetchDMCSample() {
+    if (dmc.bufferFull || dmc.bytesRemaining == 0) {
+        return;
+    }
+
+    dmc.buffer = nes->getMemory()->readCPU(dmc.currentAddress);
+    dmc.bufferFull = true;
+    nes->getCPU()->stall(DMC_FETCH_STALL);
+
+    dmc.currentAddress = dmc.currentAddress == 0xFFFF ? 0x8000 : (uint16_t)(dmc.currentAddress + 1);
+
+    if (--dmc.bytesRemaining == 0) {
+        if (dmc.loop) {
+            restartDMCSample();
+        } else if (dmc.irqEnabled) {
+            dmcIRQ = true;
+        }
+    }
+}
+
+void APU::restartDMCSample() {
+    dmc.currentAddress = dmc.sampleAddress;
+    dmc.bytesRemaining = dmc.sampleLength;
+}
+
+void APU::updateOutputs(uint64_t cycle) {
+    setAmplitude(pulses[0].amplitude, getPulseOutput(pulses[0]), PULSE_WEIGHT, cycle);
+    setAmplitude(pulses[1].amplitude, getPulseOutput(pulses[1]), PULSE_WEIGHT, cycle);
+    setAmplitude(triangle.amplitude, TRIANGLE_TABLE[triangle.sequence], TRIANGLE_WEIGHT, cycle);
+    setAmplitude(noise.amplitude, getNoiseOutput(), NOISE_WEIGHT, cycle);
+    setAmplitude(dmc.amplitude, dmc.level, DMC_WEIGHT, cycle);
+}
+
+void APU::setAmplitude(int &amplitude, int value, int weight, uint64_t cycle) {
+    if (value == amplitude) {
+        return;
+    }
+
+    if (synthesizing) {
+        blip.addDelta(cycle - blipFrameStart, (value - amplitude) * weight);
+        blipLevel += (value - amplitude) * weight;
+    }
+
+    amplitude = value;
+}
+
+int APU::getLevel() const {
+    return (pulses[0].amplitude + pulses[1].amplitude) * PULSE_WEIGHT + triangle.amplitude * TRIANGLE_WEIGHT +
+           noise.amplitude * NOISE_WEIGHT + dmc.amplitude * DMC_WEIGHT;
+}
+
+void APU::updateIRQLines() {
+    nes->getCPU()->setIRQLine(IRQSource::APU_FRAME_COUNTER, frameIRQ);
+    nes->getCPU()->setIRQLine(IRQSource::APU_DMC, dmcIRQ);
+}
+
+void APU::scheduleEvent() {
+    uint64_t next = Scheduler::NEVER;
+
+    // The frame counter IRQ has to be raised on time...
+    if (!fiveStepMode && !irqInhibit && !frameIRQ) {
+        next = frameCounterStart + FOUR_STEP_CYCLES[3];
+    }
+
+    // ... and so do DMC fetches, which stall the CPU and may raise the DMC IRQ. The next one happens when the
+    // output unit empties the buffer, at the start of its next 8-bit cycle.
+    if (dmc.bufferFull) {
+        next = std::min(next, dmc.nextStep + (uint64_t)(dmc.bitsRemaining - 1) * DMC_RATES[dmc.rateIndex]);
+    }
+
+    if (next == Scheduler::NEVER) {
+        nes->getScheduler()->cancel(EventType::APU);
+    } else {
+        nes->getScheduler()->schedule(EventType::APU, next * PPU::DOTS_PER_CPU_CYCLE);
+    }
+}
+
+bool APU::isPulseAudible(const APU::Pulse &pulse) const {
+    return pulse.length > 0 && pulse.period >= 8 && getSweepTarget(pulse, &pulse == &pulses[0]) <= 0x7FF &&
+           getEnvelopeVolume(pulse.envelope) > 0;
+}
+
+uint8_t APU::getPulseOutput(const APU::Pulse &pulse) const {
+    if (!isPulseAudible(pulse) || DUTY_TABLE[pulse.duty][pulse.sequence] == 0) {
+        return 0;
+    }
+
+    return getEnvelopeVolume(pulse.envelope);
+}
+
+uint8_t APU::getNoiseOutput() const {
+    return noise.length == 0 || (noise.shift & 1) != 0 ? 0 : getEnvelopeVolume(noise.envelope);
+}
+
+uint8_t APU::getEnvelopeVolume(const APU::Envelope &envelope) {
+    return envelope.constant ? envelope.volume : envelope.decay;
+}
+
+void APU::clockEnvelope(APU::Envelope &envelope) {
+    if (envelope.start) {
+        envelope.start = false;
+        envelope.decay = 15;
+        envelope.divider = envelope.volume;
+    } else if (envelope.divider == 0) {
+        envelope.divider = envelope.volume;
+
+        if (envelope.decay > 0) {
+            envelope.decay--;
+        } else if (envelope.loop) {
+            envelope.decay = 15;
+        }
+    } else {
+        envelope.divider--;
+    }
+}
+
+uint16_t APU::getSweepTarget(const APU::Pulse &pulse, bool onesComplement) {
+    const uint16_t change = (uint16_t)(pulse.period >> pulse.sweepShift);
+
+    if (!pulse.sweepNegate) {
+        return (uint16_t)(pulse.period + change);
+    }
+
+    // Can't go below 0; a negative target doesn't mute.
+    const int target = (int)pulse.period - change - (onesComplement ? 1 : 0);
+    return (uint16_t)std::max(target, 0);
+}
+
+void APU::saveEnvelope(StateWriter &writer, const APU::Envelope &envelope) {
+    writer.write(envelope.start);
+    writer.write(envelope.loop);
+    writer.write(envelope.constant);
+    writer.write(envelope.volume);
+    writer.write(envelope.divider);
+    writer.write(envelope.decay);
+}
+
+void APU::loadEnvelope(StateReader &reader, APU::Envelope &envelope) {
+    reader.read(envelope.start);
+    reader.read(envelope.loop);
+    reader.read(envelope.constant);
+    reader.read(envelope.volume);
+    reader.read(envelope.divider);
+    reader.read(envelope.decay);
+}
+
+void APU::saveState(StateWriter &writer) const {
+    // Field by field: the channel structs have padding, which must not make equal states differ.
+    for (const Pulse &pulse : pulses) {
+        writer.write(pulse.enabled);
+        saveEnvelope(writer, pulse.envelope);
+        writer.write(pulse.duty);
+        writer.write(pulse.sequence);
+        writer.write(pulse.period);
+        writer.write(pulse.length);
+        writer.write(pulse.sweepEnabled);
+        writer.write(pulse.sweepNegate);
+        writer.write(pulse.sweepReload);
+        writer.write(pulse.sweepPeriod);
+        writer.write(pulse.sweepShift);
+        writer.write(pulse.sweepDivider);
+        writer.write(pulse.nextStep);
+        writer.write(pulse.amplitude);
+    }
+
+    writer.write(triangle.enabled);
+    writer.write(triangle.control);
+    writer.write(triangle.linearReload);
+    writer.write(triangle.linearCounter);
+    writer.write(triangle.linearReloadFlag);
+    writer.write(triangle.period);
+    writer.write(triangle.length);
+    writer.write(triangle.sequence);
+    writer.write(triangle.nextStep);
+    writer.write(triangle.amplitude);
+
+    writer.write(noise.enabled);
+    saveEnvelope(writer, noise.envelope);
+    writer.write(noise.mode);
+    writer.write(noise.periodIndex);
+    writer.write(noise.shift);
+    writer.write(noise.length);
+    writer.write(noise.nextStep);
+    writer.write(noise.amplitude);
+
+    writer.write(dmc.irqEnabled);
+    writer.write(dmc.loop);
+    writer.write(dmc.rateIndex);
+    writer.write(dmc.level);
+    writer.write(dmc.sampleAddress);
+    writer.write(dmc.sampleLength);
+    writer.write(dmc.currentAddress);
+    writer.write(dmc.bytesRemaining);
+    writer.write(dmc.buffer);
+    writer.write(dmc.bufferFull);
+    writer.write(dmc.shift);
+    writer.write(dmc.bitsRemaining);
+    writer.write(dmc.silence);
+    writer.write(dmc.nextStep);
+    writer.write(dmc.amplitude);
+
+    writer.write(fiveStepMode);
+    writer.write(irqInhibit);
+    writer.write(frameIRQ);
+    writer.write(dmcIRQ);
+    writer.write(frameCounterStart);
+    writer.write(frameStep);
+    writer.write(syncCycle);
+}
+
+void APU::loadState(StateReader &reader) {
+    for (Pulse &pulse : pulses) {
+        reader.read(pulse.enabled);
+        loadEnvelope(reader, pulse.envelope);
+        reader.read(pulse.duty);
+        reader.read(pulse.sequence);
+        reader.read(pulse.period);
+        reader.read(pulse.length);
+        reader.read(pulse.sweepEnabled);
+        reader.read(pulse.sweepNegate);
+        reader.read(pulse.sweepReload);
+        reader.read(pulse.sweepPeriod);
+        reader.read(pulse.sweepShift);
+        reader.read(pulse.sweepDivider);
+        reader.read(pulse.nextStep);
+        reader.read(pulse.amplitude);
+    }
+
+    reader.read(triangle.enabled);
+    reader.read(triangle.control);
+    reader.read(triangle.linearReload);
+    reader.read(triangle.linearCounter);
+    reader.read(triangle.linearReloadFlag);
+    reader.read(triangle.period);
+    reader.read(triangle.length);
+    reader.read(triangle.sequence);
+    reader.read(triangle.nextStep);
+    reader.read(triangle.amplitude);
+
+    reader.read(noise.enabled);
+    loadEnvelope(reader, noise.envelope);
+    reader.read(noise.mode);
+    reader.read(noise.periodIndex);
+    reader.read(noise.shift);
+    reader.read(noise.length);
+    reader.read(noise.nextStep);
+    reader.read(noise.amplitude);
+
+    reader.read(dmc.irqEnabled);
+    reader.read(dmc.loop);
+    reader.read(dmc.rateIndex);
+    reader.read(dmc.level);
+    reader.read(dmc.sampleAddress);
+    reader.read(dmc.sampleLength);
+    reader.read(dmc.currentAddress);
+    reader.read(dmc.bytesRemaining);
+    reader.read(dmc.buffer);
+    reader.read(dmc.bufferFull);
+    reader.read(dmc.shift);
+    reader.read(dmc.bitsRemaining);
+    reader.read(dmc.silence);
+    reader.read(dmc.nextStep);
+    reader.read(dmc.amplitude);
+
+    reader.read(fiveStepMode);
+    reader.read(irqInhibit);
+    reader.read(frameIRQ);
+    reader.read(dmcIRQ);
+    reader.read(frameCounterStart);
+    reader.read(frameStep);
+    reader.read(syncCycle);
+
+    // The output continues from here, stepping to the loaded amplitudes at the next sync(); the samples already made
+    // are kept.
+    blipFrameStart = syncCycle;
+}
\ No newline at end of file
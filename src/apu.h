@@ -0,0 +1,239 @@
+#pragma once
+
+#include "address.h"
+#include "blip.h"
+
+#include <cstdint>
+#include <cstddef>
+
+class NES;
+class StateWriter;
+class StateReader;
+
+/**
+ * The 2A03's audio processing unit: two pulse channels, a triangle, noise, the delta modulation channel (DMC) and
+ * the frame counter, with its IRQ.
+ *
+ * The APU isn't clocked along with the CPU. It keeps the time up to which it has run and catches up in one go
+ * whenever that matters: when the CPU accesses one of its registers, when it has to raise an IRQ or fetch a DMC
+ * sample byte (which it schedules events for), and at the end of every frame. Catching up steps each channel from
+ * one change of its output to the next rather than cycle by cycle, and channels that are silent skip ahead in a
+ * single step.
+ *
+ * Every change of a channel's output is handed to a BlipBuffer as a band-limited step, so audio comes out at the
+ * sample rate directly. While the PPU's output is suppressed, nothing is synthesized and no samples are made; the
+ * channels still run, as the game can observe them.
+ */
+class APU {
+    friend class NES;
+public:
+    explicit APU(NES *nes);
+
+    /**
+     * Handles writes to $4000-$4013, $4015 and $4017.
+     */
+    void writeRegister(Address address, uint8_t value);
+
+    /**
+     * Reads $4015: which channels are playing, and the IRQ flags. Acknowledges the frame counter IRQ.
+     */
+    uint8_t readStatus();
+
+    /**
+     * Called by the NES when the EventType::APU event comes due.
+     */
+    void handleEvent();
+
+    /**
+     * Called by the NES at the end of every frame: brings the APU up to date and makes the frame's samples readable.
+     */
+    void endFrame();
+
+    /**
+     * Sets the rate of the samples. Samples that haven't been read yet are dropped.
+     */
+    void setSampleRate(unsigned int sampleRate);
+
+    unsigned int getSampleRate() const;
+
+    /**
+     * Makes `ratio` times as many samples per second of emulated time from the next frame on; see
+     * Audio::getRateAdjustment(). Not part of the state.
+     */
+    void setRateAdjustment(double ratio);
+
+    size_t getAvailableSamples() const;
+
+    /**
+     * Reads up to `count` mono samples. Up to a tenth of a second of samples is kept if they aren't read.
+     * @return The number of samples read.
+     */
+    size_t readSamples(int16_t *outSamples, size_t count);
+
+    /**
+     * Silences every channel and puts the frame counter back into its power-on state.
+     */
+    void powerOn();
+
+    /**
+     * What the reset button does to the APU: as if $00 was written to $4015, and $4017 was written again.
+     */
+    void reset();
+
+    void saveState(StateWriter &writer) const;
+
+    void loadState(StateReader &reader);
+
+    // NTSC: the master clock divided by 12.
+    static const double CPU_CLOCK_RATE;
+
+    static const unsigned int DEFAULT_SAMPLE_RATE;
+
+private:
+    struct Envelope {
+        bool start;
+        bool loop;          // Also halts the length counter.
+        bool constant;
+        uint8_t volume;     // The constant volume, or the divider's period.
+        uint8_t divider;
+        uint8_t decay;
+    };
+
+    struct Pulse {
+        bool enabled;
+        Envelope envelope;
+        uint8_t duty;
+        uint8_t sequence;
+        uint16_t period;
+        uint8_t length;
+
+        bool sweepEnabled;
+        bool sweepNegate;
+        bool sweepReload;
+        uint8_t sweepPeriod;
+        uint8_t sweepShift;
+        uint8_t sweepDivider;
+
+        uint64_t nextStep;  // The cycle at which the sequencer next moves on.
+        int amplitude;
+    };
+
+    struct Triangle {
+        bool enabled;
+        bool control;       // Halts the length counter and keeps reloading the linear counter.
+        uint8_t linearReload;
+        uint8_t linearCounter;
+        bool linearReloadFlag;
+        uint16_t period;
+        uint8_t length;
+        uint8_t sequence;
+
+        uint64_t nextStep;
+        int amplitude;
+    };
+
+    struct Noise {
+        bool enabled;
+        Envelope envelope;
+        bool mode;
+        uint8_t periodIndex;
+        uint16_t shift;
+        uint8_t length;
+
+        uint64_t nextStep;
+        int amplitude;
+    };
+
+    struct DMC {
+        bool irqEnabled;
+        bool loop;
+        uint8_t rateIndex;
+        uint8_t level;
+
+        uint16_t sampleAddress;
+        uint16_t sampleLength;
+        uint16_t currentAddress;
+        uint16_t bytesRemaining;
+
+        uint8_t buffer;
+        bool bufferFull;
+        uint8_t shift;
+        uint8_t bitsRemaining;
+        bool silence;
+
+        uint64_t nextStep;
+        int amplitude;
+    };
+
+    NES *nes;
+
+    Pulse pulses[2];
+    Triangle triangle;
+    Noise noise;
+    DMC dmc;
+
+    bool fiveStepMode;
+    bool irqInhibit;
+    bool frameIRQ;
+    bool dmcIRQ;
+    uint64_t frameCounterStart; // The cycle the frame counter's sequence was last restarted at.
+    uint8_t frameStep;          // The next step of the sequence.
+
+    uint64_t syncCycle;         // The APU has run up to and including this CPU cycle.
+
+    // Output, not part of the state.
+    BlipBuffer blip;
+    uint64_t blipFrameStart;    // The cycle the BlipBuffer's current frame started at.
+    int blipLevel;              // What the steps handed to the BlipBuffer add up to.
+    bool synthesizing;
+
+    void sync();
+
+    void run(uint64_t cycle);
+
+    uint64_t getFrameStepCycle() const;
+
+    void clockFrameCounter();
+
+    void clockQuarterFrame();
+
+    void clockHalfFrame();
+
+    void runPulse(Pulse &pulse, uint64_t end);
+
+    void runTriangle(uint64_t end);
+
+    void runNoise(uint64_t end);
+
+    void runDMC(uint64_t end);
+
+    void fetchDMCSample();
+
+    void restartDMCSample();
+
+    void updateOutputs(uint64_t cycle);
+
+    void setAmplitude(int &amplitude, int value, int weight, uint64_t cycle);
+
+    int getLevel() const;
+
+    void updateIRQLines();
+
+    void scheduleEvent();
+
+    bool isPulseAudible(const Pulse &pulse) const;
+
+    uint8_t getPulseOutput(const Pulse &pulse) const;
+
+    uint8_t getNoiseOutput() const;
+
+    static uint8_t getEnvelopeVolume(const Envelope &envelope);
+
+    static void clockEnvelope(Envelope &envelope);
+
+    static uint16_t getSweepTarget(const Pulse &pulse, bool onesComplement);
+
+    static void saveEnvelope(StateWriter &writer, const Envelope &envelope);
+
+    static void loadEnvelope(StateReader &reader, Envelope &envelope);
+};
\ No newline at end of file
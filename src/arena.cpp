@@ -0,0 +1,85 @@
+#include "arena.h"
+
+#include "nes.h"
+#include "mappers.h"
+
+#include <new>
+#include <cassert>
+
+const size_t NESArena::ALIGNMENT;
+const size_t NESArena::DEFAULT_CARTRIDGE_RAM_SIZE;
+
+static size_t alignSize(size_t size) {
+    return (size + NESArena::ALIGNMENT - 1) / NESArena::ALIGNMENT * NESArena::ALIGNMENT;
+}
+
+NESArena::NESArena(size_t capacity, size_t cartridgeRAMSize)
+    : mapperOffset(alignSize(sizeof(NES))),
+      ramOffset(mapperOffset + alignSize(Mappers::MAX_SIZE)),
+      ramSize(alignSize(cartridgeRAMSize)),
+      slotSize(ramOffset + ramSize),
+      storage(new uint8_t[capacity * slotSize + ALIGNMENT]),
+      slots(nullptr),
+      capacity(capacity),
+      freeSlots(),
+      live(capacity, false)
+{
+    assert(Mappers::MAX_ALIGNMENT <= ALIGNMENT);
+
+    const uintptr_t start = (uintptr_t)storage.get();
+    slots = storage.get() + (ALIGNMENT - start % ALIGNMENT) % ALIGNMENT;
+
+    // Hand out the lowest slots first, so a partly used arena only touches the start of the block.
+    freeSlots.reserve(capacity);
+
+    for (size_t i = capacity; i > 0; i--) {
+        freeSlots.push_back(i - 1);
+    }
+}
+
+NESArena::~NESArena() {
+    for (size_t i = 0; i < capacity; i++) {
+        if (live[i]) {
+            ((NES *)(slots + i * slotSize))->~NES();
+        }
+    }
+}
+
+NES *NESArena::create(Cartridge &cartridge) {
+    if (freeSlots.empty()) {
+        return nullptr;
+    }
+
+    const size_t slot = freeSlots.back();
+    freeSlots.pop_back();
+    live[slot] = true;
+
+    uint8_t *start = slots + slot * slotSize;
+    cartridge.setStorage(start + mapperOffset, start + ramOffset, ramSize);
+
+    return new (start) NES(cartridge);
+}
+
+void NESArena::destroy(NES *nes) {
+    const size_t offset = (size_t)((uint8_t *)nes - slots);
+    const size_t slot = offset / slotSize;
+
+    // Anything else would corrupt the free list, or free some other instance's slot.
+    assert((uint8_t *)nes >= slots && slot < capacity && offset % slotSize == 0 && live[slot]);
+
+    nes->~NES();
+    live[slot] = false;
+    freeSlots.push_back(slot);
+}
+
+size_t NESArena::getCapacity() const {
+    return capacity;
+}
+
+size_t NESArena::getLiveCount() const {
+    return capacity - freeSlots.size();
+}
+
+size_t NESArena::getSlotSize() const {
+    return slotSize;
+}
\ No newline at end of file
@@ -0,0 +1,72 @@
+#pragma once
+
+#include <vector>
+#include <memory>
+#include <cstdint>
+#include <cstddef>
+
+class NES;
+class Cartridge;
+
+/**
+ * A fixed number of slots for NES instances in one contiguous, cache-line-aligned block. Creating and destroying an
+ * instance takes a slot off and puts it back on a free list, so thousands of instances don't each go through the
+ * global heap, and neighbouring instances don't share cache lines.
+ *
+ * Each slot holds the NES object, its mapper (with room for the biggest one there is) and its cartridge's RAM, up to
+ * the size given to the constructor; a game that needs more RAM than that has it allocated on the heap instead. The
+ * framebuffer (once an instance draws one) and the audio buffer are still separate allocations; see
+ * NES::getMemoryUsage().
+ */
+class NESArena {
+public:
+    static const size_t ALIGNMENT = 64;
+
+    // Room for 8 KB of PRG-RAM and 8 KB of CHR-RAM, which covers nearly every board.
+    static const size_t DEFAULT_CARTRIDGE_RAM_SIZE = 16 * 1024;
+
+    explicit NESArena(size_t capacity, size_t cartridgeRAMSize = DEFAULT_CARTRIDGE_RAM_SIZE);
+
+    /**
+     * Destroys any instances that are still alive.
+     */
+    ~NESArena();
+
+    NESArena(const NESArena &) = delete;
+
+    NESArena &operator=(const NESArena &) = delete;
+
+    /**
+     * Constructs a NES in a free slot. Like the NES constructor, this _moves_ the cartridge.
+     * @return The new instance, or nullptr if every slot is taken.
+     */
+    NES *create(Cartridge &cartridge);
+
+    /**
+     * Destroys an instance created by this arena and frees its slot.
+     */
+    void destroy(NES *nes);
+
+    size_t getCapacity() const;
+
+    size_t getLiveCount() const;
+
+    /**
+     * @return How many bytes of the arena each instance takes: the NES object, the biggest mapper and the cartridge
+     * RAM, each rounded up to a whole cache line.
+     */
+    size_t getSlotSize() const;
+
+private:
+    size_t mapperOffset;                // Where the mapper and the RAM start within a slot.
+    size_t ramOffset;
+    size_t ramSize;
+    size_t slotSize;
+
+    std::unique_ptr<uint8_t[]> storage;
+    uint8_t *slots;                     // The start of the first slot, aligned within `storage`.
+    size_t capacity;
+
+    std::vector<size_t> freeSlots;
+    std::vector<bool> live;
+};
\ No newline at end of file
@@ -0,0 +1,236 @@
+#include "audio.h"
+
+#include "apu.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+
+const size_t Audio::Ring::CACHE_LINE_SIZE;
+
+const size_t Audio::WAVWriter::BUFFER_SIZE = 256 * 1024;
+
+const double Audio::MAX_RATE_ADJUSTMENT = 0.005;
+
+static const size_t WAV_HEADER_SIZE = 44;
+
+// How long the sink thread sleeps when the ring is empty. A frame is about 16.6 ms, so it's polled a few times per
+// frame.
+static const std::chrono::milliseconds SINK_POLL_INTERVAL(2);
+
+// How many samples the sink thread takes out of the ring at once.
+static const size_t SINK_CHUNK_SIZE = 4096;
+
+static size_t roundUpToPowerOfTwo(size_t value) {
+    size_t result = 1;
+
+    while (result < value) {
+        result <<= 1;
+    }
+
+    return result;
+}
+
+static void writeUint16LE(uint8_t *out, uint16_t value) {
+    out[0] = (uint8_t)value;
+    out[1] = (uint8_t)(value >> 8);
+}
+
+static void writeUint32LE(uint8_t *out, uint32_t value) {
+    for (size_t i = 0; i < 4; i++) {
+        out[i] = (uint8_t)(value >> (i * 8));
+    }
+}
+
+Audio::Ring::Ring(size_t capacity)
+    : samples(roundUpToPowerOfTwo(capacity)),
+      mask(samples.size() - 1),
+      head(0),
+      cachedTail(0),
+      consumerPadding(),
+      tail(0),
+      cachedHead(0),
+      producerPadding()
+{
+}
+
+size_t Audio::Ring::write(const int16_t *source, size_t count) {
+    const size_t position = tail.load(std::memory_order_relaxed);
+
+    if (samples.size() - (position - cachedHead) < count) {
+        cachedHead = head.load(std::memory_order_acquire);
+    }
+
+    count = std::min(count, samples.size() - (position - cachedHead));
+
+    // In at most two pieces, as the free space may wrap around the end.
+    const size_t start = position & mask;
+    const size_t first = std::min(count, samples.size() - start);
+    std::memcpy(samples.data() + start, source, first * sizeof(int16_t));
+    std::memcpy(samples.data(), source + first, (count - first) * sizeof(int16_t));
+
+    tail.store(position + count, std::memory_order_release);
+    return count;
+}
+
+size_t Audio::Ring::read(int16_t *outSamples, size_t count) {
+    const size_t position = head.load(std::memory_order_relaxed);
+
+    if (cachedTail - position < count) {
+        cachedTail = tail.load(std::memory_order_acquire);
+    }
+
+    count = std::min(count, cachedTail - position);
+
+    const size_t start = position & mask;
+    const size_t first = std::min(count, samples.size() - start);
+    std::memcpy(outSamples, samples.data() + start, first * sizeof(int16_t));
+    std::memcpy(outSamples + first, samples.data(), (count - first) * sizeof(int16_t));
+
+    head.store(position + count, std::memory_order_release);
+    return count;
+}
+
+size_t Audio::Ring::getFill() const {
+    // Head first: it only grows, so the difference can't come out negative.
+    const size_t position = head.load(std::memory_order_acquire);
+    return tail.load(std::memory_order_acquire) - position;
+}
+
+size_t Audio::Ring::getCapacity() const {
+    return samples.size();
+}
+
+Audio::WAVWriter::WAVWriter() : out(), buffer(), dataSize(0) {
+}
+
+bool Audio::WAVWriter::open(const std::string &file, unsigned int sampleRate) {
+    out.open(file, std::ios::out | std::ios::binary | std::ios::trunc);
+
+    buffer.clear();
+    buffer.reserve(BUFFER_SIZE);
+    dataSize = 0;
+
+    // The RIFF and data chunk sizes are filled in by close().
+    uint8_t header[WAV_HEADER_SIZE] = {};
+    std::memcpy(header, "RIFF", 4);
+    std::memcpy(header + 8, "WAVEfmt ", 8);
+    writeUint32LE(header + 16, 16);                 // Size of the fmt chunk
+    writeUint16LE(header + 20, 1);                  // PCM
+    writeUint16LE(header + 22, 1);                  // Channels
+    writeUint32LE(header + 24, sampleRate);
+    writeUint32LE(header + 28, sampleRate * 2);     // Bytes per second
+    writeUint16LE(header + 32, 2);                  // Bytes per frame
+    writeUint16LE(header + 34, 16);                 // Bits per sample
+    std::memcpy(header + 36, "data", 4);
+
+    return out && out.write((const char *)header, sizeof(header));
+}
+
+bool Audio::WAVWriter::write(const int16_t *samples, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        if (buffer.size() == BUFFER_SIZE && !flush()) {
+            return false;
+        }
+
+        buffer.push_back((uint8_t)samples[i]);
+        buffer.push_back((uint8_t)((uint16_t)samples[i] >> 8));
+    }
+
+    dataSize += count * 2;
+    return true;
+}
+
+bool Audio::WAVWriter::flush() {
+    out.write((const char *)buffer.data(), buffer.size());
+    buffer.clear();
+    return !out.fail();
+}
+
+bool Audio::WAVWriter::close() {
+    flush();
+
+    // A WAV file can't be bigger than 4 GB; past that, the sizes are left saturated.
+    uint8_t size[4];
+    writeUint32LE(size, (uint32_t)std::min<uint64_t>(dataSize + WAV_HEADER_SIZE - 8, UINT32_MAX));
+    out.seekp(4);
+    out.write((const char *)size, sizeof(size));
+
+    writeUint32LE(size, (uint32_t)std::min<uint64_t>(dataSize, UINT32_MAX));
+    out.seekp(40);
+    out.write((const char *)size, sizeof(size));
+    out.close();
+
+    return !out.fail();
+}
+
+double Audio::getRateAdjustment(size_t fill, size_t capacity) {
+    const double fullness = (double)std::min(fill, capacity) / capacity;
+    return 1 + MAX_RATE_ADJUSTMENT * (1 - 2 * fullness);
+}
+
+Audio::Stream::Stream(Audio::Sink *sink, Audio::Stream::Mode mode, size_t capacity)
+    : sink(sink),
+      mode(mode),
+      ring(capacity),
+      scratch(),
+      droppedSamples(0),
+      stopping(false),
+      failed(false),
+      thread(&Audio::Stream::run, this)
+{
+}
+
+Audio::Stream::~Stream() {
+    close();
+}
+
+void Audio::Stream::writeFrame(APU *apu) {
+    scratch.resize(apu->getAvailableSamples());
+    apu->readSamples(scratch.data(), scratch.size());
+
+    size_t written = ring.write(scratch.data(), scratch.size());
+
+    if (mode == Mode::LOSSLESS) {
+        while (written < scratch.size() && !failed.load(std::memory_order_relaxed)) {
+            std::this_thread::yield();
+            written += ring.write(scratch.data() + written, scratch.size() - written);
+        }
+    } else {
+        droppedSamples += scratch.size() - written;
+        apu->setRateAdjustment(getRateAdjustment(ring.getFill(), ring.getCapacity()));
+    }
+}
+
+bool Audio::Stream::close() {
+    if (thread.joinable()) {
+        stopping.store(true, std::memory_order_release);
+        thread.join();
+    }
+
+    return !failed.load(std::memory_order_relaxed);
+}
+
+uint64_t Audio::Stream::getDroppedSamples() const {
+    return droppedSamples;
+}
+
+void Audio::Stream::run() {
+    int16_t chunk[SINK_CHUNK_SIZE];
+
+    while (true) {
+        // Look at the flag before draining, so everything written before close() was called still gets out.
+        const bool stop = stopping.load(std::memory_order_acquire);
+        const size_t count = ring.read(chunk, SINK_CHUNK_SIZE);
+
+        if (count > 0) {
+            if (!failed.load(std::memory_order_relaxed) && !sink->write(chunk, count)) {
+                failed.store(true, std::memory_order_relaxed);
+            }
+        } else if (stop) {
+            break;
+        } else {
+            std::this_thread::sleep_for(SINK_POLL_INTERVAL);
+        }
+    }
+}
\ No newline at end of file
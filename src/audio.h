@@ -0,0 +1,184 @@
+#pragma once
+
+#include <vector>
+#include <string>
+#include <fstream>
+#include <thread>
+#include <atomic>
+#include <cstdint>
+#include <cstddef>
+
+class APU;
+
+/*
+ * Getting audio out of the emulation thread.
+ *
+ * The emulation thread hands each frame's samples to a Stream, which queues them in a lock-free ring; a thread of
+ * the Stream's own feeds them to a Sink, e.g. a WAVWriter. Neither side ever waits for the other to release a lock.
+ */
+namespace Audio {
+    /**
+     * A lock-free single-producer, single-consumer ring of mono samples, laid out like InputQueue.
+     */
+    class Ring {
+    public:
+        /**
+         * @param capacity How many samples can be waiting at once. Rounded up to a power of two.
+         */
+        explicit Ring(size_t capacity);
+
+        Ring(const Ring &) = delete;
+
+        Ring &operator=(const Ring &) = delete;
+
+        /**
+         * Producer side: adds as many of the samples as fit.
+         * @return The number of samples added.
+         */
+        size_t write(const int16_t *samples, size_t count);
+
+        /**
+         * Consumer side: removes up to `count` samples.
+         * @return The number of samples read.
+         */
+        size_t read(int16_t *outSamples, size_t count);
+
+        /**
+         * @return How many samples are waiting. Exact on either side when the other side isn't running, approximate
+         * otherwise.
+         */
+        size_t getFill() const;
+
+        size_t getCapacity() const;
+
+    private:
+        static const size_t CACHE_LINE_SIZE = 64;
+
+        std::vector<int16_t> samples;
+        size_t mask;
+
+        std::atomic<size_t> head;       // The next sample to read, written by the consumer.
+        size_t cachedTail;              // The consumer's last look at `tail`.
+        uint8_t consumerPadding[CACHE_LINE_SIZE - sizeof(std::atomic<size_t>) - sizeof(size_t)];
+
+        std::atomic<size_t> tail;       // Where the next sample is written, written by the producer.
+        size_t cachedHead;              // The producer's last look at `head`.
+        uint8_t producerPadding[CACHE_LINE_SIZE - sizeof(std::atomic<size_t>) - sizeof(size_t)];
+    };
+
+    /**
+     * Where a Stream's samples end up. Only ever called from the Stream's thread.
+     */
+    class Sink {
+    public:
+        virtual ~Sink() = default;
+
+        /**
+         * @return false if the samples couldn't be taken; the Stream then stops feeding the sink.
+         */
+        virtual bool write(const int16_t *samples, size_t count) = 0;
+    };
+
+    /**
+     * Streams 16-bit mono PCM into a WAV file, in large writes. The sizes in the header are filled in by close().
+     */
+    class WAVWriter : public Sink {
+    public:
+        WAVWriter();
+
+        /**
+         * @return false if the file couldn't be created.
+         */
+        bool open(const std::string &file, unsigned int sampleRate);
+
+        bool write(const int16_t *samples, size_t count) override;
+
+        /**
+         * Writes out what is buffered, fills in the sizes and closes the file.
+         * @return false if anything couldn't be written.
+         */
+        bool close();
+
+        // The size of the writes, in bytes.
+        static const size_t BUFFER_SIZE;
+
+    private:
+        std::ofstream out;
+        std::vector<uint8_t> buffer;
+        uint64_t dataSize;
+
+        bool flush();
+    };
+
+    // How far the rate control may stray from the nominal sample rate: 0.5%, which nobody hears as a change of pitch.
+    extern const double MAX_RATE_ADJUSTMENT;
+
+    /**
+     * Dynamic rate control: the ratio to pass to APU::setRateAdjustment() so that a buffer drained at a fixed rate
+     * stays about half full. Below half, slightly more samples are made per frame, above it slightly fewer, in
+     * proportion to the distance from half, up to MAX_RATE_ADJUSTMENT at empty or full. Audio and video then stay
+     * locked to the frame rate without either side ever blocking.
+     */
+    double getRateAdjustment(size_t fill, size_t capacity);
+
+    /**
+     * Takes the APU's samples after every frame and feeds them to a Sink on a thread of its own.
+     */
+    class Stream {
+    public:
+        enum class Mode {
+            // A sink that drains at the sample rate, e.g. a sound card: the APU's rate follows the ring's fill, and
+            // if the ring is full anyway, samples are dropped rather than stalling the emulation.
+            REAL_TIME,
+            // A sink that takes everything it gets, e.g. a WAVWriter: the rate stays nominal and no sample is
+            // dropped, so the output is the same on every run. When the ring is full, the emulation thread yields
+            // until there is room.
+            LOSSLESS
+        };
+
+        /**
+         * Starts the sink thread. The sink must outlive the Stream.
+         * @param capacity The size of the ring, in samples.
+         */
+        Stream(Sink *sink, Mode mode, size_t capacity);
+
+        Stream(const Stream &) = delete;
+
+        Stream &operator=(const Stream &) = delete;
+
+        /**
+         * Stops the sink thread, after it has written everything queued.
+         */
+        ~Stream();
+
+        /**
+         * Queues the samples the APU has made, and in real time mode adjusts its rate. Call after every frame, from
+         * the thread that runs the NES.
+         */
+        void writeFrame(APU *apu);
+
+        /**
+         * Waits until the sink has taken everything queued, and stops the sink thread.
+         * @return false if the sink failed at any point.
+         */
+        bool close();
+
+        /**
+         * @return How many samples didn't fit into the ring, in real time mode.
+         */
+        uint64_t getDroppedSamples() const;
+
+    private:
+        Sink *sink;
+        Mode mode;
+        Ring ring;
+        std::vector<int16_t> scratch;  // The emulation thread's staging area, so writeFrame() doesn't allocate.
+        uint64_t droppedSamples;
+
+        std::atomic<bool> stopping;
+        std::atomic<bool> failed;
+        std::thread thread;
+
+        void run();
+    };
+}
\ No newline at end of file
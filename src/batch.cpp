@@ -0,0 +1,199 @@
+#include "batch.h"
+
+#include "nes.h"
+#include "mappers.h"
+#include "hash.h"
+
+#include <deque>
+#include <chrono>
+#include <algorithm>
+
+struct BatchRunner::Worker {
+    std::mutex mutex;
+    std::deque<size_t> queue;
+
+    // The emulator from this worker's last job.
+    std::unique_ptr<NES> nes;
+};
+
+BatchRunner::BatchRunner(unsigned int threads)
+    : workers(),
+      threads(),
+      mutex(),
+      workAvailable(),
+      workDone(),
+      jobs(nullptr),
+      results(nullptr),
+      batch(0),
+      finishedWorkers(0),
+      stopping(false)
+{
+    if (threads == 0) {
+        threads = std::max(1u, std::thread::hardware_concurrency());
+    }
+
+    for (unsigned int i = 0; i < threads; i++) {
+        workers.emplace_back(new Worker());
+    }
+
+    for (unsigned int i = 0; i < threads; i++) {
+        this->threads.emplace_back(&BatchRunner::work, this, i);
+    }
+}
+
+BatchRunner::~BatchRunner() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+
+    workAvailable.notify_all();
+
+    for (std::thread &thread : threads) {
+        thread.join();
+    }
+}
+
+void BatchRunner::run(const std::vector<BatchJob> &jobs, std::vector<BatchResult> &outResults) {
+    outResults.clear();
+    outResults.resize(jobs.size());
+
+    if (jobs.empty()) {
+        return;
+    }
+
+    // Consecutive jobs go to the same worker, since they are likely to be for the same game.
+    const size_t perWorker = (jobs.size() + workers.size() - 1) / workers.size();
+
+    for (size_t i = 0; i < jobs.size(); i++) {
+        Worker &worker = *workers[i / perWorker];
+        std::lock_guard<std::mutex> lock(worker.mutex);
+        worker.queue.push_back(i);
+    }
+
+    // Every worker takes part in every batch, and the batch only ends once all of them are done with it, so no
+    // worker can still be looking at these jobs when the next batch starts.
+    std::unique_lock<std::mutex> lock(mutex);
+    this->jobs = &jobs;
+    this->results = &outResults;
+    finishedWorkers = 0;
+    batch++;
+
+    workAvailable.notify_all();
+    workDone.wait(lock, [this]() { return finishedWorkers == workers.size(); });
+
+    this->jobs = nullptr;
+    this->results = nullptr;
+}
+
+unsigned int BatchRunner::getThreadCount() const {
+    return (unsigned int)threads.size();
+}
+
+void BatchRunner::work(size_t index) {
+    uint64_t lastBatch = 0;
+
+    while (true) {
+        const std::vector<BatchJob> *jobs;
+        std::vector<BatchResult> *results;
+
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            workAvailable.wait(lock, [&]() { return stopping || batch != lastBatch; });
+
+            if (stopping) {
+                return;
+            }
+
+            lastBatch = batch;
+            jobs = this->jobs;
+            results = this->results;
+        }
+
+        size_t job;
+
+        while (takeJob(index, job)) {
+            runJob(*workers[index], (*jobs)[job], (*results)[job]);
+        }
+
+        std::lock_guard<std::mutex> lock(mutex);
+
+        if (++finishedWorkers == workers.size()) {
+            workDone.notify_one();
+        }
+    }
+}
+
+bool BatchRunner::takeJob(size_t index, size_t &outJob) {
+    {
+        Worker &worker = *workers[index];
+        std::lock_guard<std::mutex> lock(worker.mutex);
+
+        if (!worker.queue.empty()) {
+            outJob = worker.queue.front();
+            worker.queue.pop_front();
+            return true;
+        }
+    }
+
+    for (size_t i = 1; i < workers.size(); i++) {
+        Worker &victim = *workers[(index + i) % workers.size()];
+        std::lock_guard<std::mutex> lock(victim.mutex);
+
+        if (!victim.queue.empty()) {
+            outJob = victim.queue.back();
+            victim.queue.pop_back();
+            return true;
+        }
+    }
+
+    return false;
+}
+
+void BatchRunner::runJob(Worker &worker, const BatchJob &job, BatchResult &result) {
+    result.mapperSupported = Mappers::isSupported(job.rom->getMapperNumber());
+
+    if (!result.mapperSupported) {
+        return;
+    }
+
+    const auto start = std::chrono::steady_clock::now();
+
+    if (worker.nes == nullptr) {
+        Cartridge cartridge(job.rom);
+        worker.nes.reset(new NES(cartridge));
+        worker.nes->getDiagnostics()->verbose = false;
+    } else if (worker.nes->getCartridge()->getROM() == job.rom) {
+        worker.nes->reset(ResetType::POWER_ON);
+    } else {
+        worker.nes->insertCartridge(job.rom);
+    }
+
+    NES *nes = worker.nes.get();
+
+    const PPU *ppu = nes->getPPU();
+    const size_t framebufferSize = PPU::SCREEN_WIDTH * PPU::SCREEN_HEIGHT;
+
+    if (job.hashFrames) {
+        result.frameHashes.reserve(job.frames);
+    }
+
+    for (unsigned int frame = 0; frame < job.frames; frame++) {
+        nes->getController(0)->setButtons(frame < job.input.size() ? job.input[frame] : (uint8_t)0x00);
+        nes->runFrame();
+
+        if (job.hashFrames) {
+            result.frameHashes.push_back(Hash::crc32(ppu->getFramebuffer(), framebufferSize));
+        }
+    }
+
+    if (job.dumpRAM) {
+        const uint8_t *ram = nes->getMemory()->getInternalMemory();
+        result.ram.assign(ram, ram + NES_INTERNAL_MEMORY_SIZE);
+        const uint8_t *prgRAM = nes->getCartridge()->getPRGRAM();
+        result.prgRAM.assign(prgRAM, prgRAM + nes->getCartridge()->getPRGRAMSize());
+    }
+
+    result.diagnostics = *nes->getDiagnostics();
+    result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
\ No newline at end of file
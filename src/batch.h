@@ -0,0 +1,98 @@
+#pragma once
+
+#include "diagnostics.h"
+#include "rom.h"
+
+#include <vector>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <cstdint>
+#include <cstddef>
+
+/**
+ * One headless run of a game.
+ */
+struct BatchJob {
+    std::shared_ptr<const ROMImage> rom;
+
+    /**
+     * The buttons held on controller 1 during each frame (see ControllerButton). Frames past the end of the script
+     * are played with no buttons held.
+     */
+    std::vector<uint8_t> input;
+
+    unsigned int frames = 0;
+
+    bool hashFrames = true;    // Record a hash of the framebuffer after every frame.
+    bool dumpRAM = true;       // Copy the internal RAM and the cartridge's PRG-RAM after the last frame.
+};
+
+struct BatchResult {
+    bool mapperSupported = false;   // If false, the game wasn't run and nothing else is filled in.
+
+    std::vector<uint32_t> frameHashes;  // CRC-32 of the framebuffer after each frame.
+    std::vector<uint8_t> ram;
+    std::vector<uint8_t> prgRAM;
+
+    Diagnostics diagnostics;
+    double seconds = 0.0;
+};
+
+/**
+ * Runs lots of jobs on a pool of threads, one emulator per job at a time.
+ *
+ * The jobs of a batch are split into one queue per thread, in order, and a thread that runs out of work steals from
+ * the back of the others' queues. Each thread keeps its emulator around and powers it on again for the next job,
+ * with NES::reset() for the same ROM image or NES::insertCartridge() for another one, so a batch doesn't allocate
+ * after the first run on each thread unless the games need different mappers or bigger cartridge RAM. Emulators
+ * share no mutable state, so throughput scales with the number of cores.
+ */
+class BatchRunner {
+public:
+    /**
+     * @param threads How many threads to run jobs on, or 0 for one per hardware thread.
+     */
+    explicit BatchRunner(unsigned int threads = 0);
+
+    ~BatchRunner();
+
+    BatchRunner(const BatchRunner &) = delete;
+
+    BatchRunner &operator=(const BatchRunner &) = delete;
+
+    /**
+     * Runs every job and waits for all of them to finish.
+     * @param outResults Receives one result per job, in the order of the jobs.
+     */
+    void run(const std::vector<BatchJob> &jobs, std::vector<BatchResult> &outResults);
+
+    unsigned int getThreadCount() const;
+
+private:
+    struct Worker;
+
+    std::vector<std::unique_ptr<Worker>> workers;
+    std::vector<std::thread> threads;
+
+    std::mutex mutex;
+    std::condition_variable workAvailable;
+    std::condition_variable workDone;
+
+    const std::vector<BatchJob> *jobs;
+    std::vector<BatchResult> *results;
+    uint64_t batch;         // Incremented for each run(), so the workers can tell a new batch has started.
+    size_t finishedWorkers; // Workers that have run out of jobs in the current batch.
+    bool stopping;
+
+    void work(size_t index);
+
+    /**
+     * Takes the next job from the given worker's queue, or steals one from another worker.
+     * @return false if every queue is empty.
+     */
+    bool takeJob(size_t index, size_t &outJob);
+
+    static void runJob(Worker &worker, const BatchJob &job, BatchResult &result);
+};
\ No newline at end of file
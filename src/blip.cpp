@@ -0,0 +1,156 @@
+#include "blip.h"
+
+#include <algorithm>
+#include <cmath>
+
+const size_t BlipBuffer::KERNEL_WIDTH;
+const size_t BlipBuffer::KERNEL_PHASES;
+
+static const double PI = 3.14159265358979323846;
+
+// The cutoff of the kernel's low-pass, as a fraction of the sample rate; a little under Nyquist, as a 16-tap kernel
+// has a wide transition band.
+static const double CUTOFF = 0.43;
+
+static const unsigned int DELTA_BITS = 15;
+
+static const unsigned int PHASE_BITS = 6;
+static_assert(BlipBuffer::KERNEL_PHASES == 1 << PHASE_BITS, "PHASE_BITS must match KERNEL_PHASES");
+
+// How quickly reading removes the DC offset: the higher, the lower the high-pass cutoff (about 15 Hz at 48 kHz).
+static const unsigned int BASS_SHIFT = 9;
+
+BlipBuffer::Kernel::Kernel() {
+    const double halfWidth = KERNEL_WIDTH / 2;
+
+    for (size_t phase = 0; phase < KERNEL_PHASES; phase++) {
+        const double fraction = (double)phase / KERNEL_PHASES;
+        double values[KERNEL_WIDTH];
+        double sum = 0;
+
+        for (size_t tap = 0; tap < KERNEL_WIDTH; tap++) {
+            // The distance of the tap from the step, which lies between taps halfWidth - 1 and halfWidth.
+            const double x = (double)tap - (halfWidth - 1) - fraction;
+            const double sinc = x == 0 ? 1 : std::sin(PI * 2 * CUTOFF * x) / (PI * 2 * CUTOFF * x);
+            const double position = (x + halfWidth) / KERNEL_WIDTH;
+            const double blackman = 0.42 - 0.5 * std::cos(2 * PI * position) + 0.08 * std::cos(4 * PI * position);
+
+            values[tap] = sinc * blackman;
+            sum += values[tap];
+        }
+
+        // Every phase must add exactly the same in total, or steps would leave a residue behind.
+        int total = 0;
+        size_t largest = 0;
+
+        for (size_t tap = 0; tap < KERNEL_WIDTH; tap++) {
+            taps[phase][tap] = (int16_t)std::lround(values[tap] / sum * (1 << DELTA_BITS));
+            total += taps[phase][tap];
+
+            if (taps[phase][tap] > taps[phase][largest]) {
+                largest = tap;
+            }
+        }
+
+        taps[phase][largest] = (int16_t)(taps[phase][largest] + (1 << DELTA_BITS) - total);
+    }
+}
+
+const BlipBuffer::Kernel &BlipBuffer::getKernel() {
+    static const Kernel kernel;
+    return kernel;
+}
+
+BlipBuffer::BlipBuffer(double clockRate, unsigned int sampleRate, size_t capacity)
+    : sampleRate(sampleRate),
+      nominalFactor(sampleRate / clockRate * 4294967296.0),
+      factor((uint64_t)std::llround(nominalFactor)),
+      nextFactor(factor),
+      offset(0),
+      buffer(capacity * 2 + KERNEL_WIDTH, 0),
+      available(0),
+      integrator(0)
+{
+    // Build the kernel now rather than in the middle of the first frame.
+    getKernel();
+}
+
+void BlipBuffer::clear() {
+    std::fill(buffer.begin(), buffer.end(), 0);
+    offset = 0;
+    available = 0;
+    integrator = 0;
+}
+
+void BlipBuffer::addDelta(uint64_t time, int delta) {
+    const uint64_t position = offset + time * factor;
+    const size_t index = available + (size_t)(position >> 32);
+    const size_t phase = (size_t)(position >> (32 - PHASE_BITS)) & (KERNEL_PHASES - 1);
+
+    if (index + KERNEL_WIDTH > buffer.size()) {
+        return;
+    }
+
+    const int16_t *taps = getKernel().taps[phase];
+    int32_t *out = buffer.data() + index;
+
+    for (size_t tap = 0; tap < KERNEL_WIDTH; tap++) {
+        out[tap] += taps[tap] * delta;
+    }
+}
+
+void BlipBuffer::endFrame(uint64_t duration) {
+    const uint64_t position = offset + duration * factor;
+
+    available = std::min(available + (size_t)(position >> 32), buffer.size() - KERNEL_WIDTH);
+    offset = position & 0xFFFFFFFF;
+
+    // Deltas are timed from the start of the frame, so the rate can only change between frames.
+    factor = nextFactor;
+
+    // Nobody is reading: make room for the next frame by dropping the oldest samples.
+    const size_t capacity = (buffer.size() - KERNEL_WIDTH) / 2;
+
+    if (available > capacity) {
+        readSamples(nullptr, available - capacity);
+    }
+}
+
+void BlipBuffer::setRateAdjustment(double ratio) {
+    nextFactor = (uint64_t)std::llround(nominalFactor * ratio);
+}
+
+size_t BlipBuffer::getAvailableSamples() const {
+    return available;
+}
+
+size_t BlipBuffer::readSamples(int16_t *outSamples, size_t count) {
+    count = std::min(count, available);
+
+    for (size_t i = 0; i < count; i++) {
+        int32_t sample = integrator >> DELTA_BITS;
+        integrator += buffer[i];
+        sample = std::max(-32768, std::min(32767, sample));
+
+        if (outSamples != nullptr) {
+            outSamples[i] = (int16_t)sample;
+        }
+
+        integrator -= sample * (1 << (DELTA_BITS - BASS_SHIFT));
+    }
+
+    // Move what hasn't been read, including the tails of the kernels that reach into the next frame, to the front.
+    std::copy(buffer.begin() + count, buffer.begin() + available + KERNEL_WIDTH, buffer.begin());
+    std::fill(buffer.begin() + available + KERNEL_WIDTH - count, buffer.begin() + available + KERNEL_WIDTH, 0);
+    available -= count;
+
+    return count;
+}
+
+unsigned int BlipBuffer::getSampleRate() const {
+    return sampleRate;
+}
+
+size_t BlipBuffer::getMemoryUsage() const {
+    return buffer.capacity() * sizeof(int32_t);
+}
\ No newline at end of file
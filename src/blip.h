@@ -0,0 +1,88 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+/**
+ * Turns a signal given as a list of steps (at this clock, the level changes by that much) into samples at a much
+ * lower rate, band-limited so the steps don't alias.
+ *
+ * Each step adds a band-limited impulse, a windowed sinc looked up for the step's position between two output
+ * samples, to a buffer of differences; reading the samples out integrates them. The cost is per step, not per
+ * clock, so a 1.79 MHz source that changes a few thousand times per second is cheap to resample. Reading also
+ * removes the DC offset with a gentle high-pass.
+ *
+ * Time is counted in clocks from the start of the current frame, which endFrame() ends.
+ */
+class BlipBuffer {
+public:
+    /**
+     * @param clockRate The rate of the clock that steps are timed with.
+     * @param sampleRate The rate of the output.
+     * @param capacity How many samples can be waiting to be read; when more are made, the oldest are dropped.
+     */
+    BlipBuffer(double clockRate, unsigned int sampleRate, size_t capacity);
+
+    /**
+     * Throws away all samples and the pending steps.
+     */
+    void clear();
+
+    /**
+     * @param time The clock, counted from the start of the frame, at which the level changes.
+     * @param delta The change; full scale is about +-32767.
+     */
+    void addDelta(uint64_t time, int delta);
+
+    /**
+     * Ends the frame: the samples up to `duration` clocks after its start become readable, and the next frame starts
+     * there.
+     */
+    void endFrame(uint64_t duration);
+
+    /**
+     * Makes `ratio` times as many samples per clock as the nominal rates say, from the next frame on. Used to keep a
+     * consumer's buffer from running dry or over without a noticeable change of pitch.
+     */
+    void setRateAdjustment(double ratio);
+
+    size_t getAvailableSamples() const;
+
+    /**
+     * Reads up to `count` samples.
+     * @param outSamples Receives the samples, or nullptr to just drop them.
+     * @return The number of samples read.
+     */
+    size_t readSamples(int16_t *outSamples, size_t count);
+
+    unsigned int getSampleRate() const;
+
+    /**
+     * @return The size of the sample buffer, in bytes.
+     */
+    size_t getMemoryUsage() const;
+
+    static const size_t KERNEL_WIDTH = 16;
+    static const size_t KERNEL_PHASES = 64;
+
+private:
+    // The step kernels for each phase, in 1/32768ths; every phase sums to 32768.
+    struct Kernel {
+        int16_t taps[KERNEL_PHASES][KERNEL_WIDTH];
+
+        Kernel();
+    };
+
+    static const Kernel &getKernel();
+
+    unsigned int sampleRate;
+    double nominalFactor;
+    uint64_t factor;        // Samples per clock, in 32.32 fixed point.
+    uint64_t nextFactor;    // Takes over from `factor` at the end of the frame.
+    uint64_t offset;    // The fraction of a sample that the current frame starts past `available`, in 32.32.
+
+    std::vector<int32_t> buffer;
+    size_t available;
+    int32_t integrator;
+};
\ No newline at end of file
@@ -3,62 +3,166 @@
 #include "nes.h"
 #include "mappers.h"
 #include "ines.h"
+#include "rom.h"
 #include "utils.h"
+#include "savestate.h"
 
 #include <utility>
+#include <algorithm>
+
+/*
+ * Mappers bank-switch PRG-RAM in 8 KB and CHR-RAM in 1 KB units, so smaller RAMs (NES 2.0 headers describe some) are
+ * rounded up. Boards without CHR-ROM always have at least 8 KB of CHR-RAM, whatever the header says.
+ */
+
+static size_t getPRGRAMAllocationSize(const ROMImage &rom) {
+    return rom.getPRGRAMSize() == 0 ? 0 : std::max(rom.getPRGRAMSize(), iNES::PRG_RAM_SIZE);
+}
+
+static size_t getCHRRAMAllocationSize(const ROMImage &rom) {
+    return rom.hasCHRRAM() ? std::max(rom.getCHRRAMSize(), iNES::CHR_ROM_SIZE) : 0;
+}
 
 Cartridge::Cartridge(iNES::File &file)
-    : prg(std::move(file.prgROM)),
-      chr(std::move(file.chrROM)),
-      prgram(file.header.prgRAMCount == 0 ? iNES::PRG_RAM_SIZE : file.header.prgRAMCount * iNES::PRG_RAM_SIZE),
-      chrram(file.header.chrROMCount == 0),
-      mapperNumber((uint8_t)((file.header.flags6 >> 4) | (file.header.flags7 & 0xF0))),
-      mapper(nullptr),
-      mirroring(Utils::isBitSet(file.header.flags6, 3) ? Mirroring::FOUR_SCREEN :
-                Utils::isBitSet(file.header.flags6, 0) ? Mirroring::VERTICAL : Mirroring::HORIZONTAL)
+    : Cartridge(ROMImage::create(file))
 {
 }
 
+Cartridge::Cartridge(std::shared_ptr<const ROMImage> rom)
+    : rom(std::move(rom)),
+      prgram(nullptr),
+      prgramSize(0),
+      chrram(nullptr),
+      chrramSize(0),
+      ramBuffer(),
+      ramStorage(nullptr),
+      ramStorageSize(0),
+      mapperStorage(nullptr),
+      mapper(nullptr, Mappers::Deleter())
+{
+    // The RAM is allocated by the NES the cartridge is inserted into, once it's known where it should go.
+}
+
+const std::shared_ptr<const ROMImage> &Cartridge::getROM() const {
+    return rom;
+}
+
 size_t Cartridge::getPRGROMCount() const {
-    return prg.size() / iNES::PRG_ROM_SIZE;
+    return rom->getPRGROMSize() / iNES::PRG_ROM_SIZE;
+}
+
+const uint8_t *Cartridge::getPRGROM() const {
+    return rom->getPRGROM();
 }
 
-const std::vector<uint8_t> *Cartridge::getPRGROM() const {
-    return &prg;
+size_t Cartridge::getPRGROMSize() const {
+    return rom->getPRGROMSize();
 }
 
 size_t Cartridge::getPRGRAMCount() const {
-    return prgram.size() / iNES::PRG_RAM_SIZE;
+    return prgramSize / iNES::PRG_RAM_SIZE;
+}
+
+uint8_t *Cartridge::getPRGRAM() {
+    return prgram;
 }
 
-std::vector<uint8_t> *Cartridge::getPRGRAM() {
-    return &prgram;
+size_t Cartridge::getPRGRAMSize() const {
+    return prgramSize;
 }
 
 size_t Cartridge::getCHRCount() const {
-    return chr.size() / iNES::CHR_ROM_SIZE;
+    return getCHRSize() / iNES::CHR_ROM_SIZE;
+}
+
+const uint8_t *Cartridge::getCHR() const {
+    return isCHRRAM() ? chrram : rom->getCHRROM();
+}
+
+size_t Cartridge::getCHRSize() const {
+    return isCHRRAM() ? chrramSize : rom->getCHRROMSize();
 }
 
-std::vector<uint8_t> *Cartridge::getCHR() {
-    return &chr;
+uint8_t *Cartridge::getCHRRAM() {
+    return isCHRRAM() ? chrram : nullptr;
 }
 
 bool Cartridge::isCHRRAM() const {
-    return chrram;
+    return rom->hasCHRRAM();
 }
 
 Mapper *Cartridge::getMapper() {
     return mapper.get();
 }
 
+void Cartridge::setStorage(void *mapperStorage, uint8_t *ram, size_t ramSize) {
+    this->mapperStorage = mapperStorage;
+    ramStorage = ram;
+    ramStorageSize = ramSize;
+}
+
 void Cartridge::initMapper(NES *nes) {
-    mapper = std::move(Mappers::create(nes, mapperNumber));
+    // The old mapper may live in the same storage as the new one, so it has to be gone first.
+    mapper.reset();
+    mapper = Mappers::create(nes, getMapperNumber(), mapperStorage);
 }
 
-uint8_t Cartridge::getMapperNumber() const {
-    return mapperNumber;
+void Cartridge::allocateRAM() {
+    prgramSize = getPRGRAMAllocationSize(*rom);
+    chrramSize = getCHRRAMAllocationSize(*rom);
+
+    const size_t size = prgramSize + chrramSize;
+    uint8_t *ram;
+
+    if (ramStorage != nullptr && size <= ramStorageSize) {
+        std::vector<uint8_t>().swap(ramBuffer);
+        ram = ramStorage;
+        std::fill(ram, ram + size, 0x00);
+    } else {
+        ramBuffer.assign(size, 0x00);
+        ram = ramBuffer.data();
+    }
+
+    prgram = ram;
+    chrram = ram + prgramSize;
+}
+
+void Cartridge::setROM(std::shared_ptr<const ROMImage> rom) {
+    this->rom = std::move(rom);
+    allocateRAM();
+}
+
+void Cartridge::powerOn() {
+    std::fill(prgram, prgram + prgramSize, 0x00);
+    std::fill(chrram, chrram + chrramSize, 0x00);
+
+    if (mapper != nullptr) {
+        mapper->powerOn();
+    }
+}
+
+uint16_t Cartridge::getMapperNumber() const {
+    return rom->getMapperNumber();
 }
 
 Mirroring Cartridge::getMirroring() const {
-    return mirroring;
+    return rom->getMirroring();
+}
+
+void Cartridge::saveState(StateWriter &writer) const {
+    writer.writeBytes(prgram, prgramSize);
+    writer.writeBytes(chrram, chrramSize);
+
+    if (mapper != nullptr) {
+        mapper->saveState(writer);
+    }
 }
+
+void Cartridge::loadState(StateReader &reader) {
+    reader.readBytes(prgram, prgramSize);
+    reader.readBytes(chrram, chrramSize);
+
+    if (mapper != nullptr) {
+        mapper->loadState(reader);
+    }
+}
\ No newline at end of file
@@ -2,21 +2,21 @@
 
 #include "ines.h"
 #include "mapper.h"
+#include "mappers.h"
+#include "mirroring.h"
+#include "rom.h"
 
 #include <vector>
 #include <memory>
 #include <cstdint>
 
 class NES;
-
-enum class Mirroring: uint8_t {
-    VERTICAL,
-    HORIZONTAL,
-    FOUR_SCREEN
-};
+class StateWriter;
+class StateReader;
 
 class Cartridge {
     friend class NES;
+    friend class NESArena;
 public:
     /**
      * Creates a Cartridge from an `iNES::File`. Note that the contents of the `iNES::File` are _moved_,
@@ -27,17 +27,44 @@ public:
      */
     explicit Cartridge(iNES::File &file);
 
+    /**
+     * Creates a Cartridge that plays the given ROM image. The image is shared, not copied, so this is the way to run
+     * many instances of the same game: load it once, create the image once and give every Cartridge a reference.
+     *
+     * @param rom The ROM image to create the cartridge from.
+     */
+    explicit Cartridge(std::shared_ptr<const ROMImage> rom);
+
+    const std::shared_ptr<const ROMImage> &getROM() const;
+
     size_t getPRGROMCount() const;
 
-    const std::vector<uint8_t> *getPRGROM() const;
+    const uint8_t *getPRGROM() const;
+
+    size_t getPRGROMSize() const;
 
     size_t getCHRCount() const;
 
-    std::vector<uint8_t> *getCHR();
+    /**
+     * @return The CHR-ROM, or this cartridge's CHR-RAM if isCHRRAM() is true.
+     */
+    const uint8_t *getCHR() const;
+
+    size_t getCHRSize() const;
+
+    /**
+     * @return This cartridge's CHR-RAM, or nullptr if it has CHR-ROM.
+     */
+    uint8_t *getCHRRAM();
 
     size_t getPRGRAMCount() const;
 
-    std::vector<uint8_t> *getPRGRAM();
+    /**
+     * @return This cartridge's PRG-RAM, getPRGRAMSize() bytes of it.
+     */
+    uint8_t *getPRGRAM();
+
+    size_t getPRGRAMSize() const;
 
     /**
      * @return true if getCHR returns CHR-RAM, false if getCHR returns CHR-ROM.
@@ -46,19 +73,54 @@ public:
 
     Mapper *getMapper();
 
-    uint8_t getMapperNumber() const;
+    uint16_t getMapperNumber() const;
 
     Mirroring getMirroring() const;
 
+    /**
+     * Saves the cartridge's RAM and its mapper's registers.
+     */
+    void saveState(StateWriter &writer) const;
+
+    void loadState(StateReader &reader);
+
 private:
+    /**
+     * Has the mapper and the RAM constructed in the given memory rather than on the heap, the next time they are. The
+     * mapper storage must hold Mappers::MAX_SIZE bytes; RAM that doesn't fit in `ramSize` bytes still goes on the heap.
+     */
+    void setStorage(void *mapperStorage, uint8_t *ram, size_t ramSize);
+
     void initMapper(NES *nes);
 
-    std::vector<uint8_t> prg;
-    std::vector<uint8_t> chr;
-    std::vector<uint8_t> prgram;
-    std::unique_ptr<Mapper> mapper;
+    /**
+     * Allocates the RAM the ROM image asks for, in the storage given to setStorage() if it fits there, or otherwise
+     * in a heap buffer that is reused if it is big enough.
+     */
+    void allocateRAM();
+
+    /**
+     * Switches to another ROM image and allocates its RAM. The mapper is left alone.
+     */
+    void setROM(std::shared_ptr<const ROMImage> rom);
+
+    /**
+     * Clears the cartridge's RAM and powers the mapper on.
+     */
+    void powerOn();
+
+    std::shared_ptr<const ROMImage> rom;
+
+    // PRG-RAM followed by CHR-RAM, in either the storage given to setStorage() or ramBuffer.
+    uint8_t *prgram;
+    size_t prgramSize;
+    uint8_t *chrram;
+    size_t chrramSize;
+    std::vector<uint8_t> ramBuffer;
+
+    uint8_t *ramStorage;
+    size_t ramStorageSize;
+    void *mapperStorage;
 
-    bool chrram;
-    uint8_t mapperNumber;
-    Mirroring mirroring;
+    Mappers::MapperPointer mapper;
 };
\ No newline at end of file
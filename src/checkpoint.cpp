@@ -0,0 +1,250 @@
+#include "checkpoint.h"
+
+#include "nes.h"
+#include "hash.h"
+
+#include <algorithm>
+#include <cstring>
+
+/*
+ * A checkpoint file is a 16-byte header followed by a record per frame, all little-endian:
+ *
+ *     0   char[4]  magic bytes "NCP\x1A"
+ *     4   uint8    version
+ *     5   uint8    the number of components per record
+ *     6   char[10] reserved, 0
+ *
+ * A record is the frame, the chained hash and the component hashes, each a uint64. The number of records follows
+ * from the file size, so the file of a run that was cut short can still be compared.
+ */
+static const char MAGIC_BYTES[4] = { 'N', 'C', 'P', '\x1A' };
+static const uint8_t VERSION = 1;
+static const size_t HEADER_SIZE = 16;
+static const size_t RECORD_FIELDS = 2 + (size_t)Checkpoint::Component::COUNT;
+static const size_t RECORD_SIZE = RECORD_FIELDS * 8;
+
+static void encodeRecord(const Checkpoint::Record &record, uint8_t *outData) {
+    uint64_t fields[RECORD_FIELDS] = { record.frame, record.chain };
+    std::copy(record.components, record.components + (size_t)Checkpoint::Component::COUNT, fields + 2);
+
+    for (size_t i = 0; i < RECORD_FIELDS; i++) {
+        for (size_t byte = 0; byte < 8; byte++) {
+            outData[i * 8 + byte] = (uint8_t)(fields[i] >> (byte * 8));
+        }
+    }
+}
+
+static void decodeRecord(const uint8_t *data, Checkpoint::Record &outRecord) {
+    uint64_t fields[RECORD_FIELDS] = {};
+
+    for (size_t i = 0; i < RECORD_FIELDS; i++) {
+        for (size_t byte = 0; byte < 8; byte++) {
+            fields[i] |= (uint64_t)data[i * 8 + byte] << (byte * 8);
+        }
+    }
+
+    outRecord.frame = fields[0];
+    outRecord.chain = fields[1];
+    std::copy(fields + 2, fields + RECORD_FIELDS, outRecord.components);
+}
+
+const char *Checkpoint::getComponentName(Checkpoint::Component component) {
+    switch (component) {
+        case Checkpoint::Component::CPU:
+            return "CPU registers";
+
+        case Checkpoint::Component::RAM:
+            return "RAM";
+
+        case Checkpoint::Component::VRAM:
+            return "VRAM";
+
+        case Checkpoint::Component::OAM:
+            return "OAM";
+
+        case Checkpoint::Component::PALETTE_RAM:
+            return "palette RAM";
+
+        case Checkpoint::Component::FRAMEBUFFER:
+            return "framebuffer";
+
+        case Checkpoint::Component::COUNT:
+            break;
+    }
+
+    return "N/A";
+}
+
+void Checkpoint::hash(NES &nes, uint64_t previousChain, Checkpoint::Record &outRecord) {
+    PPU *ppu = nes.getPPU();
+    Memory *mem = nes.getMemory();
+    const RegisterFile *r = nes.getCPU()->getRegs();
+
+    // Field by field, leaving out RegisterFile's padding.
+    const uint8_t registers[] = { r->a, r->x, r->y, (uint8_t)r->p, r->s, (uint8_t)r->pc, (uint8_t)(r->pc >> 8) };
+
+    uint64_t *components = outRecord.components;
+    components[(size_t)Checkpoint::Component::CPU] = Hash::xxh64(registers, sizeof(registers));
+    components[(size_t)Checkpoint::Component::RAM] = Hash::xxh64(mem->getInternalMemory(),
+                                                                 NES_INTERNAL_MEMORY_SIZE);
+    components[(size_t)Checkpoint::Component::VRAM] = Hash::xxh64(mem->getInternalVideoMemory(),
+                                                                  NES_INTERNAL_VIDEO_MEMORY_SIZE);
+    components[(size_t)Checkpoint::Component::OAM] = Hash::xxh64(ppu->getOAM(), PPU::OBJECT_ATTRIBUTE_MEMORY_SIZE);
+    components[(size_t)Checkpoint::Component::PALETTE_RAM] = Hash::xxh64(mem->getPaletteRAM(), NES_PALETTE_RAM_SIZE);
+
+    // The framebuffer is more than ten times the size of everything else together, so it gets the CRC-32, which
+    // runs on the CPU's carry-less multiplier or CRC instructions at about twice XXH64's speed.
+    components[(size_t)Checkpoint::Component::FRAMEBUFFER] = ppu->isOutputSuppressed() ? 0 :
+        Hash::crc32(ppu->getFramebuffer(), PPU::SCREEN_WIDTH * PPU::SCREEN_HEIGHT);
+
+    outRecord.frame = ppu->getFrame();
+    outRecord.chain = Hash::xxh64((const uint8_t *)components, sizeof(outRecord.components), previousChain);
+}
+
+Checkpoint::Writer::Writer()
+    : chain(0)
+{
+}
+
+bool Checkpoint::Writer::open(const std::string &file) {
+    out.open(file, std::ios::out | std::ios::binary | std::ios::trunc);
+    chain = 0;
+
+    uint8_t header[HEADER_SIZE] = {};
+    std::memcpy(header, MAGIC_BYTES, sizeof(MAGIC_BYTES));
+    header[4] = VERSION;
+    header[5] = (uint8_t)Checkpoint::Component::COUNT;
+
+    return out && out.write((const char *)header, sizeof(header));
+}
+
+void Checkpoint::Writer::record(NES &nes) {
+    Checkpoint::Record record;
+    Checkpoint::hash(nes, chain, record);
+    chain = record.chain;
+
+    uint8_t data[RECORD_SIZE];
+    encodeRecord(record, data);
+    out.write((const char *)data, sizeof(data));
+}
+
+bool Checkpoint::Writer::close() {
+    out.close();
+    return !out.fail();
+}
+
+std::string Checkpoint::getLoadErrorMessage(Checkpoint::LoadError error) {
+    switch (error) {
+        case Checkpoint::LoadError::NO_ERROR:
+            return "No error.";
+
+        case Checkpoint::LoadError::OPEN_FAILED:
+            return "Could not open file!";
+
+        case Checkpoint::LoadError::READ_ERROR:
+            return "Failed to read from file!";
+
+        case Checkpoint::LoadError::MAGIC_BYTES_MISMATCH:
+            return "Magic bytes do not match. This is not a checkpoint file!";
+
+        case Checkpoint::LoadError::UNSUPPORTED_VERSION:
+            return "The checkpoint file is from a different version!";
+    }
+
+    return "N/A";
+}
+
+Checkpoint::Reader::Reader()
+    : recordCount(0)
+{
+}
+
+uint64_t Checkpoint::Reader::getRecordCount() const {
+    return recordCount;
+}
+
+bool Checkpoint::Reader::read(uint64_t index, Checkpoint::Record &outRecord) {
+    uint8_t data[RECORD_SIZE];
+
+    if (index >= recordCount) {
+        return false;
+    }
+
+    in.clear();
+
+    if (!in.seekg(HEADER_SIZE + index * RECORD_SIZE) || !in.read((char *)data, sizeof(data))) {
+        return false;
+    }
+
+    decodeRecord(data, outRecord);
+    return true;
+}
+
+Checkpoint::LoadError Checkpoint::open(const std::string &file, std::unique_ptr<Checkpoint::Reader> &outReader) {
+    std::unique_ptr<Checkpoint::Reader> reader(new Checkpoint::Reader());
+    reader->in.open(file, std::ios::in | std::ios::binary);
+
+    if (!reader->in) {
+        return Checkpoint::LoadError::OPEN_FAILED;
+    }
+
+    uint8_t header[HEADER_SIZE];
+
+    if (!reader->in.read((char *)header, sizeof(header))) {
+        return Checkpoint::LoadError::READ_ERROR;
+    }
+
+    if (std::memcmp(header, MAGIC_BYTES, sizeof(MAGIC_BYTES)) != 0) {
+        return Checkpoint::LoadError::MAGIC_BYTES_MISMATCH;
+    }
+
+    if (header[4] != VERSION || header[5] != (uint8_t)Checkpoint::Component::COUNT) {
+        return Checkpoint::LoadError::UNSUPPORTED_VERSION;
+    }
+
+    if (!reader->in.seekg(0, std::ios::end)) {
+        return Checkpoint::LoadError::READ_ERROR;
+    }
+
+    // A partly written record at the end is ignored.
+    reader->recordCount = ((uint64_t)reader->in.tellg() - HEADER_SIZE) / RECORD_SIZE;
+
+    outReader = std::move(reader);
+    return Checkpoint::LoadError::NO_ERROR;
+}
+
+Checkpoint::Divergence Checkpoint::findDivergence(Checkpoint::Reader &a, Checkpoint::Reader &b) {
+    Checkpoint::Divergence divergence = {};
+    Checkpoint::Record recordA, recordB;
+
+    // Find the first record whose chained hashes differ: everything before it matches, everything after it doesn't.
+    uint64_t low = 0;
+    uint64_t high = std::min(a.getRecordCount(), b.getRecordCount());
+
+    while (low < high) {
+        const uint64_t middle = low + (high - low) / 2;
+
+        if (a.read(middle, recordA) && b.read(middle, recordB) && recordA.chain == recordB.chain) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+
+    if (low == std::min(a.getRecordCount(), b.getRecordCount()) || !a.read(low, recordA) || !b.read(low, recordB)) {
+        return divergence;
+    }
+
+    divergence.diverged = true;
+    divergence.index = low;
+    divergence.records[0] = recordA;
+    divergence.records[1] = recordB;
+
+    for (size_t i = 0; i < (size_t)Checkpoint::Component::COUNT; i++) {
+        if (recordA.components[i] != recordB.components[i]) {
+            divergence.components |= (uint8_t)(1 << i);
+        }
+    }
+
+    return divergence;
+}
\ No newline at end of file
@@ -0,0 +1,116 @@
+#pragma once
+
+#include <string>
+#include <memory>
+#include <fstream>
+#include <cstdint>
+#include <cstddef>
+
+class NES;
+
+/**
+ * Per-frame hashes of the parts of the machine a change to the CPU or PPU would disturb, to find out exactly when two
+ * runs of the same game stop behaving alike.
+ *
+ * Every record also holds a chained hash: the hash of its components seeded with the previous record's chained hash.
+ * Once two runs diverge, their chained hashes never match again, so the first diverging frame of two checkpoint files
+ * is found by bisection, reading only a few records of either.
+ */
+namespace Checkpoint {
+    enum class Component : uint8_t {
+        CPU,            // The registers.
+        RAM,
+        VRAM,
+        OAM,
+        PALETTE_RAM,
+        FRAMEBUFFER,    // 0 while the PPU's output is suppressed.
+        COUNT
+    };
+
+    const char *getComponentName(Component component);
+
+    struct Record {
+        uint64_t frame;     // PPU::getFrame() when the record was taken.
+        uint64_t chain;
+        uint64_t components[(size_t)Component::COUNT];
+    };
+
+    /**
+     * Hashes the machine's components into a record.
+     * @param previousChain The chained hash of the previous record, or 0 for the first.
+     */
+    void hash(NES &nes, uint64_t previousChain, Record &outRecord);
+
+    /**
+     * Writes a record for every frame the machine completes. Attach it with NES::setCheckpointWriter().
+     */
+    class Writer {
+    public:
+        Writer();
+
+        /**
+         * @return false if the file couldn't be created.
+         */
+        bool open(const std::string &file);
+
+        /**
+         * Hashes the machine and appends the record.
+         */
+        void record(NES &nes);
+
+        /**
+         * @return false if anything couldn't be written.
+         */
+        bool close();
+
+    private:
+        std::ofstream out;
+        uint64_t chain;
+    };
+
+    enum class LoadError {
+        NO_ERROR,
+        OPEN_FAILED,
+        READ_ERROR,
+        MAGIC_BYTES_MISMATCH,
+        UNSUPPORTED_VERSION
+    };
+
+    std::string getLoadErrorMessage(LoadError error);
+
+    /**
+     * Random access to the records of a checkpoint file, which are only read when asked for.
+     */
+    class Reader {
+    public:
+        uint64_t getRecordCount() const;
+
+        /**
+         * @return false if the record couldn't be read.
+         */
+        bool read(uint64_t index, Record &outRecord);
+
+    private:
+        friend LoadError open(const std::string &file, std::unique_ptr<Reader> &outReader);
+
+        Reader();
+
+        std::ifstream in;
+        uint64_t recordCount;
+    };
+
+    LoadError open(const std::string &file, std::unique_ptr<Reader> &outReader);
+
+    struct Divergence {
+        bool diverged;
+        uint64_t index;         // The first record that differs.
+        Record records[2];      // That record from either file.
+        uint8_t components;     // Bit n is set if Component n differs.
+    };
+
+    /**
+     * Bisects two checkpoint files for the first record that differs. If one file is merely shorter than the other,
+     * they don't diverge; compare the record counts for that.
+     */
+    Divergence findDivergence(Reader &a, Reader &b);
+}
\ No newline at end of file
@@ -0,0 +1,52 @@
+#include "controller.h"
+
+#include "savestate.h"
+
+Controller::Controller()
+    : buttons(0x00),
+      shiftRegister(0x00),
+      strobe(false)
+{
+}
+
+void Controller::setButtons(uint8_t buttons) {
+    this->buttons = buttons;
+
+    if (strobe) {
+        shiftRegister = buttons;
+    }
+}
+
+uint8_t Controller::getButtons() const {
+    return buttons;
+}
+
+void Controller::writeStrobe(bool strobe) {
+    this->strobe = strobe;
+
+    if (strobe) {
+        shiftRegister = buttons;
+    }
+}
+
+uint8_t Controller::read() {
+    if (strobe) {
+        return buttons & 0x01;
+    }
+
+    const uint8_t bit = shiftRegister & 0x01;
+    shiftRegister = (uint8_t)((shiftRegister >> 1) | 0x80);
+    return bit;
+}
+
+void Controller::saveState(StateWriter &writer) const {
+    writer.write(buttons);
+    writer.write(shiftRegister);
+    writer.write(strobe);
+}
+
+void Controller::loadState(StateReader &reader) {
+    reader.read(buttons);
+    reader.read(shiftRegister);
+    reader.read(strobe);
+}
\ No newline at end of file
@@ -0,0 +1,52 @@
+#pragma once
+
+#include <cstdint>
+
+class StateWriter;
+class StateReader;
+
+/**
+ * The buttons of a standard controller, in the order the controller shifts them out.
+ */
+enum class ControllerButton : uint8_t {
+    A = 1 << 0,
+    B = 1 << 1,
+    SELECT = 1 << 2,
+    START = 1 << 3,
+    UP = 1 << 4,
+    DOWN = 1 << 5,
+    LEFT = 1 << 6,
+    RIGHT = 1 << 7
+};
+
+/**
+ * A standard controller. While the strobe bit ($4016 bit 0) is set, the controller keeps loading the buttons into
+ * its shift register; once it is cleared, each read from the port returns the next button, A first.
+ */
+class Controller {
+public:
+    Controller();
+
+    /**
+     * @param buttons The ControllerButton flags of the buttons that are held down.
+     */
+    void setButtons(uint8_t buttons);
+
+    uint8_t getButtons() const;
+
+    void writeStrobe(bool strobe);
+
+    /**
+     * @return The next button in bit 0. After all eight buttons, an official controller returns 1s.
+     */
+    uint8_t read();
+
+    void saveState(StateWriter &writer) const;
+
+    void loadState(StateReader &reader);
+
+private:
+    uint8_t buttons;
+    uint8_t shiftRegister;
+    bool strobe;
+};
\ No newline at end of file
@@ -4,24 +4,45 @@
 #include "op.h"
 #include "utils.h"
 #include "memory.h"
+#include "savestate.h"
 
 #include <vector>
 #include <string>
 #include <iostream>
 
+static const RegisterFile POWER_ON_REGISTERS = {
+    0,                // a
+    0,                // x
+    0,                // y
+    // p: the unused flag must always be set, and the reset sequence leaves IRQs disabled.
+    (CPUFlag)((uint8_t)CPUFlag::UNUSED | (uint8_t)CPUFlag::IRQ_DISABLE),
+    0xFF,             // s
+    0x0000            // pc
+};
+
 CPU::CPU(NES *nes)
     : nes(nes),
-      r(RegisterFile {
-          0,                // a
-          0,                // x
-          0,                // y
-          CPUFlag::UNUSED,  // p, unused flag must always be set.
-          0xFF,             // s
-          0x0000            // pc
-      })
+      r(POWER_ON_REGISTERS),
+      irqLines(0),
+      nmiPending(false),
+      stallCycles(0)
 {
 }
 
+void CPU::powerOn() {
+    r = POWER_ON_REGISTERS;
+    irqLines = 0;
+    nmiPending = false;
+    stallCycles = 0;
+}
+
+void CPU::reset() {
+    r.s -= 3;
+    setFlag(CPUFlag::IRQ_DISABLE, true);
+    nmiPending = false;
+    stallCycles = 0;
+}
+
 NES *CPU::getNES() {
     return nes;
 }
@@ -48,14 +69,77 @@ uint8_t CPU::pull() {
     return nes->getMemory()->readCPU(NES_STACK_ADDRESS + r.s);
 }
 
+void CPU::setIRQLine(IRQSource source, bool asserted) {
+    if (asserted) {
+        irqLines |= (uint8_t)source;
+    } else {
+        irqLines &= ~(uint8_t)source;
+    }
+}
+
+bool CPU::isIRQLineAsserted(IRQSource source) const {
+    return (irqLines & (uint8_t)source) != 0;
+}
+
+bool CPU::isIRQLineAsserted() const {
+    return irqLines != 0;
+}
+
+bool CPU::isNMIPending() const {
+    return nmiPending;
+}
+
+void CPU::triggerNMI() {
+    nmiPending = true;
+}
+
+void CPU::stall(unsigned int cycles) {
+    stallCycles += cycles;
+}
+
+unsigned int CPU::takeStallCycles() {
+    const unsigned int cycles = stallCycles;
+    stallCycles = 0;
+    return cycles;
+}
+
+unsigned int CPU::interrupt(Address vector) {
+    uint8_t high, low;
+    Utils::splitUint16LE(r.pc, &low, &high);
+
+    push(high);
+    push(low);
+
+    // Unlike BRK and PHP, hardware interrupts push the flags with the break flag clear.
+    push((uint8_t)Utils::setFlag8(r.p, CPUFlag::BREAK, false));
+    setFlag(CPUFlag::IRQ_DISABLE, true);
+
+    r.pc = vector;
+    return 7;
+}
+
 unsigned int CPU::step() {
+    if (nmiPending) {
+        nmiPending = false;
+        return interrupt(nes->getMemory()->getNMIVector());
+    } else if (irqLines != 0 && !isFlagSet(CPUFlag::IRQ_DISABLE)) {
+        return interrupt(nes->getMemory()->getIRQVector());
+    }
+
     const uint8_t op = fetch();
     const Op::Opcode *opDecoded = Op::decode(op);
 
     if (opDecoded == nullptr) {
-        std::cerr << "$";
-        Utils::writeHexToStream(std::cerr, op);
-        std::cerr << " was not a valid opcode!\n";
+        Diagnostics *diagnostics = nes->getDiagnostics();
+        diagnostics->unsupportedOpcodes.set(op);
+        diagnostics->unsupportedOpcodeCount++;
+
+        if (diagnostics->verbose) {
+            std::cerr << "$";
+            Utils::writeHexToStream(std::cerr, op);
+            std::cerr << " was not a valid opcode!\n";
+        }
+
         return 0;
     }
 
@@ -71,7 +155,11 @@ unsigned int CPU::step() {
     std::cout << inst << "\n";
 #endif
 
-    return opDecoded->handler(this, operands, opDecoded) + opDecoded->baseCycles;
+    const unsigned int cycles = opDecoded->handler(this, operands, opDecoded) + opDecoded->baseCycles;
+    const unsigned int stalled = stallCycles;
+
+    stallCycles = 0;
+    return cycles + stalled;
 }
 
 uint8_t CPU::fetch() {
@@ -113,3 +201,26 @@ void CPU::printState() const {
 void CPU::jump(Address address) {
     r.pc = address;
 }
+
+void CPU::saveState(StateWriter &writer) const {
+    // Field by field, as the padding byte before pc is never initialised and would make equal states differ.
+    writer.write(r.a);
+    writer.write(r.x);
+    writer.write(r.y);
+    writer.write(r.p);
+    writer.write(r.s);
+    writer.write(r.pc);
+    writer.write(irqLines);
+    writer.write(nmiPending);
+}
+
+void CPU::loadState(StateReader &reader) {
+    reader.read(r.a);
+    reader.read(r.x);
+    reader.read(r.y);
+    reader.read(r.p);
+    reader.read(r.s);
+    reader.read(r.pc);
+    reader.read(irqLines);
+    reader.read(nmiPending);
+}
\ No newline at end of file
@@ -17,6 +17,12 @@ enum class CPUFlag: uint8_t {
     NEGATIVE = 1 << 7
 };
 
+enum class IRQSource: uint8_t {
+    MAPPER = 1 << 0,
+    APU_FRAME_COUNTER = 1 << 1,
+    APU_DMC = 1 << 2
+};
+
 struct RegisterFile {
     uint8_t a;      // Accumulator
     uint8_t x;      // X Index Register
@@ -27,6 +33,8 @@ struct RegisterFile {
 };
 
 class NES;
+class StateWriter;
+class StateReader;
 
 class CPU {
 public:
@@ -46,14 +54,66 @@ public:
 
     uint8_t pull();
 
+    /**
+     * Asserts or releases one of the wired-OR inputs of the /IRQ line. The CPU takes the interrupt before its next
+     * instruction for as long as any input is asserted and interrupts aren't disabled.
+     */
+    void setIRQLine(IRQSource source, bool asserted);
+
+    bool isIRQLineAsserted(IRQSource source) const;
+
+    /**
+     * @return Whether any input of the /IRQ line is asserted, whether or not interrupts are disabled.
+     */
+    bool isIRQLineAsserted() const;
+
+    bool isNMIPending() const;
+
+    /**
+     * Signals an edge on the /NMI line. The CPU takes the interrupt before its next instruction.
+     */
+    void triggerNMI();
+
+    /**
+     * Halts the CPU for the given number of cycles after the current instruction, for example during OAM DMA.
+     */
+    void stall(unsigned int cycles);
+
+    /**
+     * @return The cycles stall() has added since the last instruction, which are then cleared. step() adds them to the
+     * instruction it executes; this is for code that executes the instructions itself, like VectorLockstep.
+     */
+    unsigned int takeStallCycles();
+
     unsigned int step();
 
+    /**
+     * Puts the registers and interrupt lines back into their power-on state.
+     */
+    void powerOn();
+
+    /**
+     * What the reset button does to the CPU: the stack pointer moves down by three, as for an interrupt whose pushes
+     * were suppressed, and IRQs are disabled. The caller then jumps to the reset vector.
+     */
+    void reset();
+
     void printState() const;
 
+    void saveState(StateWriter &writer) const;
+
+    void loadState(StateReader &reader);
+
 private:
     NES *nes;
     RegisterFile r;
 
+    uint8_t irqLines;
+    bool nmiPending;
+    unsigned int stallCycles;   // Always 0 between steps, so it isn't part of the state.
+
+    unsigned int interrupt(Address vector);
+
     uint8_t fetch();
 
     void fetchOperands(size_t count, std::vector<uint8_t> &operands);
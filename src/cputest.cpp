@@ -0,0 +1,521 @@
+#include "cputest.h"
+
+#include "nes.h"
+#include "rom.h"
+
+// How much of a file is read at once.
+static const size_t READ_BUFFER_SIZE = 1024 * 1024;
+
+// How deep skipValue() follows nested arrays and objects before it gives up on the file.
+static const unsigned int MAX_SKIP_DEPTH = 64;
+
+// The 8-bit register of a state a key names, or nullptr.
+static uint8_t *findRegister(CPUTest::State &state, const std::string &key) {
+    if (key.size() != 1) {
+        return nullptr;
+    }
+
+    switch (key[0]) {
+        case 's': return &state.s;
+        case 'a': return &state.a;
+        case 'x': return &state.x;
+        case 'y': return &state.y;
+        case 'p': return &state.p;
+    }
+
+    return nullptr;
+}
+
+bool CPUTest::BusCycle::operator==(const CPUTest::BusCycle &other) const {
+    return address == other.address && value == other.value && write == other.write;
+}
+
+std::string CPUTest::getParseErrorMessage(CPUTest::ParseError error) {
+    switch (error) {
+        case CPUTest::ParseError::NO_ERROR:
+            return "No error";
+
+        case CPUTest::ParseError::OPEN_FAILED:
+            return "Couldn't open the file";
+
+        case CPUTest::ParseError::READ_ERROR:
+            return "Couldn't read the file";
+
+        case CPUTest::ParseError::SYNTAX_ERROR:
+            return "The file isn't a list of tests";
+    }
+
+    return "Unknown error";
+}
+
+CPUTest::VectorReader::VectorReader()
+    : in(),
+      buffer(READ_BUFFER_SIZE),
+      position(0),
+      end(0),
+      started(false),
+      finished(false),
+      error(ParseError::NO_ERROR),
+      key()
+{
+}
+
+CPUTest::ParseError CPUTest::VectorReader::open(const std::string &file) {
+    in.close();
+    in.clear();
+    in.open(file, std::ios::in | std::ios::binary);
+
+    position = 0;
+    end = 0;
+    started = false;
+    finished = false;
+    error = in ? ParseError::NO_ERROR : ParseError::OPEN_FAILED;
+    return error;
+}
+
+CPUTest::ParseError CPUTest::VectorReader::getError() const {
+    return error;
+}
+
+bool CPUTest::VectorReader::read(CPUTest::Vector &outVector) {
+    if (error != ParseError::NO_ERROR || finished) {
+        return false;
+    }
+
+    skipWhitespace();
+
+    if (!started) {
+        if (!expect('[')) {
+            return fail();
+        }
+
+        started = true;
+        skipWhitespace();
+
+        if (peek() == ']') {
+            finished = true;
+            return false;
+        }
+    } else {
+        const int c = get();
+
+        if (c == ']') {
+            finished = true;
+            return false;
+        } else if (c != ',') {
+            return fail();
+        }
+    }
+
+    return parseVector(outVector) || fail();
+}
+
+int CPUTest::VectorReader::peek() {
+    if (position == end) {
+        if (!in) {
+            return -1;
+        }
+
+        in.read(buffer.data(), buffer.size());
+        position = 0;
+        end = (size_t)in.gcount();
+
+        if (in.bad()) {
+            error = ParseError::READ_ERROR;
+            end = 0;
+        }
+
+        if (end == 0) {
+            return -1;
+        }
+    }
+
+    return (unsigned char)buffer[position];
+}
+
+int CPUTest::VectorReader::get() {
+    const int c = peek();
+
+    if (c >= 0) {
+        position++;
+    }
+
+    return c;
+}
+
+void CPUTest::VectorReader::skipWhitespace() {
+    int c = peek();
+
+    while (c == ' ' || c == '\n' || c == '\r' || c == '\t') {
+        position++;
+        c = peek();
+    }
+}
+
+bool CPUTest::VectorReader::expect(char c) {
+    skipWhitespace();
+    return get() == c;
+}
+
+bool CPUTest::VectorReader::parseNumber(uint32_t &outNumber) {
+    skipWhitespace();
+
+    uint32_t number = 0;
+    int c = peek();
+
+    if (c < '0' || c > '9') {
+        return false;
+    }
+
+    while (c >= '0' && c <= '9') {
+        number = number * 10 + (uint32_t)(c - '0');
+        position++;
+        c = peek();
+    }
+
+    outNumber = number;
+    return true;
+}
+
+bool CPUTest::VectorReader::parseString(std::string &outString) {
+    if (!expect('"')) {
+        return false;
+    }
+
+    outString.clear();
+
+    // The tests only have names, keys and bus directions, so escapes are kept as they are rather than decoded.
+    while (true) {
+        const int c = get();
+
+        if (c < 0) {
+            return false;
+        } else if (c == '"') {
+            return true;
+        } else if (c == '\\') {
+            const int escaped = get();
+
+            if (escaped < 0) {
+                return false;
+            }
+
+            outString += (char)c;
+            outString += (char)escaped;
+        } else {
+            outString += (char)c;
+        }
+    }
+}
+
+bool CPUTest::VectorReader::skipValue() {
+    // Iteratively, with a count of the open brackets, as nobody needs to know what is in there.
+    unsigned int depth = 0;
+
+    do {
+        skipWhitespace();
+        int c = peek();
+
+        if (c == '"') {
+            if (!parseString(key)) {
+                return false;
+            }
+        } else if (c == '[' || c == '{') {
+            if (++depth > MAX_SKIP_DEPTH) {
+                return false;
+            }
+
+            position++;
+        } else if (c == ']' || c == '}') {
+            if (depth == 0) {
+                return false;
+            }
+
+            depth--;
+            position++;
+        } else if (c == ',' || c == ':') {
+            if (depth == 0) {
+                return false;
+            }
+
+            position++;
+        } else if (c < 0) {
+            return false;
+        } else {
+            // A number, true, false or null.
+            while (c >= 0 && c != ',' && c != ']' && c != '}' && c != ' ' && c != '\n' && c != '\r' && c != '\t') {
+                position++;
+                c = peek();
+            }
+        }
+    } while (depth > 0);
+
+    return true;
+}
+
+bool CPUTest::VectorReader::parseState(CPUTest::State &outState) {
+    if (!expect('{')) {
+        return false;
+    }
+
+    while (true) {
+        if (!parseString(key) || !expect(':')) {
+            return false;
+        }
+
+        uint32_t number;
+        uint8_t *reg = findRegister(outState, key);
+
+        if (reg != nullptr || key == "pc") {
+            if (!parseNumber(number)) {
+                return false;
+            }
+
+            if (reg != nullptr) {
+                *reg = (uint8_t)number;
+            } else {
+                outState.pc = (uint16_t)number;
+            }
+        } else if (key == "ram") {
+            if (!parseRAM(outState.ram)) {
+                return false;
+            }
+        } else if (!skipValue()) {
+            return false;
+        }
+
+        skipWhitespace();
+        const int c = get();
+
+        if (c == '}') {
+            return true;
+        } else if (c != ',') {
+            return false;
+        }
+    }
+}
+
+bool CPUTest::VectorReader::parseRAM(std::vector<std::pair<Address, uint8_t>> &outRAM) {
+    outRAM.clear();
+
+    if (!expect('[')) {
+        return false;
+    }
+
+    skipWhitespace();
+
+    if (peek() == ']') {
+        position++;
+        return true;
+    }
+
+    while (true) {
+        uint32_t address, value;
+
+        if (!expect('[') || !parseNumber(address) || !expect(',') || !parseNumber(value) || !expect(']')) {
+            return false;
+        }
+
+        outRAM.emplace_back((Address)address, (uint8_t)value);
+        skipWhitespace();
+        const int c = get();
+
+        if (c == ']') {
+            return true;
+        } else if (c != ',') {
+            return false;
+        }
+    }
+}
+
+bool CPUTest::VectorReader::parseCycles(std::vector<CPUTest::BusCycle> &outCycles) {
+    outCycles.clear();
+
+    if (!expect('[')) {
+        return false;
+    }
+
+    skipWhitespace();
+
+    if (peek() == ']') {
+        position++;
+        return true;
+    }
+
+    while (true) {
+        uint32_t address, value;
+
+        if (!expect('[') || !parseNumber(address) || !expect(',') || !parseNumber(value) || !expect(',') ||
+            !parseString(key) || !expect(']')) {
+            return false;
+        }
+
+        outCycles.push_back({ (Address)address, (uint8_t)value, key == "write" });
+        skipWhitespace();
+        const int c = get();
+
+        if (c == ']') {
+            return true;
+        } else if (c != ',') {
+            return false;
+        }
+    }
+}
+
+bool CPUTest::VectorReader::parseVector(CPUTest::Vector &outVector) {
+    outVector.name.clear();
+    outVector.initial.ram.clear();
+    outVector.final.ram.clear();
+    outVector.cycles.clear();
+
+    if (!expect('{')) {
+        return false;
+    }
+
+    while (true) {
+        if (!parseString(key) || !expect(':')) {
+            return false;
+        }
+
+        bool parsed;
+
+        if (key == "name") {
+            parsed = parseString(outVector.name);
+        } else if (key == "initial") {
+            parsed = parseState(outVector.initial);
+        } else if (key == "final") {
+            parsed = parseState(outVector.final);
+        } else if (key == "cycles") {
+            parsed = parseCycles(outVector.cycles);
+        } else {
+            parsed = skipValue();
+        }
+
+        if (!parsed) {
+            return false;
+        }
+
+        skipWhitespace();
+        const int c = get();
+
+        if (c == '}') {
+            return true;
+        } else if (c != ',') {
+            return false;
+        }
+    }
+}
+
+bool CPUTest::VectorReader::fail() {
+    if (error == ParseError::NO_ERROR) {
+        error = ParseError::SYNTAX_ERROR;
+    }
+
+    return false;
+}
+
+CPUTest::Bus::Bus() : ram(), cycles() {
+}
+
+uint8_t CPUTest::Bus::read(Address address) {
+    const uint8_t value = ram[address];
+    cycles.push_back({ address, value, false });
+    return value;
+}
+
+void CPUTest::Bus::write(Address address, uint8_t value) {
+    ram[address] = value;
+    cycles.push_back({ address, value, true });
+}
+
+std::string CPUTest::getMismatchDescription(uint8_t mismatches) {
+    static const char *const NAMES[] = { "registers", "RAM", "cycle count", "bus cycles", "unsupported" };
+    std::string description;
+
+    for (size_t i = 0; i < sizeof(NAMES) / sizeof(NAMES[0]); i++) {
+        if ((mismatches & (1 << i)) != 0) {
+            description += (description.empty() ? "" : ", ") + std::string(NAMES[i]);
+        }
+    }
+
+    return description;
+}
+
+CPUTest::Runner::Runner() : nes(), bus() {
+    // The smallest cartridge there is. It is never read, as the bus takes every CPU access.
+    iNES::HeaderInfo info = {};
+    info.prgROMSize = 0x4000;
+    info.chrROMSize = 0x2000;
+    info.mirroring = Mirroring::HORIZONTAL;
+
+    iNES::File file;
+    file.header = iNES::makeHeader(info);
+    file.prgROM.assign(info.prgROMSize, 0);
+    file.chrROM.assign(info.chrROMSize, 0);
+
+    Cartridge cartridge(ROMImage::create(file));
+    nes.reset(new NES(cartridge));
+    nes->getDiagnostics()->verbose = false;
+    nes->getMemory()->setCPUBus(&bus);
+
+    // An instruction takes at most 8 cycles; more than that only comes from a broken one.
+    bus.cycles.reserve(64);
+}
+
+CPUTest::Runner::~Runner() {
+}
+
+uint8_t CPUTest::Runner::run(const CPUTest::Vector &vector, bool checkBusCycles) {
+    for (const auto &entry : vector.initial.ram) {
+        bus.ram[entry.first] = entry.second;
+    }
+
+    bus.cycles.clear();
+
+    CPU *cpu = nes->getCPU();
+    RegisterFile *regs = cpu->getRegs();
+    regs->pc = vector.initial.pc;
+    regs->s = vector.initial.s;
+    regs->a = vector.initial.a;
+    regs->x = vector.initial.x;
+    regs->y = vector.initial.y;
+    regs->p = (CPUFlag)vector.initial.p;
+
+    Diagnostics *diagnostics = nes->getDiagnostics();
+    const uint64_t unsupportedOpcodeCount = diagnostics->unsupportedOpcodeCount;
+    const unsigned int cycles = cpu->step();
+    uint8_t mismatches = 0;
+
+    if (diagnostics->unsupportedOpcodeCount != unsupportedOpcodeCount) {
+        mismatches = UNSUPPORTED;
+    } else {
+        if (regs->pc != vector.final.pc || regs->s != vector.final.s || regs->a != vector.final.a ||
+            regs->x != vector.final.x || regs->y != vector.final.y || (uint8_t)regs->p != vector.final.p) {
+            mismatches |= REGISTERS;
+        }
+
+        for (const auto &entry : vector.final.ram) {
+            if (bus.ram[entry.first] != entry.second) {
+                mismatches |= RAM;
+            }
+        }
+
+        if (cycles != vector.cycles.size()) {
+            mismatches |= CYCLE_COUNT;
+        }
+
+        if (checkBusCycles && bus.cycles != vector.cycles) {
+            mismatches |= BUS_CYCLES;
+        }
+    }
+
+    // Clear what this test touched, so that what the next one doesn't set reads as 0 whatever ran before it.
+    for (const auto &entry : vector.initial.ram) {
+        bus.ram[entry.first] = 0;
+    }
+
+    for (const BusCycle &cycle : bus.cycles) {
+        bus.ram[cycle.address] = 0;
+    }
+
+    return mismatches;
+}
\ No newline at end of file
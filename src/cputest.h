@@ -0,0 +1,161 @@
+#pragma once
+
+#include "memory.h"
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <fstream>
+#include <cstdint>
+#include <cstddef>
+
+class NES;
+
+/*
+ * Runs the CPU one instruction at a time against "single step" test vectors: JSON files with one array of tests per
+ * opcode, each giving the registers and the RAM before and after the instruction and every bus cycle it takes.
+ *
+ *     [ { "name": "a9 c3 11", "initial": { "pc": 1234, "s": 253, "a": 0, "x": 0, "y": 0, "p": 36,
+ *                                          "ram": [ [1234, 169], [1235, 195] ] },
+ *         "final": { ... }, "cycles": [ [1234, 169, "read"], [1235, 195, "read"] ] }, ... ]
+ *
+ * The files hold thousands of tests each, so they are parsed as a stream into a Vector the caller reuses, which
+ * doesn't allocate once its buffers have grown to fit.
+ */
+namespace CPUTest {
+    struct State {
+        uint16_t pc;
+        uint8_t s;
+        uint8_t a;
+        uint8_t x;
+        uint8_t y;
+        uint8_t p;
+        std::vector<std::pair<Address, uint8_t>> ram;
+    };
+
+    struct BusCycle {
+        Address address;
+        uint8_t value;
+        bool write;
+
+        bool operator==(const BusCycle &other) const;
+    };
+
+    struct Vector {
+        std::string name;
+        State initial;
+        State final;
+        std::vector<BusCycle> cycles;
+    };
+
+    enum class ParseError {
+        NO_ERROR,
+        OPEN_FAILED,
+        READ_ERROR,
+        SYNTAX_ERROR
+    };
+
+    std::string getParseErrorMessage(ParseError error);
+
+    /**
+     * Reads the tests of a file one after the other.
+     */
+    class VectorReader {
+    public:
+        VectorReader();
+
+        ParseError open(const std::string &file);
+
+        /**
+         * @return false at the end of the file, or if it couldn't be read or parsed; getError() tells which.
+         */
+        bool read(Vector &outVector);
+
+        ParseError getError() const;
+
+    private:
+        std::ifstream in;
+        std::vector<char> buffer;
+        size_t position;
+        size_t end;
+        bool started;
+        bool finished;
+        ParseError error;
+        std::string key;    // Scratch space for object keys, kept so that parsing doesn't allocate.
+
+        int peek();
+
+        int get();
+
+        void skipWhitespace();
+
+        bool expect(char c);
+
+        bool parseNumber(uint32_t &outNumber);
+
+        bool parseString(std::string &outString);
+
+        bool skipValue();
+
+        bool parseRAM(std::vector<std::pair<Address, uint8_t>> &outRAM);
+
+        bool parseState(State &outState);
+
+        bool parseCycles(std::vector<BusCycle> &outCycles);
+
+        bool parseVector(Vector &outVector);
+
+        bool fail();
+    };
+
+    /**
+     * 64 KB of RAM that logs every access.
+     */
+    class Bus : public CPUBus {
+    public:
+        Bus();
+
+        uint8_t read(Address address) override;
+
+        void write(Address address, uint8_t value) override;
+
+        uint8_t ram[0x10000];
+        std::vector<BusCycle> cycles;
+    };
+
+    // What Runner::run() found wrong, as bits.
+    enum Mismatch : uint8_t {
+        REGISTERS = 1 << 0,
+        RAM = 1 << 1,
+        CYCLE_COUNT = 1 << 2,   // CPU::step() returned another number of cycles than the test has.
+        BUS_CYCLES = 1 << 3,    // The addresses, values or directions of the accesses differ.
+        UNSUPPORTED = 1 << 4    // The opcode hit the unsupported handler; nothing else was compared.
+    };
+
+    std::string getMismatchDescription(uint8_t mismatches);
+
+    /**
+     * A CPU wired to a Bus, in an NES of its own whose other parts never run.
+     */
+    class Runner {
+    public:
+        Runner();
+
+        ~Runner();
+
+        Runner(const Runner &) = delete;
+
+        Runner &operator=(const Runner &) = delete;
+
+        /**
+         * Runs one instruction from the test's initial state and compares the outcome with its final state.
+         * @param checkBusCycles Compare the bus accesses one by one, rather than only how many cycles there are.
+         * @return The Mismatch bits, 0 if the test passed.
+         */
+        uint8_t run(const Vector &vector, bool checkBusCycles);
+
+    private:
+        std::unique_ptr<NES> nes;
+        Bus bus;
+    };
+}
\ No newline at end of file
@@ -0,0 +1,17 @@
+#pragma once
+
+#include <bitset>
+#include <cstdint>
+
+/**
+ * Counts the things a game tried to do that the emulator can't do (yet). By default every one of them is also
+ * reported on the console; tools that run lots of games unattended turn that off and read the counters instead.
+ */
+struct Diagnostics {
+    bool verbose = true;
+
+    std::bitset<256> unsupportedOpcodes;    // Which opcodes hit the unsupported handler.
+    uint64_t unsupportedOpcodeCount = 0;
+    uint64_t unmappedReads = 0;
+    uint64_t unmappedWrites = 0;
+};
\ No newline at end of file
@@ -0,0 +1,418 @@
+#include "hash.h"
+
+#include <cstring>
+
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64)
+#define NESULATOR_CRC32_PCLMUL
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#define PCLMUL_TARGET
+#else
+#define PCLMUL_TARGET __attribute__((target("pclmul,sse4.1")))
+#endif
+#elif defined(__ARM_FEATURE_CRC32)
+#define NESULATOR_CRC32_ARM
+#include <arm_acle.h>
+#endif
+
+const size_t Hash::SHA1_SIZE = 20;
+
+namespace {
+    struct CRC32Tables {
+        uint32_t t[8][256];
+
+        CRC32Tables() {
+            for (uint32_t i = 0; i < 256; i++) {
+                uint32_t crc = i;
+
+                for (int bit = 0; bit < 8; bit++) {
+                    crc = (crc >> 1) ^ ((crc & 1) != 0 ? 0xEDB88320 : 0);
+                }
+
+                t[0][i] = crc;
+            }
+
+            for (uint32_t i = 0; i < 256; i++) {
+                for (size_t k = 1; k < 8; k++) {
+                    t[k][i] = (t[k - 1][i] >> 8) ^ t[0][t[k - 1][i] & 0xFF];
+                }
+            }
+        }
+    };
+
+    const CRC32Tables &getCRC32Tables() {
+        static const CRC32Tables tables;
+        return tables;
+    }
+
+    uint32_t readUint32LE(const uint8_t *p) {
+        return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+    }
+
+    // Works on the inverted CRC, like all the other kernels.
+    uint32_t crc32Table(const uint8_t *data, size_t size, uint32_t crc) {
+        const auto &t = getCRC32Tables().t;
+
+        while (size >= 8) {
+            const uint32_t one = readUint32LE(data) ^ crc;
+            const uint32_t two = readUint32LE(data + 4);
+
+            crc = t[7][one & 0xFF] ^ t[6][(one >> 8) & 0xFF] ^ t[5][(one >> 16) & 0xFF] ^ t[4][one >> 24] ^
+                  t[3][two & 0xFF] ^ t[2][(two >> 8) & 0xFF] ^ t[1][(two >> 16) & 0xFF] ^ t[0][two >> 24];
+
+            data += 8;
+            size -= 8;
+        }
+
+        while (size-- > 0) {
+            crc = (crc >> 8) ^ t[0][(crc ^ *data++) & 0xFF];
+        }
+
+        return crc;
+    }
+
+#ifdef NESULATOR_CRC32_PCLMUL
+    bool hasPCLMUL() {
+#ifdef _MSC_VER
+        int info[4];
+        __cpuid(info, 1);
+        return (info[2] & (1 << 1)) != 0 && (info[2] & (1 << 19)) != 0;
+#else
+        return __builtin_cpu_supports("pclmul") && __builtin_cpu_supports("sse4.1");
+#endif
+    }
+
+    /*
+     * Folds 64-byte blocks with carry-less multiplication and finishes with a Barrett reduction, as described in
+     * Intel's "Fast CRC Computation for Generic Polynomials Using PCLMULQDQ Instruction". `size` must be a multiple
+     * of 16 and at least 64.
+     */
+    PCLMUL_TARGET uint32_t crc32PCLMUL(const uint8_t *data, size_t size, uint32_t crc) {
+        alignas(16) static const uint64_t k1k2[] = { 0x0154442bd4, 0x01c6e41596 };
+        alignas(16) static const uint64_t k3k4[] = { 0x01751997d0, 0x00ccaa009e };
+        alignas(16) static const uint64_t k5k0[] = { 0x0163cd6124, 0x0000000000 };
+        alignas(16) static const uint64_t poly[] = { 0x01db710641, 0x01f7011641 };
+
+        __m128i x0, x1, x2, x3, x4, x5, x6, x7, x8, y5, y6, y7, y8;
+
+        x1 = _mm_loadu_si128((const __m128i *)(data + 0x00));
+        x2 = _mm_loadu_si128((const __m128i *)(data + 0x10));
+        x3 = _mm_loadu_si128((const __m128i *)(data + 0x20));
+        x4 = _mm_loadu_si128((const __m128i *)(data + 0x30));
+        x1 = _mm_xor_si128(x1, _mm_cvtsi32_si128((int)crc));
+        x0 = _mm_load_si128((const __m128i *)k1k2);
+
+        data += 64;
+        size -= 64;
+
+        while (size >= 64) {
+            x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+            x6 = _mm_clmulepi64_si128(x2, x0, 0x00);
+            x7 = _mm_clmulepi64_si128(x3, x0, 0x00);
+            x8 = _mm_clmulepi64_si128(x4, x0, 0x00);
+
+            x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+            x2 = _mm_clmulepi64_si128(x2, x0, 0x11);
+            x3 = _mm_clmulepi64_si128(x3, x0, 0x11);
+            x4 = _mm_clmulepi64_si128(x4, x0, 0x11);
+
+            y5 = _mm_loadu_si128((const __m128i *)(data + 0x00));
+            y6 = _mm_loadu_si128((const __m128i *)(data + 0x10));
+            y7 = _mm_loadu_si128((const __m128i *)(data + 0x20));
+            y8 = _mm_loadu_si128((const __m128i *)(data + 0x30));
+
+            x1 = _mm_xor_si128(_mm_xor_si128(x1, x5), y5);
+            x2 = _mm_xor_si128(_mm_xor_si128(x2, x6), y6);
+            x3 = _mm_xor_si128(_mm_xor_si128(x3, x7), y7);
+            x4 = _mm_xor_si128(_mm_xor_si128(x4, x8), y8);
+
+            data += 64;
+            size -= 64;
+        }
+
+        // Fold the four lanes into one.
+        x0 = _mm_load_si128((const __m128i *)k3k4);
+
+        x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+        x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+        x1 = _mm_xor_si128(_mm_xor_si128(x1, x2), x5);
+
+        x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+        x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+        x1 = _mm_xor_si128(_mm_xor_si128(x1, x3), x5);
+
+        x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+        x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+        x1 = _mm_xor_si128(_mm_xor_si128(x1, x4), x5);
+
+        // Remaining 16-byte blocks.
+        while (size >= 16) {
+            x2 = _mm_loadu_si128((const __m128i *)data);
+
+            x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+            x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+            x1 = _mm_xor_si128(_mm_xor_si128(x1, x2), x5);
+
+            data += 16;
+            size -= 16;
+        }
+
+        // Fold 128 bits down to 64.
+        x2 = _mm_clmulepi64_si128(x1, x0, 0x10);
+        x3 = _mm_setr_epi32(~0, 0, ~0, 0);
+        x1 = _mm_srli_si128(x1, 8);
+        x1 = _mm_xor_si128(x1, x2);
+
+        x0 = _mm_loadl_epi64((const __m128i *)k5k0);
+
+        x2 = _mm_srli_si128(x1, 4);
+        x1 = _mm_and_si128(x1, x3);
+        x1 = _mm_clmulepi64_si128(x1, x0, 0x00);
+        x1 = _mm_xor_si128(x1, x2);
+
+        // Barrett reduction down to 32 bits.
+        x0 = _mm_load_si128((const __m128i *)poly);
+
+        x2 = _mm_and_si128(x1, x3);
+        x2 = _mm_clmulepi64_si128(x2, x0, 0x10);
+        x2 = _mm_and_si128(x2, x3);
+        x2 = _mm_clmulepi64_si128(x2, x0, 0x00);
+        x1 = _mm_xor_si128(x1, x2);
+
+        return (uint32_t)_mm_extract_epi32(x1, 1);
+    }
+#endif
+
+#ifdef NESULATOR_CRC32_ARM
+    uint32_t crc32ARM(const uint8_t *data, size_t size, uint32_t crc) {
+        while (size >= 8) {
+            uint64_t word;
+            std::memcpy(&word, data, sizeof(word));
+            crc = __crc32d(crc, word);
+            data += 8;
+            size -= 8;
+        }
+
+        while (size-- > 0) {
+            crc = __crc32b(crc, *data++);
+        }
+
+        return crc;
+    }
+#endif
+
+    uint32_t rotateLeft(uint32_t x, unsigned int n) {
+        return (x << n) | (x >> (32 - n));
+    }
+
+    // Compilers turn this into a single load on little-endian CPUs.
+    uint64_t readUint64LE(const uint8_t *p) {
+        return (uint64_t)readUint32LE(p) | ((uint64_t)readUint32LE(p + 4) << 32);
+    }
+
+    uint64_t rotateLeft64(uint64_t x, unsigned int n) {
+        return (x << n) | (x >> (64 - n));
+    }
+
+    const uint64_t XXH_PRIME64_1 = 0x9E3779B185EBCA87ULL;
+    const uint64_t XXH_PRIME64_2 = 0xC2B2AE3D27D4EB4FULL;
+    const uint64_t XXH_PRIME64_3 = 0x165667B19E3779F9ULL;
+    const uint64_t XXH_PRIME64_4 = 0x85EBCA77C2B2AE63ULL;
+    const uint64_t XXH_PRIME64_5 = 0x27D4EB2F165667C5ULL;
+
+    uint64_t xxh64Round(uint64_t accumulator, uint64_t input) {
+        accumulator += input * XXH_PRIME64_2;
+        accumulator = rotateLeft64(accumulator, 31);
+        return accumulator * XXH_PRIME64_1;
+    }
+
+    uint64_t xxh64MergeRound(uint64_t accumulator, uint64_t value) {
+        accumulator ^= xxh64Round(0, value);
+        return accumulator * XXH_PRIME64_1 + XXH_PRIME64_4;
+    }
+}
+
+uint32_t Hash::crc32(const uint8_t *data, size_t size, uint32_t crc) {
+    crc = ~crc;
+
+#if defined(NESULATOR_CRC32_PCLMUL)
+    static const bool pclmul = hasPCLMUL();
+
+    if (pclmul && size >= 64) {
+        const size_t blocks = size & ~(size_t)15;
+        crc = crc32PCLMUL(data, blocks, crc);
+        data += blocks;
+        size -= blocks;
+    }
+#elif defined(NESULATOR_CRC32_ARM)
+    return ~crc32ARM(data, size, crc);
+#endif
+
+    return ~crc32Table(data, size, crc);
+}
+
+uint64_t Hash::xxh64(const uint8_t *data, size_t size, uint64_t seed) {
+    const uint8_t *end = data + size;
+    uint64_t hash;
+
+    if (size >= 32) {
+        // Four independent lanes, so the multiplications of consecutive 8-byte words overlap.
+        uint64_t v1 = seed + XXH_PRIME64_1 + XXH_PRIME64_2;
+        uint64_t v2 = seed + XXH_PRIME64_2;
+        uint64_t v3 = seed;
+        uint64_t v4 = seed - XXH_PRIME64_1;
+
+        do {
+            v1 = xxh64Round(v1, readUint64LE(data));
+            v2 = xxh64Round(v2, readUint64LE(data + 8));
+            v3 = xxh64Round(v3, readUint64LE(data + 16));
+            v4 = xxh64Round(v4, readUint64LE(data + 24));
+            data += 32;
+        } while (end - data >= 32);
+
+        hash = rotateLeft64(v1, 1) + rotateLeft64(v2, 7) + rotateLeft64(v3, 12) + rotateLeft64(v4, 18);
+        hash = xxh64MergeRound(hash, v1);
+        hash = xxh64MergeRound(hash, v2);
+        hash = xxh64MergeRound(hash, v3);
+        hash = xxh64MergeRound(hash, v4);
+    } else {
+        hash = seed + XXH_PRIME64_5;
+    }
+
+    hash += size;
+
+    while (end - data >= 8) {
+        hash ^= xxh64Round(0, readUint64LE(data));
+        hash = rotateLeft64(hash, 27) * XXH_PRIME64_1 + XXH_PRIME64_4;
+        data += 8;
+    }
+
+    if (end - data >= 4) {
+        hash ^= (uint64_t)readUint32LE(data) * XXH_PRIME64_1;
+        hash = rotateLeft64(hash, 23) * XXH_PRIME64_2 + XXH_PRIME64_3;
+        data += 4;
+    }
+
+    while (data < end) {
+        hash ^= *data * XXH_PRIME64_5;
+        hash = rotateLeft64(hash, 11) * XXH_PRIME64_1;
+        data++;
+    }
+
+    hash ^= hash >> 33;
+    hash *= XXH_PRIME64_2;
+    hash ^= hash >> 29;
+    hash *= XXH_PRIME64_3;
+    hash ^= hash >> 32;
+    return hash;
+}
+
+Hash::SHA1::SHA1()
+    : state { 0x67452301, 0xEFCDAB89, 0x98BADCFE, 0x10325476, 0xC3D2E1F0 },
+      length(0),
+      block {},
+      blockSize(0)
+{
+}
+
+void Hash::SHA1::update(const uint8_t *data, size_t size) {
+    length += size;
+
+    if (blockSize > 0) {
+        const size_t count = size < sizeof(block) - blockSize ? size : sizeof(block) - blockSize;
+        std::memcpy(block + blockSize, data, count);
+        blockSize += count;
+        data += count;
+        size -= count;
+
+        if (blockSize < sizeof(block)) {
+            return;
+        }
+
+        processBlock(block);
+        blockSize = 0;
+    }
+
+    while (size >= sizeof(block)) {
+        processBlock(data);
+        data += sizeof(block);
+        size -= sizeof(block);
+    }
+
+    std::memcpy(block, data, size);
+    blockSize = size;
+}
+
+void Hash::SHA1::finish(uint8_t *outDigest) {
+    const uint64_t bits = length * 8;
+
+    block[blockSize++] = 0x80;
+
+    if (blockSize > 56) {
+        std::memset(block + blockSize, 0, sizeof(block) - blockSize);
+        processBlock(block);
+        blockSize = 0;
+    }
+
+    std::memset(block + blockSize, 0, 56 - blockSize);
+
+    for (int i = 0; i < 8; i++) {
+        block[56 + i] = (uint8_t)(bits >> (56 - i * 8));
+    }
+
+    processBlock(block);
+
+    for (size_t i = 0; i < 5; i++) {
+        outDigest[i * 4 + 0] = (uint8_t)(state[i] >> 24);
+        outDigest[i * 4 + 1] = (uint8_t)(state[i] >> 16);
+        outDigest[i * 4 + 2] = (uint8_t)(state[i] >> 8);
+        outDigest[i * 4 + 3] = (uint8_t)state[i];
+    }
+}
+
+void Hash::SHA1::processBlock(const uint8_t *data) {
+    uint32_t w[80];
+
+    for (size_t i = 0; i < 16; i++) {
+        w[i] = ((uint32_t)data[i * 4] << 24) | ((uint32_t)data[i * 4 + 1] << 16) |
+               ((uint32_t)data[i * 4 + 2] << 8) | (uint32_t)data[i * 4 + 3];
+    }
+
+    for (size_t i = 16; i < 80; i++) {
+        w[i] = rotateLeft(w[i - 3] ^ w[i - 8] ^ w[i - 14] ^ w[i - 16], 1);
+    }
+
+    uint32_t a = state[0], b = state[1], c = state[2], d = state[3], e = state[4];
+
+    for (size_t i = 0; i < 80; i++) {
+        uint32_t f, k;
+
+        if (i < 20) {
+            f = (b & c) | (~b & d);
+            k = 0x5A827999;
+        } else if (i < 40) {
+            f = b ^ c ^ d;
+            k = 0x6ED9EBA1;
+        } else if (i < 60) {
+            f = (b & c) | (b & d) | (c & d);
+            k = 0x8F1BBCDC;
+        } else {
+            f = b ^ c ^ d;
+            k = 0xCA62C1D6;
+        }
+
+        const uint32_t temp = rotateLeft(a, 5) + f + e + k + w[i];
+        e = d;
+        d = c;
+        c = rotateLeft(b, 30);
+        b = a;
+        a = temp;
+    }
+
+    state[0] += a;
+    state[1] += b;
+    state[2] += c;
+    state[3] += d;
+    state[4] += e;
+}
\ No newline at end of file
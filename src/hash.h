@@ -0,0 +1,41 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+
+namespace Hash {
+    extern const size_t SHA1_SIZE;
+
+    /**
+     * Computes the CRC-32 (the zlib/PNG/ZIP polynomial) of a buffer. Pass the result of a previous call as `crc` to
+     * continue a running checksum. Uses carry-less multiplication on x86 CPUs that have it and the CRC32 instructions
+     * on ARMv8, and a slicing-by-8 table everywhere else.
+     */
+    uint32_t crc32(const uint8_t *data, size_t size, uint32_t crc = 0);
+
+    /**
+     * Computes the 64-bit xxHash (XXH64) of a buffer: a fast non-cryptographic hash, for telling states apart.
+     */
+    uint64_t xxh64(const uint8_t *data, size_t size, uint64_t seed = 0);
+
+    class SHA1 {
+    public:
+        SHA1();
+
+        void update(const uint8_t *data, size_t size);
+
+        /**
+         * Finishes the hash. The object must not be updated afterwards.
+         * @param outDigest Receives SHA1_SIZE bytes.
+         */
+        void finish(uint8_t *outDigest);
+
+    private:
+        uint32_t state[5];
+        uint64_t length;
+        uint8_t block[64];
+        size_t blockSize;
+
+        void processBlock(const uint8_t *data);
+    };
+}
\ No newline at end of file
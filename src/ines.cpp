@@ -1,10 +1,22 @@
 #include "ines.h"
+#include "romstream.h"
 #include "utils.h"
 
 #include <vector>
 #include <string>
 #include <cstring>
-#include <fstream>
+#include <memory>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
 
 const size_t iNES::PRG_ROM_SIZE = 16384;
 const size_t iNES::PRG_RAM_SIZE = 8192;
@@ -12,26 +24,128 @@ const size_t iNES::CHR_ROM_SIZE = 8192;
 const char iNES::HEADER_MAGIC_BYTES[4] = { 'N', 'E', 'S', '\x1A' };
 const size_t iNES::TRAINER_SIZE = 512;
 
-iNES::LoadError iNES::loadFromFile(const std::string &file, iNES::File &outFile) {
-	std::ifstream in(file, std::ios::in | std::ios::binary);
+bool iNES::isNES20(const iNES::Header &header) {
+    return (header.flags7 & 0x0C) == 0x08;
+}
 
-    if (!in) {
-        return iNES::LoadError::OPEN_FAILED;
+static size_t decodeROMSize(uint8_t lsb, uint8_t msb, size_t unit) {
+    if (msb == 0x0F) {
+        // Exponent-multiplier notation: 2^E * (MM * 2 + 1) bytes.
+        const unsigned int exponent = lsb >> 2;
+        const size_t multiplier = (size_t)(lsb & 0x3) * 2 + 1;
+        return exponent < sizeof(size_t) * 8 - 2 ? ((size_t)1 << exponent) * multiplier : 0;
     }
 
-#define READ_MEMBER(mem) in.read((char*)&(mem), sizeof(mem))
-	
-	bool headerSuccessfullyRead = 
-		READ_MEMBER(outFile.header.magicBytes) &&
-		READ_MEMBER(outFile.header.prgROMCount) &&
-		READ_MEMBER(outFile.header.chrROMCount) &&
-		READ_MEMBER(outFile.header.flags6) &&
-		READ_MEMBER(outFile.header.flags7) &&
-		READ_MEMBER(outFile.header.prgRAMCount) &&
-		READ_MEMBER(outFile.header.padding);
+    return (((size_t)msb << 8) | lsb) * unit;
+}
 
-    if (!headerSuccessfullyRead) {
-        return iNES::LoadError::READ_ERROR;
+static size_t decodeRAMSize(uint8_t shift) {
+    return shift == 0 ? 0 : (size_t)64 << shift;
+}
+
+iNES::HeaderInfo iNES::parseHeader(const iNES::Header &header) {
+    iNES::HeaderInfo info = {};
+
+    info.nes20 = iNES::isNES20(header);
+    info.mapper = (uint16_t)((header.flags6 >> 4) | (header.flags7 & 0xF0));
+    info.mirroring = Utils::isBitSet(header.flags6, 3) ? Mirroring::FOUR_SCREEN :
+                     Utils::isBitSet(header.flags6, 0) ? Mirroring::VERTICAL : Mirroring::HORIZONTAL;
+    info.battery = Utils::isBitSet(header.flags6, 1);
+    info.trainer = Utils::isBitSet(header.flags6, 2);
+
+    if (info.nes20) {
+        info.mapper |= (uint16_t)((header.prgRAMCount & 0x0F) << 8);
+        info.submapper = (uint8_t)(header.prgRAMCount >> 4);
+        info.prgROMSize = decodeROMSize(header.prgROMCount, (uint8_t)(header.flags9 & 0x0F), iNES::PRG_ROM_SIZE);
+        info.chrROMSize = decodeROMSize(header.chrROMCount, (uint8_t)(header.flags9 >> 4), iNES::CHR_ROM_SIZE);
+        info.prgRAMSize = decodeRAMSize((uint8_t)(header.flags10 & 0x0F));
+        info.prgNVRAMSize = decodeRAMSize((uint8_t)(header.flags10 >> 4));
+        info.chrRAMSize = decodeRAMSize((uint8_t)(header.flags11 & 0x0F));
+        info.chrNVRAMSize = decodeRAMSize((uint8_t)(header.flags11 >> 4));
+        info.timing = (iNES::Timing)(header.flags12 & 0x3);
+    } else {
+        // Old dumping tools wrote junk like "DiskDude!" from byte 7 on, so nothing from there on can be trusted.
+        const bool junk = header.flags12 != 0 || header.flags13 != 0 || header.flags14 != 0 || header.flags15 != 0;
+
+        if (junk) {
+            info.mapper &= 0x0F;
+        }
+
+        info.prgROMSize = header.prgROMCount * iNES::PRG_ROM_SIZE;
+        info.chrROMSize = header.chrROMCount * iNES::CHR_ROM_SIZE;
+        info.prgRAMSize =
+            junk || header.prgRAMCount == 0 ? iNES::PRG_RAM_SIZE : header.prgRAMCount * iNES::PRG_RAM_SIZE;
+        info.chrRAMSize = header.chrROMCount == 0 ? iNES::CHR_ROM_SIZE : 0;
+        info.timing = !junk && Utils::isBitSet(header.flags9, 0) ? iNES::Timing::PAL : iNES::Timing::NTSC;
+    }
+
+    return info;
+}
+
+static void encodeROMSize(size_t size, size_t unit, uint8_t &outLSB, uint8_t &outMSB) {
+    if (size % unit == 0 && size / unit < 0xF00) {
+        outLSB = (uint8_t)(size / unit);
+        outMSB = (uint8_t)((size / unit) >> 8);
+        return;
+    }
+
+    // Find the smallest 2^E * (MM * 2 + 1) that holds the ROM.
+    for (unsigned int exponent = 0; exponent < 64; exponent++) {
+        for (size_t multiplier = 0; multiplier < 4; multiplier++) {
+            if (((size_t)1 << exponent) * (multiplier * 2 + 1) >= size) {
+                outLSB = (uint8_t)((exponent << 2) | multiplier);
+                outMSB = 0x0F;
+                return;
+            }
+        }
+    }
+}
+
+static uint8_t encodeRAMSize(size_t size) {
+    uint8_t shift = 0;
+
+    if (size > 0) {
+        for (shift = 1; shift < 0x0F && ((size_t)64 << shift) < size; shift++) {
+        }
+    }
+
+    return shift;
+}
+
+iNES::Header iNES::makeHeader(const iNES::HeaderInfo &info) {
+    iNES::Header header = {};
+    uint8_t prgMSB = 0, chrMSB = 0;
+
+    std::memcpy(header.magicBytes, iNES::HEADER_MAGIC_BYTES, sizeof(iNES::HEADER_MAGIC_BYTES));
+    encodeROMSize(info.prgROMSize, iNES::PRG_ROM_SIZE, header.prgROMCount, prgMSB);
+    encodeROMSize(info.chrROMSize, iNES::CHR_ROM_SIZE, header.chrROMCount, chrMSB);
+
+    header.flags6 = (uint8_t)((info.mapper & 0x0F) << 4);
+    header.flags6 |= info.mirroring == Mirroring::VERTICAL ? 0x01 : 0x00;
+    header.flags6 |= info.battery ? 0x02 : 0x00;
+    header.flags6 |= info.trainer ? 0x04 : 0x00;
+    header.flags6 |= info.mirroring == Mirroring::FOUR_SCREEN ? 0x08 : 0x00;
+    header.flags7 = (uint8_t)((info.mapper & 0xF0) | 0x08);
+    header.prgRAMCount = (uint8_t)(((info.mapper >> 8) & 0x0F) | (info.submapper << 4));
+    header.flags9 = (uint8_t)((prgMSB & 0x0F) | (chrMSB << 4));
+    header.flags10 = (uint8_t)(encodeRAMSize(info.prgRAMSize) | (encodeRAMSize(info.prgNVRAMSize) << 4));
+    header.flags11 = (uint8_t)(encodeRAMSize(info.chrRAMSize) | (encodeRAMSize(info.chrNVRAMSize) << 4));
+    header.flags12 = (uint8_t)info.timing;
+
+    return header;
+}
+
+iNES::LoadError iNES::loadFromFile(const std::string &file, iNES::File &outFile) {
+    std::unique_ptr<ROMStream> in;
+    iNES::LoadError error = ROMStream::open(file, in);
+
+    if (error != iNES::LoadError::NO_ERROR) {
+        return error;
+    }
+
+    // The header comes first, so the buffers can be sized before the rest of the file is read (or inflated) into them.
+    if ((error = in->read((uint8_t *)&outFile.header, sizeof(outFile.header))) != iNES::LoadError::NO_ERROR) {
+        return error == iNES::LoadError::TRUNCATED ? iNES::LoadError::READ_ERROR : error;
     }
 
     if (std::memcmp(outFile.header.magicBytes, iNES::HEADER_MAGIC_BYTES, sizeof(iNES::HEADER_MAGIC_BYTES)) != 0) {
@@ -39,35 +153,217 @@ iNES::LoadError iNES::loadFromFile(const std::string &file, iNES::File &outFile)
         return iNES::LoadError::MAGIC_BYTES_MISMATCH;
     }
 
-    const bool hasTrainer = Utils::isBitSet(outFile.header.flags6, 2);
+    const iNES::HeaderInfo info = iNES::parseHeader(outFile.header);
 
-    if (hasTrainer) {
+    // NES 2.0 headers can claim sizes of up to 2^61 bytes, so check them against what the file can actually hold
+    // before allocating anything. Each size is checked on its own first so the sum can't overflow.
+    const uint64_t limit = in->getSizeLimit();
+
+    if (info.prgROMSize > limit || info.chrROMSize > limit ||
+        (info.trainer ? iNES::TRAINER_SIZE : 0) + (uint64_t)info.prgROMSize + info.chrROMSize > limit) {
+        return iNES::LoadError::TRUNCATED;
+    }
+
+    if (info.trainer) {
         outFile.trainer.resize(TRAINER_SIZE);
 
-		if (!in.read((char*)outFile.trainer.data(), outFile.trainer.size())) {
-			return iNES::LoadError::READ_ERROR;
+        if ((error = in->read(outFile.trainer.data(), outFile.trainer.size())) != iNES::LoadError::NO_ERROR) {
+            return error;
         }
     }
 
-    const size_t prgSize = outFile.header.prgROMCount * iNES::PRG_ROM_SIZE;
-    outFile.prgROM.resize(prgSize);
+    outFile.prgROM.resize(info.prgROMSize);
 
-    if (!in.read((char*)outFile.prgROM.data(), outFile.prgROM.size())) {
-		return iNES::LoadError::READ_ERROR;
+    if ((error = in->read(outFile.prgROM.data(), outFile.prgROM.size())) != iNES::LoadError::NO_ERROR) {
+        return error;
     }
 
-    if (outFile.header.chrROMCount > 0) {
-        const size_t chrSize = outFile.header.chrROMCount * iNES::CHR_ROM_SIZE;
-        outFile.chrROM.resize(chrSize);
+    if (info.chrROMSize > 0) {
+        outFile.chrROM.resize(info.chrROMSize);
 
-        if (!in.read((char*)outFile.chrROM.data(), outFile.chrROM.size())) {
-			return iNES::LoadError::READ_ERROR;
+        if ((error = in->read(outFile.chrROM.data(), outFile.chrROM.size())) != iNES::LoadError::NO_ERROR) {
+            return error;
         }
     } else {
         // We're dealing with CHR-RAM.
         outFile.chrROM.resize(iNES::CHR_ROM_SIZE, 0x00);
     }
 
+    // Archives carry a checksum of everything in them, so make sure what we just read wasn't corrupted.
+    return in->finish();
+}
+
+iNES::MappedFile::MappedFile()
+    : data(nullptr),
+      size(0),
+      trainer(nullptr),
+      prgROM(nullptr),
+      prgROMSize(0),
+      chrROM(nullptr),
+      chrROMSize(0)
+#ifdef _WIN32
+      , fileHandle(INVALID_HANDLE_VALUE),
+      mappingHandle(nullptr)
+#endif
+{
+}
+
+iNES::MappedFile::~MappedFile() {
+#ifdef _WIN32
+    if (data != nullptr) UnmapViewOfFile(data);
+    if (mappingHandle != nullptr) CloseHandle(mappingHandle);
+    if (fileHandle != INVALID_HANDLE_VALUE) CloseHandle(fileHandle);
+#else
+    if (data != nullptr) munmap((void *)data, size);
+#endif
+}
+
+const iNES::Header *iNES::MappedFile::getHeader() const {
+    return (const iNES::Header *)data;
+}
+
+const uint8_t *iNES::MappedFile::getTrainer() const {
+    return trainer;
+}
+
+const uint8_t *iNES::MappedFile::getPRGROM() const {
+    return prgROM;
+}
+
+size_t iNES::MappedFile::getPRGROMSize() const {
+    return prgROMSize;
+}
+
+const uint8_t *iNES::MappedFile::getCHRROM() const {
+    return chrROM;
+}
+
+size_t iNES::MappedFile::getCHRROMSize() const {
+    return chrROMSize;
+}
+
+void iNES::MappedFile::copyTo(iNES::File &outFile) const {
+    std::memcpy(&outFile.header, getHeader(), sizeof(iNES::Header));
+
+    if (trainer != nullptr) {
+        outFile.trainer.assign(trainer, trainer + iNES::TRAINER_SIZE);
+    } else {
+        outFile.trainer.clear();
+    }
+
+    outFile.prgROM.assign(prgROM, prgROM + prgROMSize);
+
+    if (chrROM != nullptr) {
+        outFile.chrROM.assign(chrROM, chrROM + chrROMSize);
+    } else {
+        // We're dealing with CHR-RAM.
+        outFile.chrROM.assign(iNES::CHR_ROM_SIZE, 0x00);
+    }
+}
+
+iNES::LoadError iNES::mapFile(const std::string &file, std::shared_ptr<const iNES::MappedFile> &outFile) {
+    std::unique_ptr<iNES::MappedFile> mapped(new iNES::MappedFile());
+
+#ifdef _WIN32
+    HANDLE fileHandle = CreateFileA(file.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+                                    FILE_ATTRIBUTE_NORMAL, nullptr);
+
+    if (fileHandle == INVALID_HANDLE_VALUE) {
+        return iNES::LoadError::OPEN_FAILED;
+    }
+
+    mapped->fileHandle = fileHandle;
+
+    LARGE_INTEGER fileSize;
+
+    if (!GetFileSizeEx(fileHandle, &fileSize)) {
+        return iNES::LoadError::READ_ERROR;
+    }
+
+    if ((uint64_t)fileSize.QuadPart < sizeof(iNES::Header)) {
+        return iNES::LoadError::TRUNCATED;
+    }
+
+    mapped->mappingHandle = CreateFileMappingA(fileHandle, nullptr, PAGE_READONLY, 0, 0, nullptr);
+
+    if (mapped->mappingHandle == nullptr) {
+        return iNES::LoadError::READ_ERROR;
+    }
+
+    mapped->data = (const uint8_t *)MapViewOfFile(mapped->mappingHandle, FILE_MAP_READ, 0, 0, 0);
+
+    if (mapped->data == nullptr) {
+        return iNES::LoadError::READ_ERROR;
+    }
+
+    mapped->size = (size_t)fileSize.QuadPart;
+#else
+    const int fd = open(file.c_str(), O_RDONLY);
+
+    if (fd < 0) {
+        return iNES::LoadError::OPEN_FAILED;
+    }
+
+    struct stat st;
+
+    if (fstat(fd, &st) != 0) {
+        close(fd);
+        return iNES::LoadError::READ_ERROR;
+    }
+
+    if ((size_t)st.st_size < sizeof(iNES::Header)) {
+        close(fd);
+        return iNES::LoadError::TRUNCATED;
+    }
+
+    void *data = mmap(nullptr, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+
+    // The mapping keeps its own reference to the file.
+    close(fd);
+
+    if (data == MAP_FAILED) {
+        return iNES::LoadError::READ_ERROR;
+    }
+
+    mapped->data = (const uint8_t *)data;
+    mapped->size = (size_t)st.st_size;
+#endif
+
+    const iNES::Header *header = mapped->getHeader();
+
+    if (std::memcmp(header->magicBytes, iNES::HEADER_MAGIC_BYTES, sizeof(iNES::HEADER_MAGIC_BYTES)) != 0) {
+        // This is not an iNES file!!
+        return iNES::LoadError::MAGIC_BYTES_MISMATCH;
+    }
+
+    const iNES::HeaderInfo info = iNES::parseHeader(*header);
+
+    if (info.prgROMSize > mapped->size || info.chrROMSize > mapped->size) {
+        return iNES::LoadError::TRUNCATED;
+    }
+
+    size_t offset = sizeof(iNES::Header);
+
+    if (info.trainer) {
+        mapped->trainer = mapped->data + offset;
+        offset += iNES::TRAINER_SIZE;
+    }
+
+    mapped->prgROM = mapped->data + offset;
+    mapped->prgROMSize = info.prgROMSize;
+    offset += mapped->prgROMSize;
+
+    if (info.chrROMSize > 0) {
+        mapped->chrROM = mapped->data + offset;
+        mapped->chrROMSize = info.chrROMSize;
+        offset += mapped->chrROMSize;
+    }
+
+    if (offset > mapped->size) {
+        return iNES::LoadError::TRUNCATED;
+    }
+
+    outFile = std::move(mapped);
     return iNES::LoadError::NO_ERROR;
 }
 
@@ -84,6 +380,12 @@ std::string iNES::getLoadErrorMessage(iNES::LoadError error) {
 
         case iNES::LoadError::READ_ERROR:
             return "Failed to read from file!";
+
+        case iNES::LoadError::TRUNCATED:
+            return "The file is shorter than its header says it is!";
+
+        case iNES::LoadError::UNSUPPORTED_COMPRESSION:
+            return "The file is compressed in a way that can't be read!";
     }
 
 	return "N/A";
@@ -1,9 +1,12 @@
 #pragma once
 
+#include "mirroring.h"
+
 #include <cstdint>
 #include <cstdlib>
 #include <vector>
 #include <string>
+#include <memory>
 
 namespace iNES {
     extern const size_t PRG_ROM_SIZE;
@@ -18,10 +21,54 @@ namespace iNES {
         uint8_t chrROMCount;
         uint8_t flags6;
         uint8_t flags7;
-        uint8_t prgRAMCount;
-        uint8_t padding[7];
+        uint8_t prgRAMCount;    // NES 2.0: Mapper MSB (bits 0-3) and submapper (bits 4-7).
+        uint8_t flags9;         // NES 2.0: PRG-ROM (bits 0-3) and CHR-ROM (bits 4-7) size MSB.
+        uint8_t flags10;        // NES 2.0: PRG-RAM (bits 0-3) and PRG-NVRAM (bits 4-7) shift count.
+        uint8_t flags11;        // NES 2.0: CHR-RAM (bits 0-3) and CHR-NVRAM (bits 4-7) shift count.
+        uint8_t flags12;        // NES 2.0: CPU/PPU timing.
+        uint8_t flags13;        // NES 2.0: Vs. System type or extended console type.
+        uint8_t flags14;        // NES 2.0: Number of miscellaneous ROMs.
+        uint8_t flags15;        // NES 2.0: Default expansion device.
+    };
+
+    static_assert(sizeof(Header) == 16, "iNES::Header must match the on-disk layout");
+
+    enum class Timing : uint8_t {
+        NTSC,
+        PAL,
+        MULTIPLE_REGION,
+        DENDY
     };
 
+    /**
+     * Everything a header says about the cartridge, decoded. Headers in the original iNES format leave most of this
+     * unspecified; the fields then hold the values every iNES emulator has always assumed.
+     */
+    struct HeaderInfo {
+        bool nes20;
+        uint16_t mapper;
+        uint8_t submapper;
+        size_t prgROMSize;
+        size_t chrROMSize;
+        size_t prgRAMSize;
+        size_t prgNVRAMSize;
+        size_t chrRAMSize;
+        size_t chrNVRAMSize;
+        Mirroring mirroring;
+        bool battery;
+        bool trainer;
+        Timing timing;
+    };
+
+    bool isNES20(const Header &header);
+
+    HeaderInfo parseHeader(const Header &header);
+
+    /**
+     * Encodes a NES 2.0 header. Sizes that don't fit the format are rounded up to the next size that does.
+     */
+    Header makeHeader(const HeaderInfo &info);
+
     struct File {
         Header header;
         std::vector<uint8_t> trainer;
@@ -34,9 +81,77 @@ namespace iNES {
         MAGIC_BYTES_MISMATCH,
         READ_ERROR,
         OPEN_FAILED,
+        TRUNCATED,
+        UNSUPPORTED_COMPRESSION,
+    };
+
+    /**
+     * A read-only memory mapping of an iNES file. The header is validated in place and the trainer, PRG-ROM and
+     * CHR-ROM are exposed as pointers into the mapping, so nothing is read or copied until it's actually used. The
+     * pointers stay valid for as long as the MappedFile exists.
+     */
+    class MappedFile {
+    public:
+        ~MappedFile();
+
+        MappedFile(const MappedFile &) = delete;
+
+        MappedFile &operator=(const MappedFile &) = delete;
+
+        const Header *getHeader() const;
+
+        /**
+         * @return The trainer, or nullptr if the file has none.
+         */
+        const uint8_t *getTrainer() const;
+
+        const uint8_t *getPRGROM() const;
+
+        size_t getPRGROMSize() const;
+
+        /**
+         * @return The CHR-ROM, or nullptr if the cartridge uses CHR-RAM.
+         */
+        const uint8_t *getCHRROM() const;
+
+        size_t getCHRROMSize() const;
+
+        /**
+         * Copies the contents of the mapping into an `iNES::File`, for callers that want to own (or modify) them.
+         * Like loadFromFile, this fills in 8 KB of zeroed CHR for CHR-RAM cartridges.
+         */
+        void copyTo(File &outFile) const;
+
+    private:
+        friend LoadError mapFile(const std::string &file, std::shared_ptr<const MappedFile> &outFile);
+
+        MappedFile();
+
+        const uint8_t *data;
+        size_t size;
+
+        const uint8_t *trainer;
+        const uint8_t *prgROM;
+        size_t prgROMSize;
+        const uint8_t *chrROM;
+        size_t chrROMSize;
+
+#ifdef _WIN32
+        void *fileHandle;
+        void *mappingHandle;
+#endif
     };
 
+    /**
+     * Reads an iNES file. The file may also be gzip-compressed, or a zip archive; then the first .nes file in it is
+     * read. Compressed data is decompressed on the fly, straight into the File's buffers.
+     */
     LoadError loadFromFile(const std::string &file, File &outFile);
 
+    /**
+     * Maps an iNES file into memory instead of reading it. See MappedFile.
+     */
+    LoadError mapFile(const std::string &file, std::shared_ptr<const MappedFile> &outFile);
+
     std::string getLoadErrorMessage(LoadError error);
 }
\ No newline at end of file
@@ -0,0 +1,60 @@
+#include "inputqueue.h"
+
+const size_t InputQueue::CACHE_LINE_SIZE;
+
+static size_t roundUpToPowerOfTwo(size_t value) {
+    size_t result = 1;
+
+    while (result < value) {
+        result <<= 1;
+    }
+
+    return result;
+}
+
+InputQueue::InputQueue(size_t capacity)
+    : events(roundUpToPowerOfTwo(capacity)),
+      mask(events.size() - 1),
+      head(0),
+      cachedTail(0),
+      consumerPadding(),
+      tail(0),
+      cachedHead(0),
+      producerPadding()
+{
+}
+
+bool InputQueue::push(const InputEvent &event) {
+    const size_t position = tail.load(std::memory_order_relaxed);
+
+    if (position - cachedHead == events.size()) {
+        cachedHead = head.load(std::memory_order_acquire);
+
+        if (position - cachedHead == events.size()) {
+            return false;
+        }
+    }
+
+    events[position & mask] = event;
+    tail.store(position + 1, std::memory_order_release);
+    return true;
+}
+
+bool InputQueue::peek(InputEvent &outEvent) {
+    const size_t position = head.load(std::memory_order_relaxed);
+
+    if (position == cachedTail) {
+        cachedTail = tail.load(std::memory_order_acquire);
+
+        if (position == cachedTail) {
+            return false;
+        }
+    }
+
+    outEvent = events[position & mask];
+    return true;
+}
+
+void InputQueue::pop() {
+    head.store(head.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+}
\ No newline at end of file
@@ -0,0 +1,68 @@
+#pragma once
+
+#include <vector>
+#include <atomic>
+#include <cstdint>
+#include <cstddef>
+
+/**
+ * A change of the buttons held on one controller.
+ */
+struct InputEvent {
+    uint64_t time;      // Emulated time, in PPU dots (see Scheduler), from which on the buttons are held.
+    uint8_t port;       // 0 or 1.
+    uint8_t buttons;    // ControllerButton flags.
+};
+
+/**
+ * A lock-free single-producer, single-consumer queue of input events: the frontend or harness pushes from its own
+ * thread, the emulator pops from the thread that runs it, and neither ever blocks.
+ *
+ * Events must be pushed in order of time. The emulator only looks at the queue when the game strobes the
+ * controllers, and then applies every event that is due, so a button press lands at exactly the right point in the
+ * game's input polling no matter when it was pushed. When nothing was pushed, that look is a single load.
+ */
+class InputQueue {
+public:
+    /**
+     * @param capacity How many events can be waiting at once. Rounded up to a power of two.
+     */
+    explicit InputQueue(size_t capacity = 256);
+
+    InputQueue(const InputQueue &) = delete;
+
+    InputQueue &operator=(const InputQueue &) = delete;
+
+    /**
+     * Producer side.
+     * @return false if the queue is full, in which case the event was not added.
+     */
+    bool push(const InputEvent &event);
+
+    /**
+     * Consumer side: looks at the oldest event without removing it.
+     * @return false if the queue is empty.
+     */
+    bool peek(InputEvent &outEvent);
+
+    /**
+     * Consumer side: removes the oldest event. The queue must not be empty.
+     */
+    void pop();
+
+private:
+    static const size_t CACHE_LINE_SIZE = 64;
+
+    std::vector<InputEvent> events;
+    size_t mask;
+
+    // The two indices live on separate cache lines, each next to the other side's cached copy of the index it
+    // reads, so the threads only touch each other's line when they have to.
+    std::atomic<size_t> head;       // The next event to pop, written by the consumer.
+    size_t cachedTail;              // The consumer's last look at `tail`.
+    uint8_t consumerPadding[CACHE_LINE_SIZE - sizeof(std::atomic<size_t>) - sizeof(size_t)];
+
+    std::atomic<size_t> tail;       // Where the next event is pushed, written by the producer.
+    size_t cachedHead;              // The producer's last look at `head`.
+    uint8_t producerPadding[CACHE_LINE_SIZE - sizeof(std::atomic<size_t>) - sizeof(size_t)];
+};
\ No newline at end of file
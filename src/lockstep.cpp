@@ -0,0 +1,192 @@
+#include "lockstep.h"
+
+#include "checkpoint.h"
+#include "nes.h"
+
+#include <algorithm>
+#include <cstring>
+
+static const size_t NO_LANE = (size_t)-1;
+
+Lockstep::Lockstep(std::shared_ptr<const ROMImage> rom, size_t lanes)
+    : machines(),
+      laneMachines(lanes, 0),
+      firstLanes(),
+      groupMachines(),
+      hashes(),
+      states()
+{
+    Cartridge cartridge(std::move(rom));
+    machines.emplace_back(new NES(cartridge));
+}
+
+Lockstep::~Lockstep() = default;
+
+void Lockstep::runFrame(const uint8_t *inputs) {
+    const size_t lanes = laneMachines.size();
+
+    // Group the lanes by machine and input. A lane joins the group of the first earlier lane on the same machine
+    // with the same input; the first group on each machine keeps it, the others fork it. The forks are cloned before
+    // any machine runs, so they all start from the state the lanes shared.
+    firstLanes.assign(machines.size(), NO_LANE);
+    groupMachines.assign(lanes, 0);
+
+    for (size_t lane = 0; lane < lanes; lane++) {
+        const size_t machine = laneMachines[lane];
+
+        if (firstLanes[machine] == NO_LANE) {
+            firstLanes[machine] = lane;
+            groupMachines[lane] = machine;
+            continue;
+        }
+
+        size_t group = NO_LANE;
+
+        for (size_t other = firstLanes[machine]; other < lane; other++) {
+            if (laneMachines[other] == machine && inputs[other] == inputs[lane]) {
+                group = groupMachines[other];
+                break;
+            }
+        }
+
+        if (group == NO_LANE) {
+            group = machines.size();
+            machines.push_back(machines[machine]->clone());
+        }
+
+        groupMachines[lane] = group;
+    }
+
+    laneMachines.swap(groupMachines);
+
+    // Every machine now has lanes with a single input. Run each one once.
+    firstLanes.assign(machines.size(), NO_LANE);
+
+    for (size_t lane = 0; lane < lanes; lane++) {
+        if (firstLanes[laneMachines[lane]] == NO_LANE) {
+            firstLanes[laneMachines[lane]] = lane;
+        }
+    }
+
+    for (size_t machine = 0; machine < machines.size(); machine++) {
+        NES *nes = machines[machine].get();
+        nes->getController(0)->setButtons(inputs[firstLanes[machine]]);
+        nes->runFrame();
+    }
+
+    if (machines.size() > 1) {
+        merge();
+    }
+}
+
+void Lockstep::merge() {
+    const size_t count = machines.size();
+
+    // Hashing RAM, VRAM, OAM and the registers finds the candidates cheaply; only machines with the same hash have
+    // their whole states compared.
+    hashes.clear();
+
+    for (size_t machine = 0; machine < count; machine++) {
+        Checkpoint::Record record;
+        Checkpoint::hash(*machines[machine], 0, record);
+        hashes.emplace_back(record.chain, machine);
+    }
+
+    std::sort(hashes.begin(), hashes.end());
+
+    // Each machine merges into the first machine of its hash that is in the same state, or stays where it is.
+    groupMachines.resize(count);
+
+    for (size_t machine = 0; machine < count; machine++) {
+        groupMachines[machine] = machine;
+    }
+
+    for (size_t first = 0, last = 0; first < count; first = last) {
+        for (last = first + 1; last < count && hashes[last].first == hashes[first].first; last++) {
+            const size_t machine = hashes[last].second;
+
+            for (size_t other = first; other < last; other++) {
+                const size_t target = hashes[other].second;
+
+                if (groupMachines[target] == target && isSameState(target, machine)) {
+                    groupMachines[machine] = target;
+                    break;
+                }
+            }
+        }
+    }
+
+    // Renumber the machines that still have lanes, keeping their order, and free the others.
+    firstLanes.assign(count, NO_LANE);
+
+    for (size_t &machine : laneMachines) {
+        machine = groupMachines[machine];
+        firstLanes[machine] = 0;
+    }
+
+    size_t kept = 0;
+
+    for (size_t machine = 0; machine < count; machine++) {
+        if (firstLanes[machine] == NO_LANE) {
+            continue;
+        }
+
+        if (kept != machine) {
+            machines[kept] = std::move(machines[machine]);
+        }
+
+        firstLanes[machine] = kept++;
+    }
+
+    machines.resize(kept);
+
+    for (size_t &machine : laneMachines) {
+        machine = firstLanes[machine];
+    }
+}
+
+bool Lockstep::isSameState(size_t machine, size_t other) {
+    NES *nes = machines[machine].get();
+    NES *otherNES = machines[other].get();
+
+    nes->saveState(states[0]);
+    otherNES->saveState(states[1]);
+
+    if (states[0] != states[1]) {
+        return false;
+    }
+
+    // The framebuffer isn't part of the state, but the lanes' last frames must match too.
+    const PPU *ppu = nes->getPPU();
+    const PPU *otherPPU = otherNES->getPPU();
+
+    if (ppu->isOutputSuppressed() || otherPPU->isOutputSuppressed()) {
+        return ppu->isOutputSuppressed() == otherPPU->isOutputSuppressed();
+    }
+
+    return std::memcmp(ppu->getFramebuffer(), otherPPU->getFramebuffer(), PPU::SCREEN_WIDTH * PPU::SCREEN_HEIGHT) == 0;
+}
+
+NES *Lockstep::getLane(size_t lane) {
+    return machines[laneMachines[lane]].get();
+}
+
+void Lockstep::split(size_t lane) {
+    const size_t machine = laneMachines[lane];
+
+    for (size_t other = 0; other < laneMachines.size(); other++) {
+        if (other != lane && laneMachines[other] == machine) {
+            laneMachines[lane] = machines.size();
+            machines.push_back(machines[machine]->clone());
+            return;
+        }
+    }
+}
+
+size_t Lockstep::getLaneCount() const {
+    return laneMachines.size();
+}
+
+size_t Lockstep::getMachineCount() const {
+    return machines.size();
+}
\ No newline at end of file
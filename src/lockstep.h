@@ -0,0 +1,80 @@
+#pragma once
+
+#include "rom.h"
+
+#include <vector>
+#include <utility>
+#include <memory>
+#include <cstdint>
+#include <cstddef>
+
+class NES;
+
+/**
+ * Runs many instances ("lanes") of the same game with different inputs, emulating each distinct state only once.
+ *
+ * Lanes that are in exactly the same state share one machine. Each frame, the lanes of a machine are grouped by
+ * their input: the first group keeps the machine and every other group gets a clone, so lanes only cost emulation
+ * time once their inputs have actually made them different. After the frame, machines that have ended up in the same
+ * state again (because the game ignored the input that told them apart, or only keeps the latest buttons) are merged
+ * and the spare ones freed, so the machine count follows the number of distinct states rather than only ever growing.
+ *
+ * Sharing whole machines saves the PPU and mapper work too, which makes identical lanes nearly free, but only while
+ * the lanes agree: once the inputs keep every lane in a state of its own, it runs no faster than one machine per lane
+ * (the merge check costs a few percent on top). VectorLockstep executes the CPUs of lanes in different states
+ * together instead, which pays off when the lanes differ in their data but mostly run the same code.
+ * nesulator_bench's "lockstep." benchmarks measure both. It uses one thread: run one Lockstep per core to use more.
+ */
+class Lockstep {
+public:
+    /**
+     * @param rom The game to run. Every lane starts at power-on.
+     * @param lanes How many instances to run.
+     */
+    Lockstep(std::shared_ptr<const ROMImage> rom, size_t lanes);
+
+    ~Lockstep();
+
+    /**
+     * Runs one frame on every lane.
+     * @param inputs The buttons held on controller 1 of each lane, one entry per lane (see ControllerButton).
+     */
+    void runFrame(const uint8_t *inputs);
+
+    /**
+     * @return The machine a lane is currently running on, to read its RAM or framebuffer. It is shared with every
+     * lane in the same state, so it must not be changed; call split() first for that. The pointer is only valid until
+     * the next runFrame(), which may merge the lane onto another machine.
+     */
+    NES *getLane(size_t lane);
+
+    /**
+     * Gives a lane a machine of its own. If it is still in the same state as other lanes after the next frame, it is
+     * merged with them again.
+     */
+    void split(size_t lane);
+
+    size_t getLaneCount() const;
+
+    /**
+     * @return How many distinct machines the lanes currently run on.
+     */
+    size_t getMachineCount() const;
+
+private:
+    std::vector<std::unique_ptr<NES>> machines;
+    std::vector<size_t> laneMachines;       // The index of each lane's machine.
+
+    // Scratch space for runFrame() and merge().
+    std::vector<size_t> firstLanes;         // The first lane seen on each machine.
+    std::vector<size_t> groupMachines;      // For each lane, the machine its (machine, input) group runs on.
+    std::vector<std::pair<uint64_t, size_t>> hashes;   // The hash of each machine's state, and the machine.
+    std::vector<uint8_t> states[2];
+
+    /**
+     * Moves the lanes of machines in the same state onto one of them and frees the machines left without lanes.
+     */
+    void merge();
+
+    bool isSameState(size_t machine, size_t other);
+};
\ No newline at end of file
@@ -1,16 +1,18 @@
 #include "ines.h"
 #include "nes.h"
+#include "romdb.h"
 #include "utils.h"
 
 #include <iostream>
 #include <thread>
 #include <chrono>
+#include <memory>
 
 static const unsigned int NANOSECONDS_PER_CYCLE = 602;
 
 int main() {
-	iNES::File file = {};
-    iNES::LoadError error = iNES::loadFromFile("test.nes", file);
+    std::shared_ptr<const iNES::MappedFile> file;
+    iNES::LoadError error = iNES::mapFile("test.nes", file);
 
     if (error != iNES::LoadError::NO_ERROR) {
         std::cerr << "iNES Load Error: " << iNES::getLoadErrorMessage(error) << "\n";
@@ -20,7 +22,17 @@ int main() {
         return EXIT_FAILURE;
     }
 
-    Cartridge cartridge(file);
+    // The ROM database is optional; without it, the header is taken at its word.
+    ROMDatabase database;
+    const bool haveDatabase = database.load("nes20db.ndb") == iNES::LoadError::NO_ERROR;
+
+    std::shared_ptr<const ROMImage> rom = ROMImage::create(file, haveDatabase ? &database : nullptr);
+
+    if (rom->hasDatabaseSizeMismatch()) {
+        std::cerr << "Warning: The ROM database disagrees with the file about the PRG-ROM/CHR-ROM sizes\n";
+    }
+
+    Cartridge cartridge(rom);
     NES nes(cartridge);
 
     Mapper *mapper = nes.getCartridge()->getMapper();
@@ -39,7 +51,7 @@ int main() {
 
     while (true) {
         cpu->printState();
-        unsigned int cycles = cpu->step();
+        unsigned int cycles = nes.step();
         std::this_thread::sleep_for(std::chrono::nanoseconds(cycles * NANOSECONDS_PER_CYCLE));
     }
 
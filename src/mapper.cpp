@@ -3,23 +3,41 @@
 #include "cartridge.h"
 #include "nes.h"
 #include "utils.h"
+#include "savestate.h"
 
 #include <iostream>
+#include <algorithm>
 
 const size_t NES_NAMETABLE_SIZE = 1024;
 
-Mapper::Mapper(NES *nes, uint8_t id, const std::string &name)
+const size_t MAPPER_PRG_WINDOW_SIZE = 0x2000;
+const size_t MAPPER_CHR_WINDOW_SIZE = 0x0400;
+
+// What the CPU sees in $8000-$FFFF if the cartridge has no PRG-ROM at all.
+static const uint8_t OPEN_BUS_PRG_WINDOW[MAPPER_PRG_WINDOW_SIZE] = {};
+
+// How a save state marks a window that doesn't point into the cartridge.
+static const uint32_t UNMAPPED_WINDOW_OFFSET = 0xFFFFFFFF;
+
+Mapper::Mapper(NES *nes, uint16_t id, const std::string &name)
     : nes(nes),
       id(id),
-      name(name)
+      name(name),
+      prgWindows { OPEN_BUS_PRG_WINDOW, OPEN_BUS_PRG_WINDOW, OPEN_BUS_PRG_WINDOW, OPEN_BUS_PRG_WINDOW },
+      chrWindows { nullptr },
+      nametables { nullptr },
+      prgRAMWindow(nullptr),
+      hooks(0),
+      mirroring(Mirroring::HORIZONTAL)
 {
+    Mapper::powerOn();
 }
 
 NES *Mapper::getNES() {
     return nes;
 }
 
-uint8_t Mapper::getID() const {
+uint16_t Mapper::getID() const {
     return id;
 }
 
@@ -27,77 +45,228 @@ const std::string *Mapper::getName() const {
     return &name;
 }
 
-uint8_t Mapper::basicNametableRead(Address address) {
-    const Cartridge *cartridge = nes->getCartridge();
-    const auto *vram = nes->getMemory()->getInternalVideoMemory();
+void Mapper::handleEvent() {
 
-    switch (cartridge->getMirroring()) {
-        case Mirroring::HORIZONTAL:
-            if (Utils::inRange(address, 0x2000, 0x27FF)) {
-                return vram->at((size_t)(address - 0x2000) % NES_NAMETABLE_SIZE);
-            } else if (Utils::inRange(address, 0x2800, 0x2FFF)) {
-                return vram->at((size_t)(address - 0x2000) % NES_NAMETABLE_SIZE + NES_NAMETABLE_SIZE * 2);
-            }
+}
 
-        case Mirroring::VERTICAL:
-            if (Utils::inRange(address, 0x2000, 0x23FF) || Utils::inRange(address, 0x2800, 0x2BFF)) {
-                return vram->at((size_t)(address - 0x2000) % NES_NAMETABLE_SIZE);
-            } else if (Utils::inRange(address, 0x2400, 0x27FF) || Utils::inRange(address, 0x2C00, 0x2FFF)) {
-                return vram->at((size_t)(address - 0x2000) % NES_NAMETABLE_SIZE + NES_NAMETABLE_SIZE * 2);
-            }
+void Mapper::handlePPUConfigChange() {
 
-        case Mirroring::FOUR_SCREEN:
-            std::cout << "Warning: This mapper does not support four-screen mode, yet the cartridge requires it! Assuming $00.\n";
-            return 0;
+}
+
+void Mapper::powerOn() {
+    // Power-on state of the simplest boards: the first 32 KB of PRG and the first 8 KB of CHR. PRG-ROMs smaller
+    // than 32 KB wrap, which mirrors a 16 KB ROM into both halves just like NROM-128.
+    mapPRG32K(0);
+    mapCHR8K(0);
+    setMirroring(nes->getCartridge()->getMirroring());
+    setPRGRAMEnabled(true);
+    hooks = 0;
+
+    std::fill(fourScreenVideoMem.begin(), fourScreenVideoMem.end(), 0x00);
+}
+
+void Mapper::saveRegisters(StateWriter &) const {
+    // Boards without registers beyond their windows, like NROM, have nothing to add.
+}
+
+void Mapper::loadRegisters(StateReader &) {
+}
+
+void Mapper::saveState(StateWriter &writer) const {
+    const uint8_t *prg = nes->getCartridge()->getPRGROM();
+    const uint8_t *chr = nes->getCartridge()->getCHR();
+
+    for (const uint8_t *window : prgWindows) {
+        writer.write(window != OPEN_BUS_PRG_WINDOW ? (uint32_t)(window - prg) : UNMAPPED_WINDOW_OFFSET);
     }
 
-	return 0;
+    for (const uint8_t *window : chrWindows) {
+        writer.write(window != nullptr ? (uint32_t)(window - chr) : UNMAPPED_WINDOW_OFFSET);
+    }
+
+    writer.write(mirroring);
+    writer.write(prgRAMWindow != nullptr);
+    writer.write(hooks);
+    writer.writeVector(fourScreenVideoMem);
+
+    saveRegisters(writer);
 }
 
-void Mapper::basicNametableWrite(Address address, uint8_t value) {
-    Cartridge *cartridge = nes->getCartridge();
-    auto *vram = nes->getMemory()->getInternalVideoMemory();
+void Mapper::loadState(StateReader &reader) {
+    const size_t prgSize = nes->getCartridge()->getPRGROMSize();
+    const size_t chrSize = nes->getCartridge()->getCHRSize();
+    const uint8_t *prg = nes->getCartridge()->getPRGROM();
+    const uint8_t *chr = nes->getCartridge()->getCHR();
+
+    for (const uint8_t *&window : prgWindows) {
+        uint32_t offset = UNMAPPED_WINDOW_OFFSET;
+        reader.read(offset);
+        window = offset != UNMAPPED_WINDOW_OFFSET && offset + MAPPER_PRG_WINDOW_SIZE <= prgSize ?
+                 prg + offset : OPEN_BUS_PRG_WINDOW;
+    }
+
+    for (const uint8_t *&window : chrWindows) {
+        uint32_t offset = UNMAPPED_WINDOW_OFFSET;
+        reader.read(offset);
+        window = offset != UNMAPPED_WINDOW_OFFSET && offset + MAPPER_CHR_WINDOW_SIZE <= chrSize ?
+                 chr + offset : nullptr;
+    }
+
+    Mirroring savedMirroring = mirroring;
+    bool prgRAMEnabled = false;
+
+    reader.read(savedMirroring);
+    reader.read(prgRAMEnabled);
+    reader.read(hooks);
+
+    setMirroring(savedMirroring);
+    setPRGRAMEnabled(prgRAMEnabled);
+    reader.readVector(fourScreenVideoMem);
+
+    loadRegisters(reader);
+}
+
+Mirroring Mapper::getMirroring() const {
+    return mirroring;
+}
+
+size_t Mapper::getPRGBankCount8K() const {
+    return nes->getCartridge()->getPRGROMSize() / MAPPER_PRG_WINDOW_SIZE;
+}
+
+size_t Mapper::getCHRBankCount1K() const {
+    return nes->getCartridge()->getCHRSize() / MAPPER_CHR_WINDOW_SIZE;
+}
+
+void Mapper::mapPRG8K(size_t slot, size_t bank) {
+    const size_t count = getPRGBankCount8K();
+
+    if (count == 0) {
+        return;
+    }
+
+    const uint8_t *prg = nes->getCartridge()->getPRGROM();
+    prgWindows[slot & 0x3] = prg + (bank % count) * MAPPER_PRG_WINDOW_SIZE;
+}
+
+void Mapper::mapPRG16K(size_t slot, size_t bank) {
+    mapPRG8K(slot * 2, bank * 2);
+    mapPRG8K(slot * 2 + 1, bank * 2 + 1);
+}
+
+void Mapper::mapPRG32K(size_t bank) {
+    for (size_t i = 0; i < 4; i++) {
+        mapPRG8K(i, bank * 4 + i);
+    }
+}
+
+void Mapper::mapCHR1K(size_t slot, size_t bank) {
+    const size_t count = getCHRBankCount1K();
+
+    if (count == 0) {
+        return;
+    }
+
+    const uint8_t *chr = nes->getCartridge()->getCHR();
+    chrWindows[slot & 0x7] = chr + (bank % count) * MAPPER_CHR_WINDOW_SIZE;
+}
 
-    switch (cartridge->getMirroring()) {
+void Mapper::mapCHR4K(size_t slot, size_t bank) {
+    for (size_t i = 0; i < 4; i++) {
+        mapCHR1K(slot * 4 + i, bank * 4 + i);
+    }
+}
+
+void Mapper::mapCHR8K(size_t bank) {
+    for (size_t i = 0; i < 8; i++) {
+        mapCHR1K(i, bank * 8 + i);
+    }
+}
+
+void Mapper::setMirroring(Mirroring mirroring) {
+    uint8_t *vram = nes->getMemory()->getInternalVideoMemory();
+    uint8_t *a = vram;
+    uint8_t *b = vram + NES_NAMETABLE_SIZE;
+
+    this->mirroring = mirroring;
+
+    switch (mirroring) {
         case Mirroring::HORIZONTAL:
-            if (Utils::inRange(address, 0x2000, 0x27FF)) {
-                vram->at((size_t)(address - 0x2000) % NES_NAMETABLE_SIZE) = value;
-            } else if (Utils::inRange(address, 0x2800, 0x2FFF)) {
-                vram->at((size_t)(address - 0x2000) % NES_NAMETABLE_SIZE + NES_NAMETABLE_SIZE * 2) = value;
-            }
+            nametables[0] = a; nametables[1] = a;
+            nametables[2] = b; nametables[3] = b;
             break;
 
         case Mirroring::VERTICAL:
-            if (Utils::inRange(address, 0x2000, 0x23FF) || Utils::inRange(address, 0x2800, 0x2BFF)) {
-                vram->at((size_t)(address - 0x2000) % NES_NAMETABLE_SIZE) = value;
-            } else if (Utils::inRange(address, 0x2400, 0x27FF) || Utils::inRange(address, 0x2C00, 0x2FFF)) {
-                vram->at((size_t)(address - 0x2000) % NES_NAMETABLE_SIZE + NES_NAMETABLE_SIZE * 2) = value;
-            }
+            nametables[0] = a; nametables[1] = b;
+            nametables[2] = a; nametables[3] = b;
+            break;
+
+        case Mirroring::SINGLE_SCREEN_LOWER:
+            nametables[0] = nametables[1] = nametables[2] = nametables[3] = a;
+            break;
+
+        case Mirroring::SINGLE_SCREEN_UPPER:
+            nametables[0] = nametables[1] = nametables[2] = nametables[3] = b;
             break;
 
         case Mirroring::FOUR_SCREEN:
-            std::cout << "Warning: This mapper does not support four-screen mode, yet the cartridge requires it!\n";
+            // The other two nametables live in extra RAM on the cartridge.
+            fourScreenVideoMem.resize(NES_NAMETABLE_SIZE * 2, 0x00);
+            nametables[0] = a; nametables[1] = b;
+            nametables[2] = fourScreenVideoMem.data();
+            nametables[3] = fourScreenVideoMem.data() + NES_NAMETABLE_SIZE;
             break;
     }
 }
 
-uint8_t Mapper::basicPatternTableRead(Address address) {
+void Mapper::setPRGRAMEnabled(bool enabled) {
     Cartridge *cartridge = nes->getCartridge();
-    auto *chr = cartridge->getCHR();
+    prgRAMWindow = enabled && cartridge->getPRGRAMSize() >= MAPPER_PRG_WINDOW_SIZE ? cartridge->getPRGRAM() : nullptr;
+}
+
+void Mapper::setHooked(MapperHook hook, bool hooked) {
+    if (hooked) {
+        hooks |= (uint8_t)hook;
+    } else {
+        hooks &= ~(uint8_t)hook;
+    }
+}
+
+uint8_t Mapper::basicPRGRAMRead(Address address) {
+    return readPRGRAM(address);
+}
+
+void Mapper::basicPRGRAMWrite(Address address, uint8_t value) {
+    if (prgRAMWindow != nullptr) {
+        prgRAMWindow[address & 0x1FFF] = value;
+    }
+}
 
+uint8_t Mapper::basicNametableRead(Address address) {
+    return readNametable(address);
+}
+
+void Mapper::basicNametableWrite(Address address, uint8_t value) {
+    nametables[(address >> 10) & 0x3][address & 0x3FF] = value;
+}
+
+uint8_t Mapper::basicPatternTableRead(Address address) {
     if (Utils::inRange(address, 0x0000, 0x1FFF)) {
-        return chr->at(address);
+        return readCHR(address);
     }
 
 	return 0;
 }
 
 void Mapper::basicPatternTableWrite(Address address, uint8_t value) {
-    Cartridge *cartridge = nes->getCartridge();
-    auto *chr = cartridge->getCHR();
+    if (!nes->getCartridge()->isCHRRAM()) {
+        // CHR-ROM is, well, read-only.
+        return;
+    }
 
     if (Utils::inRange(address, 0x0000, 0x1FFF)) {
-        chr->at(address) = value;
+        // With CHR-RAM every window points into the cartridge's own, writable copy.
+        const_cast<uint8_t *>(chrWindows[(address >> 10) & 0x7])[address & 0x3FF] = value;
     }
 }
 
@@ -115,7 +284,7 @@ void Mapper::basicPPUWrite(Address address, uint8_t value) {
     if (Utils::inRange(address, 0x0000, 0x1FFF)) {
         basicPatternTableWrite(address, value);
     } else if (Utils::inRange(address, 0x2000, 0x2FFF)) {
-        basicPatternTableWrite(address, value);
+        basicNametableWrite(address, value);
     }
 }
 
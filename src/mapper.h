@@ -2,18 +2,36 @@
 
 #include "address.h"
 #include "memory.h"
+#include "mirroring.h"
 
 #include <cstdint>
 #include <string>
 #include <memory>
+#include <vector>
 
 class NES;
+class StateWriter;
+class StateReader;
 
 extern const size_t NES_NAMETABLE_SIZE;
 
+extern const size_t MAPPER_PRG_WINDOW_SIZE;
+extern const size_t MAPPER_CHR_WINDOW_SIZE;
+
+/**
+ * Accesses a mapper wants to see through its virtual read functions. Reads that aren't hooked never reach the mapper
+ * object at all: Memory serves them straight from the mapper's bank windows.
+ */
+enum class MapperHook : uint8_t {
+    CPU_READ = 1 << 0,  // Reads from $6000-$FFFF have side effects or don't follow the windows.
+    PPU_READ = 1 << 1   // Reads from $0000-$3EFF have side effects or don't follow the windows.
+};
+
 class Mapper {
 public:
-    Mapper(NES *nes, uint8_t id, const std::string &name);
+    Mapper(NES *nes, uint16_t id, const std::string &name);
+
+    virtual ~Mapper() = default;
 
     uint8_t read(MemoryAccessSource source, Address address);
 
@@ -27,15 +45,125 @@ public:
 
     virtual void writePPU(Address address, uint8_t value) = 0;
 
-    virtual void step() = 0;
+    /**
+     * Called when the EventType::MAPPER event the mapper scheduled comes due. Mappers that need to do something at a
+     * certain time (count scanlines, cycles...) schedule an event for it instead of being stepped all the time.
+     */
+    virtual void handleEvent();
+
+    /**
+     * Called by the PPU whenever PPUCTRL or PPUMASK is written, so mappers that predict the PPU's bus activity can
+     * catch up with the old configuration and re-plan their events.
+     */
+    virtual void handlePPUConfigChange();
+
+    /**
+     * Puts the mapper back into its power-on state, in place: the default bank windows, the cartridge's mirroring and
+     * whatever registers the particular mapper has. Mappers with registers override this and call it first.
+     */
+    virtual void powerOn();
 
     NES *getNES();
 
-    uint8_t getID() const;
+    uint16_t getID() const;
 
     const std::string *getName() const;
 
+    /**
+     * @return The nametable mirroring currently in effect. This starts out as the cartridge's mirroring, but some
+     * mappers can switch it at runtime.
+     */
+    Mirroring getMirroring() const;
+
+    /**
+     * Saves the bank windows, mirroring and hooks, followed by whatever saveRegisters() adds. Windows are saved as
+     * offsets into the memory behind them, so the state doesn't depend on where the ROM happens to be loaded.
+     */
+    void saveState(StateWriter &writer) const;
+
+    void loadState(StateReader &reader);
+
+    bool isHooked(MapperHook hook) const {
+        return (hooks & (uint8_t)hook) != 0;
+    }
+
+    /*
+     * Non-virtual reads through the bank windows. Every mapper's reads end up here unless they are hooked, so Memory
+     * calls these directly and only falls back to readCPU()/readPPU() for hooked mappers.
+     */
+
+    uint8_t readPRG(Address address) const {
+        return prgWindows[(address >> 13) & 0x3][address & 0x1FFF];
+    }
+
+    /**
+     * @return The memory the PRG-ROM window at $8000 + 8 KB * slot shows. Two mappers show the same banks if their
+     * windows are equal.
+     */
+    const uint8_t *getPRGWindow(size_t slot) const {
+        return prgWindows[slot];
+    }
+
+    uint8_t readPRGRAM(Address address) const {
+        return prgRAMWindow != nullptr ? prgRAMWindow[address & 0x1FFF] : (uint8_t)0x00;
+    }
+
+    uint8_t readCHR(Address address) const {
+        return chrWindows[(address >> 10) & 0x7][address & 0x3FF];
+    }
+
+    uint8_t readNametable(Address address) const {
+        return nametables[(address >> 10) & 0x3][address & 0x3FF];
+    }
+
 protected:
+    /**
+     * Saves the registers of a particular mapper, i.e. everything that isn't already described by its windows.
+     */
+    virtual void saveRegisters(StateWriter &writer) const;
+
+    virtual void loadRegisters(StateReader &reader);
+
+    /*
+     * Bank switching.
+     *
+     * PRG-ROM is seen through four 8 KB windows at $8000, $A000, $C000 and $E000, CHR through eight 1 KB windows at
+     * $0000-$1FFF and the nametables through four 1 KB windows at $2000-$2FFF. Each window is just a pointer into the
+     * cartridge's (or the NES's) memory, so switching a bank is a couple of pointer stores and reading through a
+     * window is a shift, a mask and a load. Bank numbers are in units of the size being mapped and wrap around the
+     * size of the underlying memory, like the unconnected upper bank lines on a real board.
+     */
+
+    void mapPRG8K(size_t slot, size_t bank);
+
+    void mapPRG16K(size_t slot, size_t bank);
+
+    void mapPRG32K(size_t bank);
+
+    void mapCHR1K(size_t slot, size_t bank);
+
+    void mapCHR4K(size_t slot, size_t bank);
+
+    void mapCHR8K(size_t bank);
+
+    void setMirroring(Mirroring mirroring);
+
+    /**
+     * Maps or unmaps the cartridge's PRG-RAM at $6000-$7FFF. Reads from unmapped PRG-RAM return $00 and writes are
+     * ignored.
+     */
+    void setPRGRAMEnabled(bool enabled);
+
+    void setHooked(MapperHook hook, bool hooked);
+
+    size_t getPRGBankCount8K() const;
+
+    size_t getCHRBankCount1K() const;
+
+    uint8_t basicPRGRAMRead(Address address);
+
+    void basicPRGRAMWrite(Address address, uint8_t value);
+
     uint8_t basicNametableRead(Address address);
 
     void basicNametableWrite(Address address, uint8_t value);
@@ -51,6 +179,16 @@ protected:
     NES *nes;
 
 private:
-    const uint8_t id;
+    const uint16_t id;
     const std::string name;
-};
\ No newline at end of file
+
+    const uint8_t *prgWindows[4];
+    const uint8_t *chrWindows[8];
+    uint8_t *nametables[4];
+    uint8_t *prgRAMWindow;
+
+    uint8_t hooks;
+
+    Mirroring mirroring;
+    std::vector<uint8_t> fourScreenVideoMem;
+};
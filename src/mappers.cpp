@@ -3,21 +3,56 @@
 #include "nes.h"
 
 #include "mappers/nrom.h"
+#include "mappers/mmc1.h"
+#include "mappers/uxrom.h"
+#include "mappers/cnrom.h"
+#include "mappers/mmc3.h"
+#include "mappers/axrom.h"
 
 #include <memory>
-#include <iostream>
+#include <new>
+#include <algorithm>
 
-#define FACTORY(name) ([](NES *nes) { return std::unique_ptr<Mapper>(new name(nes)); })
+#define FACTORY(name) ([](NES *nes, void *storage) -> Mapper * { \
+    return storage != nullptr ? new (storage) name(nes) : new name(nes); \
+})
 
 static const Mappers::MapperFactory MAPPER_FACTORIES[] = {
-    FACTORY(NROM)
+    FACTORY(NROM),  // 0
+    FACTORY(MMC1),  // 1
+    FACTORY(UxROM), // 2
+    FACTORY(CNROM), // 3
+    FACTORY(MMC3),  // 4
+    nullptr,        // 5
+    nullptr,        // 6
+    FACTORY(AxROM)  // 7
 };
 
-std::unique_ptr<Mapper> Mappers::create(NES *nes, uint8_t id) {
+const size_t Mappers::MAX_SIZE = std::max({ sizeof(NROM), sizeof(MMC1), sizeof(UxROM), sizeof(CNROM), sizeof(MMC3),
+                                            sizeof(AxROM) });
+const size_t Mappers::MAX_ALIGNMENT = std::max({ alignof(NROM), alignof(MMC1), alignof(UxROM), alignof(CNROM),
+                                                 alignof(MMC3), alignof(AxROM) });
+
+void Mappers::Deleter::operator()(Mapper *mapper) const {
+    if (inPlace) {
+        mapper->~Mapper();
+    } else {
+        delete mapper;
+    }
+}
+
+Mappers::MapperPointer Mappers::create(NES *nes, uint16_t id, void *storage) {
+    const Mappers::Deleter deleter = { storage != nullptr };
+
     if (id < sizeof(MAPPER_FACTORIES) / sizeof(Mappers::MapperFactory)) {
         auto factory = MAPPER_FACTORIES[id];
-        return factory != nullptr ? factory(nes) : nullptr;
+        return Mappers::MapperPointer(factory != nullptr ? factory(nes, storage) : nullptr, deleter);
     } else {
-        return nullptr;
+        return Mappers::MapperPointer(nullptr, deleter);
     }
 }
+
+
+bool Mappers::isSupported(uint16_t id) {
+    return id < sizeof(MAPPER_FACTORIES) / sizeof(Mappers::MapperFactory) && MAPPER_FACTORIES[id] != nullptr;
+}
\ No newline at end of file
@@ -3,11 +3,37 @@
 #include "mapper.h"
 
 #include <memory>
+#include <cstddef>
 
 class NES;
 
 namespace Mappers {
-    typedef std::unique_ptr<Mapper> (*MapperFactory)(NES *nes);
+    /**
+     * Deletes a mapper made by create(), or only destroys it if create() constructed it in storage it was given.
+     */
+    struct Deleter {
+        bool inPlace;
 
-    std::unique_ptr<Mapper> create(NES *nes, uint8_t id);
+        void operator()(Mapper *mapper) const;
+    };
+
+    typedef std::unique_ptr<Mapper, Deleter> MapperPointer;
+
+    typedef Mapper *(*MapperFactory)(NES *nes, void *storage);
+
+    /**
+     * Creates the mapper with the given ID, on the heap or, if `storage` isn't nullptr, in `storage`, which must hold
+     * MAX_SIZE bytes aligned to MAX_ALIGNMENT.
+     * @return The mapper, or nullptr if it isn't supported.
+     */
+    MapperPointer create(NES *nes, uint16_t id, void *storage = nullptr);
+
+    /**
+     * @return true if create() can create the mapper with the given ID.
+     */
+    bool isSupported(uint16_t id);
+
+    // The size and alignment of the biggest mapper, for callers that give create() storage of their own.
+    extern const size_t MAX_SIZE;
+    extern const size_t MAX_ALIGNMENT;
 }
\ No newline at end of file
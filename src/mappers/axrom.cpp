@@ -0,0 +1,39 @@
+#include "axrom.h"
+
+#include "../mapper.h"
+#include "../utils.h"
+#include "../nes.h"
+#include "../cartridge.h"
+
+AxROM::AxROM(NES *nes) : Mapper(nes, 7, "AxROM") {
+    AxROM::powerOn();
+}
+
+void AxROM::powerOn() {
+    Mapper::powerOn();
+    setMirroring(Mirroring::SINGLE_SCREEN_LOWER);
+}
+
+uint8_t AxROM::readCPU(Address address) {
+    if (Utils::inRange(address, 0x8000, 0xFFFF)) {
+        return readPRG(address);
+    }
+
+    return 0x00;
+}
+
+uint8_t AxROM::readPPU(Address address) {
+    return basicPPURead(address);
+}
+
+void AxROM::writeCPU(Address address, uint8_t value) {
+    if (Utils::inRange(address, 0x8000, 0xFFFF)) {
+        // Bits 0-2 select the 32 KB PRG bank, bit 4 selects the nametable that all four nametables mirror.
+        mapPRG32K(value & 0x07);
+        setMirroring(Utils::isBitSet(value, 4) ? Mirroring::SINGLE_SCREEN_UPPER : Mirroring::SINGLE_SCREEN_LOWER);
+    }
+}
+
+void AxROM::writePPU(Address address, uint8_t value) {
+    basicPPUWrite(address, value);
+}
\ No newline at end of file
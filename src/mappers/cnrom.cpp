@@ -0,0 +1,36 @@
+#include "cnrom.h"
+
+#include "../mapper.h"
+#include "../utils.h"
+#include "../nes.h"
+#include "../cartridge.h"
+
+CNROM::CNROM(NES *nes) : Mapper(nes, 3, "CNROM") {
+
+}
+
+uint8_t CNROM::readCPU(Address address) {
+    if (Utils::inRange(address, 0x6000, 0x7FFF)) {
+        return basicPRGRAMRead(address);
+    } else if (Utils::inRange(address, 0x8000, 0xFFFF)) {
+        return readPRG(address);
+    }
+
+    return 0x00;
+}
+
+uint8_t CNROM::readPPU(Address address) {
+    return basicPPURead(address);
+}
+
+void CNROM::writeCPU(Address address, uint8_t value) {
+    if (Utils::inRange(address, 0x6000, 0x7FFF)) {
+        basicPRGRAMWrite(address, value);
+    } else if (Utils::inRange(address, 0x8000, 0xFFFF)) {
+        mapCHR8K(value);
+    }
+}
+
+void CNROM::writePPU(Address address, uint8_t value) {
+    basicPPUWrite(address, value);
+}
\ No newline at end of file
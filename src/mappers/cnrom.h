@@ -0,0 +1,16 @@
+#pragma once
+
+#include "../mapper.h"
+
+class CNROM final : public Mapper {
+public:
+    CNROM(NES *nes);
+
+    uint8_t readCPU(Address address) override;
+
+    uint8_t readPPU(Address address) override;
+
+    void writeCPU(Address address, uint8_t value) override;
+
+    void writePPU(Address address, uint8_t value) override;
+};
\ No newline at end of file
@@ -0,0 +1,139 @@
+#include "mmc1.h"
+
+#include "../mapper.h"
+#include "../utils.h"
+#include "../nes.h"
+#include "../cartridge.h"
+#include "../savestate.h"
+
+static const uint8_t SHIFT_REGISTER_EMPTY = 0b10000;
+
+MMC1::MMC1(NES *nes) : Mapper(nes, 1, "MMC1") {
+    MMC1::powerOn();
+}
+
+void MMC1::powerOn() {
+    Mapper::powerOn();
+
+    shift = SHIFT_REGISTER_EMPTY;
+    control = 0x0C;
+    chrBank0 = 0;
+    chrBank1 = 0;
+    prgBank = 0;
+
+    updateBanks();
+}
+
+uint8_t MMC1::readCPU(Address address) {
+    if (Utils::inRange(address, 0x6000, 0x7FFF)) {
+        return basicPRGRAMRead(address);
+    } else if (Utils::inRange(address, 0x8000, 0xFFFF)) {
+        return readPRG(address);
+    }
+
+    return 0x00;
+}
+
+uint8_t MMC1::readPPU(Address address) {
+    return basicPPURead(address);
+}
+
+void MMC1::writeCPU(Address address, uint8_t value) {
+    if (Utils::inRange(address, 0x6000, 0x7FFF)) {
+        basicPRGRAMWrite(address, value);
+        return;
+    } else if (!Utils::inRange(address, 0x8000, 0xFFFF)) {
+        return;
+    }
+
+    if (Utils::isBitSet(value, 7)) {
+        // Writing a value with bit 7 set resets the shift register and locks the last PRG bank at $C000.
+        shift = SHIFT_REGISTER_EMPTY;
+        control |= 0x0C;
+        updateBanks();
+        return;
+    }
+
+    const bool complete = (shift & 0b1) == 1;
+    shift = (uint8_t)((shift >> 1) | ((value & 0b1) << 4));
+
+    if (complete) {
+        writeRegister(address, shift);
+        shift = SHIFT_REGISTER_EMPTY;
+    }
+}
+
+void MMC1::writePPU(Address address, uint8_t value) {
+    basicPPUWrite(address, value);
+}
+
+void MMC1::writeRegister(Address address, uint8_t value) {
+    // Only bits 13 and 14 of the address of the fifth write matter.
+    switch ((address >> 13) & 0x3) {
+        case 0: control = value; break;
+        case 1: chrBank0 = value; break;
+        case 2: chrBank1 = value; break;
+        case 3: prgBank = value; break;
+    }
+
+    updateBanks();
+}
+
+void MMC1::updateBanks() {
+    switch (control & 0x3) {
+        case 0: setMirroring(Mirroring::SINGLE_SCREEN_LOWER); break;
+        case 1: setMirroring(Mirroring::SINGLE_SCREEN_UPPER); break;
+        case 2: setMirroring(Mirroring::VERTICAL); break;
+        case 3: setMirroring(Mirroring::HORIZONTAL); break;
+    }
+
+    // SUROM and friends have 512 KB of PRG-ROM; they use bit 4 of the CHR bank register to select the 256 KB half.
+    const size_t prgBankCount16K = getPRGBankCount8K() / 2;
+    const size_t outer = prgBankCount16K > 16 ? (size_t)(chrBank0 & 0x10) : 0;
+    const size_t inner = (size_t)(prgBank & 0x0F);
+
+    switch ((control >> 2) & 0x3) {
+        case 0:
+        case 1:
+            // Switch 32 KB at $8000, ignoring the low bit of the bank number.
+            mapPRG32K((outer | inner) >> 1);
+            break;
+
+        case 2:
+            // Fix the first bank at $8000, switch 16 KB at $C000.
+            mapPRG16K(0, outer);
+            mapPRG16K(1, outer | inner);
+            break;
+
+        case 3:
+            // Switch 16 KB at $8000, fix the last bank at $C000.
+            mapPRG16K(0, outer | inner);
+            mapPRG16K(1, outer | 0x0F);
+            break;
+    }
+
+    if (Utils::isBitSet(control, 4)) {
+        // Two separate 4 KB banks.
+        mapCHR4K(0, chrBank0);
+        mapCHR4K(1, chrBank1);
+    } else {
+        // One 8 KB bank, ignoring the low bit of the bank number.
+        mapCHR8K((size_t)(chrBank0 >> 1));
+    }
+}
+
+void MMC1::saveRegisters(StateWriter &writer) const {
+    writer.write(shift);
+    writer.write(control);
+    writer.write(chrBank0);
+    writer.write(chrBank1);
+    writer.write(prgBank);
+}
+
+void MMC1::loadRegisters(StateReader &reader) {
+    reader.read(shift);
+    reader.read(control);
+    reader.read(chrBank0);
+    reader.read(chrBank1);
+    reader.read(prgBank);
+}
\ No newline at end of file
@@ -0,0 +1,37 @@
+#pragma once
+
+#include "../mapper.h"
+
+class MMC1 final : public Mapper {
+public:
+    MMC1(NES *nes);
+
+    uint8_t readCPU(Address address) override;
+
+    uint8_t readPPU(Address address) override;
+
+    void writeCPU(Address address, uint8_t value) override;
+
+    void writePPU(Address address, uint8_t value) override;
+
+    void powerOn() override;
+
+protected:
+    void saveRegisters(StateWriter &writer) const override;
+
+    void loadRegisters(StateReader &reader) override;
+
+private:
+    // The MMC1 is programmed one bit at a time through a 5-bit shift register. A 1 in bit 4 marks the register as
+    // empty, so once that bit has been shifted down to bit 0 the next write completes the value.
+    uint8_t shift;
+
+    uint8_t control;
+    uint8_t chrBank0;
+    uint8_t chrBank1;
+    uint8_t prgBank;
+
+    void writeRegister(Address address, uint8_t value);
+
+    void updateBanks();
+};
\ No newline at end of file
@@ -0,0 +1,344 @@
+#include "mmc3.h"
+
+#include "../mapper.h"
+#include "../utils.h"
+#include "../nes.h"
+#include "../cartridge.h"
+#include "../savestate.h"
+#include "../ppu.h"
+#include "../scheduler.h"
+
+#include <algorithm>
+
+// The PPU raises A12 once per rendered scanline: on the visible scanlines and the pre-render scanline.
+static const uint64_t CLOCKS_PER_FRAME = 241;
+
+// Dots at which A12 rises when the background and the sprites use different pattern tables.
+static const unsigned int CLOCK_DOT_SPRITES_AT_1000 = 260;
+static const unsigned int CLOCK_DOT_BACKGROUND_AT_1000 = 324;
+
+// The MMC3 ignores rising edges of A12 unless it has been low for a few M2 cycles: longer than the 9 dots between
+// the last nametable fetch of a scanline and the first pattern fetch of the next, which never clock it.
+static const uint64_t A12_FILTER_DOTS = 10;
+
+MMC3::MMC3(NES *nes)
+    : Mapper(nes, 4, "MMC3"),
+      forceExactA12(false)
+{
+    MMC3::powerOn();
+}
+
+void MMC3::powerOn() {
+    static const uint8_t POWER_ON_BANK_REGISTERS[8] = { 0, 2, 4, 5, 6, 7, 0, 1 };
+
+    Mapper::powerOn();
+
+    bankSelect = 0;
+    std::copy(POWER_ON_BANK_REGISTERS, POWER_ON_BANK_REGISTERS + 8, bankRegisters);
+    prgRAMWriteProtected = false;
+    irqLatch = 0;
+    irqCounter = 0;
+    irqReload = false;
+    irqEnabled = false;
+    predicting = true;
+    clockDot = 0;
+    syncTime = nes->getScheduler()->getTime();
+    a12High = false;
+    a12LowSince = 0;
+
+    updateBanks();
+    reconfigure();
+    scheduleIRQ();
+}
+
+uint8_t MMC3::readCPU(Address address) {
+    if (Utils::inRange(address, 0x6000, 0x7FFF)) {
+        return basicPRGRAMRead(address);
+    } else if (Utils::inRange(address, 0x8000, 0xFFFF)) {
+        return readPRG(address);
+    }
+
+    return 0x00;
+}
+
+uint8_t MMC3::readPPU(Address address) {
+    // Only called while PPU reads are hooked, i.e. in exact mode.
+    if (!predicting) {
+        watchA12(address);
+    }
+
+    return basicPPURead(address);
+}
+
+void MMC3::writeCPU(Address address, uint8_t value) {
+    if (Utils::inRange(address, 0x6000, 0x7FFF)) {
+        if (!prgRAMWriteProtected) {
+            basicPRGRAMWrite(address, value);
+        }
+
+        return;
+    }
+
+    // Each register is mirrored across its 8 KB range, with even and odd addresses selecting a pair.
+    const bool odd = (address & 0x1) != 0;
+
+    if (Utils::inRange(address, 0x8000, 0x9FFF)) {
+        if (odd) {
+            bankRegisters[bankSelect & 0x7] = value;
+        } else {
+            bankSelect = value;
+        }
+
+        updateBanks();
+    } else if (Utils::inRange(address, 0xA000, 0xBFFF)) {
+        if (odd) {
+            setPRGRAMEnabled(Utils::isBitSet(value, 7));
+            prgRAMWriteProtected = Utils::isBitSet(value, 6);
+        } else if (nes->getCartridge()->getMirroring() != Mirroring::FOUR_SCREEN) {
+            setMirroring(Utils::isBitSet(value, 0) ? Mirroring::HORIZONTAL : Mirroring::VERTICAL);
+        }
+    } else if (Utils::inRange(address, 0xC000, 0xFFFF)) {
+        // The IRQ registers change what the counter does from now on, so bring it up to date first.
+        sync();
+
+        if (address < 0xE000) {
+            if (odd) {
+                irqCounter = 0;
+                irqReload = true;
+            } else {
+                irqLatch = value;
+            }
+        } else {
+            irqEnabled = odd;
+
+            if (!irqEnabled) {
+                nes->getCPU()->setIRQLine(IRQSource::MAPPER, false);
+            }
+        }
+
+        scheduleIRQ();
+    }
+}
+
+void MMC3::writePPU(Address address, uint8_t value) {
+    if (!predicting) {
+        watchA12(address);
+    }
+
+    basicPPUWrite(address, value);
+}
+
+void MMC3::handleEvent() {
+    // The counter reaches zero right now; sync() applies that clock and raises the IRQ.
+    sync();
+    scheduleIRQ();
+}
+
+void MMC3::handlePPUConfigChange() {
+    sync();
+    reconfigure();
+    scheduleIRQ();
+}
+
+void MMC3::setExactA12(bool exact) {
+    sync();
+    forceExactA12 = exact;
+    reconfigure();
+    scheduleIRQ();
+}
+
+bool MMC3::isExactA12() const {
+    return !predicting;
+}
+
+void MMC3::updateBanks() {
+    const bool prgSwapped = Utils::isBitSet(bankSelect, 6);
+    const bool chrInverted = Utils::isBitSet(bankSelect, 7);
+    const size_t prgBankCount = getPRGBankCount8K();
+
+    // R6 and the second-to-last bank trade places between $8000 and $C000, R7 and the last bank never move.
+    mapPRG8K(prgSwapped ? 2 : 0, bankRegisters[6] & 0x3F);
+    mapPRG8K(1, bankRegisters[7] & 0x3F);
+    mapPRG8K(prgSwapped ? 0 : 2, prgBankCount - 2);
+    mapPRG8K(3, prgBankCount - 1);
+
+    // Two 2 KB banks (R0, R1) in one half of the pattern tables, four 1 KB banks (R2-R5) in the other.
+    const size_t wide = chrInverted ? 4 : 0;
+    const size_t narrow = chrInverted ? 0 : 4;
+
+    mapCHR1K(wide + 0, bankRegisters[0] & 0xFE);
+    mapCHR1K(wide + 1, bankRegisters[0] | 0x01);
+    mapCHR1K(wide + 2, bankRegisters[1] & 0xFE);
+    mapCHR1K(wide + 3, bankRegisters[1] | 0x01);
+
+    for (size_t i = 0; i < 4; i++) {
+        mapCHR1K(narrow + i, bankRegisters[2 + i]);
+    }
+}
+
+void MMC3::clockCounter(uint64_t clocks) {
+    if (clocks == 0) {
+        return;
+    }
+
+    // The first clock reloads the counter if it's zero or a reload was requested, otherwise it counts down.
+    if (irqCounter == 0 || irqReload) {
+        irqCounter = irqLatch;
+        irqReload = false;
+    } else {
+        irqCounter--;
+    }
+
+    bool reachedZero = irqCounter == 0;
+    clocks--;
+
+    // Any further clocks count the counter down to zero, after which it runs through periods of latch + 1 clocks.
+    if (clocks > 0 && irqCounter > 0) {
+        if (clocks >= irqCounter) {
+            clocks -= irqCounter;
+            irqCounter = 0;
+            reachedZero = true;
+        } else {
+            irqCounter -= (uint8_t)clocks;
+            clocks = 0;
+        }
+    }
+
+    if (clocks > 0) {
+        const uint64_t period = (uint64_t)irqLatch + 1;
+        const uint64_t phase = clocks % period;
+
+        irqCounter = phase == 0 ? (uint8_t)0 : (uint8_t)(period - phase);
+        reachedZero = reachedZero || clocks >= period;
+    }
+
+    if (reachedZero && irqEnabled) {
+        nes->getCPU()->setIRQLine(IRQSource::MAPPER, true);
+    }
+}
+
+uint64_t MMC3::countClocksUpTo(uint64_t time) const {
+    if (clockDot == 0) {
+        return 0;
+    }
+
+    const uint64_t frames = time / PPU::DOTS_PER_FRAME;
+    const uint64_t position = time % PPU::DOTS_PER_FRAME;
+    uint64_t clocks = frames * CLOCKS_PER_FRAME;
+
+    if (position >= clockDot) {
+        const uint64_t lastScanline = (position - clockDot) / PPU::DOTS_PER_SCANLINE;
+
+        clocks += (lastScanline < 240 ? lastScanline : 239) + 1;
+
+        if (lastScanline >= PPU::PRE_RENDER_SCANLINE) {
+            clocks++;
+        }
+    }
+
+    return clocks;
+}
+
+uint64_t MMC3::getClockTime(uint64_t clock) const {
+    // Clocks are numbered from 1, the inverse of countClocksUpTo().
+    const uint64_t frame = (clock - 1) / CLOCKS_PER_FRAME;
+    const uint64_t index = (clock - 1) % CLOCKS_PER_FRAME;
+    const uint64_t scanline = index < 240 ? index : PPU::PRE_RENDER_SCANLINE;
+
+    return frame * PPU::DOTS_PER_FRAME + scanline * PPU::DOTS_PER_SCANLINE + clockDot;
+}
+
+void MMC3::sync() {
+    const uint64_t now = nes->getScheduler()->getTime();
+
+    if (predicting && now > syncTime) {
+        clockCounter(countClocksUpTo(now) - countClocksUpTo(syncTime));
+    }
+
+    syncTime = now;
+}
+
+void MMC3::reconfigure() {
+    const PPU *ppu = nes->getPPU();
+    const bool backgroundAt1000 = ppu->isControlFlagSet(PPUControlFlag::BACKGROUND_PATTERN_TABLE);
+    const bool spritesAt1000 = ppu->isControlFlagSet(PPUControlFlag::SPRITE_PATTERN_TABLE);
+    const bool tallSprites = ppu->isControlFlagSet(PPUControlFlag::SPRITE_HEIGHT);
+
+    if (!ppu->isRenderingEnabled()) {
+        // No fetches, no clocks.
+        predicting = !forceExactA12;
+        clockDot = 0;
+    } else if (!tallSprites && backgroundAt1000 != spritesAt1000) {
+        predicting = !forceExactA12;
+        clockDot = backgroundAt1000 ? CLOCK_DOT_BACKGROUND_AT_1000 : CLOCK_DOT_SPRITES_AT_1000;
+    } else {
+        // 8x16 sprites pick their pattern table per tile, and with both tables on the same side A12 depends on
+        // filter timing. Neither can be predicted from the registers alone.
+        predicting = false;
+        clockDot = 0;
+    }
+
+    setHooked(MapperHook::PPU_READ, !predicting);
+}
+
+void MMC3::scheduleIRQ() {
+    Scheduler *scheduler = nes->getScheduler();
+
+    if (!predicting || clockDot == 0 || !irqEnabled) {
+        scheduler->cancel(EventType::MAPPER);
+        return;
+    }
+
+    // The number of clocks until the counter next reaches zero.
+    const uint64_t clocks = (irqCounter == 0 || irqReload) ? (uint64_t)irqLatch + 1 : (uint64_t)irqCounter;
+    scheduler->schedule(EventType::MAPPER, getClockTime(countClocksUpTo(syncTime) + clocks));
+}
+
+void MMC3::watchA12(Address address) {
+    // The PPU makes a scanline's fetches all at once, but tells us the dot each one belongs to.
+    const uint64_t time = nes->getPPU()->getBusTime();
+
+    if (Utils::isBitSet(address, 12)) {
+        if (!a12High && time >= a12LowSince + A12_FILTER_DOTS) {
+            clockCounter(1);
+        }
+
+        a12High = true;
+    } else if (a12High) {
+        a12High = false;
+        a12LowSince = time;
+    }
+}
+
+void MMC3::saveRegisters(StateWriter &writer) const {
+    writer.write(bankSelect);
+    writer.write(bankRegisters);
+    writer.write(prgRAMWriteProtected);
+    writer.write(irqLatch);
+    writer.write(irqCounter);
+    writer.write(irqReload);
+    writer.write(irqEnabled);
+    writer.write(forceExactA12);
+    writer.write(predicting);
+    writer.write(clockDot);
+    writer.write(syncTime);
+    writer.write(a12High);
+    writer.write(a12LowSince);
+}
+
+void MMC3::loadRegisters(StateReader &reader) {
+    // The IRQ event itself is restored along with the rest of the scheduler.
+    reader.read(bankSelect);
+    reader.read(bankRegisters);
+    reader.read(prgRAMWriteProtected);
+    reader.read(irqLatch);
+    reader.read(irqCounter);
+    reader.read(irqReload);
+    reader.read(irqEnabled);
+    reader.read(forceExactA12);
+    reader.read(predicting);
+    reader.read(clockDot);
+    reader.read(syncTime);
+    reader.read(a12High);
+    reader.read(a12LowSince);
+}
\ No newline at end of file
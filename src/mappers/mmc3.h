@@ -0,0 +1,80 @@
+#pragma once
+
+#include "../mapper.h"
+
+#include <cstdint>
+
+class MMC3 final : public Mapper {
+public:
+    MMC3(NES *nes);
+
+    uint8_t readCPU(Address address) override;
+
+    uint8_t readPPU(Address address) override;
+
+    void writeCPU(Address address, uint8_t value) override;
+
+    void writePPU(Address address, uint8_t value) override;
+
+    void handleEvent() override;
+
+    void handlePPUConfigChange() override;
+
+    /**
+     * Resets the registers and the IRQ counter. Whether exact A12 mode is forced is a setting, not state, and is kept.
+     */
+    void powerOn() override;
+
+    /**
+     * By default the scanline counter is clocked from a prediction of when the PPU raises A12, which only works for
+     * the usual configuration of background and sprite pattern tables. In exact mode every PPU access that reaches
+     * the cartridge is watched for rising edges of A12 instead. Exact mode is always used for configurations the
+     * prediction cannot handle.
+     */
+    void setExactA12(bool exact);
+
+    bool isExactA12() const;
+
+protected:
+    void saveRegisters(StateWriter &writer) const override;
+
+    void loadRegisters(StateReader &reader) override;
+
+private:
+    uint8_t bankSelect;
+    uint8_t bankRegisters[8];
+
+    bool prgRAMWriteProtected;
+
+    uint8_t irqLatch;
+    uint8_t irqCounter;
+    bool irqReload;
+    bool irqEnabled;
+
+    bool forceExactA12;
+
+    // Prediction state, captured from the PPU when the counter was last brought up to date.
+    bool predicting;
+    unsigned int clockDot;  // Dot at which A12 rises on each rendered scanline, or 0 if it never does.
+    uint64_t syncTime;      // Every clock up to and including this time has been applied.
+
+    // Exact mode state.
+    bool a12High;
+    uint64_t a12LowSince;
+
+    void updateBanks();
+
+    void clockCounter(uint64_t clocks);
+
+    uint64_t countClocksUpTo(uint64_t time) const;
+
+    uint64_t getClockTime(uint64_t clock) const;
+
+    void sync();
+
+    void reconfigure();
+
+    void scheduleIRQ();
+
+    void watchA12(Address address);
+};
\ No newline at end of file
@@ -10,16 +10,10 @@ NROM::NROM(NES *nes) : Mapper(nes, 0, "NROM") {
 }
 
 uint8_t NROM::readCPU(Address address) {
-    Cartridge *cartridge = nes->getCartridge();
-    auto prgram = cartridge->getPRGRAM();
-    auto prgrom = cartridge->getPRGROM();
-
     if (Utils::inRange(address, 0x6000, 0x7FFF)) {
-        return prgram->at((size_t)(address - 0x6000));
-    } else if (Utils::inRange(address, 0x8000, 0xBFFF)) {
-        return prgrom->at((size_t)(address - 0x8000));
-    } else if (Utils::inRange(address, 0xC000, 0xFFFF)) {
-        return prgrom->at((size_t)(address - 0x8000) % prgrom->size());
+        return basicPRGRAMRead(address);
+    } else if (Utils::inRange(address, 0x8000, 0xFFFF)) {
+        return readPRG(address);
     }
 
     return 0x00;
@@ -30,18 +24,11 @@ uint8_t NROM::readPPU(Address address) {
 }
 
 void NROM::writeCPU(Address address, uint8_t value) {
-    Cartridge *cartridge = nes->getCartridge();
-    auto prgram = cartridge->getPRGRAM();
-
     if (Utils::inRange(address, 0x6000, 0x7FFF)) {
-        prgram->at((size_t)(address - 0x6000)) = value;
+        basicPRGRAMWrite(address, value);
     }
 }
 
 void NROM::writePPU(Address address, uint8_t value) {
     basicPPUWrite(address, value);
-}
-
-void NROM::step() {
-
 }
\ No newline at end of file
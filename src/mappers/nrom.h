@@ -2,7 +2,7 @@
 
 #include "../mapper.h"
 
-class NROM : public Mapper {
+class NROM final : public Mapper {
 public:
     NROM(NES *nes);
 
@@ -14,8 +14,6 @@ public:
 
     void writePPU(Address address, uint8_t value) override;
 
-    void step();
-
 private:
 
 };
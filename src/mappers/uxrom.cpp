@@ -0,0 +1,44 @@
+#include "uxrom.h"
+
+#include "../mapper.h"
+#include "../utils.h"
+#include "../nes.h"
+#include "../cartridge.h"
+
+UxROM::UxROM(NES *nes) : Mapper(nes, 2, "UxROM") {
+    UxROM::powerOn();
+}
+
+void UxROM::powerOn() {
+    Mapper::powerOn();
+
+    // The last 16 KB bank is always visible at $C000.
+    mapPRG16K(0, 0);
+    mapPRG16K(1, getPRGBankCount8K() / 2 - 1);
+}
+
+uint8_t UxROM::readCPU(Address address) {
+    if (Utils::inRange(address, 0x6000, 0x7FFF)) {
+        return basicPRGRAMRead(address);
+    } else if (Utils::inRange(address, 0x8000, 0xFFFF)) {
+        return readPRG(address);
+    }
+
+    return 0x00;
+}
+
+uint8_t UxROM::readPPU(Address address) {
+    return basicPPURead(address);
+}
+
+void UxROM::writeCPU(Address address, uint8_t value) {
+    if (Utils::inRange(address, 0x6000, 0x7FFF)) {
+        basicPRGRAMWrite(address, value);
+    } else if (Utils::inRange(address, 0x8000, 0xFFFF)) {
+        mapPRG16K(0, value);
+    }
+}
+
+void UxROM::writePPU(Address address, uint8_t value) {
+    basicPPUWrite(address, value);
+}
\ No newline at end of file
@@ -0,0 +1,18 @@
+#pragma once
+
+#include "../mapper.h"
+
+class UxROM final : public Mapper {
+public:
+    UxROM(NES *nes);
+
+    uint8_t readCPU(Address address) override;
+
+    uint8_t readPPU(Address address) override;
+
+    void writeCPU(Address address, uint8_t value) override;
+
+    void writePPU(Address address, uint8_t value) override;
+
+    void powerOn() override;
+};
\ No newline at end of file
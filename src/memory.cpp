@@ -1,21 +1,23 @@
 #include "memory.h"
 
 #include "nes.h"
+#include "mapper.h"
 #include "utils.h"
+#include "savestate.h"
 
 #include <iostream>
+#include <algorithm>
 
-const size_t NES_INTERNAL_MEMORY_SIZE = 2048;
-const size_t NES_INTERNAL_VIDEO_MEMORY_SIZE = 2048;
-const size_t NES_PALETTE_RAM_SIZE = 32;
 const size_t NES_PAGE_SIZE = 256;
 const Address NES_STACK_ADDRESS = NES_PAGE_SIZE * 1;
 
 Memory::Memory(NES *nes)
     : nes(nes),
-      internalMem(NES_INTERNAL_MEMORY_SIZE, 0),
-      internalVideoMem(NES_INTERNAL_VIDEO_MEMORY_SIZE, 0),
-      paletteRAM(NES_PALETTE_RAM_SIZE, 0)
+      mapper(nullptr),
+      cpuBus(nullptr),
+      internalMem(),
+      internalVideoMem(),
+      paletteRAM()
 {
 }
 
@@ -35,28 +37,45 @@ void Memory::write(MemoryAccessSource source, Address address, uint8_t value) {
     }
 }
 
+void Memory::setMapper(Mapper *mapper) {
+    this->mapper = mapper;
+}
+
+void Memory::setCPUBus(CPUBus *bus) {
+    cpuBus = bus;
+}
+
 uint8_t Memory::readCPU(Address address) const {
-    if (Utils::inRange(address, 0x0000, 0x1FFF)) {
+    if (cpuBus != nullptr) {
+        return cpuBus->read(address);
+    } else if (Utils::inRange(address, 0x0000, 0x1FFF)) {
         return internalMem[address % 0x0800];
-    } else if (Utils::inRange(address, 0x2000, 0x2007) || address == 0x4014) {
+    } else if (address >= 0x6000 && mapper != nullptr && !mapper->isHooked(MapperHook::CPU_READ)) {
+        // Plain PRG-ROM and PRG-RAM reads, served from the mapper's windows without a virtual call.
+        return address >= 0x8000 ? mapper->readPRG(address) : mapper->readPRGRAM(address);
+    } else if (Utils::inRange(address, 0x2000, 0x3FFF) || address == 0x4014) {
         PPURegister reg;
 
         if (PPU::getRegisterFromAddress(address, &reg)) {
             return nes->getPPU()->readRegister(reg);
         }
+    } else if (address == 0x4015) {
+        return nes->getAPU()->readStatus();
+    } else if (address == 0x4016 || address == 0x4017) {
+        // Only bit 0 is driven by a standard controller; the rest is open bus, usually the $40 of the address.
+        return (uint8_t)(0x40 | nes->getController(address - 0x4016)->read());
+    } else if (Utils::inRange(address, 0x4000, 0x4013)) {
+        // The other APU registers are write-only; reading them returns open bus, usually the $40 of the address.
+        return 0x40;
     } else if (Utils::inRange(address, 0x4020, 0xFFFF)) {
-        Mapper *mapper = nes->getCartridge()->getMapper();
-
         if (mapper != nullptr) {
             return mapper->readCPU(address);
-        } else {
+        } else if (countUnmapped(false)) {
             std::cout << "Warning: Could not read from CPU address $";
             Utils::writeHexToStream(std::cout, address);
             std::cout << ", because the cartridge has no mapper! Assuming $00.\n";
         }
-    } else if (Utils::inRange(address, 0x3F00, 0x3FFF)) {
-        return paletteRAM[(address - 0x3F00) % NES_PALETTE_RAM_SIZE];
-    } else {
+    } else if (countUnmapped(false)) {
         std::cerr << "Could not read from unmapped CPU address $";
         Utils::writeHexToStream(std::cerr, address);
         std::cerr << "!!! Assuming $00.\n";
@@ -65,48 +84,68 @@ uint8_t Memory::readCPU(Address address) const {
     return 0x00;
 }
 
+uint8_t Memory::peekPPU(Address address) const {
+    if (mapper == nullptr) {
+        return 0x00;
+    }
+
+    return address < 0x2000 ? mapper->readCHR(address) : mapper->readNametable(address);
+}
+
 uint8_t Memory::readPPU(Address address) const {
     if (Utils::inRange(address, 0x3F00, 0x3FFF)) {
-        return paletteRAM[(address - 0x3F00) % NES_PALETTE_RAM_SIZE];
+        return paletteRAM[getPaletteIndex(address)];
+    } else if (address < 0x3F00 && mapper != nullptr && !mapper->isHooked(MapperHook::PPU_READ)) {
+        // The nametable windows only look at A10-A11, so $3000-$3EFF mirrors $2000-$2EFF by itself.
+        return address < 0x2000 ? mapper->readCHR(address) : mapper->readNametable(address);
     } else {
-        Mapper *mapper = nes->getCartridge()->getMapper();
-
         if (mapper != nullptr) {
             if (Utils::inRange(address, 0x3000, 0x3EFF)) {
-                // This is a mirror of $2000-$23FF, it would be a nuisance to implement this in every mapper.
-                address %= 0x0F00;
+                // This is a mirror of $2000-$2EFF, it would be a nuisance to implement this in every mapper.
+                address -= 0x1000;
             }
 
             return mapper->readPPU(address);
         } else {
-            std::cerr << "Could not read from unmapped PPU address $";
-            Utils::writeHexToStream(std::cerr, address);
-            std::cerr << "!!! Assuming $00.\n";
+            if (countUnmapped(false)) {
+                std::cerr << "Could not read from unmapped PPU address $";
+                Utils::writeHexToStream(std::cerr, address);
+                std::cerr << "!!! Assuming $00.\n";
+            }
+
             return 0x00;
         }
     }
 }
 
 void Memory::writeCPU(Address address, uint8_t value) {
-    if (Utils::inRange(address, 0x0000, 0x1FFF)) {
+    if (cpuBus != nullptr) {
+        cpuBus->write(address, value);
+    } else if (Utils::inRange(address, 0x0000, 0x1FFF)) {
         internalMem[address % 0x0800] = value;
-    } else if (Utils::inRange(address, 0x2000, 0x2007)) {
+    } else if (Utils::inRange(address, 0x2000, 0x3FFF) || address == 0x4014) {
         PPURegister reg;
 
         if (PPU::getRegisterFromAddress(address, &reg)) {
             nes->getPPU()->writeRegister(reg, value);
         }
+    } else if (address == 0x4016) {
+        // The strobe goes to both ports. This is when the controllers look at the buttons, so queued input is
+        // applied now.
+        nes->pollInput();
+        nes->getController(0)->writeStrobe(Utils::isBitSet(value, 0));
+        nes->getController(1)->writeStrobe(Utils::isBitSet(value, 0));
+    } else if (Utils::inRange(address, 0x4000, 0x4013) || address == 0x4015 || address == 0x4017) {
+        nes->getAPU()->writeRegister(address, value);
     } else if (Utils::inRange(address, 0x4020, 0xFFFF)) {
-        Mapper *mapper = nes->getCartridge()->getMapper();
-
         if (mapper != nullptr) {
             mapper->writeCPU(address, value);
-        } else {
+        } else if (countUnmapped(true)) {
             std::cout << "Warning: Could not write to CPU address $";
             Utils::writeHexToStream(std::cout, address);
             std::cout << ", because the cartridge has no mapper!\n";
         }
-    } else {
+    } else if (countUnmapped(true)) {
         std::cerr << "Could not write to unmapped CPU address $";
         Utils::writeHexToStream(std::cerr, address);
         std::cerr << "!!!\n";
@@ -115,18 +154,16 @@ void Memory::writeCPU(Address address, uint8_t value) {
 
 void Memory::writePPU(Address address, uint8_t value) {
     if (Utils::inRange(address, 0x3F00, 0x3FFF)) {
-        paletteRAM[(address - 0x3F00) % NES_PALETTE_RAM_SIZE] = value;
+        paletteRAM[getPaletteIndex(address)] = value;
     } else {
-        Mapper *mapper = nes->getCartridge()->getMapper();
-
         if (mapper != nullptr) {
             if (Utils::inRange(address, 0x3000, 0x3EFF)) {
-                // This is a mirror of $2000-$23FF, it would be a nuisance to implement this in every mapper.
-                address %= 0x0F00;
+                // This is a mirror of $2000-$2EFF, it would be a nuisance to implement this in every mapper.
+                address -= 0x1000;
             }
 
             mapper->writePPU(address, value);
-        } else {
+        } else if (countUnmapped(true)) {
             std::cout << "Warning: Could not write to CPU address $";
             Utils::writeHexToStream(std::cout, address);
             std::cout << ", because the cartridge has no mapper!\n";
@@ -134,6 +171,29 @@ void Memory::writePPU(Address address, uint8_t value) {
     }
 }
 
+size_t Memory::getPaletteIndex(Address address) {
+    size_t index = address & 0x1F;
+
+    // The backdrop entries of the sprite palettes ($3F10/$3F14/$3F18/$3F1C) are the background's.
+    if ((index & 0x13) == 0x10) {
+        index &= 0x0F;
+    }
+
+    return index;
+}
+
+bool Memory::countUnmapped(bool write) const {
+    Diagnostics *diagnostics = nes->getDiagnostics();
+    (write ? diagnostics->unmappedWrites : diagnostics->unmappedReads)++;
+    return diagnostics->verbose;
+}
+
+void Memory::powerOn() {
+    std::fill(internalMem, internalMem + NES_INTERNAL_MEMORY_SIZE, 0x00);
+    std::fill(internalVideoMem, internalVideoMem + NES_INTERNAL_VIDEO_MEMORY_SIZE, 0x00);
+    std::fill(paletteRAM, paletteRAM + NES_PALETTE_RAM_SIZE, 0x00);
+}
+
 Address Memory::getResetVector() const {
     return Utils::combineUint8sLE(readCPU(0xFFFC), readCPU(0xFFFD));
 }
@@ -142,14 +202,30 @@ Address Memory::getIRQVector() const {
     return Utils::combineUint8sLE(readCPU(0xFFFE), readCPU(0xFFFF));
 }
 
-std::vector<uint8_t> *Memory::getInternalMemory() {
-    return &internalMem;
+Address Memory::getNMIVector() const {
+    return Utils::combineUint8sLE(readCPU(0xFFFA), readCPU(0xFFFB));
+}
+
+uint8_t *Memory::getInternalMemory() {
+    return internalMem;
+}
+
+uint8_t *Memory::getInternalVideoMemory() {
+    return internalVideoMem;
 }
 
-std::vector<uint8_t> *Memory::getInternalVideoMemory() {
-    return &internalVideoMem;
+uint8_t *Memory::getPaletteRAM() {
+    return paletteRAM;
 }
 
-std::vector<uint8_t> *Memory::getPaletteRAM() {
-    return &paletteRAM;
+void Memory::saveState(StateWriter &writer) const {
+    writer.write(internalMem);
+    writer.write(internalVideoMem);
+    writer.write(paletteRAM);
 }
+
+void Memory::loadState(StateReader &reader) {
+    reader.read(internalMem);
+    reader.read(internalVideoMem);
+    reader.read(paletteRAM);
+}
\ No newline at end of file
@@ -2,16 +2,33 @@
 
 #include "address.h"
 
-#include <vector>
 #include <cstdint>
+#include <cstddef>
+
+// These size arrays in Memory, so they are defined here rather than in memory.cpp.
+const size_t NES_INTERNAL_MEMORY_SIZE = 2048;
+const size_t NES_INTERNAL_VIDEO_MEMORY_SIZE = 2048;
+const size_t NES_PALETTE_RAM_SIZE = 32;
 
-extern const size_t NES_INTERNAL_MEMORY_SIZE;
-extern const size_t NES_INTERNAL_VIDEO_MEMORY_SIZE;
-extern const size_t NES_PALETTE_RAM_SIZE;
 extern const size_t NES_PAGE_SIZE;
 extern const Address NES_STACK_ADDRESS;
 
 class NES;
+class Mapper;
+class StateWriter;
+class StateReader;
+
+/**
+ * Stands in for the whole CPU address space, for running the CPU on its own (see Memory::setCPUBus()).
+ */
+class CPUBus {
+public:
+    virtual ~CPUBus() = default;
+
+    virtual uint8_t read(Address address) = 0;
+
+    virtual void write(Address address, uint8_t value) = 0;
+};
 
 enum class MemoryAccessSource {
     CPU,
@@ -30,24 +47,73 @@ public:
 
     uint8_t readPPU(Address address) const;
 
+    /**
+     * Reads a pattern or nametable byte straight from the mapper's windows, without the mapper seeing the access. For
+     * the PPU to read again what it has fetched before.
+     */
+    uint8_t peekPPU(Address address) const;
+
     void writeCPU(Address address, uint8_t value);
 
     void writePPU(Address address, uint8_t value);
 
+    /**
+     * Sets the mapper that cartridge space is routed to. Memory keeps its own pointer so the fast paths don't have
+     * to go through the NES and the Cartridge on every access.
+     */
+    void setMapper(Mapper *mapper);
+
+    /**
+     * Sends every CPU read and write to the given bus instead of RAM, the PPU, the APU and the cartridge, e.g. to
+     * run the CPU against test vectors that assume 64 KB of flat RAM. nullptr puts the NES's own map back.
+     */
+    void setCPUBus(CPUBus *bus);
+
+    /**
+     * Clears RAM, VRAM and palette RAM.
+     */
+    void powerOn();
+
     Address getResetVector() const;
 
     Address getIRQVector() const;
 
-    std::vector<uint8_t> *getInternalMemory();
+    Address getNMIVector() const;
+
+    /**
+     * @return The NES_INTERNAL_MEMORY_SIZE bytes of internal RAM.
+     */
+    uint8_t *getInternalMemory();
+
+    /**
+     * @return The NES_INTERNAL_VIDEO_MEMORY_SIZE bytes of internal VRAM, i.e. two nametables.
+     */
+    uint8_t *getInternalVideoMemory();
 
-    std::vector<uint8_t> *getInternalVideoMemory();
+    /**
+     * @return The NES_PALETTE_RAM_SIZE bytes of palette RAM.
+     */
+    uint8_t *getPaletteRAM();
 
-    std::vector<uint8_t> *getPaletteRAM();
+    void saveState(StateWriter &writer) const;
+
+    void loadState(StateReader &reader);
 
 private:
+    /**
+     * Records an access to an address nothing answers to.
+     * @return true if the access should be reported on the console.
+     */
+    bool countUnmapped(bool write) const;
+
+    static size_t getPaletteIndex(Address address);
 
     NES *nes;
-    std::vector<uint8_t> internalMem;
-    std::vector<uint8_t> internalVideoMem;
-    std::vector<uint8_t> paletteRAM;
+    Mapper *mapper;
+    CPUBus *cpuBus;
+
+    // The memories are part of the object rather than separate allocations, so a whole NES is one block.
+    uint8_t internalMem[NES_INTERNAL_MEMORY_SIZE];
+    uint8_t internalVideoMem[NES_INTERNAL_VIDEO_MEMORY_SIZE];
+    uint8_t paletteRAM[NES_PALETTE_RAM_SIZE];
 };
\ No newline at end of file
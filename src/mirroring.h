@@ -0,0 +1,11 @@
+#pragma once
+
+#include <cstdint>
+
+enum class Mirroring: uint8_t {
+    VERTICAL,
+    HORIZONTAL,
+    FOUR_SCREEN,
+    SINGLE_SCREEN_LOWER,
+    SINGLE_SCREEN_UPPER
+};
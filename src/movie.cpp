@@ -0,0 +1,486 @@
+#include "movie.h"
+
+#include "hash.h"
+
+#include <string>
+#include <cstring>
+#include <cstdlib>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+/*
+ * The native format is a 16-byte header followed by one record per frame, all little-endian:
+ *
+ *     0   char[4]  magic bytes "NMV\x1A"
+ *     4   uint8    version
+ *     5   uint8    flags, bit 0: the records have hashes
+ *     6   uint16   reserved, 0
+ *     8   uint64   the number of frames
+ *
+ * A record is the buttons of controller 1 and 2, the commands and, if the movie has hashes, the uint32 state hash.
+ */
+static const char MAGIC_BYTES[4] = { 'N', 'M', 'V', '\x1A' };
+static const uint8_t VERSION = 1;
+static const uint8_t FLAG_HASHES = 1 << 0;
+static const size_t HEADER_SIZE = 16;
+static const size_t RECORD_SIZE = 3;
+static const size_t HASH_SIZE = 4;
+
+// FM2 writes the buttons of a gamepad as "RLDUTSBA", with any character other than '.' or ' ' meaning held.
+static const size_t FM2_GAMEPAD_FIELD_SIZE = 8;
+
+static uint64_t readUint64LE(const uint8_t *p) {
+    uint64_t value = 0;
+
+    for (size_t i = 0; i < 8; i++) {
+        value |= (uint64_t)p[i] << (i * 8);
+    }
+
+    return value;
+}
+
+static uint32_t readUint32LE(const uint8_t *p) {
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static void writeUint64LE(uint8_t *p, uint64_t value) {
+    for (size_t i = 0; i < 8; i++) {
+        p[i] = (uint8_t)(value >> (i * 8));
+    }
+}
+
+static void writeUint32LE(uint8_t *p, uint32_t value) {
+    for (size_t i = 0; i < 4; i++) {
+        p[i] = (uint8_t)(value >> (i * 8));
+    }
+}
+
+Movie::Reader::Reader()
+    : data(nullptr),
+      size(0),
+      offset(0),
+      format(Movie::Format::NATIVE),
+      hashes(false),
+      frameCount(0),
+      position(0),
+      fm2Ports()
+#ifdef _WIN32
+      , fileHandle(INVALID_HANDLE_VALUE),
+      mappingHandle(nullptr)
+#endif
+{
+}
+
+Movie::Reader::~Reader() {
+#ifdef _WIN32
+    if (data != nullptr) UnmapViewOfFile(data);
+    if (mappingHandle != nullptr) CloseHandle(mappingHandle);
+    if (fileHandle != INVALID_HANDLE_VALUE) CloseHandle(fileHandle);
+#else
+    if (data != nullptr) munmap((void *)data, size);
+#endif
+}
+
+Movie::Format Movie::Reader::getFormat() const {
+    return format;
+}
+
+bool Movie::Reader::hasHashes() const {
+    return hashes;
+}
+
+uint64_t Movie::Reader::getFrameCount() const {
+    return frameCount;
+}
+
+uint64_t Movie::Reader::getPosition() const {
+    return position;
+}
+
+bool Movie::Reader::next(Movie::Frame &outFrame) {
+    const bool read = format == Movie::Format::NATIVE ? nextNative(outFrame) : nextFM2(outFrame);
+
+    if (read) {
+        position++;
+    }
+
+    return read;
+}
+
+bool Movie::Reader::nextNative(Movie::Frame &outFrame) {
+    if (position == frameCount) {
+        return false;
+    }
+
+    const uint8_t *record = data + offset;
+
+    outFrame.buttons[0] = record[0];
+    outFrame.buttons[1] = record[1];
+    outFrame.commands = record[2];
+    outFrame.hasHash = hashes;
+    outFrame.hash = hashes ? readUint32LE(record + RECORD_SIZE) : 0;
+
+    offset += RECORD_SIZE + (hashes ? HASH_SIZE : 0);
+    return true;
+}
+
+static uint8_t parseFM2Gamepad(const uint8_t *field, size_t length) {
+    uint8_t buttons = 0;
+
+    for (size_t i = 0; i < length && i < FM2_GAMEPAD_FIELD_SIZE; i++) {
+        if (field[i] != '.' && field[i] != ' ') {
+            buttons |= (uint8_t)(0x80 >> i);
+        }
+    }
+
+    return buttons;
+}
+
+static uint8_t parseFM2Commands(const uint8_t *field, size_t length) {
+    unsigned int commands = 0;
+
+    for (size_t i = 0; i < length && field[i] >= '0' && field[i] <= '9'; i++) {
+        commands = commands * 10 + (field[i] - '0');
+    }
+
+    return (uint8_t)commands;
+}
+
+bool Movie::Reader::nextFM2(Movie::Frame &outFrame) {
+    // Input lines look like "|commands|port0|port1|port2|"; everything else (the header, comments) is skipped.
+    while (offset < size) {
+        const uint8_t *line = data + offset;
+        const uint8_t *end = (const uint8_t *)std::memchr(line, '\n', size - offset);
+        const size_t length = end != nullptr ? (size_t)(end - line) : size - offset;
+
+        offset += length + 1;
+
+        if (length == 0 || line[0] != '|') {
+            continue;
+        }
+
+        outFrame = {};
+
+        size_t field = 0;
+        size_t fieldStart = 1;
+
+        for (size_t i = 1; i <= length; i++) {
+            if (i < length && line[i] != '|') {
+                continue;
+            }
+
+            if (field == 0) {
+                outFrame.commands = parseFM2Commands(line + fieldStart, i - fieldStart);
+            } else if (field <= NES::CONTROLLER_PORTS && fm2Ports[field - 1]) {
+                outFrame.buttons[field - 1] = parseFM2Gamepad(line + fieldStart, i - fieldStart);
+            }
+
+            field++;
+            fieldStart = i + 1;
+        }
+
+        return true;
+    }
+
+    return false;
+}
+
+/**
+ * Reads the header of an FM2 movie, which ends where the first input line starts.
+ */
+static Movie::LoadError parseFM2Header(const uint8_t *data, size_t size, bool *outPorts) {
+    size_t offset = 0;
+
+    while (offset < size && data[offset] != '|') {
+        const uint8_t *end = (const uint8_t *)std::memchr(data + offset, '\n', size - offset);
+        const size_t length = end != nullptr ? (size_t)(end - data - offset) : size - offset;
+        const std::string line((const char *)data + offset, length);
+        const size_t space = line.find(' ');
+        const std::string key = line.substr(0, space);
+        const std::string value = space != std::string::npos ? line.substr(space + 1) : "";
+        const unsigned long number = std::strtoul(value.c_str(), nullptr, 10);
+
+        offset += length + 1;
+
+        if (key == "binary" && number != 0) {
+            return Movie::LoadError::UNSUPPORTED_VERSION;
+        } else if (key == "port0" || key == "port1") {
+            // 0 is nothing plugged in, 1 a gamepad, 2 a Zapper.
+            if (number > 1) {
+                return Movie::LoadError::UNSUPPORTED_INPUT_DEVICE;
+            }
+
+            outPorts[key[4] - '0'] = number == 1;
+        } else if (key == "port2" && number != 0) {
+            // The Famicom expansion port, or a Four Score.
+            return Movie::LoadError::UNSUPPORTED_INPUT_DEVICE;
+        }
+    }
+
+    return Movie::LoadError::NO_ERROR;
+}
+
+Movie::LoadError Movie::open(const std::string &file, std::unique_ptr<Movie::Reader> &outReader) {
+    std::unique_ptr<Movie::Reader> reader(new Movie::Reader());
+
+#ifdef _WIN32
+    HANDLE fileHandle = CreateFileA(file.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+                                    FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+
+    if (fileHandle == INVALID_HANDLE_VALUE) {
+        return Movie::LoadError::OPEN_FAILED;
+    }
+
+    reader->fileHandle = fileHandle;
+
+    LARGE_INTEGER fileSize;
+
+    if (!GetFileSizeEx(fileHandle, &fileSize)) {
+        return Movie::LoadError::READ_ERROR;
+    }
+
+    if (fileSize.QuadPart == 0) {
+        return Movie::LoadError::UNKNOWN_FORMAT;
+    }
+
+    reader->mappingHandle = CreateFileMappingA(fileHandle, nullptr, PAGE_READONLY, 0, 0, nullptr);
+
+    if (reader->mappingHandle == nullptr) {
+        return Movie::LoadError::READ_ERROR;
+    }
+
+    reader->data = (const uint8_t *)MapViewOfFile(reader->mappingHandle, FILE_MAP_READ, 0, 0, 0);
+
+    if (reader->data == nullptr) {
+        return Movie::LoadError::READ_ERROR;
+    }
+
+    reader->size = (size_t)fileSize.QuadPart;
+#else
+    const int fd = ::open(file.c_str(), O_RDONLY);
+
+    if (fd < 0) {
+        return Movie::LoadError::OPEN_FAILED;
+    }
+
+    struct stat st;
+
+    if (fstat(fd, &st) != 0) {
+        close(fd);
+        return Movie::LoadError::READ_ERROR;
+    }
+
+    if (st.st_size == 0) {
+        close(fd);
+        return Movie::LoadError::UNKNOWN_FORMAT;
+    }
+
+    void *data = mmap(nullptr, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+
+    // The mapping keeps its own reference to the file.
+    close(fd);
+
+    if (data == MAP_FAILED) {
+        return Movie::LoadError::READ_ERROR;
+    }
+
+    // The movie is read front to back exactly once: read ahead, and let pages that have been played go.
+    madvise(data, (size_t)st.st_size, MADV_SEQUENTIAL);
+
+    reader->data = (const uint8_t *)data;
+    reader->size = (size_t)st.st_size;
+#endif
+
+    if (reader->size >= sizeof(MAGIC_BYTES) && std::memcmp(reader->data, MAGIC_BYTES, sizeof(MAGIC_BYTES)) == 0) {
+        if (reader->size < HEADER_SIZE) {
+            return Movie::LoadError::TRUNCATED;
+        }
+
+        if (reader->data[4] != VERSION) {
+            return Movie::LoadError::UNSUPPORTED_VERSION;
+        }
+
+        reader->format = Movie::Format::NATIVE;
+        reader->hashes = (reader->data[5] & FLAG_HASHES) != 0;
+        reader->frameCount = readUint64LE(reader->data + 8);
+        reader->offset = HEADER_SIZE;
+
+        const size_t recordSize = RECORD_SIZE + (reader->hashes ? HASH_SIZE : 0);
+
+        if (reader->frameCount > (reader->size - HEADER_SIZE) / recordSize) {
+            return Movie::LoadError::TRUNCATED;
+        }
+    } else {
+        // FM2 files start with their version: "version 3".
+        static const char FM2_START[] = "version ";
+
+        if (reader->size < sizeof(FM2_START) - 1 ||
+            std::memcmp(reader->data, FM2_START, sizeof(FM2_START) - 1) != 0) {
+            return Movie::LoadError::UNKNOWN_FORMAT;
+        }
+
+        reader->format = Movie::Format::FM2;
+
+        // A movie without port lines is played with gamepads in both ports.
+        reader->fm2Ports[0] = true;
+        reader->fm2Ports[1] = true;
+
+        const Movie::LoadError error = parseFM2Header(reader->data, reader->size, reader->fm2Ports);
+
+        if (error != Movie::LoadError::NO_ERROR) {
+            return error;
+        }
+    }
+
+    outReader = std::move(reader);
+    return Movie::LoadError::NO_ERROR;
+}
+
+std::string Movie::getLoadErrorMessage(Movie::LoadError error) {
+    switch (error) {
+        case Movie::LoadError::NO_ERROR:
+            return "No error.";
+
+        case Movie::LoadError::OPEN_FAILED:
+            return "Could not open file!";
+
+        case Movie::LoadError::READ_ERROR:
+            return "Failed to read from file!";
+
+        case Movie::LoadError::UNKNOWN_FORMAT:
+            return "This is neither a native nor an FM2 movie!";
+
+        case Movie::LoadError::UNSUPPORTED_VERSION:
+            return "The movie is in a version of its format that can't be read!";
+
+        case Movie::LoadError::UNSUPPORTED_INPUT_DEVICE:
+            return "The movie uses an input device other than standard controllers!";
+
+        case Movie::LoadError::TRUNCATED:
+            return "The file is shorter than its header says it is!";
+    }
+
+    return "N/A";
+}
+
+Movie::Writer::Writer()
+    : hashes(false),
+      frameCount(0)
+{
+}
+
+bool Movie::Writer::open(const std::string &file, bool hashes) {
+    out.open(file, std::ios::out | std::ios::binary | std::ios::trunc);
+
+    this->hashes = hashes;
+    frameCount = 0;
+
+    // The frame count is filled in by close().
+    uint8_t header[HEADER_SIZE] = {};
+    std::memcpy(header, MAGIC_BYTES, sizeof(MAGIC_BYTES));
+    header[4] = VERSION;
+    header[5] = hashes ? FLAG_HASHES : 0;
+
+    return out && out.write((const char *)header, sizeof(header));
+}
+
+void Movie::Writer::write(const Movie::Frame &frame) {
+    uint8_t record[RECORD_SIZE + HASH_SIZE] = { frame.buttons[0], frame.buttons[1], frame.commands };
+    writeUint32LE(record + RECORD_SIZE, frame.hash);
+
+    out.write((const char *)record, RECORD_SIZE + (hashes ? HASH_SIZE : 0));
+    frameCount++;
+}
+
+bool Movie::Writer::close() {
+    uint8_t count[8];
+    writeUint64LE(count, frameCount);
+
+    out.seekp(8);
+    out.write((const char *)count, sizeof(count));
+    out.close();
+
+    return !out.fail();
+}
+
+uint32_t Movie::hashState(const NES &nes, std::vector<uint8_t> &scratch) {
+    nes.saveState(scratch);
+    return Hash::crc32(scratch.data(), scratch.size());
+}
+
+Movie::Player::Player(NES *nes, Movie::Reader *reader)
+    : nes(nes),
+      reader(reader),
+      status(Movie::Player::Status::PLAYING),
+      frame(0),
+      lastFrame(),
+      lastHash(0)
+{
+    nes->reset(ResetType::POWER_ON);
+}
+
+Movie::Player::Status Movie::Player::step() {
+    if (status != Movie::Player::Status::PLAYING) {
+        return status;
+    }
+
+    if (!reader->next(lastFrame)) {
+        status = Movie::Player::Status::FINISHED;
+        return status;
+    }
+
+    if ((lastFrame.commands & (uint8_t)Movie::Command::POWER_ON) != 0) {
+        nes->reset(ResetType::POWER_ON);
+    } else if ((lastFrame.commands & (uint8_t)Movie::Command::SOFT_RESET) != 0) {
+        nes->reset(ResetType::SOFT);
+    }
+
+    for (size_t port = 0; port < NES::CONTROLLER_PORTS; port++) {
+        nes->getController(port)->setButtons(lastFrame.buttons[port]);
+    }
+
+    nes->runFrame();
+    frame++;
+
+    if (lastFrame.hasHash) {
+        lastHash = Movie::hashState(*nes, scratch);
+
+        if (lastHash != lastFrame.hash) {
+            status = Movie::Player::Status::DESYNCED;
+        }
+    }
+
+    return status;
+}
+
+Movie::Player::Status Movie::Player::run() {
+    while (step() == Movie::Player::Status::PLAYING) {
+    }
+
+    return status;
+}
+
+Movie::Player::Status Movie::Player::getStatus() const {
+    return status;
+}
+
+uint64_t Movie::Player::getFrame() const {
+    return frame;
+}
+
+const Movie::Frame &Movie::Player::getLastFrame() const {
+    return lastFrame;
+}
+
+uint32_t Movie::Player::getLastHash() const {
+    return lastHash;
+}
\ No newline at end of file
@@ -0,0 +1,209 @@
+#pragma once
+
+#include "nes.h"
+
+#include <vector>
+#include <string>
+#include <memory>
+#include <fstream>
+#include <cstdint>
+#include <cstddef>
+
+/**
+ * Input movies: the buttons held on every frame of a game, from power-on, to be played back deterministically.
+ *
+ * Two formats are read. FCEUX's text-based FM2, for importing existing movies, and a compact native format of
+ * fixed-size records: the buttons of both controllers, the commands (resets) and, optionally, a hash of the machine's
+ * state after the frame, so playback notices the frame a run stops matching the recording.
+ *
+ * Movie files are memory-mapped and read one frame at a time as they're played, so even a movie that runs for
+ * hours opens instantly and is played in constant memory.
+ */
+namespace Movie {
+    enum class Format {
+        NATIVE,
+        FM2
+    };
+
+    /**
+     * What happens before a frame's input is applied. Uses the same bits as FM2.
+     */
+    enum class Command : uint8_t {
+        SOFT_RESET = 1 << 0,
+        POWER_ON = 1 << 1
+    };
+
+    struct Frame {
+        uint8_t buttons[NES::CONTROLLER_PORTS];   // ControllerButton flags.
+        uint8_t commands;                       // Command flags.
+        bool hasHash;
+        uint32_t hash;                          // hashState() after the frame, if hasHash.
+    };
+
+    enum class LoadError {
+        NO_ERROR,
+        OPEN_FAILED,
+        READ_ERROR,
+        UNKNOWN_FORMAT,
+        UNSUPPORTED_VERSION,
+        UNSUPPORTED_INPUT_DEVICE,
+        TRUNCATED
+    };
+
+    std::string getLoadErrorMessage(LoadError error);
+
+    /**
+     * Reads a movie frame by frame from a read-only mapping of its file.
+     */
+    class Reader {
+    public:
+        ~Reader();
+
+        Reader(const Reader &) = delete;
+
+        Reader &operator=(const Reader &) = delete;
+
+        Format getFormat() const;
+
+        /**
+         * @return true if every frame carries a state hash. Only native movies can.
+         */
+        bool hasHashes() const;
+
+        /**
+         * @return The number of frames in the movie, or 0 if the format doesn't say (FM2). Playing doesn't need it.
+         */
+        uint64_t getFrameCount() const;
+
+        /**
+         * Reads the next frame.
+         * @return false at the end of the movie.
+         */
+        bool next(Frame &outFrame);
+
+        /**
+         * @return How many frames next() has returned.
+         */
+        uint64_t getPosition() const;
+
+    private:
+        friend LoadError open(const std::string &file, std::unique_ptr<Reader> &outReader);
+
+        Reader();
+
+        bool nextNative(Frame &outFrame);
+
+        bool nextFM2(Frame &outFrame);
+
+        const uint8_t *data;
+        size_t size;
+        size_t offset;
+
+        Format format;
+        bool hashes;
+        uint64_t frameCount;
+        uint64_t position;
+
+        // FM2 only: which of the fields on an input line are controllers.
+        bool fm2Ports[NES::CONTROLLER_PORTS];
+
+#ifdef _WIN32
+        void *fileHandle;
+        void *mappingHandle;
+#endif
+    };
+
+    /**
+     * Opens a movie in either format; the format is detected from the file's contents.
+     */
+    LoadError open(const std::string &file, std::unique_ptr<Reader> &outReader);
+
+    /**
+     * Writes a movie in the native format.
+     */
+    class Writer {
+    public:
+        Writer();
+
+        /**
+         * @param hashes Whether the frames will carry state hashes. Then every frame written must have one.
+         * @return false if the file couldn't be created.
+         */
+        bool open(const std::string &file, bool hashes);
+
+        void write(const Frame &frame);
+
+        /**
+         * Fills in the frame count and closes the file.
+         * @return false if anything couldn't be written.
+         */
+        bool close();
+
+    private:
+        std::ofstream out;
+        bool hashes;
+        uint64_t frameCount;
+    };
+
+    /**
+     * Hashes the complete state of a machine, i.e. its save state, to compare runs frame by frame.
+     * @param scratch Holds the save state; pass the same vector every frame so hashing doesn't allocate.
+     */
+    uint32_t hashState(const NES &nes, std::vector<uint8_t> &scratch);
+
+    /**
+     * Plays a movie on a machine as fast as it will go.
+     */
+    class Player {
+    public:
+        enum class Status {
+            PLAYING,
+            FINISHED,   // The movie has no more frames.
+            DESYNCED    // The state after the last frame didn't match the movie's hash.
+        };
+
+        /**
+         * Powers the machine on, as movies start from power-on. Both must outlive the Player.
+         */
+        Player(NES *nes, Reader *reader);
+
+        /**
+         * Applies the next frame's commands and buttons, runs the frame and, if the movie has a hash for it, checks
+         * the machine's state against it. Does nothing once the movie has finished or desynced.
+         */
+        Status step();
+
+        /**
+         * Steps until the movie finishes or desyncs.
+         */
+        Status run();
+
+        Status getStatus() const;
+
+        /**
+         * @return The number of frames played.
+         */
+        uint64_t getFrame() const;
+
+        /**
+         * @return The last frame read from the movie; after a desync, this is the one whose hash didn't match.
+         */
+        const Frame &getLastFrame() const;
+
+        /**
+         * @return The hash of the state after the last frame, if the movie had one for it.
+         */
+        uint32_t getLastHash() const;
+
+    private:
+        NES *nes;
+        Reader *reader;
+
+        Status status;
+        uint64_t frame;
+        Frame lastFrame;
+        uint32_t lastHash;
+
+        std::vector<uint8_t> scratch;
+    };
+}
\ No newline at end of file
@@ -1,19 +1,52 @@
 #include "nes.h"
 
 #include "cartridge.h"
+#include "checkpoint.h"
 #include "cpu.h"
 #include "memory.h"
 #include "mappers.h"
+#include "savestate.h"
 
 #include <utility>
+#include <cstring>
+
+const size_t NES::CONTROLLER_PORTS;
+
+static const char STATE_MAGIC_BYTES[4] = { 'N', 'S', 'S', '\x1A' };
+
+// What a state records about the cartridge it was made with, to refuse states from other games.
+struct StateCartridgeInfo {
+    uint32_t mapperNumber;
+    uint32_t prgROMSize;
+    uint32_t chrSize;
+    uint32_t prgRAMSize;
+};
+
+static StateCartridgeInfo getStateCartridgeInfo(const Cartridge &cartridge) {
+    StateCartridgeInfo info = {};
+    info.mapperNumber = cartridge.getMapperNumber();
+    info.prgROMSize = (uint32_t)cartridge.getPRGROMSize();
+    info.chrSize = (uint32_t)cartridge.getCHRSize();
+    info.prgRAMSize = (uint32_t)(cartridge.getPRGRAMCount() * iNES::PRG_RAM_SIZE);
+    return info;
+}
 
 NES::NES(Cartridge &cartridge)
-    : cartridge(std::move(cartridge)),
+    : scheduler(),
       cpu(this),
+      mem(this),
       ppu(this),
-      mem(this)
+      apu(this),
+      controllers(),
+      inputQueue(nullptr),
+      checkpointWriter(nullptr),
+      diagnostics(),
+      cartridge(std::move(cartridge)),
+      knownStateSize(0)
 {
+    this->cartridge.allocateRAM();
     this->cartridge.initMapper(this);
+    mem.setMapper(this->cartridge.getMapper());
     cpu.jump(mem.getResetVector());
 }
 
@@ -32,3 +65,253 @@ Cartridge *NES::getCartridge() {
 PPU *NES::getPPU() {
     return &ppu;
 }
+
+APU *NES::getAPU() {
+    return &apu;
+}
+
+Scheduler *NES::getScheduler() {
+    return &scheduler;
+}
+
+Diagnostics *NES::getDiagnostics() {
+    return &diagnostics;
+}
+
+Controller *NES::getController(size_t port) {
+    return &controllers[port];
+}
+
+void NES::setInputQueue(InputQueue *queue) {
+    inputQueue = queue;
+}
+
+void NES::setCheckpointWriter(Checkpoint::Writer *writer) {
+    checkpointWriter = writer;
+}
+
+void NES::pollInput() {
+    if (inputQueue == nullptr) {
+        return;
+    }
+
+    InputEvent event;
+
+    while (inputQueue->peek(event) && event.time <= scheduler.getTime()) {
+        if (event.port < CONTROLLER_PORTS) {
+            controllers[event.port].setButtons(event.buttons);
+        }
+
+        inputQueue->pop();
+    }
+}
+
+unsigned int NES::step() {
+    unsigned int cycles = cpu.step();
+
+    if (cycles == 0) {
+        // Jammed and unsupported instructions take no time of their own, but the rest of the system keeps going.
+        cycles = 1;
+    }
+
+    scheduler.advance(cycles * PPU::DOTS_PER_CPU_CYCLE);
+    handleDueEvents();
+    return cycles;
+}
+
+void NES::handleDueEvents() {
+    EventType type;
+
+    while (scheduler.hasDueEvent() && scheduler.popDueEvent(&type)) {
+        switch (type) {
+            case EventType::PPU: {
+                const uint64_t frame = ppu.getFrame();
+                ppu.handleEvent();
+
+                if (ppu.getFrame() != frame) {
+                    apu.endFrame();
+
+                    if (checkpointWriter != nullptr) {
+                        checkpointWriter->record(*this);
+                    }
+                }
+                break;
+            }
+
+            case EventType::APU:
+                apu.handleEvent();
+                break;
+
+            case EventType::MAPPER:
+                if (cartridge.getMapper() != nullptr) {
+                    cartridge.getMapper()->handleEvent();
+                }
+                break;
+
+            case EventType::COUNT:
+                break;
+        }
+    }
+}
+
+void NES::runFrame() {
+    const uint64_t frame = ppu.getFrame();
+
+    while (ppu.getFrame() == frame) {
+        step();
+    }
+}
+
+std::unique_ptr<NES> NES::clone() const {
+    Cartridge copy(cartridge.getROM());
+    std::unique_ptr<NES> nes(new NES(copy));
+
+    // The save state covers everything but the output, and loading it reuses the new instance's buffers.
+    std::vector<uint8_t> state;
+    saveState(state);
+    nes->knownStateSize = knownStateSize;
+    nes->loadState(state.data(), state.size());
+
+    nes->ppu.framebuffer = ppu.framebuffer;
+    nes->ppu.outputSuppressed = ppu.outputSuppressed;
+    nes->diagnostics = diagnostics;
+
+    return nes;
+}
+
+void NES::reset(ResetType type) {
+    if (type == ResetType::SOFT) {
+        cpu.reset();
+        ppu.reset();
+        apu.reset();
+    } else {
+        // In the same order as the constructor, which is the order the components expect.
+        scheduler.reset();
+        cpu.powerOn();
+        mem.powerOn();
+        ppu.powerOn();
+        apu.powerOn();
+
+        for (Controller &controller : controllers) {
+            controller = Controller();
+        }
+
+        const bool verbose = diagnostics.verbose;
+        diagnostics = Diagnostics();
+        diagnostics.verbose = verbose;
+
+        cartridge.powerOn();
+    }
+
+    cpu.jump(mem.getResetVector());
+}
+
+void NES::insertCartridge(std::shared_ptr<const ROMImage> rom) {
+    const uint16_t oldMapperNumber = cartridge.getMapperNumber();
+    const bool hadMapper = cartridge.getMapper() != nullptr;
+
+    cartridge.setROM(std::move(rom));
+    knownStateSize = 0;
+
+    if (!hadMapper || cartridge.getMapperNumber() != oldMapperNumber) {
+        cartridge.initMapper(this);
+        mem.setMapper(cartridge.getMapper());
+    }
+
+    reset(ResetType::POWER_ON);
+}
+
+size_t NES::getMemoryUsage() const {
+    return sizeof(NES) + cartridge.prgramSize + cartridge.chrramSize + ppu.framebuffer.capacity() +
+           apu.blip.getMemoryUsage();
+}
+
+void NES::saveState(std::vector<uint8_t> &outState) const {
+    StateWriter writer(outState);
+    const StateCartridgeInfo info = getStateCartridgeInfo(cartridge);
+
+    outState.clear();
+
+    writer.write(STATE_MAGIC_BYTES);
+    writer.write(SAVE_STATE_VERSION);
+    writer.write((uint32_t)0); // Size, filled in below.
+    writer.write(info);
+
+    scheduler.saveState(writer);
+    cpu.saveState(writer);
+    ppu.saveState(writer);
+    mem.saveState(writer);
+    cartridge.saveState(writer);
+
+    for (const Controller &controller : controllers) {
+        controller.saveState(writer);
+    }
+
+    apu.saveState(writer);
+
+    const uint32_t size = (uint32_t)outState.size();
+    std::memcpy(outState.data() + sizeof(STATE_MAGIC_BYTES) + sizeof(SAVE_STATE_VERSION), &size, sizeof(size));
+    knownStateSize = size;
+}
+
+size_t NES::getStateSize() const {
+    if (knownStateSize == 0) {
+        std::vector<uint8_t> state;
+        saveState(state);
+    }
+
+    return knownStateSize;
+}
+
+StateLoadError NES::loadState(const uint8_t *state, size_t size) {
+    StateReader reader(state, size);
+
+    char magic[sizeof(STATE_MAGIC_BYTES)] = {};
+    uint32_t version = 0;
+    uint32_t stateSize = 0;
+    StateCartridgeInfo info = {};
+
+    reader.read(magic);
+    reader.read(version);
+    reader.read(stateSize);
+    reader.read(info);
+
+    if (reader.hasFailed()) {
+        return StateLoadError::TRUNCATED;
+    }
+
+    if (std::memcmp(magic, STATE_MAGIC_BYTES, sizeof(STATE_MAGIC_BYTES)) != 0) {
+        return StateLoadError::MAGIC_BYTES_MISMATCH;
+    }
+
+    if (version != SAVE_STATE_VERSION) {
+        return StateLoadError::VERSION_MISMATCH;
+    }
+
+    const StateCartridgeInfo expected = getStateCartridgeInfo(cartridge);
+
+    if (std::memcmp(&info, &expected, sizeof(info)) != 0) {
+        return StateLoadError::CARTRIDGE_MISMATCH;
+    }
+
+    // The layout is fixed for a given machine, so once the size matches this machine's own states every read below
+    // succeeds and the load can't fail halfway through. The cartridge info alone doesn't pin the size down; four-screen
+    // VRAM, for one, isn't part of it.
+    if (stateSize != size || size != getStateSize()) {
+        return StateLoadError::TRUNCATED;
+    }
+
+    scheduler.loadState(reader);
+    cpu.loadState(reader);
+    ppu.loadState(reader);
+    mem.loadState(reader);
+    cartridge.loadState(reader);
+
+    for (Controller &controller : controllers) {
+        controller.loadState(reader);
+    }
+
+    apu.loadState(reader);
+
+    return reader.hasFailed() ? StateLoadError::TRUNCATED : StateLoadError::NO_ERROR;
+}
\ No newline at end of file
@@ -1,12 +1,33 @@
 #pragma once
 
+#include "apu.h"
 #include "cartridge.h"
+#include "controller.h"
 #include "cpu.h"
+#include "diagnostics.h"
+#include "inputqueue.h"
 #include "ppu.h"
 #include "memory.h"
+#include "scheduler.h"
+#include "savestate.h"
+
+#include <vector>
+#include <memory>
+#include <cstdint>
+
+enum class ResetType {
+    SOFT,       // The reset button: the CPU and PPU restart, RAM and the mapper keep their contents.
+    POWER_ON    // Everything goes back to the state of a newly constructed NES.
+};
+
+namespace Checkpoint {
+    class Writer;
+}
 
 class NES {
 public:
+    static const size_t CONTROLLER_PORTS = 2;
+
     /**
      * Constructs a NES, initialised with the given Cartridge. The Cartridge object is _moved_!! This means you cannot
      * use the object afterwards, you must make a copy.
@@ -14,17 +35,125 @@ public:
      */
     NES(Cartridge &cartridge);
 
+    /*
+     * Every component keeps a pointer back to its NES, so a memberwise copy would leave the copy's components
+     * pointing at the original. Use clone() instead.
+     */
+    NES(const NES &) = delete;
+
+    NES &operator=(const NES &) = delete;
+
+    /**
+     * Creates an independent NES in the same state as this one, e.g. to fork a search tree. The ROM image is shared;
+     * everything the game can change (RAM, VRAM, cartridge RAM, registers, pending events) is copied, along with the
+     * framebuffer, the output suppression setting and the diagnostics.
+     *
+     * The copy is eager. The mutable state is only about 14 KB plus the framebuffer, so copying it outright takes a
+     * few microseconds, less than the page faults copy-on-write would cost as soon as the fork runs a frame (which
+     * touches RAM, VRAM and OAM in nearly every game), and without adding an indirection to every memory access.
+     * Suppress the PPU's output on machines that are only searched: they never allocate a framebuffer, so neither do
+     * their clones.
+     */
+    std::unique_ptr<NES> clone() const;
+
+    /**
+     * Resets the machine in place, without allocating, and jumps to the reset vector. Settings (PPU output
+     * suppression, diagnostics verbosity, forced MMC3 A12 mode) are kept.
+     */
+    void reset(ResetType type);
+
+    /**
+     * Swaps in another game and powers on. The RAM buffers are reused when they are big enough, and so is the mapper
+     * if the new game uses the same one; only a different mapper is allocated anew.
+     */
+    void insertCartridge(std::shared_ptr<const ROMImage> rom);
+
+    /**
+     * @return Roughly how many bytes this instance takes: the NES object, which holds all of the fixed-size state, plus
+     * its cartridge RAM, framebuffer and audio buffer. The mapper's own few dozen bytes aren't counted.
+     */
+    size_t getMemoryUsage() const;
+
     Cartridge *getCartridge();
 
     CPU *getCPU();
 
     PPU *getPPU();
 
+    APU *getAPU();
+
     Memory *getMemory();
 
+    Scheduler *getScheduler();
+
+    Diagnostics *getDiagnostics();
+
+    /**
+     * @param port 0 for the controller at $4016, 1 for the one at $4017.
+     */
+    Controller *getController(size_t port);
+
+    /**
+     * Feeds the controllers from a queue instead of (or as well as) Controller::setButtons(). The queue is read from
+     * the thread that runs the NES whenever the game strobes the controllers. Pass nullptr to detach it.
+     */
+    void setInputQueue(InputQueue *queue);
+
+    /**
+     * Applies every event in the input queue that is due by now. Called by Memory when $4016 is written.
+     */
+    void pollInput();
+
+    /**
+     * Has a checkpoint record written at the end of every frame, i.e. at the start of each vertical blank. Pass
+     * nullptr to stop.
+     */
+    void setCheckpointWriter(Checkpoint::Writer *writer);
+
+    /**
+     * Executes one CPU instruction (or interrupt) and handles every event that came due in the meantime.
+     * @return The number of CPU cycles that passed.
+     */
+    unsigned int step();
+
+    /**
+     * Handles every event that is due by the current time. step() does this after each instruction; this is for
+     * code that executes the CPU's instructions itself and advances the scheduler, like VectorLockstep.
+     */
+    void handleDueEvents();
+
+    /**
+     * Steps until the PPU has finished the current frame, i.e. until the start of the next vertical blank.
+     */
+    void runFrame();
+
+    /**
+     * Saves the state of the whole machine: CPU, RAM, PPU, APU, cartridge RAM and mapper, and the scheduler.
+     * @param outState Receives the state. Its previous contents are discarded, but its capacity is reused, so saving
+     * into the same vector every frame doesn't allocate.
+     */
+    void saveState(std::vector<uint8_t> &outState) const;
+
+    /**
+     * Restores a state saved by saveState() with the same cartridge. Nothing is reallocated; every buffer is
+     * overwritten in place. If an error is returned, the machine is unchanged.
+     */
+    StateLoadError loadState(const uint8_t *state, size_t size);
+
 private:
-    Cartridge cartridge;
+    // Laid out roughly in the order the CPU loop touches things: the scheduler and the CPU on every step, RAM on
+    // nearly every instruction, the PPU and the controllers on register accesses, the rest rarely.
+    Scheduler scheduler; // Must come before the components, they schedule their first events on construction.
     CPU cpu;
-    PPU ppu;
     Memory mem;
+    PPU ppu;
+    APU apu;
+    Controller controllers[CONTROLLER_PORTS];
+    InputQueue *inputQueue;
+    Checkpoint::Writer *checkpointWriter;
+    Diagnostics diagnostics;
+    Cartridge cartridge;
+    mutable size_t knownStateSize; // The size of this machine's save states, or 0 until one has been saved.
+
+    size_t getStateSize() const;
 };
@@ -19,9 +19,16 @@
 #include <iostream>
 
 static unsigned int unsupported(CPU *cpu, Op::Operands &operands, const Op::Opcode *opcode) {
-    std::cerr << "Opcode $";
-    Utils::writeHexToStream(std::cerr, opcode->code);
-    std::cerr << " (" << opcode->name << ") is not supported!\n";
+    Diagnostics *diagnostics = cpu->getNES()->getDiagnostics();
+    diagnostics->unsupportedOpcodes.set(opcode->code);
+    diagnostics->unsupportedOpcodeCount++;
+
+    if (diagnostics->verbose) {
+        std::cerr << "Opcode $";
+        Utils::writeHexToStream(std::cerr, opcode->code);
+        std::cerr << " (" << opcode->name << ") is not supported!\n";
+    }
+
     return 0;
 }
 
@@ -109,7 +116,7 @@ static const Opcode OPCODES[] = {
     Opcode { 0x3A, 2, "NOP", AM::IMPLICIT, unsupported },
     Opcode { 0x3B, 7, "RLA", AM::ABSOLUTE_Y, unsupported },
     Opcode { 0x3C, 4, "NOP", AM::ABSOLUTE_X, unsupported },
-    Opcode { 0x3D, 4, "AND", AM::ABSOLUTE, Op::_and },
+    Opcode { 0x3D, 4, "AND", AM::ABSOLUTE_X, Op::_and },
     Opcode { 0x3E, 7, "ROL", AM::ABSOLUTE_X, Op::rol },
     Opcode { 0x3F, 7, "RLA", AM::ABSOLUTE_X, unsupported },
 
@@ -157,7 +164,7 @@ static const Opcode OPCODES[] = {
      * 0x60 - 0x6F
      */
     Opcode { 0x60, 6, "RTS", AM::IMPLICIT, Op::rts },
-    Opcode { 0x61, 6, "ADC", AM::INDIRECT_INDEXED, Op::adc },
+    Opcode { 0x61, 6, "ADC", AM::INDEXED_INDIRECT, Op::adc },
     Opcode { 0x62, 0, "KIL", AM::IMPLICIT, unsupported },
     Opcode { 0x63, 8, "RRA", AM::INDEXED_INDIRECT, unsupported },
     Opcode { 0x64, 3, "NOP", AM::ZERO_PAGE, unsupported },
@@ -3,45 +3,148 @@
 #include "utils.h"
 #include "nes.h"
 #include "memory.h"
+#include "mapper.h"
+#include "scheduler.h"
+#include "savestate.h"
 
 #include <iostream>
 #include <algorithm>
 
-const size_t PPU::SPRITE_SIZE = 0x4;
-const size_t PPU::OBJECT_ATTRIBUTE_MEMORY_SIZE = 64 * SPRITE_SIZE;
+const size_t PPU::SPRITE_SIZE;
+const size_t PPU::OBJECT_ATTRIBUTE_MEMORY_SIZE;
+
+const unsigned int PPU::SCREEN_WIDTH = 256;
+const unsigned int PPU::SCREEN_HEIGHT = 240;
+
+// What getFramebuffer() returns until the first frame is drawn.
+static const uint8_t BLANK_FRAMEBUFFER[PPU::SCREEN_WIDTH * PPU::SCREEN_HEIGHT] = {};
+
+static const unsigned int SPRITES_PER_SCANLINE = 8;
+static const uint8_t SPRITE_PIXEL_BEHIND = 1 << 6;  // The sprite is behind the background.
+static const uint8_t SPRITE_PIXEL_ZERO = 1 << 7;    // The pixel comes from sprite 0.
+static const Address SCROLL_X_MASK = 0x041F;        // Coarse X and the horizontal nametable bit.
+static const unsigned int OAM_DMA_CYCLES = 513;
+
+/*
+ * Where the fetches are made on a rendered scanline, in dots from its start. Each tile takes 8 dots: the nametable
+ * byte, the attribute byte and the two pattern planes, each put on the bus 2 dots after the last. Sprite slots fetch
+ * two nametable bytes nobody uses in place of the first two.
+ */
+static const unsigned int DOTS_PER_FETCH = 2;
+static const unsigned int DOTS_PER_TILE = 4 * DOTS_PER_FETCH;
+static const unsigned int BACKGROUND_FETCH_DOT = 1;     // Tiles 2-33 of the scanline.
+static const unsigned int SPRITE_FETCH_DOT = 257;
+static const unsigned int PREFETCH_DOT = 321;           // Tiles 0 and 1 of the next scanline, then two nametable bytes.
+static const unsigned int PREFETCH_TILES = 2;
+static const unsigned int BACKGROUND_TILES = 34;        // 33 can show with fine X scrolling; the PPU fetches one more.
+
+static Address getNametableAddress(Address v) {
+    return (Address)(0x2000 | (v & 0x0FFF));
+}
+
+static Address getAttributeAddress(Address v) {
+    return (Address)(0x23C0 | (v & 0x0C00) | ((v >> 4) & 0x38) | ((v >> 2) & 0x07));
+}
+
+static Address incrementCoarseX(Address v) {
+    // Coarse X wraps into the horizontally adjacent nametable.
+    return (v & 0x001F) == 0x001F ? (Address)((v & ~0x001F) ^ 0x0400) : (Address)(v + 1);
+}
+
+const unsigned int PPU::DOTS_PER_CPU_CYCLE = 3;
+const unsigned int PPU::DOTS_PER_SCANLINE = 341;
+const unsigned int PPU::SCANLINES_PER_FRAME = 262;
+const unsigned int PPU::DOTS_PER_FRAME = DOTS_PER_SCANLINE * SCANLINES_PER_FRAME;
+const unsigned int PPU::VBLANK_SCANLINE = 241;
+const unsigned int PPU::PRE_RENDER_SCANLINE = 261;
 
 PPU::PPU(NES *nes)
     : nes(nes),
+      nextEvent(Event::RENDER_SCANLINE),
+      eventTime(0),
+      frame(0),
       controlFlags((PPUControlFlag)0x00),
       maskFlags((PPUMaskFlag)0x00),
       statusFlags((PPUStatusFlag)0x00),
       ppuLatch(0x00),
+      readBuffer(0x00),
       addressLatch(false),
-      scrollX(0), scrollY(0),
       address(0x0000),
-      oam(OBJECT_ATTRIBUTE_MEMORY_SIZE, 0x00)
+      tempAddress(0x0000),
+      fineX(0),
+      oamAddress(0),
+      oam(),
+      framebuffer(),
+      outputSuppressed(false),
+      busTime(Scheduler::NEVER)
 {
+    // Power on at the top of the picture, so the first frame is drawn completely (in the backdrop colour, as
+    // rendering starts out disabled) and doesn't depend on what the framebuffer held before.
+    scheduleEvent(Event::RENDER_SCANLINE, 0, SCREEN_WIDTH);
+}
+
+void PPU::powerOn() {
+    // The mapper isn't notified: it is powered on after the PPU and picks up the configuration then.
+    frame = 0;
+    controlFlags = (PPUControlFlag)0x00;
+    maskFlags = (PPUMaskFlag)0x00;
+    statusFlags = (PPUStatusFlag)0x00;
+    ppuLatch = 0x00;
+    readBuffer = 0x00;
+    addressLatch = false;
+    address = 0x0000;
+    tempAddress = 0x0000;
+    fineX = 0;
+    oamAddress = 0;
+    std::fill(oam, oam + OBJECT_ATTRIBUTE_MEMORY_SIZE, 0x00);
+
+    eventTime = nes->getScheduler()->getTime();
+    scheduleEvent(Event::RENDER_SCANLINE, 0, SCREEN_WIDTH);
+}
+
+void PPU::reset() {
+    controlFlags = (PPUControlFlag)0x00;
+    maskFlags = (PPUMaskFlag)0x00;
+    readBuffer = 0x00;
+    addressLatch = false;
+    tempAddress = 0x0000;
+    fineX = 0;
+
+    notifyMapper();
 }
 
 void PPU::writeRegister(PPURegister reg, uint8_t value) {
     ppuLatch = value;
 
     switch (reg) {
-        case PPURegister::PPUCTRL:
+        case PPURegister::PPUCTRL: {
+            const bool nmiWasEnabled = isControlFlagSet(PPUControlFlag::NMI_ENABLE);
             controlFlags = (PPUControlFlag)value;
+            tempAddress = (Address)((tempAddress & ~0x0C00) | ((value & 0x03) << 10));
+
+            // Enabling NMIs in the middle of vertical blank fires one straight away.
+            if (!nmiWasEnabled && isControlFlagSet(PPUControlFlag::NMI_ENABLE) &&
+                isStatusFlagSet(PPUStatusFlag::VERTICAL_BLANK)) {
+                nes->getCPU()->triggerNMI();
+            }
+
+            notifyMapper();
             break;
+        }
 
         case PPURegister::PPUMASK:
             maskFlags = (PPUMaskFlag)value;
+            notifyMapper();
             break;
 
         case PPURegister::PPUSCROLL:
             if (!addressLatch) {
-                // First write
-                scrollX = value;
+                // First write: X scroll.
+                tempAddress = (Address)((tempAddress & ~0x001F) | (value >> 3));
+                fineX = value & 0x07;
             } else {
-                // Second write
-                scrollY = value;
+                // Second write: Y scroll.
+                tempAddress = (Address)((tempAddress & ~0x73E0) | ((value & 0x07) << 12) | ((value & 0xF8) << 2));
             }
 
             addressLatch = !addressLatch;
@@ -49,18 +152,19 @@ void PPU::writeRegister(PPURegister reg, uint8_t value) {
 
         case PPURegister::PPUADDR:
             if (!addressLatch) {
-                // First write
-                address = (uint16_t)value << 8;
+                // First write: high byte. Only 14 bits are kept.
+                tempAddress = (Address)((tempAddress & 0x00FF) | ((value & 0x3F) << 8));
             } else {
-                // Second write
-                address |= value;
+                // Second write: low byte, after which the address takes effect.
+                tempAddress = (Address)((tempAddress & 0xFF00) | value);
+                address = tempAddress;
             }
 
             addressLatch = !addressLatch;
             break;
 
         case PPURegister::PPUDATA:
-            nes->getMemory()->writePPU(address, value);
+            nes->getMemory()->writePPU(address & 0x3FFF, value);
             incrementAddress();
             break;
 
@@ -73,13 +177,15 @@ void PPU::writeRegister(PPURegister reg, uint8_t value) {
             break;
 
         case PPURegister::OAMDMA: {
+            // Copies a page of CPU memory into OAM, starting at OAMADDR. The CPU is halted while it does.
             const Memory *mem = nes->getMemory();
             const Address start = (Address)value << 8;
 
-            for (Address i = 0; i < oam.size(); i++) {
-                oam[i] = mem->readPPU(i + start);
+            for (Address i = 0; i < OBJECT_ATTRIBUTE_MEMORY_SIZE; i++) {
+                oam[(oamAddress + i) & 0xFF] = mem->readCPU(start + i);
             }
 
+            nes->getCPU()->stall(OAM_DMA_CYCLES);
             break;
         }
 
@@ -90,12 +196,29 @@ void PPU::writeRegister(PPURegister reg, uint8_t value) {
 
 uint8_t PPU::readRegister(PPURegister reg) {
     switch (reg) {
-        case PPURegister::PPUSTATUS:
-            return (uint8_t)statusFlags | (ppuLatch & (uint8_t)0b00011111);
+        case PPURegister::PPUSTATUS: {
+            const uint8_t status = (uint8_t)statusFlags | (ppuLatch & (uint8_t)0b00011111);
+            setStatusFlag(PPUStatusFlag::VERTICAL_BLANK, false);
+            addressLatch = false;
+            return status;
+        }
+
+        case PPURegister::PPUDATA: {
+            const Address vramAddress = address & 0x3FFF;
+            const Memory *mem = nes->getMemory();
+            uint8_t value = readBuffer;
+
+            if (vramAddress >= 0x3F00) {
+                // Palette reads are immediate, but still fill the buffer, with the nametable byte "underneath".
+                value = mem->readPPU(vramAddress);
+                readBuffer = mem->readPPU(vramAddress - 0x1000);
+            } else {
+                readBuffer = mem->readPPU(vramAddress);
+            }
 
-        case PPURegister::PPUDATA:
             incrementAddress();
-            return nes->getMemory()->readPPU(address);
+            return value;
+        }
 
         case PPURegister::OAMDATA:
             return oam[oamAddress++];
@@ -126,8 +249,9 @@ bool PPU::getRegisterFromAddress(Address address, PPURegister *outReg) {
         return false;
     }
 
-    if (Utils::inRange(address, 0x2000, 0x2007)) {
-        *outReg = (PPURegister)(address - 0x2000);
+    if (Utils::inRange(address, 0x2000, 0x3FFF)) {
+        // The eight registers are mirrored all the way up to $3FFF.
+        *outReg = (PPURegister)(address & 0x0007);
         return true;
     } else if (address == 0x4014) {
         *outReg = PPURegister::OAMDMA;
@@ -169,3 +293,459 @@ void PPU::incrementAddress() {
     }
 }
 
+bool PPU::isRenderingEnabled() const {
+    return isMaskFlagSet(PPUMaskFlag::SHOW_BACKGROUND) || isMaskFlagSet(PPUMaskFlag::SHOW_SPRITES);
+}
+
+unsigned int PPU::getScanline() const {
+    return (unsigned int)(nes->getScheduler()->getTime() % DOTS_PER_FRAME) / DOTS_PER_SCANLINE;
+}
+
+unsigned int PPU::getDot() const {
+    return (unsigned int)(nes->getScheduler()->getTime() % DOTS_PER_FRAME) % DOTS_PER_SCANLINE;
+}
+
+uint64_t PPU::getFrame() const {
+    return frame;
+}
+
+const uint8_t *PPU::getFramebuffer() const {
+    return framebuffer.empty() ? BLANK_FRAMEBUFFER : framebuffer.data();
+}
+
+const uint8_t *PPU::getOAM() const {
+    return oam;
+}
+
+void PPU::setOutputSuppressed(bool suppressed) {
+    outputSuppressed = suppressed;
+}
+
+bool PPU::isOutputSuppressed() const {
+    return outputSuppressed;
+}
+
+uint64_t PPU::getBusTime() const {
+    return busTime != Scheduler::NEVER ? busTime : nes->getScheduler()->getTime();
+}
+
+void PPU::handleEvent() {
+    switch (nextEvent) {
+        case Event::VBLANK_START:
+            setStatusFlag(PPUStatusFlag::VERTICAL_BLANK, true);
+            frame++;
+
+            if (isControlFlagSet(PPUControlFlag::NMI_ENABLE)) {
+                nes->getCPU()->triggerNMI();
+            }
+
+            scheduleEvent(Event::PRE_RENDER_START, PRE_RENDER_SCANLINE, 1);
+            break;
+
+        case Event::PRE_RENDER_START:
+            setStatusFlag(PPUStatusFlag::VERTICAL_BLANK, false);
+            setStatusFlag(PPUStatusFlag::SPRITE_0_HIT, false);
+            setStatusFlag(PPUStatusFlag::SPRITE_OVERFLOW, false);
+
+            // The scroll position is reloaded for the new frame. The real PPU does this over the course of the
+            // pre-render scanline; games only write the scroll registers during vertical blank, so doing it all
+            // now makes no difference.
+            if (isRenderingEnabled()) {
+                address = tempAddress;
+            }
+
+            scheduleEvent(Event::PRE_RENDER_SCANLINE, PRE_RENDER_SCANLINE, SCREEN_WIDTH);
+            break;
+
+        case Event::PRE_RENDER_SCANLINE:
+            // Nothing is drawn, so the fetches only matter to a mapper that watches them. The sprite slots are empty.
+            if (isRenderingEnabled() && isBusWatched()) {
+                const uint64_t lineStart = getScanlineStart(PRE_RENDER_SCANLINE);
+
+                renderBackground(lineStart, nullptr);
+                fetchEmptySpriteSlots(0, lineStart);
+                prefetchBackground(lineStart);
+            }
+
+            scheduleEvent(Event::RENDER_SCANLINE, 0, SCREEN_WIDTH);
+            break;
+
+        case Event::RENDER_SCANLINE: {
+            const unsigned int scanline = (unsigned int)(eventTime % DOTS_PER_FRAME) / DOTS_PER_SCANLINE;
+
+            renderScanline(scanline);
+
+            if (isRenderingEnabled()) {
+                incrementScrollY();
+                copyScrollX();
+
+                if (isBusWatched()) {
+                    prefetchBackground(getScanlineStart(scanline));
+                }
+            }
+
+            if (scanline + 1 < SCREEN_HEIGHT) {
+                scheduleEvent(Event::RENDER_SCANLINE, scanline + 1, SCREEN_WIDTH);
+            } else {
+                scheduleEvent(Event::VBLANK_START, VBLANK_SCANLINE, 1);
+            }
+
+            break;
+        }
+    }
+}
+
+void PPU::renderScanline(unsigned int scanline) {
+    const bool showBackground = isMaskFlagSet(PPUMaskFlag::SHOW_BACKGROUND);
+    const bool showSprites = isMaskFlagSet(PPUMaskFlag::SHOW_SPRITES);
+    const uint8_t *palette = nes->getMemory()->getPaletteRAM();
+
+    uint8_t background[SCREEN_WIDTH] = {};
+    uint8_t sprites[SCREEN_WIDTH] = {};
+
+    if (showBackground || showSprites) {
+        // A mapper that watches the bus sees every fetch the PPU makes, in order, whatever is shown and whether or not
+        // the output is suppressed. Otherwise the fetches have no side effects, and only those whose data is needed
+        // are made.
+        const uint64_t lineStart = getScanlineStart(scanline);
+        const bool watched = isBusWatched();
+
+        if (watched) {
+            renderBackground(lineStart, background);
+        }
+
+        renderSprites(scanline, lineStart, sprites);
+
+        // With output suppressed, the background is only needed to find a sprite 0 hit.
+        bool needBackground = showBackground;
+
+        if (outputSuppressed) {
+            needBackground = showBackground && showSprites && !isStatusFlagSet(PPUStatusFlag::SPRITE_0_HIT) &&
+                             std::any_of(sprites, sprites + SCREEN_WIDTH, [](uint8_t pixel) {
+                                 return (pixel & SPRITE_PIXEL_ZERO) != 0;
+                             });
+        }
+
+        if (!watched && needBackground) {
+            renderBackground(lineStart, background);
+        }
+
+        if (!showBackground) {
+            std::fill(background, background + SCREEN_WIDTH, 0);
+        }
+
+        if (!showSprites) {
+            std::fill(sprites, sprites + SCREEN_WIDTH, 0);
+        }
+
+        // Nothing to draw and no sprite 0 hit to find.
+        if (outputSuppressed && !needBackground) {
+            return;
+        }
+    } else if (outputSuppressed) {
+        return;
+    }
+
+    const unsigned int backgroundStart = isMaskFlagSet(PPUMaskFlag::SHOW_BACKGROUND_LEFT_COLUMN) ? 0 : 8;
+    const unsigned int spriteStart = isMaskFlagSet(PPUMaskFlag::SHOW_SPRITES_LEFT_COLUMN) ? 0 : 8;
+    const uint8_t colorMask = isMaskFlagSet(PPUMaskFlag::GREYSCALE) ? 0x30 : 0x3F;
+
+    // The framebuffer is only allocated once something is drawn, so machines that never show anything (search tree
+    // nodes, run-ahead forks) don't carry it around.
+    if (!outputSuppressed && framebuffer.empty()) {
+        framebuffer.resize(SCREEN_WIDTH * SCREEN_HEIGHT, 0x00);
+    }
+
+    uint8_t *out = outputSuppressed ? nullptr : framebuffer.data() + scanline * SCREEN_WIDTH;
+
+    for (unsigned int x = 0; x < SCREEN_WIDTH; x++) {
+        const uint8_t backgroundPixel = x >= backgroundStart ? background[x] : 0;
+        const uint8_t spritePixel = x >= spriteStart ? sprites[x] : 0;
+        const uint8_t spriteColor = spritePixel & 0x1F;
+
+        if ((spritePixel & SPRITE_PIXEL_ZERO) != 0 && spriteColor != 0 && backgroundPixel != 0 && x != 255) {
+            setStatusFlag(PPUStatusFlag::SPRITE_0_HIT, true);
+        }
+
+        if (outputSuppressed) {
+            continue;
+        }
+
+        uint8_t color = 0;
+
+        if (spriteColor != 0 && (backgroundPixel == 0 || (spritePixel & SPRITE_PIXEL_BEHIND) == 0)) {
+            color = spriteColor;
+        } else if (backgroundPixel != 0) {
+            color = backgroundPixel;
+        }
+
+        out[x] = palette[color] & colorMask;
+    }
+}
+
+void PPU::renderBackground(uint64_t lineStart, uint8_t *outPixels) {
+    const Memory *mem = nes->getMemory();
+    const Address patternTable = isControlFlagSet(PPUControlFlag::BACKGROUND_PATTERN_TABLE) ? 0x1000 : 0x0000;
+    const unsigned int fineY = (address >> 12) & 0x07;
+
+    uint8_t pixels[BACKGROUND_TILES * 8];
+    Address v = address;
+
+    for (unsigned int tile = 0; tile < BACKGROUND_TILES; v = incrementCoarseX(v), tile++) {
+        const bool prefetched = tile < PREFETCH_TILES;
+
+        if (prefetched && outPixels == nullptr) {
+            continue;
+        }
+
+        const uint64_t time =
+            prefetched ? 0 : lineStart + BACKGROUND_FETCH_DOT + (tile - PREFETCH_TILES) * DOTS_PER_TILE;
+        const Address nametableAddress = getNametableAddress(v);
+        const Address attributeAddress = getAttributeAddress(v);
+
+        const uint8_t index = prefetched ? mem->peekPPU(nametableAddress) : fetch(nametableAddress, time);
+        const uint8_t attribute = prefetched ? mem->peekPPU(attributeAddress) :
+                                  fetch(attributeAddress, time + DOTS_PER_FETCH);
+        const Address pattern = (Address)(patternTable + index * 16 + fineY);
+        const uint8_t low = prefetched ? mem->peekPPU(pattern) : fetch(pattern, time + 2 * DOTS_PER_FETCH);
+        const uint8_t high = prefetched ? mem->peekPPU((Address)(pattern + 8)) :
+                             fetch((Address)(pattern + 8), time + 3 * DOTS_PER_FETCH);
+
+        if (outPixels == nullptr) {
+            continue;
+        }
+
+        const uint8_t paletteBits = (uint8_t)(((attribute >> (((v >> 4) & 0x04) | (v & 0x02))) & 0x03) << 2);
+
+        for (unsigned int bit = 0; bit < 8; bit++) {
+            const uint8_t value = (uint8_t)(((low >> (7 - bit)) & 0x01) | (((high >> (7 - bit)) & 0x01) << 1));
+            pixels[tile * 8 + bit] = value != 0 ? (uint8_t)(paletteBits | value) : (uint8_t)0;
+        }
+    }
+
+    if (outPixels != nullptr) {
+        std::copy(pixels + fineX, pixels + fineX + SCREEN_WIDTH, outPixels);
+    }
+}
+
+void PPU::prefetchBackground(uint64_t lineStart) {
+    const Address patternTable = isControlFlagSet(PPUControlFlag::BACKGROUND_PATTERN_TABLE) ? 0x1000 : 0x0000;
+    const unsigned int fineY = (address >> 12) & 0x07;
+    Address v = address;
+
+    for (unsigned int tile = 0; tile < PREFETCH_TILES; v = incrementCoarseX(v), tile++) {
+        const uint64_t time = lineStart + PREFETCH_DOT + tile * DOTS_PER_TILE;
+        const uint8_t index = fetch(getNametableAddress(v), time);
+        fetch(getAttributeAddress(v), time + DOTS_PER_FETCH);
+
+        const Address pattern = (Address)(patternTable + index * 16 + fineY);
+        fetch(pattern, time + 2 * DOTS_PER_FETCH);
+        fetch((Address)(pattern + 8), time + 3 * DOTS_PER_FETCH);
+    }
+
+    const uint64_t time = lineStart + PREFETCH_DOT + PREFETCH_TILES * DOTS_PER_TILE;
+    fetch(getNametableAddress(v), time);
+    fetch(getNametableAddress(v), time + DOTS_PER_FETCH);
+}
+
+void PPU::renderSprites(unsigned int scanline, uint64_t lineStart, uint8_t *outPixels) {
+    const unsigned int height = isControlFlagSet(PPUControlFlag::SPRITE_HEIGHT) ? 16 : 8;
+    const Address nametableAddress = getNametableAddress(address);
+
+    // The first eight sprites on the scanline get a slot; finding a ninth sets the overflow flag.
+    uint8_t slots[SPRITES_PER_SCANLINE];
+    unsigned int count = 0;
+
+    for (unsigned int sprite = 0; sprite < 64; sprite++) {
+        const uint8_t y = oam[sprite * SPRITE_SIZE];
+
+        // OAM holds the Y position minus one.
+        if (scanline < (unsigned int)y + 1 || scanline - y - 1 >= height) {
+            continue;
+        }
+
+        if (count == SPRITES_PER_SCANLINE) {
+            setStatusFlag(PPUStatusFlag::SPRITE_OVERFLOW, true);
+            break;
+        }
+
+        slots[count++] = (uint8_t)sprite;
+    }
+
+    // With output suppressed, only sprite 0's pixels are looked at, and unless a mapper watches the bus, the other
+    // sprites' fetches don't matter either.
+    const bool onlySprite0 = outputSuppressed && !isBusWatched();
+
+    for (unsigned int slot = 0; slot < count; slot++) {
+        const unsigned int sprite = slots[slot];
+
+        if (onlySprite0 && sprite != 0) {
+            continue;
+        }
+
+        const uint8_t *data = &oam[sprite * SPRITE_SIZE];
+        const unsigned int row = scanline - data[0] - 1;
+        const uint8_t attributes = data[2];
+        const unsigned int flippedRow = Utils::isBitSet(attributes, 7) ? height - 1 - row : row;
+        Address pattern;
+
+        if (height == 16) {
+            // 8x16 sprites pick their pattern table with bit 0 of the tile index.
+            pattern = (Address)(((data[1] & 0x01) << 12) + (data[1] & 0xFE) * 16 + (flippedRow >= 8 ? 16 : 0));
+        } else {
+            const Address patternTable = isControlFlagSet(PPUControlFlag::SPRITE_PATTERN_TABLE) ? 0x1000 : 0x0000;
+            pattern = (Address)(patternTable + data[1] * 16);
+        }
+
+        pattern = (Address)(pattern + (flippedRow & 0x07));
+
+        const uint64_t time = lineStart + SPRITE_FETCH_DOT + slot * DOTS_PER_TILE;
+        fetch(nametableAddress, time);
+        fetch(nametableAddress, time + DOTS_PER_FETCH);
+
+        const uint8_t low = fetch(pattern, time + 2 * DOTS_PER_FETCH);
+        const uint8_t high = fetch((Address)(pattern + 8), time + 3 * DOTS_PER_FETCH);
+        const uint8_t flags = (uint8_t)(0x10 | ((attributes & 0x03) << 2) |
+                                        (Utils::isBitSet(attributes, 5) ? SPRITE_PIXEL_BEHIND : 0) |
+                                        (sprite == 0 ? SPRITE_PIXEL_ZERO : 0));
+
+        for (unsigned int bit = 0; bit < 8; bit++) {
+            const unsigned int x = data[3] + bit;
+            const unsigned int shift = Utils::isBitSet(attributes, 6) ? bit : 7 - bit;
+            const uint8_t value = (uint8_t)(((low >> shift) & 0x01) | (((high >> shift) & 0x01) << 1));
+
+            // Sprites earlier in OAM are in front of later ones.
+            if (x < SCREEN_WIDTH && value != 0 && (outPixels[x] & 0x1F) == 0) {
+                outPixels[x] = (uint8_t)(flags | value);
+            }
+        }
+    }
+
+    fetchEmptySpriteSlots(count, lineStart);
+}
+
+void PPU::fetchEmptySpriteSlots(unsigned int slot, uint64_t lineStart) {
+    // Their data is thrown away, so only a mapper watching the bus cares about these fetches.
+    if (!isBusWatched()) {
+        return;
+    }
+
+    const Address nametableAddress = getNametableAddress(address);
+    Address pattern;
+
+    if (isControlFlagSet(PPUControlFlag::SPRITE_HEIGHT)) {
+        pattern = (Address)(0x1000 + 0xFE * 16);
+    } else {
+        pattern = (Address)((isControlFlagSet(PPUControlFlag::SPRITE_PATTERN_TABLE) ? 0x1000 : 0x0000) + 0xFF * 16);
+    }
+
+    for (; slot < SPRITES_PER_SCANLINE; slot++) {
+        const uint64_t time = lineStart + SPRITE_FETCH_DOT + slot * DOTS_PER_TILE;
+        fetch(nametableAddress, time);
+        fetch(nametableAddress, time + DOTS_PER_FETCH);
+        fetch(pattern, time + 2 * DOTS_PER_FETCH);
+        fetch((Address)(pattern + 8), time + 3 * DOTS_PER_FETCH);
+    }
+}
+
+uint8_t PPU::fetch(Address address, uint64_t time) {
+    busTime = time;
+    const uint8_t value = nes->getMemory()->readPPU(address);
+    busTime = Scheduler::NEVER;
+
+    return value;
+}
+
+bool PPU::isBusWatched() const {
+    const Mapper *mapper = nes->getCartridge()->getMapper();
+    return mapper != nullptr && mapper->isHooked(MapperHook::PPU_READ);
+}
+
+uint64_t PPU::getScanlineStart(unsigned int scanline) const {
+    return eventTime - eventTime % DOTS_PER_FRAME + scanline * DOTS_PER_SCANLINE;
+}
+
+void PPU::incrementScrollY() {
+    if ((address & 0x7000) != 0x7000) {
+        address += 0x1000;
+        return;
+    }
+
+    // Fine Y overflows into coarse Y, which wraps into the vertically adjacent nametable after row 29.
+    address &= ~0x7000;
+    unsigned int coarseY = (address & 0x03E0) >> 5;
+
+    if (coarseY == 29) {
+        coarseY = 0;
+        address ^= 0x0800;
+    } else if (coarseY == 31) {
+        coarseY = 0;
+    } else {
+        coarseY++;
+    }
+
+    address = (Address)((address & ~0x03E0) | (coarseY << 5));
+}
+
+void PPU::copyScrollX() {
+    address = (Address)((address & ~SCROLL_X_MASK) | (tempAddress & SCROLL_X_MASK));
+}
+
+void PPU::scheduleEvent(Event event, unsigned int scanline, unsigned int dot) {
+    // Frames are a fixed number of dots long and frame 0 starts at time 0, so a position within the frame maps
+    // straight onto the timeline. The next event follows the one that was due, not the current time: an OAM DMA
+    // holds the CPU for several scanlines, and the events that came due in the meantime must each still happen, at
+    // their own times, rather than be skipped.
+    uint64_t time = eventTime - eventTime % DOTS_PER_FRAME + scanline * DOTS_PER_SCANLINE + dot;
+
+    if (time <= eventTime) {
+        time += DOTS_PER_FRAME;
+    }
+
+    nextEvent = event;
+    eventTime = time;
+    nes->getScheduler()->schedule(EventType::PPU, time);
+}
+
+void PPU::notifyMapper() {
+    Mapper *mapper = nes->getCartridge()->getMapper();
+
+    if (mapper != nullptr) {
+        mapper->handlePPUConfigChange();
+    }
+}
+
+void PPU::saveState(StateWriter &writer) const {
+    writer.write(nextEvent);
+    writer.write(frame);
+    writer.write(controlFlags);
+    writer.write(maskFlags);
+    writer.write(statusFlags);
+    writer.write(ppuLatch);
+    writer.write(readBuffer);
+    writer.write(addressLatch);
+    writer.write(address);
+    writer.write(tempAddress);
+    writer.write(fineX);
+    writer.write(oamAddress);
+    writer.write(oam);
+}
+
+void PPU::loadState(StateReader &reader) {
+    // The PPU's event is restored along with the rest of the scheduler, which is loaded first. The framebuffer is
+    // output, not state.
+    reader.read(nextEvent);
+    eventTime = nes->getScheduler()->getEventTime(EventType::PPU);
+    reader.read(frame);
+    reader.read(controlFlags);
+    reader.read(maskFlags);
+    reader.read(statusFlags);
+    reader.read(ppuLatch);
+    reader.read(readBuffer);
+    reader.read(addressLatch);
+    reader.read(address);
+    reader.read(tempAddress);
+    reader.read(fineX);
+    reader.read(oamAddress);
+    reader.read(oam);
+}
\ No newline at end of file
@@ -4,6 +4,7 @@
 
 #include <vector>
 #include <cstdint>
+#include <cstddef>
 
 enum class PPURegister : uint8_t {
     PPUCTRL = 0,
@@ -18,34 +19,39 @@ enum class PPURegister : uint8_t {
 };
 
 enum class PPUControlFlag : uint8_t {
-    NMI_ENABLE = 1 << 0,
-    PPU_MASTER_SLAVE = 1 << 1,
-    SPRITE_HEIGHT = 1 << 2,
-    BACKGROUND_PATTERN_TABLE = 1 << 3,
-    SPRITE_PATTERN_TABLE = 1 << 4,
-    INCREMENT_MODE = 1 << 5
+    NAMETABLE_X = 1 << 0,
+    NAMETABLE_Y = 1 << 1,
+    INCREMENT_MODE = 1 << 2,
+    SPRITE_PATTERN_TABLE = 1 << 3,
+    BACKGROUND_PATTERN_TABLE = 1 << 4,
+    SPRITE_HEIGHT = 1 << 5,
+    PPU_MASTER_SLAVE = 1 << 6,
+    NMI_ENABLE = 1 << 7
 };
 
 enum class PPUMaskFlag : uint8_t {
-    EMPHASISE_BLUE = 1 << 0,
-    EMPHASISE_GREEN = 1 << 1,
-    EMPHASISE_RED = 1 << 2,
-    SHOW_SPRITES = 1 << 3,
-    SHOW_BACKGROUND = 1 << 4,
-    SHOW_SPRITES_LEFT_COLUMN = 1 << 5,
-    SHOW_BACKGROUND_LEFT_COLUMN = 1 << 6,
-    GREYSCALE = 1 << 7
+    GREYSCALE = 1 << 0,
+    SHOW_BACKGROUND_LEFT_COLUMN = 1 << 1,
+    SHOW_SPRITES_LEFT_COLUMN = 1 << 2,
+    SHOW_BACKGROUND = 1 << 3,
+    SHOW_SPRITES = 1 << 4,
+    EMPHASISE_RED = 1 << 5,
+    EMPHASISE_GREEN = 1 << 6,
+    EMPHASISE_BLUE = 1 << 7
 };
 
 enum class PPUStatusFlag : uint8_t {
-    VERTICAL_BLANK,
-    SPRITE_0_HIT,
-    SPRITE_OVERFLOW
+    SPRITE_OVERFLOW = 1 << 5,
+    SPRITE_0_HIT = 1 << 6,
+    VERTICAL_BLANK = 1 << 7
 };
 
 class NES;
+class StateWriter;
+class StateReader;
 
 class PPU {
+    friend class NES;
 public:
     PPU(NES *nes);
 
@@ -65,31 +71,176 @@ public:
 
     void setStatusFlag(PPUStatusFlag flag, bool set);
 
+    /**
+     * @return true if either the background or the sprites are shown, i.e. the PPU is fetching from CHR.
+     */
+    bool isRenderingEnabled() const;
+
+    unsigned int getScanline() const;
+
+    unsigned int getDot() const;
+
+    /**
+     * @return The number of frames that have been completed, counted at the start of each vertical blank.
+     */
+    uint64_t getFrame() const;
+
+    /**
+     * @return The last frame the PPU rendered: SCREEN_WIDTH * SCREEN_HEIGHT palette indices (0-63), row by row. A
+     * frame is complete when getFrame() changes.
+     */
+    const uint8_t *getFramebuffer() const;
+
+    /**
+     * @return The OBJECT_ATTRIBUTE_MEMORY_SIZE bytes of OAM.
+     */
+    const uint8_t *getOAM() const;
+
+    /**
+     * While output is suppressed, the PPU skips drawing pixels and only does what the game can observe: sprite 0
+     * hits, sprite overflow and, for mappers that watch the bus, every fetch. The framebuffer keeps its last contents.
+     * Used to run frames nobody is going to see.
+     */
+    void setOutputSuppressed(bool suppressed);
+
+    bool isOutputSuppressed() const;
+
+    /**
+     * @return The time of the PPU bus access being made. A scanline's fetches are all made at once, so while they
+     * are, this is the dot the real PPU would make the current one at; otherwise it's the current time.
+     */
+    uint64_t getBusTime() const;
+
+    /**
+     * Called by the NES when the EventType::PPU event comes due.
+     */
+    void handleEvent();
+
+    /**
+     * Puts every register and OAM back into the power-on state and starts over at frame 0. The framebuffer keeps its
+     * memory, and output suppression is a setting, so it is kept too.
+     */
+    void powerOn();
+
+    /**
+     * What the reset button does to the PPU: PPUCTRL, PPUMASK, the scroll and the write latch are cleared.
+     */
+    void reset();
+
+    void saveState(StateWriter &writer) const;
+
+    void loadState(StateReader &reader);
+
     static Address getPPURegisterAddress(PPURegister reg);
 
     static bool getRegisterFromAddress(Address address, PPURegister *outReg);
 
-    static const size_t SPRITE_SIZE;
-    static const size_t OBJECT_ATTRIBUTE_MEMORY_SIZE;
+    static const size_t SPRITE_SIZE = 4;
+    static const size_t OBJECT_ATTRIBUTE_MEMORY_SIZE = 64 * SPRITE_SIZE;
+
+    static const unsigned int SCREEN_WIDTH;
+    static const unsigned int SCREEN_HEIGHT;
+
+    // NTSC timing. The scheduler counts time in PPU dots.
+    static const unsigned int DOTS_PER_CPU_CYCLE;
+    static const unsigned int DOTS_PER_SCANLINE;
+    static const unsigned int SCANLINES_PER_FRAME;
+    static const unsigned int DOTS_PER_FRAME;
+    static const unsigned int VBLANK_SCANLINE;
+    static const unsigned int PRE_RENDER_SCANLINE;
 
 private:
+    enum class Event : uint8_t {
+        VBLANK_START,
+        PRE_RENDER_START,
+        RENDER_SCANLINE,        // The end of a visible scanline's pixels; the whole scanline is drawn at once.
+        PRE_RENDER_SCANLINE     // The same point on the pre-render scanline, which fetches but draws nothing.
+    };
+
     NES *nes;
 
+    Event nextEvent;
+    uint64_t eventTime; // When the next event is due, or, while it is being handled, when it was due.
+    uint64_t frame;
+
     PPUControlFlag controlFlags;
     PPUMaskFlag maskFlags;
     PPUStatusFlag statusFlags;
 
     uint8_t ppuLatch;
+    uint8_t readBuffer; // PPUDATA reads below the palette return the byte fetched by the previous read.
 
     bool addressLatch;
 
-    uint8_t scrollX;
-    uint8_t scrollY;
-
+    // The scroll position and the VRAM address share the same registers: `address` is the current VRAM address,
+    // which rendering walks through the nametables, and `tempAddress` is where PPUSCROLL and PPUADDR writes go, to
+    // be copied into `address` at the start of each scanline and frame. Bits 0-4 hold the coarse X scroll, 5-9 the
+    // coarse Y scroll, 10-11 the nametable and 12-14 the fine Y scroll.
     Address address;
+    Address tempAddress;
+    uint8_t fineX;
+
     uint8_t oamAddress; // OAM is just 256 bytes big, hence we can use an 8-bit address.
 
-    std::vector<uint8_t> oam;
+    uint8_t oam[OBJECT_ATTRIBUTE_MEMORY_SIZE];
+
+    std::vector<uint8_t> framebuffer;
+    bool outputSuppressed;
+
+    uint64_t busTime;   // The time of the fetch being made, or Scheduler::NEVER outside of a scanline's fetches.
 
     void incrementAddress();
+
+    void incrementScrollY();
+
+    void copyScrollX();
+
+    void renderScanline(unsigned int scanline);
+
+    /**
+     * Finds the sprites on the given scanline, fetches their patterns in the eight sprite slots the PPU has, and
+     * draws them into `outPixels`, which receives, per pixel, the sprite palette index (0 if transparent) with
+     * SPRITE_PIXEL_BEHIND and SPRITE_PIXEL_ZERO or'ed in.
+     */
+    void renderSprites(unsigned int scanline, uint64_t lineStart, uint8_t *outPixels);
+
+    /**
+     * Makes the fetches of the sprite slots from `slot` on as if they were empty: they hold $FF, so tile $FF is
+     * fetched.
+     */
+    void fetchEmptySpriteSlots(unsigned int slot, uint64_t lineStart);
+
+    /**
+     * Fetches the background tiles of the scanline that started at `lineStart` and draws them into `outPixels`. Tiles 0
+     * and 1 were fetched at the end of the previous scanline, by prefetchBackground(), so they are only read again.
+     * On the pre-render scanline, which draws nothing, `outPixels` is nullptr and tiles 0 and 1 are skipped.
+     */
+    void renderBackground(uint64_t lineStart, uint8_t *outPixels);
+
+    /**
+     * Fetches the first two tiles of the next scanline, at the end of the one that started at `lineStart`. The data
+     * isn't kept; this is only for mappers that watch the bus.
+     */
+    void prefetchBackground(uint64_t lineStart);
+
+    /**
+     * Reads from the PPU bus as the fetch the real PPU makes at `time`.
+     */
+    uint8_t fetch(Address address, uint64_t time);
+
+    /**
+     * @return true if the mapper sees PPU reads, so every fetch has to be made, in order, whether or not its data is
+     * needed.
+     */
+    bool isBusWatched() const;
+
+    /**
+     * @return When the given scanline of the frame the current event belongs to starts. Events may be handled late,
+     * so this is worked out from when the event was due, not from the current time.
+     */
+    uint64_t getScanlineStart(unsigned int scanline) const;
+
+    void scheduleEvent(Event event, unsigned int scanline, unsigned int dot);
+
+    void notifyMapper();
 };
\ No newline at end of file
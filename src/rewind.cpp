@@ -0,0 +1,272 @@
+#include "rewind.h"
+
+#include "nes.h"
+
+#include <algorithm>
+#include <cstring>
+
+/*
+ * The codec: a sequence of (zero run length, literal length, literal bytes) records, with both lengths as LEB128
+ * varints. It is only good at one thing, long runs of zeros, but that's what XOR deltas of save states are made of,
+ * and it encodes and decodes at close to memcpy speed.
+ */
+
+static void writeVarint(std::vector<uint8_t> &out, size_t value) {
+    while (value >= 0x80) {
+        out.push_back((uint8_t)(value | 0x80));
+        value >>= 7;
+    }
+
+    out.push_back((uint8_t)value);
+}
+
+static size_t readVarint(const uint8_t *&in) {
+    size_t value = 0;
+    unsigned int shift = 0;
+
+    while ((*in & 0x80) != 0) {
+        value |= (size_t)(*in++ & 0x7F) << shift;
+        shift += 7;
+    }
+
+    return value | ((size_t)*in++ << shift);
+}
+
+static size_t countZeros(const uint8_t *data, size_t size) {
+    size_t count = 0;
+
+    // Whole words at a time; delta states are mostly zeros.
+    while (count + sizeof(uint64_t) <= size) {
+        uint64_t word;
+        std::memcpy(&word, data + count, sizeof(word));
+
+        if (word != 0) {
+            break;
+        }
+
+        count += sizeof(word);
+    }
+
+    while (count < size && data[count] == 0) {
+        count++;
+    }
+
+    return count;
+}
+
+static size_t countLiterals(const uint8_t *data, size_t size) {
+    // A literal run only ends at a run of zeros long enough to be worth starting a new record for.
+    static const size_t MIN_ZERO_RUN = 4;
+    size_t count = 0;
+
+    while (count < size) {
+        const size_t window = std::min(size - count, MIN_ZERO_RUN);
+
+        if (data[count] == 0 && countZeros(data + count, window) == window) {
+            break;
+        }
+
+        count++;
+    }
+
+    return count;
+}
+
+/**
+ * Appends the encoding of `a XOR b`, or just of `a` if `b` is nullptr, to `out`.
+ */
+static void encode(const uint8_t *a, const uint8_t *b, size_t size, std::vector<uint8_t> &out,
+                   std::vector<uint8_t> &scratch) {
+    const uint8_t *data = a;
+
+    if (b != nullptr) {
+        scratch.resize(size);
+
+        for (size_t i = 0; i < size; i++) {
+            scratch[i] = a[i] ^ b[i];
+        }
+
+        data = scratch.data();
+    }
+
+    for (size_t position = 0; position < size;) {
+        const size_t zeros = countZeros(data + position, size - position);
+        const size_t literals = countLiterals(data + position + zeros, size - position - zeros);
+
+        writeVarint(out, zeros);
+        writeVarint(out, literals);
+        out.insert(out.end(), data + position + zeros, data + position + zeros + literals);
+
+        position += zeros + literals;
+    }
+}
+
+/**
+ * Decodes into `state`. Deltas are XORed into it, complete states overwrite it.
+ */
+static void decode(const uint8_t *in, size_t encodedSize, uint8_t *state, bool delta) {
+    const uint8_t *end = in + encodedSize;
+    uint8_t *out = state;
+
+    while (in < end) {
+        const size_t zeros = readVarint(in);
+        const size_t literals = readVarint(in);
+
+        if (!delta) {
+            std::memset(out, 0, zeros);
+        }
+
+        out += zeros;
+
+        if (delta) {
+            for (size_t i = 0; i < literals; i++) {
+                out[i] ^= in[i];
+            }
+        } else {
+            std::memcpy(out, in, literals);
+        }
+
+        in += literals;
+        out += literals;
+    }
+}
+
+Rewinder::Rewinder(NES *nes, size_t memoryBudget, unsigned int keyframeInterval)
+    : nes(nes),
+      keyframeInterval(std::max(1u, keyframeInterval)),
+      framesSinceKeyframe(0),
+      buffer(memoryBudget),
+      usage(0)
+{
+}
+
+void Rewinder::capture() {
+    nes->saveState(state);
+
+    const bool first = snapshots.empty() || newest.size() != state.size();
+    const bool keyframe = first || ++framesSinceKeyframe >= keyframeInterval;
+
+    // A snapshot is its delta followed, for keyframes, by the complete state.
+    Snapshot snapshot = {};
+    encoded.clear();
+
+    if (!first) {
+        encode(state.data(), newest.data(), state.size(), encoded, scratch);
+        snapshot.deltaSize = (uint32_t)encoded.size();
+    }
+
+    if (keyframe) {
+        encode(state.data(), nullptr, state.size(), encoded, scratch);
+        snapshot.fullSize = (uint32_t)(encoded.size() - snapshot.deltaSize);
+        framesSinceKeyframe = 0;
+    }
+
+    if (encoded.size() > buffer.size()) {
+        // A single snapshot doesn't even fit the budget.
+        clear();
+        return;
+    }
+
+    snapshot.offset = allocate(encoded.size());
+    std::memcpy(buffer.data() + snapshot.offset, encoded.data(), encoded.size());
+
+    snapshots.push_back(snapshot);
+    usage += encoded.size();
+    newest.swap(state);
+}
+
+size_t Rewinder::allocate(size_t size) {
+    if (snapshots.empty()) {
+        return 0;
+    }
+
+    size_t offset = getEnd(snapshots.back());
+
+    if (offset + size > buffer.size()) {
+        // Snapshots are never split, so wrap around to the start of the buffer. Anything between here and the end
+        // of the buffer is older than what's at the start, so it has to go first.
+        while (!snapshots.empty() && snapshots.front().offset >= offset) {
+            drop(snapshots.front());
+            snapshots.pop_front();
+        }
+
+        offset = 0;
+    }
+
+    // The oldest snapshot is always the next one ahead of the newest, so drop snapshots until it's out of the way.
+    while (!snapshots.empty() && snapshots.front().offset < offset + size && offset < getEnd(snapshots.front())) {
+        drop(snapshots.front());
+        snapshots.pop_front();
+    }
+
+    return offset;
+}
+
+size_t Rewinder::getEnd(const Snapshot &snapshot) {
+    return snapshot.offset + snapshot.deltaSize + snapshot.fullSize;
+}
+
+void Rewinder::drop(const Snapshot &snapshot) {
+    usage -= snapshot.deltaSize + snapshot.fullSize;
+}
+
+size_t Rewinder::rewind(size_t frames) {
+    frames = std::min(frames, getAvailableFrames());
+
+    if (frames == 0) {
+        return 0;
+    }
+
+    const size_t target = snapshots.size() - 1 - frames;
+
+    // Start from the closest keyframe between the target and the newest snapshot, if there is one, instead of
+    // walking back from the newest.
+    size_t start = snapshots.size() - 1;
+
+    for (size_t i = target; i < snapshots.size() - 1; i++) {
+        if (snapshots[i].fullSize != 0) {
+            start = i;
+            break;
+        }
+    }
+
+    if (start != snapshots.size() - 1) {
+        const Snapshot &keyframe = snapshots[start];
+        decode(buffer.data() + keyframe.offset + keyframe.deltaSize, keyframe.fullSize, newest.data(), false);
+    }
+
+    // Each delta turns its snapshot's state back into its predecessor's.
+    for (size_t i = start; i > target; i--) {
+        decode(buffer.data() + snapshots[i].offset, snapshots[i].deltaSize, newest.data(), true);
+    }
+
+    while (snapshots.size() > target + 1) {
+        drop(snapshots.back());
+        snapshots.pop_back();
+    }
+
+    // Count the distance to the next keyframe from the last one that's left.
+    framesSinceKeyframe = 0;
+
+    for (size_t i = snapshots.size(); i-- > 0 && snapshots[i].fullSize == 0;) {
+        framesSinceKeyframe++;
+    }
+
+    nes->loadState(newest.data(), newest.size());
+
+    return frames;
+}
+
+size_t Rewinder::getAvailableFrames() const {
+    return snapshots.empty() ? 0 : snapshots.size() - 1;
+}
+
+size_t Rewinder::getMemoryUsage() const {
+    return usage;
+}
+
+void Rewinder::clear() {
+    snapshots.clear();
+    usage = 0;
+    framesSinceKeyframe = 0;
+}
\ No newline at end of file
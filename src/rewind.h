@@ -0,0 +1,85 @@
+#pragma once
+
+#include <vector>
+#include <deque>
+#include <cstdint>
+#include <cstddef>
+
+class NES;
+
+/**
+ * Keeps the last few minutes of a game in a fixed amount of memory, so it can be played backwards.
+ *
+ * Every captured frame is stored as the XOR of its save state with the previous frame's, compressed with a simple
+ * zero-run codec. Most of the machine doesn't change from one frame to the next, so these deltas are tiny. The same
+ * delta that turns frame k-1 into frame k also turns frame k back into frame k-1, so stepping backwards from the
+ * newest state costs one decode per frame. Every few frames a keyframe with the complete state is stored as well,
+ * so jumping far back doesn't have to walk through every frame in between.
+ *
+ * Snapshots live in a ring buffer of the configured size; when it's full, the oldest ones are dropped.
+ */
+class Rewinder {
+public:
+    /**
+     * @param nes The machine to capture.
+     * @param memoryBudget How many bytes of snapshots to keep.
+     * @param keyframeInterval How often, in captured frames, to store a complete state.
+     */
+    Rewinder(NES *nes, size_t memoryBudget, unsigned int keyframeInterval = 60);
+
+    /**
+     * Captures the current state of the machine. Call this once per frame.
+     */
+    void capture();
+
+    /**
+     * Puts the machine back into the state it was in the given number of captures ago. The captures after that are
+     * discarded, so playing on from there captures a new timeline.
+     *
+     * @return How many captures were actually rewound, which is less than asked for if the buffer doesn't go back
+     * that far.
+     */
+    size_t rewind(size_t frames);
+
+    /**
+     * @return How many captures back rewind() can currently go.
+     */
+    size_t getAvailableFrames() const;
+
+    /**
+     * @return How many bytes of the budget the snapshots currently use.
+     */
+    size_t getMemoryUsage() const;
+
+    void clear();
+
+private:
+    struct Snapshot {
+        size_t offset;      // Where the snapshot starts in the buffer.
+        uint32_t deltaSize; // Size of the delta to the previous snapshot, or 0 if there is no previous snapshot.
+        uint32_t fullSize;  // Size of the complete state, or 0 if this isn't a keyframe.
+    };
+
+    NES *nes;
+    unsigned int keyframeInterval;
+    unsigned int framesSinceKeyframe;
+
+    std::vector<uint8_t> buffer;
+    std::deque<Snapshot> snapshots;
+    size_t usage;
+
+    std::vector<uint8_t> newest;    // The state of the newest snapshot.
+    std::vector<uint8_t> state;     // Scratch space for saving and decoding states.
+    std::vector<uint8_t> encoded;   // Scratch space for encoding snapshots.
+    std::vector<uint8_t> scratch;
+
+    /**
+     * Makes room for a snapshot of the given size, dropping the oldest snapshots if necessary.
+     * @return The offset of the space in the buffer.
+     */
+    size_t allocate(size_t size);
+
+    void drop(const Snapshot &snapshot);
+
+    static size_t getEnd(const Snapshot &snapshot);
+};
\ No newline at end of file
@@ -0,0 +1,142 @@
+#include "rom.h"
+
+#include "ines.h"
+#include "romdb.h"
+#include "hash.h"
+
+#include <utility>
+
+ROMImage::ROMImage(const iNES::Header &header)
+    : prg(nullptr),
+      prgSize(0),
+      chr(nullptr),
+      chrSize(0),
+      info(iNES::parseHeader(header)),
+      fromDatabase(false),
+      databaseSizeMismatch(false)
+{
+}
+
+std::shared_ptr<const ROMImage> ROMImage::create(iNES::File &file, const ROMDatabase *database) {
+    std::shared_ptr<ROMImage> image(new ROMImage(file.header));
+
+    image->prgStorage = std::move(file.prgROM);
+    image->prg = image->prgStorage.data();
+    image->prgSize = image->prgStorage.size();
+
+    if (image->info.chrROMSize != 0) {
+        image->chrStorage = std::move(file.chrROM);
+        image->chr = image->chrStorage.data();
+        image->chrSize = image->chrStorage.size();
+    }
+
+    image->applyDatabase(database);
+
+    return image;
+}
+
+std::shared_ptr<const ROMImage> ROMImage::create(std::shared_ptr<const iNES::MappedFile> file,
+                                                 const ROMDatabase *database) {
+    std::shared_ptr<ROMImage> image(new ROMImage(*file->getHeader()));
+
+    image->prg = file->getPRGROM();
+    image->prgSize = file->getPRGROMSize();
+    image->chr = file->getCHRROM();
+    image->chrSize = file->getCHRROMSize();
+    image->mapping = std::move(file);
+
+    image->applyDatabase(database);
+
+    return image;
+}
+
+void ROMImage::applyDatabase(const ROMDatabase *database) {
+    if (database == nullptr) {
+        return;
+    }
+
+    uint32_t crc32;
+    uint8_t sha1[Hash::SHA1_SIZE];
+
+    ROMDatabase::hash(prg, prgSize, chr, chrSize, crc32, sha1);
+
+    const ROMDatabase::Entry *entry = database->find(crc32, sha1);
+
+    if (entry == nullptr) {
+        return;
+    }
+
+    iNES::HeaderInfo corrected = iNES::parseHeader(entry->header);
+
+    if (corrected.prgROMSize != prgSize || corrected.chrROMSize != chrSize) {
+        // The hashes matched, so the file holds the right data, just split differently. Keep the file's split.
+        databaseSizeMismatch = true;
+        corrected.prgROMSize = prgSize;
+        corrected.chrROMSize = chrSize;
+    }
+
+    corrected.trainer = info.trainer;
+
+    if (chrSize == 0 && corrected.chrRAMSize == 0 && corrected.chrNVRAMSize == 0) {
+        corrected.chrRAMSize = iNES::CHR_ROM_SIZE;
+    }
+
+    info = corrected;
+    fromDatabase = true;
+}
+
+const uint8_t *ROMImage::getPRGROM() const {
+    return prg;
+}
+
+size_t ROMImage::getPRGROMSize() const {
+    return prgSize;
+}
+
+const uint8_t *ROMImage::getCHRROM() const {
+    return chr;
+}
+
+size_t ROMImage::getCHRROMSize() const {
+    return chrSize;
+}
+
+size_t ROMImage::getPRGRAMSize() const {
+    return info.prgRAMSize + info.prgNVRAMSize;
+}
+
+bool ROMImage::hasCHRRAM() const {
+    return chrSize == 0;
+}
+
+size_t ROMImage::getCHRRAMSize() const {
+    return info.chrRAMSize + info.chrNVRAMSize;
+}
+
+uint16_t ROMImage::getMapperNumber() const {
+    return info.mapper;
+}
+
+uint8_t ROMImage::getSubmapper() const {
+    return info.submapper;
+}
+
+Mirroring ROMImage::getMirroring() const {
+    return info.mirroring;
+}
+
+bool ROMImage::hasBattery() const {
+    return info.battery;
+}
+
+iNES::Timing ROMImage::getTiming() const {
+    return info.timing;
+}
+
+bool ROMImage::isFromDatabase() const {
+    return fromDatabase;
+}
+
+bool ROMImage::hasDatabaseSizeMismatch() const {
+    return databaseSizeMismatch;
+}
\ No newline at end of file
@@ -0,0 +1,104 @@
+#pragma once
+
+#include "ines.h"
+#include "mirroring.h"
+
+class ROMDatabase;
+
+#include <vector>
+#include <memory>
+#include <cstdint>
+#include <cstddef>
+
+/**
+ * The read-only part of a cartridge: PRG-ROM, CHR-ROM and the header fields that describe the board.
+ *
+ * A ROMImage never changes after it has been created, so any number of Cartridges, in any number of threads, can
+ * share one through a shared_ptr instead of each holding their own copy of the ROM. Everything that does change
+ * while a game runs (PRG-RAM, CHR-RAM, mapper registers) belongs to the Cartridge.
+ */
+class ROMImage {
+public:
+    /**
+     * Creates a ROMImage from an `iNES::File`. Like the Cartridge constructor, this _moves_ the PRG-ROM and CHR-ROM
+     * out of the file.
+     *
+     * @param file The file to create the image from.
+     * @param database If not nullptr, the game is looked up in this database and, if it's there, the database's
+     * description of the board is used instead of the file's header.
+     */
+    static std::shared_ptr<const ROMImage> create(iNES::File &file, const ROMDatabase *database = nullptr);
+
+    /**
+     * Creates a ROMImage that plays straight from a memory-mapped iNES file, without copying the ROM. The image
+     * keeps the mapping alive.
+     *
+     * @param file The mapped file to create the image from.
+     * @param database See the other overload.
+     */
+    static std::shared_ptr<const ROMImage> create(std::shared_ptr<const iNES::MappedFile> file,
+                                                  const ROMDatabase *database = nullptr);
+
+    const uint8_t *getPRGROM() const;
+
+    size_t getPRGROMSize() const;
+
+    /**
+     * @return The CHR-ROM, or nullptr if the board has CHR-RAM instead.
+     */
+    const uint8_t *getCHRROM() const;
+
+    size_t getCHRROMSize() const;
+
+    /**
+     * @return The size of the board's PRG-RAM, battery-backed or not.
+     */
+    size_t getPRGRAMSize() const;
+
+    /**
+     * @return true if the board has CHR-RAM rather than CHR-ROM.
+     */
+    bool hasCHRRAM() const;
+
+    size_t getCHRRAMSize() const;
+
+    uint16_t getMapperNumber() const;
+
+    uint8_t getSubmapper() const;
+
+    Mirroring getMirroring() const;
+
+    bool hasBattery() const;
+
+    iNES::Timing getTiming() const;
+
+    /**
+     * @return true if the board description came from a ROMDatabase rather than the file's header.
+     */
+    bool isFromDatabase() const;
+
+    /**
+     * @return true if the database entry splits the ROM into PRG-ROM and CHR-ROM differently from the file. The file's
+     * split is kept; whether that is worth a warning is up to the caller.
+     */
+    bool hasDatabaseSizeMismatch() const;
+
+private:
+    explicit ROMImage(const iNES::Header &header);
+
+    void applyDatabase(const ROMDatabase *database);
+
+    // The ROM is either owned by the image or lives in a mapped file; either way it's only accessed through these.
+    const uint8_t *prg;
+    size_t prgSize;
+    const uint8_t *chr;
+    size_t chrSize;
+
+    std::vector<uint8_t> prgStorage;
+    std::vector<uint8_t> chrStorage;
+    std::shared_ptr<const iNES::MappedFile> mapping;
+
+    iNES::HeaderInfo info;
+    bool fromDatabase;
+    bool databaseSizeMismatch;
+};
\ No newline at end of file
@@ -0,0 +1,150 @@
+#include "romdb.h"
+
+#include "ines.h"
+#include "hash.h"
+
+#include <algorithm>
+#include <fstream>
+#include <cstring>
+
+/*
+ * File layout, all integers little-endian:
+ *
+ *  0  "NDB\x1A"
+ *  4  Version (uint32)
+ *  8  Entry count (uint32)
+ * 12  Reserved (uint32)
+ * 16  Entries: CRC32 (uint32), SHA-1 (20 bytes), NES 2.0 header (16 bytes)
+ */
+
+static const char MAGIC_BYTES[4] = { 'N', 'D', 'B', '\x1A' };
+static const uint32_t VERSION = 1;
+static const size_t HEADER_SIZE = 16;
+static const size_t ENTRY_SIZE = 4 + 20 + sizeof(iNES::Header);
+
+static uint32_t readUint32LE(const uint8_t *p) {
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static void writeUint32LE(uint8_t *p, uint32_t value) {
+    p[0] = (uint8_t)value;
+    p[1] = (uint8_t)(value >> 8);
+    p[2] = (uint8_t)(value >> 16);
+    p[3] = (uint8_t)(value >> 24);
+}
+
+static bool compareEntries(const ROMDatabase::Entry &a, const ROMDatabase::Entry &b) {
+    if (a.crc32 != b.crc32) {
+        return a.crc32 < b.crc32;
+    }
+
+    return std::memcmp(a.sha1, b.sha1, sizeof(a.sha1)) < 0;
+}
+
+iNES::LoadError ROMDatabase::load(const std::string &file) {
+    std::ifstream in(file, std::ios::in | std::ios::binary);
+
+    if (!in) {
+        return iNES::LoadError::OPEN_FAILED;
+    }
+
+    uint8_t header[HEADER_SIZE];
+
+    if (!in.read((char*)header, sizeof(header))) {
+        return iNES::LoadError::READ_ERROR;
+    }
+
+    if (std::memcmp(header, MAGIC_BYTES, sizeof(MAGIC_BYTES)) != 0 || readUint32LE(header + 4) != VERSION) {
+        return iNES::LoadError::MAGIC_BYTES_MISMATCH;
+    }
+
+    // The count comes from the file, so it is checked against what the file actually holds before anything is sized
+    // from it.
+    const std::streamoff start = in.tellg();
+    in.seekg(0, std::ios::end);
+    const std::streamoff end = in.tellg();
+    in.seekg(start);
+
+    const uint64_t count = readUint32LE(header + 8);
+
+    if (!in || start < 0 || end < start || count * ENTRY_SIZE > (uint64_t)(end - start)) {
+        return iNES::LoadError::TRUNCATED;
+    }
+
+    std::vector<uint8_t> data((size_t)count * ENTRY_SIZE);
+
+    if (!in.read((char*)data.data(), data.size())) {
+        return iNES::LoadError::TRUNCATED;
+    }
+
+    entries.resize((size_t)count);
+
+    for (size_t i = 0; i < entries.size(); i++) {
+        const uint8_t *record = data.data() + i * ENTRY_SIZE;
+
+        entries[i].crc32 = readUint32LE(record);
+        std::memcpy(entries[i].sha1, record + 4, sizeof(entries[i].sha1));
+        std::memcpy(&entries[i].header, record + 24, sizeof(entries[i].header));
+    }
+
+    // The builder writes sorted files, but a lookup in an unsorted one would silently fail.
+    if (!std::is_sorted(entries.begin(), entries.end(), compareEntries)) {
+        std::sort(entries.begin(), entries.end(), compareEntries);
+    }
+
+    return iNES::LoadError::NO_ERROR;
+}
+
+bool ROMDatabase::write(const std::string &file, std::vector<ROMDatabase::Entry> entries) {
+    std::sort(entries.begin(), entries.end(), compareEntries);
+
+    std::vector<uint8_t> data(HEADER_SIZE + entries.size() * ENTRY_SIZE, 0x00);
+
+    std::memcpy(data.data(), MAGIC_BYTES, sizeof(MAGIC_BYTES));
+    writeUint32LE(data.data() + 4, VERSION);
+    writeUint32LE(data.data() + 8, (uint32_t)entries.size());
+
+    for (size_t i = 0; i < entries.size(); i++) {
+        uint8_t *record = data.data() + HEADER_SIZE + i * ENTRY_SIZE;
+
+        writeUint32LE(record, entries[i].crc32);
+        std::memcpy(record + 4, entries[i].sha1, sizeof(entries[i].sha1));
+        std::memcpy(record + 24, &entries[i].header, sizeof(entries[i].header));
+    }
+
+    std::ofstream out(file, std::ios::out | std::ios::binary | std::ios::trunc);
+    return out && out.write((const char*)data.data(), data.size());
+}
+
+const ROMDatabase::Entry *ROMDatabase::find(uint32_t crc32, const uint8_t *sha1) const {
+    auto it = std::lower_bound(entries.begin(), entries.end(), crc32, [](const Entry &entry, uint32_t crc) {
+        return entry.crc32 < crc;
+    });
+
+    for (; it != entries.end() && it->crc32 == crc32; ++it) {
+        if (sha1 == nullptr || std::memcmp(it->sha1, sha1, sizeof(it->sha1)) == 0) {
+            return &*it;
+        }
+    }
+
+    return nullptr;
+}
+
+void ROMDatabase::hash(const uint8_t *prg, size_t prgSize, const uint8_t *chr, size_t chrSize,
+                       uint32_t &outCRC32, uint8_t *outSHA1) {
+    Hash::SHA1 sha1;
+
+    outCRC32 = Hash::crc32(prg, prgSize);
+    sha1.update(prg, prgSize);
+
+    if (chr != nullptr) {
+        outCRC32 = Hash::crc32(chr, chrSize, outCRC32);
+        sha1.update(chr, chrSize);
+    }
+
+    sha1.finish(outSHA1);
+}
+
+size_t ROMDatabase::size() const {
+    return entries.size();
+}
\ No newline at end of file
@@ -0,0 +1,57 @@
+#pragma once
+
+#include "ines.h"
+
+#include <vector>
+#include <string>
+#include <cstdint>
+#include <cstddef>
+
+/**
+ * A database of known-good headers for dumped games, keyed by the CRC32 and SHA-1 of their PRG-ROM followed by their
+ * CHR-ROM (the same hashes nes20db uses). Plenty of ROMs in the wild have wrong or incomplete iNES headers, so the
+ * emulator looks every game up here and trusts the database over the file.
+ *
+ * On disk, the database is a 16-byte header followed by fixed-size records sorted by CRC32, so loading it is a single
+ * read and a lookup is a binary search. The nesulator_romdb tool builds it from nes20db's XML.
+ */
+class ROMDatabase {
+public:
+    struct Entry {
+        uint32_t crc32;
+        uint8_t sha1[20];
+        iNES::Header header;    // A NES 2.0 header describing the board.
+    };
+
+    /**
+     * Replaces the database's contents with the database stored in the given file.
+     */
+    iNES::LoadError load(const std::string &file);
+
+    /**
+     * Writes a database. The entries don't need to be sorted.
+     * @return false if the file couldn't be written.
+     */
+    static bool write(const std::string &file, std::vector<Entry> entries);
+
+    /**
+     * Looks a game up by its hashes.
+     *
+     * @param crc32 The CRC32 of the game's PRG-ROM and CHR-ROM.
+     * @param sha1 The SHA-1 of the same data, used to tell apart games whose CRC32s collide. May be nullptr, in which
+     * case the first entry with the given CRC32 is returned.
+     * @return The matching entry, or nullptr if the game isn't in the database.
+     */
+    const Entry *find(uint32_t crc32, const uint8_t *sha1) const;
+
+    /**
+     * Hashes a game the way the database keys it.
+     */
+    static void hash(const uint8_t *prg, size_t prgSize, const uint8_t *chr, size_t chrSize,
+                     uint32_t &outCRC32, uint8_t *outSHA1);
+
+    size_t size() const;
+
+private:
+    std::vector<Entry> entries;
+};
\ No newline at end of file
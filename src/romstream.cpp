@@ -0,0 +1,349 @@
+#include "romstream.h"
+
+#include "ines.h"
+#include "hash.h"
+
+#include <algorithm>
+#include <limits>
+#include <cctype>
+#include <cstring>
+
+#ifdef NESULATOR_HAVE_ZLIB
+#include <zlib.h>
+#endif
+
+static const size_t INPUT_BUFFER_SIZE = 65536;
+static const uint64_t UNKNOWN_SIZE = std::numeric_limits<uint64_t>::max();
+
+// Far more than any real game, even the biggest NES 2.0 homebrew.
+const uint64_t ROMStream::MAX_INFLATED_SIZE = 64 * 1024 * 1024;
+
+static const uint8_t GZIP_MAGIC_BYTES[2] = { 0x1F, 0x8B };
+static const uint32_t ZIP_LOCAL_FILE_HEADER_SIGNATURE = 0x04034B50;
+static const size_t ZIP_LOCAL_FILE_HEADER_SIZE = 30;
+
+static const uint16_t ZIP_FLAG_ENCRYPTED = 1 << 0;
+static const uint16_t ZIP_FLAG_DATA_DESCRIPTOR = 1 << 3;
+static const uint16_t ZIP_METHOD_STORED = 0;
+static const uint16_t ZIP_METHOD_DEFLATED = 8;
+
+static uint16_t readUint16LE(const uint8_t *p) {
+    return (uint16_t)(p[0] | (p[1] << 8));
+}
+
+static uint32_t readUint32LE(const uint8_t *p) {
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static bool isROMFileName(const std::string &name) {
+    if (name.size() < 4) {
+        return false;
+    }
+
+    std::string extension = name.substr(name.size() - 4);
+    std::transform(extension.begin(), extension.end(), extension.begin(), ::tolower);
+    return extension == ".nes";
+}
+
+#ifdef NESULATOR_HAVE_ZLIB
+struct ROMStream::Inflater {
+    z_stream stream;
+    bool ended;
+};
+#else
+struct ROMStream::Inflater {
+};
+#endif
+
+ROMStream::ROMStream()
+    : format(Format::RAW),
+      input(INPUT_BUFFER_SIZE),
+      inputPosition(0),
+      inputSize(0),
+      deflated(false),
+      remaining(UNKNOWN_SIZE),
+      checkCRC(false),
+      crc(0),
+      expectedCRC(0),
+      sizeLimit(MAX_INFLATED_SIZE),
+      inflater(nullptr)
+{
+}
+
+ROMStream::~ROMStream() {
+#ifdef NESULATOR_HAVE_ZLIB
+    if (inflater != nullptr) {
+        inflateEnd(&inflater->stream);
+    }
+#endif
+}
+
+iNES::LoadError ROMStream::open(const std::string &file, std::unique_ptr<ROMStream> &outStream) {
+    std::unique_ptr<ROMStream> stream(new ROMStream());
+
+    stream->in.open(file, std::ios::in | std::ios::binary);
+
+    if (!stream->in) {
+        return iNES::LoadError::OPEN_FAILED;
+    }
+
+    // Plain files hold exactly what they hold; the formats below replace this with what they know.
+    if (!stream->in.seekg(0, std::ios::end)) {
+        return iNES::LoadError::READ_ERROR;
+    }
+
+    stream->sizeLimit = (uint64_t)stream->in.tellg();
+    stream->in.seekg(0, std::ios::beg);
+
+    if (!stream->fill() || stream->inputSize < 4) {
+        return iNES::LoadError::READ_ERROR;
+    }
+
+    const uint8_t *magic = stream->input.data();
+
+    if (std::memcmp(magic, GZIP_MAGIC_BYTES, sizeof(GZIP_MAGIC_BYTES)) == 0) {
+        stream->format = Format::GZIP;
+        stream->deflated = true;
+        stream->sizeLimit = MAX_INFLATED_SIZE;
+    } else if (readUint32LE(magic) == ZIP_LOCAL_FILE_HEADER_SIGNATURE) {
+        stream->format = Format::ZIP;
+
+        const iNES::LoadError error = stream->openZipEntry();
+
+        if (error != iNES::LoadError::NO_ERROR) {
+            return error;
+        }
+    }
+
+    if (stream->deflated) {
+#ifdef NESULATOR_HAVE_ZLIB
+        stream->inflater.reset(new Inflater());
+        stream->inflater->ended = false;
+
+        // zlib reads the gzip header and checks the gzip trailer itself; zip entries are bare deflate streams.
+        const int windowBits = stream->format == Format::GZIP ? 16 + MAX_WBITS : -MAX_WBITS;
+
+        if (inflateInit2(&stream->inflater->stream, windowBits) != Z_OK) {
+            stream->inflater.reset();
+            return iNES::LoadError::READ_ERROR;
+        }
+#else
+        return iNES::LoadError::UNSUPPORTED_COMPRESSION;
+#endif
+    }
+
+    outStream = std::move(stream);
+    return iNES::LoadError::NO_ERROR;
+}
+
+iNES::LoadError ROMStream::openZipEntry() {
+    uint8_t header[ZIP_LOCAL_FILE_HEADER_SIZE];
+
+    // Walk the local file headers until we find a ROM. Entries are skipped by their compressed size, so this can't
+    // skip entries that only give their size after their data.
+    while (readInput(header, sizeof(header))) {
+        if (readUint32LE(header) != ZIP_LOCAL_FILE_HEADER_SIGNATURE) {
+            // We've reached the central directory.
+            return iNES::LoadError::MAGIC_BYTES_MISMATCH;
+        }
+
+        const uint16_t flags = readUint16LE(header + 6);
+        const uint16_t method = readUint16LE(header + 8);
+        const uint32_t entryCRC = readUint32LE(header + 14);
+        const uint32_t compressedSize = readUint32LE(header + 18);
+        const uint32_t uncompressedSize = readUint32LE(header + 22);
+        const uint16_t nameLength = readUint16LE(header + 26);
+        const uint16_t extraLength = readUint16LE(header + 28);
+
+        std::string name(nameLength, '\0');
+
+        if (!readInput((uint8_t *)&name[0], nameLength) || !skipInput(extraLength)) {
+            return iNES::LoadError::TRUNCATED;
+        }
+
+        const bool sizeKnown = (flags & ZIP_FLAG_DATA_DESCRIPTOR) == 0 && compressedSize != 0xFFFFFFFF;
+
+        if (!isROMFileName(name)) {
+            if (!sizeKnown) {
+                return iNES::LoadError::UNSUPPORTED_COMPRESSION;
+            }
+
+            if (!skipInput(compressedSize)) {
+                return iNES::LoadError::TRUNCATED;
+            }
+
+            continue;
+        }
+
+        if ((flags & ZIP_FLAG_ENCRYPTED) != 0 || (method != ZIP_METHOD_STORED && method != ZIP_METHOD_DEFLATED)) {
+            return iNES::LoadError::UNSUPPORTED_COMPRESSION;
+        }
+
+        if (method == ZIP_METHOD_STORED && !sizeKnown) {
+            // Stored data doesn't mark its own end.
+            return iNES::LoadError::UNSUPPORTED_COMPRESSION;
+        }
+
+        deflated = method == ZIP_METHOD_DEFLATED;
+        remaining = sizeKnown ? compressedSize : UNKNOWN_SIZE;
+        checkCRC = sizeKnown;
+        expectedCRC = entryCRC;
+        sizeLimit = sizeKnown && uncompressedSize != 0xFFFFFFFF ? uncompressedSize : MAX_INFLATED_SIZE;
+
+        return iNES::LoadError::NO_ERROR;
+    }
+
+    return iNES::LoadError::MAGIC_BYTES_MISMATCH;
+}
+
+bool ROMStream::fill() {
+    if (inputPosition < inputSize) {
+        return true;
+    }
+
+    in.read((char *)input.data(), input.size());
+    inputPosition = 0;
+    inputSize = (size_t)in.gcount();
+
+    return inputSize > 0;
+}
+
+bool ROMStream::readInput(uint8_t *data, size_t size) {
+    const size_t buffered = std::min(size, inputSize - inputPosition);
+
+    std::memcpy(data, input.data() + inputPosition, buffered);
+    inputPosition += buffered;
+    data += buffered;
+    size -= buffered;
+
+    if (size >= input.size()) {
+        // Big reads of uncompressed data go straight from the file into the caller's buffer.
+        return (bool)in.read((char *)data, size);
+    }
+
+    while (size > 0) {
+        if (!fill()) {
+            return false;
+        }
+
+        const size_t count = std::min(size, inputSize - inputPosition);
+        std::memcpy(data, input.data() + inputPosition, count);
+        inputPosition += count;
+        data += count;
+        size -= count;
+    }
+
+    return true;
+}
+
+bool ROMStream::skipInput(uint64_t size) {
+    const size_t buffered = (size_t)std::min<uint64_t>(size, inputSize - inputPosition);
+
+    inputPosition += buffered;
+    size -= buffered;
+
+    return size == 0 || (bool)in.seekg((std::streamoff)size, std::ios::cur);
+}
+
+iNES::LoadError ROMStream::read(uint8_t *data, size_t size) {
+    size_t count;
+    const iNES::LoadError error = readSome(data, size, count);
+
+    if (error != iNES::LoadError::NO_ERROR) {
+        return error;
+    }
+
+    return count == size ? iNES::LoadError::NO_ERROR : iNES::LoadError::TRUNCATED;
+}
+
+iNES::LoadError ROMStream::readSome(uint8_t *data, size_t size, size_t &outCount) {
+    outCount = 0;
+
+    if (!deflated) {
+        const size_t count = (size_t)std::min<uint64_t>(size, remaining);
+
+        if (!readInput(data, count)) {
+            return iNES::LoadError::TRUNCATED;
+        }
+
+        if (remaining != UNKNOWN_SIZE) {
+            remaining -= count;
+        }
+
+        outCount = count;
+    } else {
+#ifdef NESULATOR_HAVE_ZLIB
+        z_stream &stream = inflater->stream;
+
+        while (outCount < size && !inflater->ended) {
+            if (inputPosition == inputSize && remaining > 0 && !fill()) {
+                return iNES::LoadError::TRUNCATED;
+            }
+
+            // Never hand zlib bytes past the end of a zip entry. Both counts are only 32 bits wide in zlib.
+            const size_t available = (size_t)std::min<uint64_t>(
+                std::min<uint64_t>(inputSize - inputPosition, remaining), std::numeric_limits<uInt>::max());
+            const size_t space = std::min<size_t>(size - outCount, std::numeric_limits<uInt>::max());
+
+            stream.next_in = input.data() + inputPosition;
+            stream.avail_in = (uInt)available;
+            stream.next_out = data + outCount;
+            stream.avail_out = (uInt)space;
+
+            const int result = inflate(&stream, Z_NO_FLUSH);
+            const size_t consumed = available - stream.avail_in;
+
+            inputPosition += consumed;
+            outCount += space - stream.avail_out;
+
+            if (remaining != UNKNOWN_SIZE) {
+                remaining -= consumed;
+            }
+
+            if (result == Z_STREAM_END) {
+                inflater->ended = true;
+            } else if (result == Z_BUF_ERROR && available == 0) {
+                return iNES::LoadError::TRUNCATED;
+            } else if (result != Z_OK && result != Z_BUF_ERROR) {
+                return iNES::LoadError::READ_ERROR;
+            }
+        }
+#endif
+    }
+
+    if (checkCRC) {
+        crc = Hash::crc32(data, outCount, crc);
+    }
+
+    sizeLimit -= std::min<uint64_t>(outCount, sizeLimit);
+
+    return iNES::LoadError::NO_ERROR;
+}
+
+iNES::LoadError ROMStream::finish() {
+    if (format == Format::RAW) {
+        return iNES::LoadError::NO_ERROR;
+    }
+
+    // Read whatever follows the ROM (usually nothing), so the whole entry has been checked.
+    uint8_t scratch[4096];
+    size_t count;
+
+    do {
+        const iNES::LoadError error = readSome(scratch, sizeof(scratch), count);
+
+        if (error != iNES::LoadError::NO_ERROR) {
+            return error;
+        }
+    } while (count > 0);
+
+    return checkCRC && crc != expectedCRC ? iNES::LoadError::READ_ERROR : iNES::LoadError::NO_ERROR;
+}
+
+uint64_t ROMStream::getSizeLimit() const {
+    return sizeLimit;
+}
+
+ROMStream::Format ROMStream::getFormat() const {
+    return format;
+}
\ No newline at end of file
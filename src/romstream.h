@@ -0,0 +1,97 @@
+#pragma once
+
+#include "ines.h"
+
+#include <fstream>
+#include <memory>
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+/**
+ * A forward-only stream of the contents of a ROM file, which may be plain, gzip-compressed or the first .nes entry of
+ * a zip archive (stored or deflated). Compressed data is inflated straight into the caller's buffers; only a small
+ * window of the compressed input is ever held in memory, and nothing is written to disk.
+ *
+ * Reading deflated data needs zlib. Builds without it still read plain files and stored zip entries, and report
+ * LoadError::UNSUPPORTED_COMPRESSION for everything else.
+ */
+class ROMStream {
+public:
+    enum class Format {
+        RAW,
+        GZIP,
+        ZIP
+    };
+
+    ~ROMStream();
+
+    ROMStream(const ROMStream &) = delete;
+
+    ROMStream &operator=(const ROMStream &) = delete;
+
+    /**
+     * Opens a file and works out its format from its first bytes.
+     */
+    static iNES::LoadError open(const std::string &file, std::unique_ptr<ROMStream> &outStream);
+
+    /**
+     * Reads exactly `size` bytes.
+     * @return NO_ERROR, TRUNCATED if the data ended first, or READ_ERROR if it is corrupt.
+     */
+    iNES::LoadError read(uint8_t *data, size_t size);
+
+    /**
+     * Consumes the rest of the data, checking it against the archive's checksum. Plain files have no checksum, so
+     * this does nothing for them.
+     */
+    iNES::LoadError finish();
+
+    /**
+     * @return The most bytes that can still be read: exact for plain files and zip entries that give their size, and
+     * MAX_INFLATED_SIZE less what has been read for everything else. Sizes taken from a header can be checked against
+     * this before anything is allocated for them.
+     */
+    uint64_t getSizeLimit() const;
+
+    // The most a gzip file, or a zip entry that doesn't give its size, is trusted to inflate to.
+    static const uint64_t MAX_INFLATED_SIZE;
+
+    Format getFormat() const;
+
+private:
+    struct Inflater;
+
+    ROMStream();
+
+    iNES::LoadError openZipEntry();
+
+    /**
+     * Reads up to `size` bytes, stopping early only at the end of the data.
+     */
+    iNES::LoadError readSome(uint8_t *data, size_t size, size_t &outCount);
+
+    bool fill();
+
+    bool readInput(uint8_t *data, size_t size);
+
+    bool skipInput(uint64_t size);
+
+    std::ifstream in;
+    Format format;
+
+    // Compressed input that has been read from the file but not consumed yet.
+    std::vector<uint8_t> input;
+    size_t inputPosition;
+    size_t inputSize;
+
+    bool deflated;
+    uint64_t remaining;     // Bytes of the zip entry that are still in the file, or the maximum if unknown.
+    bool checkCRC;
+    uint32_t crc;
+    uint32_t expectedCRC;
+    uint64_t sizeLimit;
+
+    std::unique_ptr<Inflater> inflater;
+};
\ No newline at end of file
@@ -0,0 +1,105 @@
+#include "runahead.h"
+
+#include "nes.h"
+
+#include <chrono>
+
+typedef std::chrono::steady_clock Clock;
+
+static double getMicroseconds(Clock::time_point start, Clock::time_point end) {
+    return std::chrono::duration<double, std::micro>(end - start).count();
+}
+
+double RunAhead::Timings::getOverhead() const {
+    return save + aheadFrames + load;
+}
+
+RunAhead::RunAhead(NES *nes, unsigned int frames)
+    : nes(nes),
+      frames(frames),
+      state(),
+      last(),
+      total(),
+      frameCount(0)
+{
+}
+
+void RunAhead::setFrames(unsigned int frames) {
+    this->frames = frames;
+}
+
+unsigned int RunAhead::getFrames() const {
+    return frames;
+}
+
+void RunAhead::runFrame() {
+    PPU *ppu = nes->getPPU();
+    Timings timings = {};
+
+    if (frames == 0) {
+        const Clock::time_point start = Clock::now();
+        nes->runFrame();
+        timings.realFrame = getMicroseconds(start, Clock::now());
+    } else {
+        const Clock::time_point start = Clock::now();
+
+        ppu->setOutputSuppressed(true);
+        nes->runFrame();
+
+        const Clock::time_point realFrameEnd = Clock::now();
+
+        // The state vector keeps its capacity, so this doesn't allocate after the first frame.
+        nes->saveState(state);
+
+        const Clock::time_point saveEnd = Clock::now();
+
+        for (unsigned int i = 1; i < frames; i++) {
+            nes->runFrame();
+        }
+
+        ppu->setOutputSuppressed(false);
+        nes->runFrame();
+
+        const Clock::time_point aheadEnd = Clock::now();
+
+        // A state we just saved from the same machine always loads.
+        nes->loadState(state.data(), state.size());
+
+        const Clock::time_point loadEnd = Clock::now();
+
+        timings.realFrame = getMicroseconds(start, realFrameEnd);
+        timings.save = getMicroseconds(realFrameEnd, saveEnd);
+        timings.aheadFrames = getMicroseconds(saveEnd, aheadEnd);
+        timings.load = getMicroseconds(aheadEnd, loadEnd);
+    }
+
+    last = timings;
+    total.realFrame += timings.realFrame;
+    total.save += timings.save;
+    total.aheadFrames += timings.aheadFrames;
+    total.load += timings.load;
+    frameCount++;
+}
+
+const RunAhead::Timings *RunAhead::getLastTimings() const {
+    return &last;
+}
+
+RunAhead::Timings RunAhead::getAverageTimings() const {
+    Timings average = {};
+
+    if (frameCount != 0) {
+        average.realFrame = total.realFrame / frameCount;
+        average.save = total.save / frameCount;
+        average.aheadFrames = total.aheadFrames / frameCount;
+        average.load = total.load / frameCount;
+    }
+
+    return average;
+}
+
+void RunAhead::resetTimings() {
+    last = Timings();
+    total = Timings();
+    frameCount = 0;
+}
\ No newline at end of file
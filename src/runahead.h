@@ -0,0 +1,67 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+
+class NES;
+
+/**
+ * Hides the input lag built into a game's own logic by showing frames from a little bit in the future.
+ *
+ * Each call to runFrame() runs the real frame with the PPU's output suppressed, saves the machine, runs a few more
+ * frames ahead with the same input, shows the last of them and then loads the saved state again. A game that takes
+ * two frames to react to a button then reacts on screen right away, at the cost of emulating 1 + N frames per
+ * displayed frame. Only the shown frame is fully rendered and heard; the others just do what the game can observe.
+ */
+class RunAhead {
+public:
+    /**
+     * How long the parts of one runFrame() took, in microseconds.
+     */
+    struct Timings {
+        double realFrame;   // Running the frame that counts.
+        double save;        // Saving the state after it.
+        double aheadFrames; // Running the frames ahead, including the shown one.
+        double load;        // Going back to the saved state.
+
+        /**
+         * @return Everything that was spent on top of running the real frame.
+         */
+        double getOverhead() const;
+    };
+
+    /**
+     * @param nes The machine to run.
+     * @param frames How many frames ahead to show. With 0, runFrame() just runs and shows the frame.
+     */
+    RunAhead(NES *nes, unsigned int frames);
+
+    void setFrames(unsigned int frames);
+
+    unsigned int getFrames() const;
+
+    /**
+     * Runs one frame with whatever input the machine currently has. Afterwards the PPU's framebuffer holds the frame
+     * to show, and the machine is in the state right after the real frame.
+     */
+    void runFrame();
+
+    const Timings *getLastTimings() const;
+
+    /**
+     * @return The timings averaged over every runFrame() since the last resetTimings().
+     */
+    Timings getAverageTimings() const;
+
+    void resetTimings();
+
+private:
+    NES *nes;
+    unsigned int frames;
+
+    std::vector<uint8_t> state;
+
+    Timings last;
+    Timings total;
+    uint64_t frameCount;
+};
\ No newline at end of file
@@ -0,0 +1,25 @@
+#include "savestate.h"
+
+// Bump this whenever any component's state changes.
+const uint32_t SAVE_STATE_VERSION = 5;
+
+std::string getStateLoadErrorMessage(StateLoadError error) {
+    switch (error) {
+        case StateLoadError::NO_ERROR:
+            return "No error.";
+
+        case StateLoadError::MAGIC_BYTES_MISMATCH:
+            return "Magic bytes do not match. This is not a save state!";
+
+        case StateLoadError::VERSION_MISMATCH:
+            return "The save state was made by a different version of the emulator!";
+
+        case StateLoadError::CARTRIDGE_MISMATCH:
+            return "The save state was made with a different cartridge!";
+
+        case StateLoadError::TRUNCATED:
+            return "The save state is shorter than it should be!";
+    }
+
+    return "N/A";
+}
\ No newline at end of file
@@ -0,0 +1,104 @@
+#pragma once
+
+#include <vector>
+#include <string>
+#include <type_traits>
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+
+/*
+ * Save states.
+ *
+ * A save state is a header followed by every component's state, written one after another in a fixed order with no
+ * tags or padding. Values are copied as they are laid out in memory, so states are as fast to write and read as a
+ * memcpy, and are only meant to be loaded on a machine with the same byte order.
+ */
+
+extern const uint32_t SAVE_STATE_VERSION;
+
+enum class StateLoadError {
+    NO_ERROR,
+    MAGIC_BYTES_MISMATCH,
+    VERSION_MISMATCH,
+    CARTRIDGE_MISMATCH,
+    TRUNCATED
+};
+
+std::string getStateLoadErrorMessage(StateLoadError error);
+
+class StateWriter {
+public:
+    /**
+     * @param out The buffer to append to. Reusing the same buffer for every save avoids allocating once it's big
+     * enough.
+     */
+    explicit StateWriter(std::vector<uint8_t> &out) : out(out) {
+    }
+
+    template<typename T>
+    void write(const T &value) {
+        static_assert(std::is_trivially_copyable<T>::value, "Only plain values can be written directly");
+        writeBytes(&value, sizeof(value));
+    }
+
+    void writeBytes(const void *data, size_t size) {
+        const size_t offset = out.size();
+        out.resize(offset + size);
+        std::memcpy(out.data() + offset, data, size);
+    }
+
+    void writeVector(const std::vector<uint8_t> &data) {
+        writeBytes(data.data(), data.size());
+    }
+
+private:
+    std::vector<uint8_t> &out;
+};
+
+/**
+ * Reads a state back. Reads past the end don't touch the destination and mark the reader as failed, so components
+ * can read their whole state and the caller checks for errors once at the end.
+ */
+class StateReader {
+public:
+    StateReader(const uint8_t *data, size_t size) : data(data), size(size), position(0), failed(false) {
+    }
+
+    template<typename T>
+    void read(T &value) {
+        static_assert(std::is_trivially_copyable<T>::value, "Only plain values can be read directly");
+        readBytes(&value, sizeof(value));
+    }
+
+    void readBytes(void *destination, size_t count) {
+        if (failed || count > size - position) {
+            failed = true;
+            return;
+        }
+
+        std::memcpy(destination, data + position, count);
+        position += count;
+    }
+
+    /**
+     * Reads into an existing vector. The vector keeps its size, so nothing is reallocated.
+     */
+    void readVector(std::vector<uint8_t> &destination) {
+        readBytes(destination.data(), destination.size());
+    }
+
+    bool hasFailed() const {
+        return failed;
+    }
+
+    size_t getPosition() const {
+        return position;
+    }
+
+private:
+    const uint8_t *data;
+    size_t size;
+    size_t position;
+    bool failed;
+};
\ No newline at end of file
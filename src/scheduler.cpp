@@ -0,0 +1,87 @@
+#include "scheduler.h"
+
+#include "savestate.h"
+
+#include <limits>
+
+const uint64_t Scheduler::NEVER = std::numeric_limits<uint64_t>::max();
+
+Scheduler::Scheduler()
+    : time(0),
+      nextEventTime(NEVER)
+{
+    reset();
+}
+
+void Scheduler::reset() {
+    time = 0;
+    nextEventTime = NEVER;
+
+    for (auto &eventTime : eventTimes) {
+        eventTime = NEVER;
+    }
+}
+
+uint64_t Scheduler::getTime() const {
+    return time;
+}
+
+void Scheduler::advance(uint64_t ticks) {
+    time += ticks;
+}
+
+void Scheduler::schedule(EventType type, uint64_t time) {
+    eventTimes[(size_t)type] = time;
+    updateNextEventTime();
+}
+
+void Scheduler::cancel(EventType type) {
+    schedule(type, NEVER);
+}
+
+bool Scheduler::isScheduled(EventType type) const {
+    return eventTimes[(size_t)type] != NEVER;
+}
+
+uint64_t Scheduler::getEventTime(EventType type) const {
+    return eventTimes[(size_t)type];
+}
+
+bool Scheduler::popDueEvent(EventType *outType) {
+    if (!hasDueEvent()) {
+        return false;
+    }
+
+    for (size_t i = 0; i < (size_t)EventType::COUNT; i++) {
+        if (eventTimes[i] == nextEventTime) {
+            eventTimes[i] = NEVER;
+            updateNextEventTime();
+
+            if (outType) *outType = (EventType)i;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+void Scheduler::updateNextEventTime() {
+    nextEventTime = NEVER;
+
+    for (auto eventTime : eventTimes) {
+        if (eventTime < nextEventTime) {
+            nextEventTime = eventTime;
+        }
+    }
+}
+
+void Scheduler::saveState(StateWriter &writer) const {
+    writer.write(time);
+    writer.write(eventTimes);
+}
+
+void Scheduler::loadState(StateReader &reader) {
+    reader.read(time);
+    reader.read(eventTimes);
+    updateNextEventTime();
+}
\ No newline at end of file
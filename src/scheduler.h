@@ -0,0 +1,78 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+
+/**
+ * Things that happen at a known point in time rather than in response to a memory access. Every component owns a
+ * single slot, which it re-arms from its own event handler.
+ */
+class StateWriter;
+class StateReader;
+
+enum class EventType : uint8_t {
+    PPU,
+    MAPPER,
+    APU,
+    COUNT
+};
+
+/**
+ * Keeps the emulated time, in PPU dots, and the time at which each EventType is next due.
+ *
+ * There are only a handful of event types, so instead of a priority queue every type has a fixed slot and the
+ * earliest time is cached. Checking whether anything is due is a single comparison, which is all the CPU loop
+ * pays between events.
+ */
+class Scheduler {
+public:
+    static const uint64_t NEVER;
+
+    Scheduler();
+
+    /**
+     * Goes back to time 0 with nothing scheduled.
+     */
+    void reset();
+
+    uint64_t getTime() const;
+
+    void advance(uint64_t ticks);
+
+    void schedule(EventType type, uint64_t time);
+
+    void cancel(EventType type);
+
+    bool isScheduled(EventType type) const;
+
+    uint64_t getEventTime(EventType type) const;
+
+    bool hasDueEvent() const {
+        return time >= nextEventTime;
+    }
+
+    /**
+     * @return When the earliest event is due, or NEVER.
+     */
+    uint64_t getNextEventTime() const {
+        return nextEventTime;
+    }
+
+    /**
+     * Removes the earliest event that is due at the current time.
+     * @param outType Receives the type of the event.
+     * @return false if no event is due.
+     */
+    bool popDueEvent(EventType *outType);
+
+    void saveState(StateWriter &writer) const;
+
+    void loadState(StateReader &reader);
+
+private:
+    uint64_t time;
+    uint64_t nextEventTime;
+    uint64_t eventTimes[(size_t)EventType::COUNT];
+
+    void updateNextEventTime();
+};
\ No newline at end of file
@@ -0,0 +1,462 @@
+#include "synthrom.h"
+
+#include "op.h"
+
+#include <vector>
+#include <fstream>
+#include <cstring>
+
+using AM = Op::AddressingMode;
+
+static const size_t PRG_ROM_SIZE = 0x8000;
+static const Address PRG_ROM_START = 0x8000;
+
+// The generated loop ends before this address; the NMI handler and the vectors come after it.
+static const Address NMI_HANDLER = 0xFF00;
+
+static const char *const WORKLOAD_NAMES[] = {
+    "idle", "alu", "zero_page", "indirect", "branches", "ppu_registers", "oam_dma", "controller", "tone", "input"
+};
+
+static_assert(sizeof(WORKLOAD_NAMES) / sizeof(WORKLOAD_NAMES[0]) == (size_t)SynthROM::Workload::COUNT,
+              "Every workload needs a name");
+
+namespace {
+    // xorshift64*: tiny, fast and the same everywhere, unlike the distributions of <random>.
+    class Random {
+    public:
+        explicit Random(uint64_t seed) : state(seed != 0 ? seed : 0x9E3779B97F4A7C15ull) {
+        }
+
+        uint64_t next() {
+            state ^= state >> 12;
+            state ^= state << 25;
+            state ^= state >> 27;
+            return state * 0x2545F4914F6CDD1Dull;
+        }
+
+        unsigned int below(unsigned int limit) {
+            return (unsigned int)((next() >> 32) % limit);
+        }
+
+        uint8_t byte() {
+            return (uint8_t)(next() >> 56);
+        }
+
+    private:
+        uint64_t state;
+    };
+
+    /**
+     * Emits instructions by mnemonic and addressing mode, looked up in the CPU's opcode table.
+     */
+    class Assembler {
+    public:
+        Assembler(uint8_t *prgROM, Address start) : prgROM(prgROM), position(start) {
+        }
+
+        Address getPosition() const {
+            return position;
+        }
+
+        void emit(const Op::Opcode *opcode, uint16_t operand = 0) {
+            const size_t operandCount = Op::getAddressingModeOperandCount(opcode->mode);
+
+            put(opcode->code);
+
+            if (operandCount >= 1) {
+                put((uint8_t)operand);
+            }
+
+            if (operandCount == 2) {
+                put((uint8_t)(operand >> 8));
+            }
+        }
+
+        void emit(const char *name, AM mode, uint16_t operand = 0) {
+            emit(find(name, mode), operand);
+        }
+
+        /**
+         * Emits a branch back to `target`, which must be within reach.
+         */
+        void branchBack(const char *name, Address target) {
+            emit(name, AM::RELATIVE, (uint8_t)(target - (position + 2)));
+        }
+
+        /**
+         * @return The first opcode in the table with this mnemonic and addressing mode, which for every instruction
+         * the generator uses is the documented one, or nullptr if there is none.
+         */
+        static const Op::Opcode *find(const char *name, AM mode) {
+            for (unsigned int code = 0; code < 0x100; code++) {
+                const Op::Opcode *opcode = Op::decode((uint8_t)code);
+
+                if (opcode != nullptr && opcode->mode == mode && std::strcmp(opcode->name, name) == 0) {
+                    return opcode;
+                }
+            }
+
+            return nullptr;
+        }
+
+    private:
+        uint8_t *prgROM;
+        Address position;
+
+        void put(uint8_t value) {
+            prgROM[position - PRG_ROM_START] = value;
+            position++;
+        }
+    };
+
+    /**
+     * Every documented opcode with one of these mnemonics and one of these addressing modes.
+     */
+    std::vector<const Op::Opcode *> findOpcodes(std::initializer_list<const char *> names,
+                                                std::initializer_list<AM> modes) {
+        std::vector<const Op::Opcode *> opcodes;
+
+        for (const char *name : names) {
+            for (AM mode : modes) {
+                const Op::Opcode *opcode = Assembler::find(name, mode);
+
+                if (opcode != nullptr) {
+                    opcodes.push_back(opcode);
+                }
+            }
+        }
+
+        return opcodes;
+    }
+}
+
+static const std::vector<const Op::Opcode *> &getALUOpcodes() {
+    static const std::vector<const Op::Opcode *> opcodes = findOpcodes(
+        { "ADC", "SBC", "AND", "ORA", "EOR", "CMP", "CPX", "CPY", "ASL", "LSR", "ROL", "ROR", "INX", "INY", "DEX",
+          "DEY", "CLC", "SEC", "CLV", "TAX", "TXA", "TAY", "TYA" },
+        { AM::IMMEDIATE, AM::ACCUMULATOR, AM::IMPLICIT });
+    return opcodes;
+}
+
+static const std::vector<const Op::Opcode *> &getZeroPageOpcodes() {
+    static const std::vector<const Op::Opcode *> opcodes = findOpcodes(
+        { "LDA", "LDX", "LDY", "STA", "STX", "STY", "ADC", "SBC", "AND", "ORA", "EOR", "CMP", "BIT", "INC", "DEC",
+          "ASL", "LSR", "ROL", "ROR" },
+        { AM::ZERO_PAGE, AM::ZERO_PAGE_X, AM::ZERO_PAGE_Y });
+    return opcodes;
+}
+
+// X stays 0, so that (zp,X) always lands on a pointer; LDY # varies the index of (zp),Y.
+static const std::vector<const Op::Opcode *> &getIndirectOpcodes() {
+    static const std::vector<const Op::Opcode *> opcodes = findOpcodes(
+        { "LDA", "STA", "ADC", "SBC", "AND", "ORA", "EOR", "CMP", "LDY" },
+        { AM::INDIRECT_INDEXED, AM::INDEXED_INDIRECT, AM::IMMEDIATE });
+    return opcodes;
+}
+
+static const std::vector<const Op::Opcode *> &getBranchOpcodes() {
+    static const std::vector<const Op::Opcode *> opcodes = findOpcodes(
+        { "BCC", "BCS", "BEQ", "BNE", "BMI", "BPL", "BVC", "BVS" }, { AM::RELATIVE });
+    return opcodes;
+}
+
+static uint16_t makeOperand(const Op::Opcode *opcode, Random &random) {
+    switch (opcode->mode) {
+        case AM::INDIRECT_INDEXED:
+        case AM::INDEXED_INDIRECT:
+            // The pointers set up by the initialisation code, at even addresses in $00-$7F.
+            return (uint16_t)(random.below(0x40) * 2);
+
+        default:
+            return random.byte();
+    }
+}
+
+static void emitRandom(Assembler &assembler, const std::vector<const Op::Opcode *> &opcodes, Random &random) {
+    const Op::Opcode *opcode = opcodes[random.below((unsigned int)opcodes.size())];
+    assembler.emit(opcode, makeOperand(opcode, random));
+}
+
+// The longest sequence a single step of generation emits, in bytes.
+static const size_t MAX_UNIT_SIZE = 32;
+
+static void emitUnit(SynthROM::Workload workload, Assembler &a, Random &random) {
+    switch (workload) {
+        case SynthROM::Workload::ALU:
+        case SynthROM::Workload::OAM_DMA:
+        case SynthROM::Workload::CONTROLLER:
+        case SynthROM::Workload::TONE:
+            emitRandom(a, getALUOpcodes(), random);
+            break;
+
+        case SynthROM::Workload::ZERO_PAGE:
+            emitRandom(a, getZeroPageOpcodes(), random);
+            break;
+
+        case SynthROM::Workload::INDIRECT:
+            emitRandom(a, getIndirectOpcodes(), random);
+            break;
+
+        case SynthROM::Workload::BRANCHES:
+        case SynthROM::Workload::INPUT: {
+            // Whether the branch is taken depends on the data, but it always lands on the next instruction but one.
+            if (workload == SynthROM::Workload::INPUT && random.below(4) == 0) {
+                // A button decides instead, so machines with different input go different ways.
+                a.emit("LDA", AM::ZERO_PAGE, 0xF0);
+                a.emit("AND", AM::IMMEDIATE, (uint16_t)(1 << random.below(8)));
+            } else {
+                emitRandom(a, getALUOpcodes(), random);
+            }
+
+            const std::vector<const Op::Opcode *> &alu = getALUOpcodes();
+            const Op::Opcode *skipped = alu[random.below((unsigned int)alu.size())];
+            const std::vector<const Op::Opcode *> &branches = getBranchOpcodes();
+
+            a.emit(branches[random.below((unsigned int)branches.size())],
+                   (uint16_t)(1 + Op::getAddressingModeOperandCount(skipped->mode)));
+            a.emit(skipped, random.byte());
+            break;
+        }
+
+        case SynthROM::Workload::PPU_REGISTERS:
+            switch (random.below(5)) {
+                case 0: {
+                    // A run of VRAM writes into the nametables.
+                    a.emit("LDA", AM::IMMEDIATE, (uint16_t)(0x20 + random.below(4)));
+                    a.emit("STA", AM::ABSOLUTE, 0x2006);
+                    a.emit("LDA", AM::IMMEDIATE, random.byte());
+                    a.emit("STA", AM::ABSOLUTE, 0x2006);
+
+                    for (unsigned int i = random.below(4); i < 5; i++) {
+                        a.emit("LDA", AM::IMMEDIATE, random.byte());
+                        a.emit("STA", AM::ABSOLUTE, 0x2007);
+                    }
+                    break;
+                }
+
+                case 1:
+                    a.emit("LDA", AM::ABSOLUTE, 0x2007);
+                    break;
+
+                case 2:
+                    a.emit("BIT", AM::ABSOLUTE, 0x2002);
+                    break;
+
+                case 3:
+                    a.emit("LDA", AM::IMMEDIATE, random.byte());
+                    a.emit("STA", AM::ABSOLUTE, 0x2005);
+                    a.emit("LDA", AM::IMMEDIATE, random.byte());
+                    a.emit("STA", AM::ABSOLUTE, 0x2005);
+                    break;
+
+                case 4:
+                    a.emit("LDA", AM::IMMEDIATE, random.byte());
+                    a.emit("STA", AM::ABSOLUTE, 0x2003);
+                    a.emit("LDA", AM::IMMEDIATE, random.byte());
+                    a.emit("STA", AM::ABSOLUTE, 0x2004);
+                    break;
+            }
+            break;
+
+        case SynthROM::Workload::IDLE:
+        case SynthROM::Workload::COUNT:
+            break;
+    }
+}
+
+/**
+ * What every game does first, and the picture: a palette, a nametable full of different tiles, sprites all over the
+ * screen and NMIs (and rendering) on.
+ */
+static void emitInitialisation(Assembler &a, bool rendering) {
+    a.emit("SEI", AM::IMPLICIT);
+    a.emit("CLD", AM::IMPLICIT);
+    a.emit("LDX", AM::IMMEDIATE, 0xFF);
+    a.emit("TXS", AM::IMPLICIT);
+    a.emit("LDA", AM::IMMEDIATE, 0x40);
+    a.emit("STA", AM::ABSOLUTE, 0x4017);
+
+    // The PPU ignores writes until it has warmed up, for about two frames.
+    for (int i = 0; i < 2; i++) {
+        const Address wait = a.getPosition();
+        a.emit("BIT", AM::ABSOLUTE, 0x2002);
+        a.branchBack("BPL", wait);
+    }
+
+    // Pointers for the indirect addressing modes: the one at 2n points at $0300 + 256 * (n % 4) + (n * 8) % 256, so
+    // adding Y to any of them stays within RAM.
+    a.emit("LDX", AM::IMMEDIATE, 0x00);
+    const Address pointers = a.getPosition();
+    a.emit("TXA", AM::IMPLICIT);
+    a.emit("ASL", AM::ACCUMULATOR);
+    a.emit("ASL", AM::ACCUMULATOR);
+    a.emit("STA", AM::ZERO_PAGE_X, 0x00);
+    a.emit("TXA", AM::IMPLICIT);
+    a.emit("AND", AM::IMMEDIATE, 0x06);
+    a.emit("LSR", AM::ACCUMULATOR);
+    a.emit("CLC", AM::IMPLICIT);
+    a.emit("ADC", AM::IMMEDIATE, 0x03);
+    a.emit("STA", AM::ZERO_PAGE_X, 0x01);
+    a.emit("INX", AM::IMPLICIT);
+    a.emit("INX", AM::IMPLICIT);
+    a.emit("CPX", AM::IMMEDIATE, 0x80);
+    a.branchBack("BNE", pointers);
+
+    // The palette: colours 0-31.
+    a.emit("LDA", AM::IMMEDIATE, 0x3F);
+    a.emit("STA", AM::ABSOLUTE, 0x2006);
+    a.emit("LDA", AM::IMMEDIATE, 0x00);
+    a.emit("STA", AM::ABSOLUTE, 0x2006);
+    a.emit("LDX", AM::IMMEDIATE, 0x00);
+    const Address palette = a.getPosition();
+    a.emit("STX", AM::ABSOLUTE, 0x2007);
+    a.emit("INX", AM::IMPLICIT);
+    a.emit("CPX", AM::IMMEDIATE, 0x20);
+    a.branchBack("BNE", palette);
+
+    // The first nametable and its attributes: tiles 0-255, four times over.
+    a.emit("LDA", AM::IMMEDIATE, 0x20);
+    a.emit("STA", AM::ABSOLUTE, 0x2006);
+    a.emit("LDA", AM::IMMEDIATE, 0x00);
+    a.emit("STA", AM::ABSOLUTE, 0x2006);
+    a.emit("LDY", AM::IMMEDIATE, 0x04);
+    a.emit("LDX", AM::IMMEDIATE, 0x00);
+    const Address nametable = a.getPosition();
+    a.emit("STX", AM::ABSOLUTE, 0x2007);
+    a.emit("INX", AM::IMPLICIT);
+    a.branchBack("BNE", nametable);
+    a.emit("DEY", AM::IMPLICIT);
+    a.branchBack("BNE", nametable);
+
+    // Sprites for OAM DMA from page 2: every byte holds its own index, which scatters them over the screen.
+    const Address sprites = a.getPosition();
+    a.emit("TXA", AM::IMPLICIT);
+    a.emit("STA", AM::ABSOLUTE_X, 0x0200);
+    a.emit("INX", AM::IMPLICIT);
+    a.branchBack("BNE", sprites);
+    a.emit("LDA", AM::IMMEDIATE, 0x02);
+    a.emit("STA", AM::ABSOLUTE, 0x4014);
+
+    a.emit("LDA", AM::IMMEDIATE, 0x00);
+    a.emit("STA", AM::ABSOLUTE, 0x2005);
+    a.emit("STA", AM::ABSOLUTE, 0x2005);
+    a.emit("LDA", AM::IMMEDIATE, 0x80);
+    a.emit("STA", AM::ABSOLUTE, 0x2000);
+    a.emit("LDA", AM::IMMEDIATE, rendering ? 0x1E : 0x00);
+    a.emit("STA", AM::ABSOLUTE, 0x2001);
+
+    a.emit("LDX", AM::IMMEDIATE, 0x00);
+    a.emit("LDY", AM::IMMEDIATE, 0x00);
+}
+
+std::string SynthROM::getWorkloadName(SynthROM::Workload workload) {
+    return workload < Workload::COUNT ? WORKLOAD_NAMES[(size_t)workload] : "unknown";
+}
+
+bool SynthROM::findWorkload(const std::string &name, SynthROM::Workload &outWorkload) {
+    for (size_t i = 0; i < (size_t)Workload::COUNT; i++) {
+        if (name == WORKLOAD_NAMES[i]) {
+            outWorkload = (Workload)i;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+void SynthROM::generate(SynthROM::Workload workload, uint64_t seed, iNES::File &outFile) {
+    iNES::HeaderInfo info = {};
+    info.mapper = 0;
+    info.prgROMSize = PRG_ROM_SIZE;
+    info.chrROMSize = iNES::CHR_ROM_SIZE;
+    info.mirroring = Mirroring::VERTICAL;
+
+    outFile.header = iNES::makeHeader(info);
+    outFile.trainer.clear();
+    outFile.prgROM.assign(PRG_ROM_SIZE, 0xEA);
+    outFile.chrROM.resize(iNES::CHR_ROM_SIZE);
+
+    Random random(seed);
+
+    for (uint8_t &value : outFile.chrROM) {
+        value = random.byte();
+    }
+
+    Assembler a(outFile.prgROM.data(), PRG_ROM_START);
+    emitInitialisation(a, workload != Workload::PPU_REGISTERS);
+
+    if (workload == Workload::TONE) {
+        // Pulse 1 at a constant full volume, half duty, with its length counter halted; a period of 253 is 440 Hz.
+        a.emit("LDA", AM::IMMEDIATE, 0x01);
+        a.emit("STA", AM::ABSOLUTE, 0x4015);
+        a.emit("LDA", AM::IMMEDIATE, 0xBF);
+        a.emit("STA", AM::ABSOLUTE, 0x4000);
+        a.emit("LDA", AM::IMMEDIATE, 0xFD);
+        a.emit("STA", AM::ABSOLUTE, 0x4002);
+        a.emit("LDA", AM::IMMEDIATE, 0x00);
+        a.emit("STA", AM::ABSOLUTE, 0x4003);
+    }
+
+    const Address loop = a.getPosition();
+
+    if (workload != Workload::IDLE) {
+        while (a.getPosition() + MAX_UNIT_SIZE + 3 <= NMI_HANDLER) {
+            emitUnit(workload, a, random);
+        }
+    }
+
+    a.emit("JMP", AM::ABSOLUTE, loop);
+
+    Assembler nmi(outFile.prgROM.data(), NMI_HANDLER);
+
+    if (workload == Workload::OAM_DMA) {
+        // Moves the first sprite along and sends all of them to the PPU.
+        nmi.emit("PHA", AM::IMPLICIT);
+        nmi.emit("INC", AM::ABSOLUTE, 0x0203);
+        nmi.emit("LDA", AM::IMMEDIATE, 0x02);
+        nmi.emit("STA", AM::ABSOLUTE, 0x4014);
+        nmi.emit("PLA", AM::IMPLICIT);
+    } else if (workload == Workload::CONTROLLER || workload == Workload::INPUT) {
+        // Strobes the controller and shifts its eight buttons into $F0, the only place the input goes.
+        nmi.emit("PHA", AM::IMPLICIT);
+        nmi.emit("TXA", AM::IMPLICIT);
+        nmi.emit("PHA", AM::IMPLICIT);
+        nmi.emit("LDA", AM::IMMEDIATE, 0x01);
+        nmi.emit("STA", AM::ABSOLUTE, 0x4016);
+        nmi.emit("LSR", AM::ACCUMULATOR);
+        nmi.emit("STA", AM::ABSOLUTE, 0x4016);
+        nmi.emit("LDX", AM::IMMEDIATE, 0x08);
+        const Address buttons = nmi.getPosition();
+        nmi.emit("LDA", AM::ABSOLUTE, 0x4016);
+        nmi.emit("LSR", AM::ACCUMULATOR);
+        nmi.emit("ROL", AM::ZERO_PAGE, 0xF0);
+        nmi.emit("DEX", AM::IMPLICIT);
+        nmi.branchBack("BNE", buttons);
+        nmi.emit("PLA", AM::IMPLICIT);
+        nmi.emit("TAX", AM::IMPLICIT);
+        nmi.emit("PLA", AM::IMPLICIT);
+    }
+
+    nmi.emit("RTI", AM::IMPLICIT);
+
+    // NMI, reset and IRQ, which never happens.
+    const uint8_t vectors[] = {
+        (uint8_t)NMI_HANDLER, (uint8_t)(NMI_HANDLER >> 8),
+        (uint8_t)PRG_ROM_START, (uint8_t)(PRG_ROM_START >> 8),
+        (uint8_t)NMI_HANDLER, (uint8_t)(NMI_HANDLER >> 8)
+    };
+    std::memcpy(outFile.prgROM.data() + PRG_ROM_SIZE - sizeof(vectors), vectors, sizeof(vectors));
+}
+
+bool SynthROM::writeFile(const iNES::File &file, const std::string &path) {
+    std::ofstream out(path, std::ios::out | std::ios::binary | std::ios::trunc);
+
+    out.write((const char *)&file.header, sizeof(file.header));
+    out.write((const char *)file.trainer.data(), file.trainer.size());
+    out.write((const char *)file.prgROM.data(), file.prgROM.size());
+    out.write((const char *)file.chrROM.data(), file.chrROM.size());
+    out.close();
+
+    return !out.fail();
+}
\ No newline at end of file
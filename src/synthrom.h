@@ -0,0 +1,50 @@
+#pragma once
+
+#include "ines.h"
+
+#include <string>
+#include <cstdint>
+
+/*
+ * Synthetic test ROMs, for benchmarks that have to run the same instruction mix on every machine without shipping
+ * commercial games.
+ *
+ * Every image is a 32 KB NROM cartridge with 8 KB of CHR-ROM. It initialises the machine the way games do (stack,
+ * APU frame IRQ off, two vertical blanks, palette, nametable, sprites), turns on NMIs and, unless the workload
+ * writes to VRAM all the time, rendering, and then runs a long generated loop. The loop's instructions are looked
+ * up by mnemonic and addressing mode in the CPU's opcode table and drawn from a pseudo-random generator, so the same
+ * workload and seed always produce the same bytes.
+ */
+namespace SynthROM {
+    enum class Workload {
+        IDLE,           // Waits for NMIs in a JMP loop, like a game with little to do.
+        ALU,            // Arithmetic, logic, shifts and transfers on registers, no memory accesses.
+        ZERO_PAGE,      // Loads, stores and read-modify-writes in the zero page.
+        INDIRECT,       // (zp),Y and (zp,X) loads and stores into $0300-$07FF.
+        BRANCHES,       // Flag-setting instructions, each followed by a conditional branch over the next one.
+        PPU_REGISTERS,  // VRAM uploads, scroll and OAM writes and status reads, with rendering off.
+        OAM_DMA,        // The ALU mix, with an OAM DMA and a sprite update in every NMI.
+        CONTROLLER,     // The ALU mix, with controller 1 read into the zero page in every NMI, like a game's input.
+        TONE,           // The ALU mix, with a steady 440 Hz square wave playing on the first pulse channel.
+        INPUT,          // The branches mix, with some branches on the buttons the CONTROLLER NMI reads into $F0.
+        COUNT
+    };
+
+    std::string getWorkloadName(Workload workload);
+
+    /**
+     * @return false if there is no workload by that name.
+     */
+    bool findWorkload(const std::string &name, Workload &outWorkload);
+
+    /**
+     * Generates an image. Like a file loaded by iNES::loadFromFile(), it can be turned into a ROMImage.
+     */
+    void generate(Workload workload, uint64_t seed, iNES::File &outFile);
+
+    /**
+     * Writes an image as an iNES file.
+     * @return false if the file couldn't be written.
+     */
+    bool writeFile(const iNES::File &file, const std::string &path);
+}
\ No newline at end of file
@@ -0,0 +1,99 @@
+#include "testrom.h"
+
+#include "nes.h"
+
+#include <algorithm>
+
+const unsigned int TestROM::RESET_DELAY_FRAMES = 6;
+
+static const uint8_t SIGNATURE[3] = { 0xDE, 0xB0, 0x61 };
+static const size_t TEXT_OFFSET = 4;
+
+static const uint8_t STATUS_RUNNING = 0x80;
+static const uint8_t STATUS_RESET_REQUESTED = 0x81;
+
+const char *TestROM::getStatusName(TestROM::Status status) {
+    switch (status) {
+        case TestROM::Status::PASSED:
+            return "passed";
+
+        case TestROM::Status::FAILED:
+            return "failed";
+
+        case TestROM::Status::TIMED_OUT:
+            return "timed out";
+    }
+
+    return "unknown";
+}
+
+bool TestROM::readStatus(Cartridge &cartridge, uint8_t &outStatus) {
+    const uint8_t *prgRAM = cartridge.getPRGRAM();
+
+    if (cartridge.getPRGRAMSize() < TEXT_OFFSET || !std::equal(SIGNATURE, SIGNATURE + sizeof(SIGNATURE), prgRAM + 1)) {
+        return false;
+    }
+
+    outStatus = prgRAM[0];
+    return true;
+}
+
+std::string TestROM::readText(Cartridge &cartridge) {
+    const uint8_t *prgRAM = cartridge.getPRGRAM();
+    std::string text;
+
+    for (size_t i = TEXT_OFFSET; i < cartridge.getPRGRAMSize() && prgRAM[i] != 0; i++) {
+        text += (char)prgRAM[i];
+    }
+
+    // The tests end their messages with a line break or two.
+    while (!text.empty() && (text.back() == '\n' || text.back() == ' ')) {
+        text.pop_back();
+    }
+
+    return text;
+}
+
+TestROM::Result TestROM::run(NES &nes, uint64_t maxFrames) {
+    Cartridge &cartridge = *nes.getCartridge();
+    Result result = { Status::TIMED_OUT, 0, false, std::string(), 0 };
+
+    // The frame on which to press reset, or 0 if no reset is due. A reset is only pressed once per request: the test
+    // is still reporting $81 for a moment after it, until it has started up again.
+    uint64_t resetFrame = 0;
+    bool resetPressed = false;
+
+    while (result.frames < maxFrames) {
+        nes.runFrame();
+        result.frames++;
+
+        uint8_t status;
+
+        if (!readStatus(cartridge, status)) {
+            continue;
+        }
+
+        result.signature = true;
+        result.code = status;
+
+        if (status == STATUS_RESET_REQUESTED) {
+            if (resetPressed) {
+                continue;
+            } else if (resetFrame == 0) {
+                resetFrame = result.frames + RESET_DELAY_FRAMES;
+            } else if (result.frames >= resetFrame) {
+                nes.reset(ResetType::SOFT);
+                resetFrame = 0;
+                resetPressed = true;
+            }
+        } else if (status == STATUS_RUNNING) {
+            resetPressed = false;
+        } else {
+            result.status = status == 0 ? Status::PASSED : Status::FAILED;
+            break;
+        }
+    }
+
+    result.text = readText(cartridge);
+    return result;
+}
\ No newline at end of file
@@ -0,0 +1,52 @@
+#pragma once
+
+#include <string>
+#include <cstdint>
+
+class NES;
+class Cartridge;
+
+/*
+ * The protocol that blargg's test ROMs, and most accuracy tests written since, report their results with, through
+ * PRG-RAM:
+ *
+ *     $6000        The status: $80 while the test runs, $81 if the reset button should be pressed, and otherwise
+ *                  the result code, 0 for a pass.
+ *     $6001-$6003  DE B0 61, once the other bytes are valid.
+ *     $6004-       What the test printed, as text ending with a 0 byte.
+ */
+namespace TestROM {
+    enum class Status {
+        PASSED,
+        FAILED,
+        TIMED_OUT   // The test didn't finish in time, or never wrote the signature.
+    };
+
+    const char *getStatusName(Status status);
+
+    struct Result {
+        Status status;
+        uint8_t code;       // $6000 at the end, if the signature was there.
+        bool signature;     // Whether the test ever wrote the signature.
+        std::string text;
+        uint64_t frames;    // How many frames were run.
+    };
+
+    /**
+     * Reads $6000 if the signature is there.
+     * @return false if it isn't, yet.
+     */
+    bool readStatus(Cartridge &cartridge, uint8_t &outStatus);
+
+    std::string readText(Cartridge &cartridge);
+
+    /**
+     * Runs a freshly powered on NES until its test finishes or `maxFrames` frames have passed. The status is only
+     * polled between frames; a test asking for a reset gets one RESET_DELAY_FRAMES frames later, as the tests need a
+     * moment to get ready for it.
+     */
+    Result run(NES &nes, uint64_t maxFrames);
+
+    // About 100 ms, which the tests ask to wait before pressing reset.
+    extern const unsigned int RESET_DELAY_FRAMES;
+}
\ No newline at end of file
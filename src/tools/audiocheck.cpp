@@ -0,0 +1,143 @@
+#include "../nes.h"
+#include "../rom.h"
+#include "../runahead.h"
+#include "../synthrom.h"
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <memory>
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+
+/*
+ * Checks that jumping around in time doesn't change what a game sounds like:
+ *
+ *     nesulator_audiocheck [frames ahead]
+ *
+ * Plays the "tone" SynthROM workload, a steady square wave, once frame by frame, then with run-ahead (2 frames ahead
+ * by default) and then while going a few frames back every now and then by loading a state, as rewinding does. Each
+ * frame heard in the latter two runs is compared with the same frame of the plain run: it must have as many samples,
+ * give or take one, and the same mean level, give or take LEVEL_TOLERANCE. Exits with 0 if every frame matched.
+ */
+
+static const unsigned int FRAMES = 300;
+
+// Frames left out of the comparison while the output's high-pass filter settles from power-on.
+static const unsigned int SETTLE_FRAMES = 30;
+
+// Every REWIND_INTERVAL frames, the rewinding run goes REWIND_FRAMES frames back.
+static const unsigned int REWIND_INTERVAL = 7;
+static const unsigned int REWIND_FRAMES = 3;
+
+// A full-volume pulse moves the output by about 3700, and a frame of a 440 Hz tone ends mid-cycle, so a frame's mean
+// swings by a hundred or so in the plain run. An output that had lost track of the channels would be off by hundreds
+// more, in the frames after the jump.
+static const double LEVEL_TOLERANCE = 64.0;
+
+struct FrameAudio {
+    size_t samples;
+    double mean;
+};
+
+static std::unique_ptr<NES> makeNES(const std::shared_ptr<const ROMImage> &rom) {
+    Cartridge cartridge(rom);
+    std::unique_ptr<NES> nes(new NES(cartridge));
+    nes->getDiagnostics()->verbose = false;
+    return nes;
+}
+
+static FrameAudio readFrame(NES &nes) {
+    std::vector<int16_t> samples(nes.getAPU()->getAvailableSamples());
+    const size_t count = nes.getAPU()->readSamples(samples.data(), samples.size());
+
+    double sum = 0.0;
+
+    for (size_t i = 0; i < count; i++) {
+        sum += samples[i];
+    }
+
+    return { count, count != 0 ? sum / count : 0.0 };
+}
+
+/**
+ * @return How many frames didn't match.
+ */
+static unsigned int compare(const std::string &name, const std::vector<FrameAudio> &plain,
+                            const std::vector<FrameAudio> &heard, const std::vector<size_t> &frames) {
+    unsigned int failures = 0;
+
+    for (size_t i = SETTLE_FRAMES; i < heard.size(); i++) {
+        const FrameAudio &expected = plain[frames[i]];
+        const FrameAudio &actual = heard[i];
+        const size_t countDifference = std::max(expected.samples, actual.samples) -
+                                       std::min(expected.samples, actual.samples);
+
+        if ((countDifference > 1 || std::abs(expected.mean - actual.mean) > LEVEL_TOLERANCE) && failures++ < 10) {
+            std::cout << name << ", frame " << i << ": " << actual.samples << " samples with a mean of "
+                      << actual.mean << ", expected " << expected.samples << " with a mean of " << expected.mean
+                      << "\n";
+        }
+    }
+
+    std::cout << name << ": " << (heard.size() - SETTLE_FRAMES - failures) << " of " << (heard.size() - SETTLE_FRAMES)
+              << " frames matched\n";
+
+    return failures;
+}
+
+int main(int argc, char **argv) {
+    const unsigned int ahead = argc > 1 ? (unsigned int)std::max(1, std::atoi(argv[1])) : 2;
+
+    iNES::File file;
+    SynthROM::generate(SynthROM::Workload::TONE, 1, file);
+    const std::shared_ptr<const ROMImage> rom = ROMImage::create(file);
+
+    // plain[i] is the audio of the machine's frame i, counting from 0.
+    std::vector<FrameAudio> plain;
+    std::unique_ptr<NES> plainNES = makeNES(rom);
+
+    for (unsigned int frame = 0; frame < FRAMES + ahead; frame++) {
+        plainNES->runFrame();
+        plain.push_back(readFrame(*plainNES));
+    }
+
+    // Run-ahead plays frame i + N on its i-th call.
+    std::vector<FrameAudio> heard;
+    std::vector<size_t> frames;
+    std::unique_ptr<NES> aheadNES = makeNES(rom);
+    RunAhead runAhead(aheadNES.get(), ahead);
+
+    for (unsigned int frame = 0; frame < FRAMES; frame++) {
+        runAhead.runFrame();
+        heard.push_back(readFrame(*aheadNES));
+        frames.push_back(frame + ahead);
+    }
+
+    unsigned int failures = compare("Run-ahead (" + std::to_string(ahead) + " frames)", plain, heard, frames);
+
+    // Rewinding plays frames again, from states saved at the start of each.
+    std::vector<std::vector<uint8_t>> states(FRAMES);
+    std::unique_ptr<NES> rewindNES = makeNES(rom);
+    size_t position = 0;
+
+    heard.clear();
+    frames.clear();
+
+    for (unsigned int frame = 0; frame < FRAMES; frame++) {
+        if (frame % REWIND_INTERVAL == REWIND_INTERVAL - 1) {
+            position -= REWIND_FRAMES;
+            rewindNES->loadState(states[position].data(), states[position].size());
+        }
+
+        rewindNES->saveState(states[position]);
+        rewindNES->runFrame();
+        heard.push_back(readFrame(*rewindNES));
+        frames.push_back(position++);
+    }
+
+    failures += compare("Rewinding", plain, heard, frames);
+
+    return failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
\ No newline at end of file
@@ -0,0 +1,604 @@
+#include "../nes.h"
+#include "../ines.h"
+#include "../rom.h"
+#include "../mappers.h"
+#include "../ppu.h"
+#include "../synthrom.h"
+#include "../lockstep.h"
+#include "../vectorlockstep.h"
+
+#include <iostream>
+#include <fstream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <memory>
+#include <algorithm>
+#include <functional>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+/*
+ * Measures the emulator's hot paths and writes the results as JSON, for CI to track:
+ *
+ *     nesulator_bench [-s samples] [-f frames] [-o results.json] [filter]
+ *
+ * Micro benchmarks time one operation in a loop (CPU::step on each SynthROM workload, Memory::readCPU by region,
+ * mapper reads, PPU register writes, OAM DMA, loading an iNES file); every sample is the mean of a batch of
+ * iterations. Macro benchmarks run every SynthROM workload for the given number of frames, one sample per frame, and
+ * Lockstep and VectorLockstep on 32 lanes with more or less divergent inputs.
+ * Only benchmarks whose name contains the filter run.
+ *
+ * Every result has the median, the 99th percentile, the mean and the variance of its samples, in nanoseconds per
+ * operation (or frame). The median is the number to compare between builds; the variance tells whether it is.
+ */
+
+struct BenchOptions {
+    unsigned int samples = 21;
+    unsigned int frames = 600;
+    std::string output;
+    std::string filter;
+};
+
+struct BenchResult {
+    std::string name;
+    uint64_t iterations;        // Per sample.
+    std::vector<double> samples; // Nanoseconds per iteration.
+};
+
+// Keeps the compiler from optimising away reads whose results aren't otherwise used.
+static volatile uint32_t sink;
+
+class BenchRunner {
+public:
+    explicit BenchRunner(const BenchOptions &options) : options(options), results() {
+    }
+
+    bool isSelected(const std::string &name) const {
+        return name.find(options.filter) != std::string::npos;
+    }
+
+    /**
+     * Times `function(iterations)` once per sample; `setUp` runs before every sample, untimed.
+     */
+    void measure(const std::string &name, uint64_t iterations, const std::function<void(uint64_t)> &function,
+                 const std::function<void()> &setUp = nullptr) {
+        if (!isSelected(name)) {
+            return;
+        }
+
+        BenchResult result = { name, iterations, {} };
+
+        // One untimed round to warm up the caches and the branch predictors.
+        if (setUp) {
+            setUp();
+        }
+
+        function(iterations);
+
+        for (unsigned int i = 0; i < options.samples; i++) {
+            if (setUp) {
+                setUp();
+            }
+
+            const auto start = std::chrono::steady_clock::now();
+            function(iterations);
+            const auto end = std::chrono::steady_clock::now();
+
+            result.samples.push_back(std::chrono::duration<double, std::nano>(end - start).count() / iterations);
+        }
+
+        add(std::move(result));
+    }
+
+    void add(BenchResult result) {
+        std::cerr << std::left << std::setw(40) << result.name << std::right << std::fixed << std::setprecision(2)
+                  << std::setw(14) << getMedian(result.samples) << " ns\n";
+        results.push_back(std::move(result));
+    }
+
+    void writeJSON(std::ostream &out) const {
+        out << "{\n  \"samples\": " << options.samples << ",\n  \"frames\": " << options.frames
+            << ",\n  \"unit\": \"ns\",\n  \"benchmarks\": [";
+
+        for (size_t i = 0; i < results.size(); i++) {
+            const BenchResult &result = results[i];
+            double mean = 0, variance = 0;
+
+            for (double sample : result.samples) {
+                mean += sample;
+            }
+
+            mean /= result.samples.size();
+
+            for (double sample : result.samples) {
+                variance += (sample - mean) * (sample - mean);
+            }
+
+            variance /= std::max<size_t>(result.samples.size() - 1, 1);
+
+            out << (i == 0 ? "\n" : ",\n") << "    { \"name\": \"" << result.name << "\", \"iterations\": "
+                << result.iterations << ", \"samples\": " << result.samples.size() << std::fixed
+                << std::setprecision(3) << ", \"median\": " << getMedian(result.samples) << ", \"p99\": "
+                << getPercentile(result.samples, 0.99) << ", \"mean\": " << mean << ", \"variance\": " << variance
+                << " }";
+        }
+
+        out << "\n  ]\n}\n";
+    }
+
+    unsigned int getFrames() const {
+        return options.frames;
+    }
+
+private:
+    const BenchOptions &options;
+    std::vector<BenchResult> results;
+
+    static double getMedian(std::vector<double> samples) {
+        std::sort(samples.begin(), samples.end());
+        const size_t middle = samples.size() / 2;
+        return samples.size() % 2 != 0 ? samples[middle] : (samples[middle - 1] + samples[middle]) / 2;
+    }
+
+    // Nearest rank.
+    static double getPercentile(std::vector<double> samples, double fraction) {
+        std::sort(samples.begin(), samples.end());
+        const size_t rank = (size_t)std::ceil(fraction * samples.size());
+        return samples[std::max<size_t>(rank, 1) - 1];
+    }
+};
+
+/**
+ * An image that only has a header to speak of, for the mapper benchmarks, which don't run any code.
+ */
+static void makeFile(uint16_t mapper, size_t prgROMSize, size_t chrROMSize, iNES::File &outFile) {
+    iNES::HeaderInfo info = {};
+    info.mapper = mapper;
+    info.prgROMSize = prgROMSize;
+    info.chrROMSize = chrROMSize;
+    info.prgRAMSize = iNES::PRG_RAM_SIZE;
+    info.mirroring = Mirroring::VERTICAL;
+
+    outFile.header = iNES::makeHeader(info);
+    outFile.trainer.clear();
+    outFile.prgROM.assign(prgROMSize, 0xEA);
+    outFile.chrROM.assign(chrROMSize, 0x55);
+}
+
+static std::unique_ptr<NES> makeNES(iNES::File &file) {
+    Cartridge cartridge(ROMImage::create(file));
+    std::unique_ptr<NES> nes(new NES(cartridge));
+    nes->getDiagnostics()->verbose = false;
+    return nes;
+}
+
+static std::unique_ptr<NES> makeNES(SynthROM::Workload workload) {
+    iNES::File file;
+    SynthROM::generate(workload, 1, file);
+    std::unique_ptr<NES> nes = makeNES(file);
+
+    // Get through the initialisation and into the generated loop.
+    for (unsigned int i = 0; i < 4; i++) {
+        nes->runFrame();
+    }
+
+    return nes;
+}
+
+static void benchCPU(BenchRunner &runner) {
+    for (size_t i = 0; i < (size_t)SynthROM::Workload::COUNT; i++) {
+        const SynthROM::Workload workload = (SynthROM::Workload)i;
+        const std::string name = "cpu.step." + SynthROM::getWorkloadName(workload);
+
+        if (!runner.isSelected(name)) {
+            continue;
+        }
+
+        std::unique_ptr<NES> nes = makeNES(workload);
+        CPU *cpu = nes->getCPU();
+
+        // Only the CPU runs, so no NMI comes and the generated loop is all that is timed.
+        runner.measure(name, 100000, [cpu](uint64_t iterations) {
+            for (uint64_t i = 0; i < iterations; i++) {
+                cpu->step();
+            }
+        });
+    }
+}
+
+static void benchMemory(BenchRunner &runner) {
+    static const struct {
+        const char *name;
+        Address base;
+        Address mask;
+    } REGIONS[] = {
+        { "ram", 0x0000, 0x07FF },
+        { "ram_mirror", 0x0800, 0x17FF },
+        { "ppu_register", 0x2002, 0x0000 },
+        { "apu_status", 0x4015, 0x0000 },
+        { "controller", 0x4016, 0x0000 },
+        { "prg_ram", 0x6000, 0x1FFF },
+        { "prg_rom", 0x8000, 0x7FFF },
+    };
+
+    std::unique_ptr<NES> nes = makeNES(SynthROM::Workload::IDLE);
+    Memory *mem = nes->getMemory();
+
+    for (const auto &region : REGIONS) {
+        const Address base = region.base, mask = region.mask;
+
+        runner.measure(std::string("memory.read_cpu.") + region.name, 1000000, [mem, base, mask](uint64_t iterations) {
+            uint32_t sum = 0;
+
+            for (uint64_t i = 0; i < iterations; i++) {
+                sum += mem->readCPU((Address)(base + (i & mask)));
+            }
+
+            sink = sum;
+        });
+    }
+}
+
+static void benchMappers(BenchRunner &runner) {
+    static const struct {
+        const char *name;
+        uint16_t number;
+    } MAPPERS[] = {
+        { "nrom", 0 },
+        { "mmc1", 1 },
+        { "uxrom", 2 },
+        { "cnrom", 3 },
+        { "mmc3", 4 },
+        { "axrom", 7 },
+    };
+
+    for (const auto &mapperInfo : MAPPERS) {
+        const std::string prefix = std::string("mapper.") + mapperInfo.name;
+
+        if (!runner.isSelected(prefix)) {
+            continue;
+        }
+
+        const bool nrom = mapperInfo.number == 0;
+        iNES::File file;
+        makeFile(mapperInfo.number, nrom ? 0x8000 : 0x20000, nrom ? 0x2000 : 0x8000, file);
+
+        std::unique_ptr<NES> nes = makeNES(file);
+        const Mapper *mapper = nes->getCartridge()->getMapper();
+        Mapper *mutableMapper = nes->getCartridge()->getMapper();
+
+        runner.measure(prefix + ".read_prg", 1000000, [mapper](uint64_t iterations) {
+            uint32_t sum = 0;
+
+            for (uint64_t i = 0; i < iterations; i++) {
+                sum += mapper->readPRG((Address)(0x8000 + (i & 0x7FFF)));
+            }
+
+            sink = sum;
+        });
+
+        runner.measure(prefix + ".read_chr", 1000000, [mapper](uint64_t iterations) {
+            uint32_t sum = 0;
+
+            for (uint64_t i = 0; i < iterations; i++) {
+                sum += mapper->readCHR((Address)(i & 0x1FFF));
+            }
+
+            sink = sum;
+        });
+
+        // The virtual path, which hooked mappers and unusual addresses take.
+        runner.measure(prefix + ".read_cpu", 1000000, [mutableMapper](uint64_t iterations) {
+            uint32_t sum = 0;
+
+            for (uint64_t i = 0; i < iterations; i++) {
+                sum += mutableMapper->readCPU((Address)(0x8000 + (i & 0x7FFF)));
+            }
+
+            sink = sum;
+        });
+    }
+}
+
+static void benchPPU(BenchRunner &runner) {
+    std::unique_ptr<NES> nes = makeNES(SynthROM::Workload::IDLE);
+    PPU *ppu = nes->getPPU();
+
+    runner.measure("ppu.write_register.ctrl", 1000000, [ppu](uint64_t iterations) {
+        for (uint64_t i = 0; i < iterations; i++) {
+            ppu->writeRegister(PPURegister::PPUCTRL, (uint8_t)(i & 0x03));
+        }
+    });
+
+    runner.measure("ppu.write_register.scroll", 1000000, [ppu](uint64_t iterations) {
+        for (uint64_t i = 0; i < iterations; i++) {
+            ppu->writeRegister(PPURegister::PPUSCROLL, (uint8_t)i);
+        }
+    });
+
+    // Filling VRAM, as games do in vertical blank: an address, then a run of data writes.
+    runner.measure("ppu.write_register.data", 1000000, [ppu](uint64_t iterations) {
+        for (uint64_t i = 0; i < iterations; i++) {
+            if ((i & 0x1F) == 0) {
+                ppu->writeRegister(PPURegister::PPUADDR, 0x20);
+                ppu->writeRegister(PPURegister::PPUADDR, 0x00);
+            }
+
+            ppu->writeRegister(PPURegister::PPUDATA, (uint8_t)i);
+        }
+    });
+
+    Memory *mem = nes->getMemory();
+    CPU *cpu = nes->getCPU();
+
+    runner.measure("ppu.oam_dma", 10000, [mem](uint64_t iterations) {
+        for (uint64_t i = 0; i < iterations; i++) {
+            mem->writeCPU(0x4014, 0x02);
+        }
+    }, [cpu]() {
+        // Pay off the stall the previous sample's transfers ran up.
+        cpu->step();
+    });
+}
+
+static void benchINES(BenchRunner &runner) {
+    if (!runner.isSelected("ines.")) {
+        return;
+    }
+
+    // A big cartridge, so that copying shows.
+    iNES::File file;
+    makeFile(4, 0x40000, 0x20000, file);
+
+    const std::string path = "nesulator_bench.tmp.nes";
+
+    if (!SynthROM::writeFile(file, path)) {
+        std::cerr << "Couldn't write " << path << ", skipping the iNES benchmarks\n";
+        return;
+    }
+
+    runner.measure("ines.map_file", 100, [&path](uint64_t iterations) {
+        for (uint64_t i = 0; i < iterations; i++) {
+            std::shared_ptr<const iNES::MappedFile> mapped;
+            iNES::mapFile(path, mapped);
+            sink = ROMImage::create(mapped)->getPRGROM()[0];
+        }
+    });
+
+    runner.measure("ines.load_from_file", 100, [&path](uint64_t iterations) {
+        for (uint64_t i = 0; i < iterations; i++) {
+            iNES::File loaded;
+            iNES::loadFromFile(path, loaded);
+            sink = ROMImage::create(loaded)->getPRGROM()[0];
+        }
+    });
+
+    std::remove(path.c_str());
+}
+
+static void benchFrames(BenchRunner &runner) {
+    for (size_t i = 0; i < (size_t)SynthROM::Workload::COUNT; i++) {
+        const SynthROM::Workload workload = (SynthROM::Workload)i;
+        const std::string name = "frame." + SynthROM::getWorkloadName(workload);
+
+        if (!runner.isSelected(name)) {
+            continue;
+        }
+
+        std::unique_ptr<NES> nes = makeNES(workload);
+        BenchResult result = { name, 1, {} };
+
+        for (unsigned int frame = 0; frame < runner.getFrames(); frame++) {
+            const auto start = std::chrono::steady_clock::now();
+            nes->runFrame();
+            const auto end = std::chrono::steady_clock::now();
+
+            result.samples.push_back(std::chrono::duration<double, std::nano>(end - start).count());
+        }
+
+        runner.add(std::move(result));
+    }
+}
+
+// Lanes in the lockstep benchmarks.
+static const size_t LOCKSTEP_LANES = 32;
+
+/**
+ * Runs LOCKSTEP_LANES lanes of the controller workload, one sample per frame of all of them, with inputs drawn each
+ * frame from `choices` values: 1 keeps every lane on one machine, 256 makes nearly every lane different every frame.
+ * The "independent" benchmark runs the same lanes as separate machines, the baseline lockstep has to beat.
+ */
+static void benchLockstep(BenchRunner &runner) {
+    static const struct {
+        const char *name;
+        unsigned int choices;
+        bool independent;
+    } RUNS[] = {
+        { "lockstep.identical", 1, false },
+        { "lockstep.converging", 4, false },
+        { "lockstep.divergent", 256, false },
+        { "lockstep.independent", 256, true },
+    };
+
+    for (const auto &run : RUNS) {
+        if (!runner.isSelected(run.name)) {
+            continue;
+        }
+
+        iNES::File file;
+        SynthROM::generate(SynthROM::Workload::CONTROLLER, 1, file);
+        const std::shared_ptr<const ROMImage> rom = ROMImage::create(file);
+
+        Lockstep lockstep(rom, run.independent ? 0 : LOCKSTEP_LANES);
+        std::vector<std::unique_ptr<NES>> machines;
+
+        for (size_t lane = 0; run.independent && lane < LOCKSTEP_LANES; lane++) {
+            Cartridge cartridge(rom);
+            machines.emplace_back(new NES(cartridge));
+            machines.back()->getDiagnostics()->verbose = false;
+        }
+
+        if (!run.independent) {
+            lockstep.getLane(0)->getDiagnostics()->verbose = false;
+        }
+
+        BenchResult result = { run.name, 1, {} };
+        uint8_t inputs[LOCKSTEP_LANES];
+        uint64_t random = 0x9E3779B97F4A7C15ull;
+
+        for (unsigned int frame = 0; frame < runner.getFrames(); frame++) {
+            for (uint8_t &input : inputs) {
+                random = random * 6364136223846793005ull + 1442695040888963407ull;
+                input = (uint8_t)((random >> 33) % run.choices);
+            }
+
+            const auto start = std::chrono::steady_clock::now();
+
+            if (run.independent) {
+                for (size_t lane = 0; lane < LOCKSTEP_LANES; lane++) {
+                    machines[lane]->getController(0)->setButtons(inputs[lane]);
+                    machines[lane]->runFrame();
+                }
+            } else {
+                lockstep.runFrame(inputs);
+            }
+
+            const auto end = std::chrono::steady_clock::now();
+
+            result.samples.push_back(std::chrono::duration<double, std::nano>(end - start).count());
+        }
+
+        runner.add(std::move(result));
+    }
+}
+
+/**
+ * Runs LOCKSTEP_LANES lanes with VectorLockstep, one sample per frame of all of them, with inputs drawn like
+ * benchLockstep()'s. The controller workload only stores the buttons, so its lanes share every instruction whatever
+ * the inputs; the input workload branches on them. Each "independent" benchmark runs the same lanes as separate
+ * machines, and the "suppressed" ones run with the PPU's output suppressed, which leaves mostly the CPU to do.
+ */
+static void benchVectorLockstep(BenchRunner &runner) {
+    static const struct {
+        const char *name;
+        SynthROM::Workload workload;
+        unsigned int choices;
+        bool independent;
+        bool suppressed;
+    } RUNS[] = {
+        { "lockstep.vector.identical", SynthROM::Workload::CONTROLLER, 1, false, false },
+        { "lockstep.vector.controller", SynthROM::Workload::CONTROLLER, 256, false, false },
+        { "lockstep.vector.input", SynthROM::Workload::INPUT, 256, false, false },
+        { "lockstep.vector.input.independent", SynthROM::Workload::INPUT, 256, true, false },
+        { "lockstep.vector.suppressed", SynthROM::Workload::INPUT, 256, false, true },
+        { "lockstep.vector.suppressed.independent", SynthROM::Workload::INPUT, 256, true, true },
+    };
+
+    for (const auto &run : RUNS) {
+        if (!runner.isSelected(run.name)) {
+            continue;
+        }
+
+        iNES::File file;
+        SynthROM::generate(run.workload, 1, file);
+        const std::shared_ptr<const ROMImage> rom = ROMImage::create(file);
+
+        VectorLockstep lockstep(rom, run.independent ? 0 : LOCKSTEP_LANES);
+        std::vector<std::unique_ptr<NES>> machines;
+
+        for (size_t lane = 0; lane < LOCKSTEP_LANES; lane++) {
+            NES *nes;
+
+            if (run.independent) {
+                Cartridge cartridge(rom);
+                machines.emplace_back(new NES(cartridge));
+                nes = machines.back().get();
+            } else {
+                nes = lockstep.getLane(lane);
+            }
+
+            nes->getDiagnostics()->verbose = false;
+            nes->getPPU()->setOutputSuppressed(run.suppressed);
+        }
+
+        BenchResult result = { run.name, 1, {} };
+        uint8_t inputs[LOCKSTEP_LANES];
+        uint64_t random = 0x9E3779B97F4A7C15ull;
+
+        for (unsigned int frame = 0; frame < runner.getFrames(); frame++) {
+            for (uint8_t &input : inputs) {
+                random = random * 6364136223846793005ull + 1442695040888963407ull;
+                input = (uint8_t)((random >> 33) % run.choices);
+            }
+
+            const auto start = std::chrono::steady_clock::now();
+
+            if (run.independent) {
+                for (size_t lane = 0; lane < LOCKSTEP_LANES; lane++) {
+                    machines[lane]->getController(0)->setButtons(inputs[lane]);
+                    machines[lane]->runFrame();
+                }
+            } else {
+                lockstep.runFrame(inputs);
+            }
+
+            const auto end = std::chrono::steady_clock::now();
+
+            result.samples.push_back(std::chrono::duration<double, std::nano>(end - start).count());
+        }
+
+        runner.add(std::move(result));
+    }
+}
+
+int main(int argc, char **argv) {
+    BenchOptions options;
+
+    for (int i = 1; i < argc; i++) {
+        const std::string arg = argv[i];
+
+        if (arg == "-s" && i + 1 < argc) {
+            options.samples = (unsigned int)std::max(1l, std::strtol(argv[++i], nullptr, 10));
+        } else if (arg == "-f" && i + 1 < argc) {
+            options.frames = (unsigned int)std::max(1l, std::strtol(argv[++i], nullptr, 10));
+        } else if (arg == "-o" && i + 1 < argc) {
+            options.output = argv[++i];
+        } else if (arg[0] != '-' && options.filter.empty()) {
+            options.filter = arg;
+        } else {
+            std::cerr << "Usage: " << argv[0] << " [-s samples] [-f frames] [-o results.json] [filter]\n";
+            return EXIT_FAILURE;
+        }
+    }
+
+    BenchRunner runner(options);
+
+    benchCPU(runner);
+    benchMemory(runner);
+    benchMappers(runner);
+    benchPPU(runner);
+    benchINES(runner);
+    benchFrames(runner);
+    benchLockstep(runner);
+    benchVectorLockstep(runner);
+
+    if (options.output.empty()) {
+        runner.writeJSON(std::cout);
+        return EXIT_SUCCESS;
+    }
+
+    std::ofstream out(options.output);
+    runner.writeJSON(out);
+    out.close();
+
+    if (out.fail()) {
+        std::cerr << "Couldn't write " << options.output << "\n";
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
\ No newline at end of file
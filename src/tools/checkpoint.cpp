@@ -0,0 +1,129 @@
+#include "../nes.h"
+#include "../ines.h"
+#include "../rom.h"
+#include "../mappers.h"
+#include "../checkpoint.h"
+
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <memory>
+#include <cstdlib>
+
+/*
+ * Records and compares per-frame state hashes:
+ *
+ *     nesulator_checkpoint record <rom> <frames> <output.ncp>
+ *         Runs a game without input for the given number of frames and writes a checkpoint for every one.
+ *
+ *     nesulator_checkpoint compare <a.ncp> <b.ncp>
+ *         Finds the first frame on which two runs differ, and what differs. Exits with 0 if they don't.
+ *
+ * To record a run with input, use `nesulator_movie play <rom> <movie> <output.ncp>`.
+ */
+
+static int record(const std::string &romPath, unsigned long frames, const std::string &output) {
+    std::shared_ptr<const iNES::MappedFile> file;
+    const iNES::LoadError error = iNES::mapFile(romPath, file);
+
+    if (error != iNES::LoadError::NO_ERROR) {
+        std::cerr << romPath << ": " << iNES::getLoadErrorMessage(error) << "\n";
+        return EXIT_FAILURE;
+    }
+
+    std::shared_ptr<const ROMImage> rom = ROMImage::create(file);
+
+    if (!Mappers::isSupported(rom->getMapperNumber())) {
+        std::cerr << romPath << ": The mapper that this game requires (" << rom->getMapperNumber()
+                  << ") has not been implemented yet!\n";
+        return EXIT_FAILURE;
+    }
+
+    Checkpoint::Writer writer;
+
+    if (!writer.open(output)) {
+        std::cerr << "Couldn't write " << output << "\n";
+        return EXIT_FAILURE;
+    }
+
+    Cartridge cartridge(rom);
+    NES nes(cartridge);
+    nes.getDiagnostics()->verbose = false;
+    nes.setCheckpointWriter(&writer);
+
+    for (unsigned long i = 0; i < frames; i++) {
+        nes.runFrame();
+    }
+
+    if (!writer.close()) {
+        std::cerr << "Couldn't write " << output << "\n";
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
+
+static void printHash(uint64_t hash) {
+    std::cout << std::hex << std::setfill('0') << std::setw(16) << hash << std::dec;
+}
+
+static int compare(const std::string &pathA, const std::string &pathB) {
+    std::unique_ptr<Checkpoint::Reader> a, b;
+
+    for (const auto &file : { std::make_pair(&pathA, &a), std::make_pair(&pathB, &b) }) {
+        const Checkpoint::LoadError error = Checkpoint::open(*file.first, *file.second);
+
+        if (error != Checkpoint::LoadError::NO_ERROR) {
+            std::cerr << *file.first << ": " << Checkpoint::getLoadErrorMessage(error) << "\n";
+            return EXIT_FAILURE;
+        }
+    }
+
+    const Checkpoint::Divergence divergence = Checkpoint::findDivergence(*a, *b);
+
+    if (!divergence.diverged) {
+        std::cout << "No divergence in " << std::min(a->getRecordCount(), b->getRecordCount()) << " frames";
+
+        if (a->getRecordCount() != b->getRecordCount()) {
+            std::cout << " (the files have " << a->getRecordCount() << " and " << b->getRecordCount() << " frames)";
+        }
+
+        std::cout << "\n";
+        return EXIT_SUCCESS;
+    }
+
+    std::cout << "First divergence at record " << divergence.index << " (frame " << divergence.records[0].frame;
+
+    if (divergence.records[1].frame != divergence.records[0].frame) {
+        std::cout << " and " << divergence.records[1].frame;
+    }
+
+    std::cout << ")\n";
+
+    for (size_t i = 0; i < (size_t)Checkpoint::Component::COUNT; i++) {
+        if ((divergence.components & (1 << i)) != 0) {
+            std::cout << "    " << std::left << std::setw(14) << Checkpoint::getComponentName((Checkpoint::Component)i)
+                      << std::right;
+            printHash(divergence.records[0].components[i]);
+            std::cout << " ";
+            printHash(divergence.records[1].components[i]);
+            std::cout << "\n";
+        }
+    }
+
+    return EXIT_FAILURE;
+}
+
+int main(int argc, char **argv) {
+    const std::string command = argc > 1 ? argv[1] : "";
+
+    if (command == "record" && argc == 5) {
+        return record(argv[2], std::strtoul(argv[3], nullptr, 10), argv[4]);
+    } else if (command == "compare" && argc == 4) {
+        return compare(argv[2], argv[3]);
+    }
+
+    std::cerr << "Usage: " << argv[0] << " record <rom> <frames> <output.ncp>\n"
+              << "       " << argv[0] << " compare <a.ncp> <b.ncp>\n";
+    return EXIT_FAILURE;
+}
\ No newline at end of file
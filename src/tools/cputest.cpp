@@ -0,0 +1,170 @@
+#include "../cputest.h"
+#include "../op.h"
+#include "../utils.h"
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+
+/*
+ * Checks every opcode of the CPU against a directory of "single step" test vectors, one file per opcode named after
+ * it in lowercase hex (00.json to ff.json), as in https://github.com/SingleStepTests/65x02 (nes6502):
+ *
+ *     nesulator_cputest [-j threads] [-b] <directory>
+ *
+ * The files are spread over one thread per core, or as many as -j says. By default the registers, the RAM and the
+ * number of cycles are compared; -b also compares every bus access, which the CPU doesn't model dummy reads for.
+ * Exits with 0 if every supported opcode passed all of its tests.
+ */
+
+struct OpcodeResult {
+    bool found = false;
+    bool unsupported = false;
+    std::string error;          // Why the file couldn't be read, if it couldn't.
+    uint64_t tests = 0;
+    uint64_t failures = 0;
+    std::string firstFailure;   // The name of the first test that failed.
+    uint8_t mismatches = 0;     // What was wrong with it.
+};
+
+static void runOpcode(unsigned int opcode, const std::string &directory, bool checkBusCycles, CPUTest::Runner &runner,
+                      CPUTest::VectorReader &reader, CPUTest::Vector &vector, OpcodeResult &outResult) {
+    char fileName[8];
+    std::snprintf(fileName, sizeof(fileName), "%02x.json", opcode);
+
+    const CPUTest::ParseError openError = reader.open(directory + "/" + fileName);
+
+    if (openError == CPUTest::ParseError::OPEN_FAILED) {
+        return;
+    }
+
+    outResult.found = true;
+
+    while (reader.read(vector)) {
+        const uint8_t mismatches = runner.run(vector, checkBusCycles);
+        outResult.tests++;
+
+        if (mismatches == CPUTest::UNSUPPORTED) {
+            // The rest of the file would only say the same.
+            outResult.unsupported = true;
+            return;
+        } else if (mismatches != 0) {
+            if (outResult.failures++ == 0) {
+                outResult.firstFailure = vector.name;
+                outResult.mismatches = mismatches;
+            }
+        }
+    }
+
+    if (reader.getError() != CPUTest::ParseError::NO_ERROR) {
+        outResult.error = CPUTest::getParseErrorMessage(reader.getError());
+    }
+}
+
+int main(int argc, char **argv) {
+    unsigned int threadCount = 0;
+    bool checkBusCycles = false;
+    std::string directory;
+
+    for (int i = 1; i < argc; i++) {
+        const std::string arg = argv[i];
+
+        if (arg == "-j" && i + 1 < argc) {
+            threadCount = (unsigned int)std::max(1l, std::strtol(argv[++i], nullptr, 10));
+        } else if (arg == "-b") {
+            checkBusCycles = true;
+        } else if (directory.empty() && arg[0] != '-') {
+            directory = arg;
+        } else {
+            directory.clear();
+            break;
+        }
+    }
+
+    if (directory.empty()) {
+        std::cerr << "Usage: " << argv[0] << " [-j threads] [-b] <directory>\n";
+        return EXIT_FAILURE;
+    }
+
+    if (threadCount == 0) {
+        threadCount = std::max(1u, std::thread::hardware_concurrency());
+    }
+
+    std::vector<OpcodeResult> results(256);
+    std::atomic<unsigned int> nextOpcode(0);
+    std::vector<std::thread> threads;
+
+    const auto start = std::chrono::steady_clock::now();
+
+    // Each thread keeps its runner, reader and test for every file it takes, so only the first file allocates.
+    for (unsigned int i = 0; i < threadCount; i++) {
+        threads.emplace_back([&]() {
+            CPUTest::Runner runner;
+            CPUTest::VectorReader reader;
+            CPUTest::Vector vector;
+
+            for (unsigned int opcode = nextOpcode++; opcode < results.size(); opcode = nextOpcode++) {
+                runOpcode(opcode, directory, checkBusCycles, runner, reader, vector, results[opcode]);
+            }
+        });
+    }
+
+    for (std::thread &thread : threads) {
+        thread.join();
+    }
+
+    const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    uint64_t tests = 0, failures = 0;
+    unsigned int found = 0, failed = 0, unsupported = 0, unreadable = 0;
+
+    for (unsigned int opcode = 0; opcode < results.size(); opcode++) {
+        const OpcodeResult &result = results[opcode];
+
+        if (!result.found) {
+            continue;
+        }
+
+        found++;
+        tests += result.tests;
+
+        if (!result.unsupported && result.error.empty() && result.failures == 0) {
+            continue;
+        }
+
+        std::cout << "$";
+        Utils::writeHexToStream(std::cout, (uint8_t)opcode);
+        std::cout << std::dec << " " << Op::decode((uint8_t)opcode)->name << ": ";
+
+        if (result.unsupported) {
+            unsupported++;
+            std::cout << "unsupported\n";
+        } else if (!result.error.empty()) {
+            unreadable++;
+            std::cout << result.error << " after " << result.tests << " tests\n";
+        } else {
+            failed++;
+            failures += result.failures;
+            std::cout << result.failures << " of " << result.tests << " failed, the first \"" << result.firstFailure
+                      << "\" (" << CPUTest::getMismatchDescription(result.mismatches) << ")\n";
+        }
+    }
+
+    if (found == 0) {
+        std::cerr << "No test files in " << directory << "\n";
+        return EXIT_FAILURE;
+    }
+
+    std::cout << tests << " tests of " << found << " opcodes in " << seconds << " s on " << threadCount
+              << " threads: " << (found - failed - unsupported - unreadable) << " opcodes passed, " << failed
+              << " failed (" << failures << " tests), " << unsupported << " unsupported, " << unreadable
+              << " unreadable\n";
+
+    return failed == 0 && unreadable == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
\ No newline at end of file
@@ -0,0 +1,157 @@
+#include "../nes.h"
+#include "../rom.h"
+#include "../ppu.h"
+#include "../synthrom.h"
+#include "../vectorlockstep.h"
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <memory>
+#include <cstring>
+#include <cstdlib>
+
+/*
+ * Checks that VectorLockstep runs each lane exactly like a machine of its own:
+ *
+ *     nesulator_lanecheck [frames [ROM files...]]
+ *
+ * Runs every SynthROM workload, or the given games, on LANES lanes and on as many separate machines, for 60 frames
+ * by default, with the same inputs: the lanes hold the same buttons for a while, then drift apart and come together
+ * again. Every COMPARE_INTERVAL frames, and after the last one, each lane's state and picture must be the same as
+ * its machine's. Odd lanes and their machines run with the PPU's output suppressed, so they are compared by state
+ * alone. Halfway through, every lane's RAM is changed between frames, as a cheat or a debugger would, to check that
+ * the change is picked up. Exits with 0 if every lane matched.
+ */
+
+static const size_t LANES = 8;
+
+// Comparing takes the lanes out of the vector engine's hands until the next frame, so it isn't done every frame.
+static const unsigned int COMPARE_INTERVAL = 5;
+
+static std::unique_ptr<NES> makeNES(const std::shared_ptr<const ROMImage> &rom) {
+    Cartridge cartridge(rom);
+    std::unique_ptr<NES> nes(new NES(cartridge));
+    nes->getDiagnostics()->verbose = false;
+    return nes;
+}
+
+/**
+ * @return Whether every lane matched its machine.
+ */
+static bool compare(const std::string &name, unsigned int frame, VectorLockstep &lockstep,
+                    const std::vector<std::unique_ptr<NES>> &machines) {
+    bool matched = true;
+
+    for (size_t lane = 0; lane < LANES; lane++) {
+        NES *vector = lockstep.getLane(lane);
+        std::vector<uint8_t> expected;
+        std::vector<uint8_t> actual;
+        machines[lane]->saveState(expected);
+        vector->saveState(actual);
+
+        const size_t pixels = PPU::SCREEN_WIDTH * PPU::SCREEN_HEIGHT;
+
+        if (actual != expected) {
+            std::cout << name << ", frame " << frame << ", lane " << lane << ": the states differ\n";
+            matched = false;
+        } else if (!vector->getPPU()->isOutputSuppressed() && std::memcmp(vector->getPPU()->getFramebuffer(), machines[lane]->getPPU()->getFramebuffer(),
+                               pixels) != 0) {
+            std::cout << name << ", frame " << frame << ", lane " << lane << ": the pictures differ\n";
+            matched = false;
+        }
+    }
+
+    return matched;
+}
+
+/**
+ * @return Whether every lane matched its machine throughout.
+ */
+static bool check(const std::string &name, const std::shared_ptr<const ROMImage> &rom, unsigned int frames,
+                  uint64_t seed) {
+    VectorLockstep lockstep(rom, LANES);
+    std::vector<std::unique_ptr<NES>> machines;
+
+    for (size_t lane = 0; lane < LANES; lane++) {
+        NES *vector = lockstep.getLane(lane);
+        vector->getDiagnostics()->verbose = false;
+        vector->getPPU()->setOutputSuppressed(lane % 2 == 1);
+
+        machines.push_back(makeNES(rom));
+        machines.back()->getPPU()->setOutputSuppressed(lane % 2 == 1);
+    }
+
+    uint8_t inputs[LANES];
+    uint64_t random = 0x9E3779B97F4A7C15ull + seed;
+    bool matched = true;
+
+    for (unsigned int frame = 0; frame < frames && matched; frame++) {
+        // Shared buttons for 16 frames, then different ones for 16.
+        const bool shared = frame / 16 % 2 == 0;
+
+        for (size_t lane = 0; lane < LANES; lane++) {
+            if (lane == 0 || !shared) {
+                random = random * 6364136223846793005ull + 1442695040888963407ull;
+                inputs[lane] = (uint8_t)(random >> 56);
+            } else {
+                inputs[lane] = inputs[0];
+            }
+
+            machines[lane]->getController(0)->setButtons(inputs[lane]);
+            machines[lane]->runFrame();
+        }
+
+        lockstep.runFrame(inputs);
+
+        if (frame == frames / 2) {
+            for (size_t lane = 0; lane < LANES; lane++) {
+                lockstep.getLane(lane)->getMemory()->getInternalMemory()[0x10 + lane] ^= 0xFF;
+                machines[lane]->getMemory()->getInternalMemory()[0x10 + lane] ^= 0xFF;
+            }
+        }
+
+        if (frame % COMPARE_INTERVAL == COMPARE_INTERVAL - 1 || frame == frames - 1) {
+            matched = compare(name, frame, lockstep, machines);
+        }
+    }
+
+    const VectorLockstep::Statistics &statistics = lockstep.getStatistics();
+    std::cout << name << ": " << (matched ? "matched" : "FAILED") << ", " << statistics.laneSteps
+              << " lane instructions in " << statistics.groupSteps << " group steps, " << statistics.scalarSteps
+              << " scalar steps\n";
+
+    return matched;
+}
+
+int main(int argc, char **argv) {
+    const unsigned int frames = argc > 1 ? (unsigned int)std::max(1, std::atoi(argv[1])) : 60;
+    unsigned int failures = 0;
+
+    if (argc > 2) {
+        for (int i = 2; i < argc; i++) {
+            iNES::File file;
+            const iNES::LoadError error = iNES::loadFromFile(argv[i], file);
+
+            if (error != iNES::LoadError::NO_ERROR) {
+                std::cout << argv[i] << ": " << iNES::getLoadErrorMessage(error) << "\n";
+                failures++;
+            } else if (!check(argv[i], ROMImage::create(file), frames, (uint64_t)i)) {
+                failures++;
+            }
+        }
+    } else {
+        for (size_t i = 0; i < (size_t)SynthROM::Workload::COUNT; i++) {
+            const SynthROM::Workload workload = (SynthROM::Workload)i;
+
+            iNES::File file;
+            SynthROM::generate(workload, 1, file);
+
+            if (!check(SynthROM::getWorkloadName(workload), ROMImage::create(file), frames, i)) {
+                failures++;
+            }
+        }
+    }
+
+    return failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
\ No newline at end of file
@@ -0,0 +1,57 @@
+#include "library.h"
+
+#include <iomanip>
+#include <algorithm>
+#include <filesystem>
+
+namespace fs = std::filesystem;
+
+static bool isROMFile(const fs::path &path) {
+    std::string extension = path.extension().string();
+    std::transform(extension.begin(), extension.end(), extension.begin(), ::tolower);
+    return extension == ".nes";
+}
+
+std::vector<std::string> Library::findROMs(const std::vector<std::string> &paths) {
+    std::vector<std::string> roms;
+
+    for (const std::string &path : paths) {
+        std::error_code error;
+
+        if (fs::is_directory(path, error)) {
+            for (auto it = fs::recursive_directory_iterator(path, fs::directory_options::skip_permission_denied, error);
+                 it != fs::recursive_directory_iterator(); it.increment(error)) {
+                if (error) {
+                    break;
+                }
+
+                if (it->is_regular_file(error) && isROMFile(it->path())) {
+                    roms.push_back(it->path().string());
+                }
+            }
+        } else {
+            roms.push_back(path);
+        }
+    }
+
+    std::sort(roms.begin(), roms.end());
+    return roms;
+}
+
+void Library::writeJSONString(std::ostream &out, const std::string &text) {
+    out << '"';
+
+    for (char c : text) {
+        if (c == '"' || c == '\\') {
+            out << '\\' << c;
+        } else if (c == '\n') {
+            out << "\\n";
+        } else if ((unsigned char)c < 0x20) {
+            out << "\\u" << std::hex << std::setw(4) << std::setfill('0') << (int)c << std::dec;
+        } else {
+            out << c;
+        }
+    }
+
+    out << '"';
+}
\ No newline at end of file
@@ -0,0 +1,21 @@
+#pragma once
+
+#include <ostream>
+#include <string>
+#include <vector>
+
+/*
+ * What the tools that work through a ROM library (nesulator_scan, nesulator_testroms) have in common.
+ */
+namespace Library {
+    /**
+     * Expands the paths given on a command line into a sorted list of ROMs: directories are searched recursively for
+     * .nes files, anything else is taken as it is.
+     */
+    std::vector<std::string> findROMs(const std::vector<std::string> &paths);
+
+    /**
+     * Writes a string as a quoted JSON string.
+     */
+    void writeJSONString(std::ostream &out, const std::string &text);
+}
\ No newline at end of file
@@ -0,0 +1,160 @@
+#include "../nes.h"
+#include "../ines.h"
+#include "../rom.h"
+#include "../movie.h"
+#include "../mappers.h"
+#include "../checkpoint.h"
+#include "../audio.h"
+
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <memory>
+#include <chrono>
+#include <cstdlib>
+
+/*
+ * Plays input movies at full speed, for regression tests:
+ *
+ *     nesulator_movie play <rom> <movie> [checkpoints.ncp]
+ *         Plays a native or FM2 movie. If the movie has state hashes, stops at the first frame that doesn't match.
+ *         Optionally writes a checkpoint for every frame, to compare with nesulator_checkpoint.
+ *
+ *     nesulator_movie record <rom> <movie> <output.nmv>
+ *         Plays a movie and writes it out in the native format, with the hash of the state after every frame. Play
+ *         the output with a later build to find out whether, and on which frame, the emulation changed.
+ *
+ *     nesulator_movie audio <rom> <movie> <output.wav>
+ *         Plays a movie and streams the audio into a WAV file, to diff the sound of two builds.
+ *
+ * Exits with 0 if the movie played to the end in sync.
+ */
+
+static bool loadROM(const std::string &path, std::shared_ptr<const ROMImage> &outROM) {
+    std::shared_ptr<const iNES::MappedFile> file;
+    const iNES::LoadError error = iNES::mapFile(path, file);
+
+    if (error != iNES::LoadError::NO_ERROR) {
+        std::cerr << path << ": " << iNES::getLoadErrorMessage(error) << "\n";
+        return false;
+    }
+
+    outROM = ROMImage::create(file);
+
+    if (!Mappers::isSupported(outROM->getMapperNumber())) {
+        std::cerr << path << ": The mapper that this game requires (" << outROM->getMapperNumber()
+                  << ") has not been implemented yet!\n";
+        return false;
+    }
+
+    return true;
+}
+
+int main(int argc, char **argv) {
+    const std::string command = argc > 1 ? argv[1] : "";
+    const bool record = command == "record";
+    const bool checkpoints = command == "play" && argc == 5;
+    const bool audio = command == "audio";
+
+    if (!((command == "play" && (argc == 4 || argc == 5)) || ((record || audio) && argc == 5))) {
+        std::cerr << "Usage: " << argv[0] << " play <rom> <movie> [checkpoints.ncp]\n"
+                  << "       " << argv[0] << " record <rom> <movie> <output.nmv>\n"
+                  << "       " << argv[0] << " audio <rom> <movie> <output.wav>\n";
+        return EXIT_FAILURE;
+    }
+
+    std::shared_ptr<const ROMImage> rom;
+
+    if (!loadROM(argv[2], rom)) {
+        return EXIT_FAILURE;
+    }
+
+    std::unique_ptr<Movie::Reader> reader;
+    const Movie::LoadError error = Movie::open(argv[3], reader);
+
+    if (error != Movie::LoadError::NO_ERROR) {
+        std::cerr << argv[3] << ": " << Movie::getLoadErrorMessage(error) << "\n";
+        return EXIT_FAILURE;
+    }
+
+    Movie::Writer writer;
+
+    if (record && !writer.open(argv[4], true)) {
+        std::cerr << "Couldn't write " << argv[4] << "\n";
+        return EXIT_FAILURE;
+    }
+
+    Checkpoint::Writer checkpointWriter;
+
+    if (checkpoints && !checkpointWriter.open(argv[4])) {
+        std::cerr << "Couldn't write " << argv[4] << "\n";
+        return EXIT_FAILURE;
+    }
+
+    Cartridge cartridge(rom);
+    NES nes(cartridge);
+    nes.getDiagnostics()->verbose = false;
+
+    Audio::WAVWriter wavWriter;
+
+    if (audio && !wavWriter.open(argv[4], nes.getAPU()->getSampleRate())) {
+        std::cerr << "Couldn't write " << argv[4] << "\n";
+        return EXIT_FAILURE;
+    }
+
+    // Nobody watches, but checkpoints cover the framebuffer, and nothing is heard while the output is suppressed.
+    if (checkpoints) {
+        nes.setCheckpointWriter(&checkpointWriter);
+    } else if (!audio) {
+        nes.getPPU()->setOutputSuppressed(true);
+    }
+
+    Movie::Player player(&nes, reader.get());
+    std::vector<uint8_t> scratch;
+
+    // A second of audio can be waiting for the disk.
+    std::unique_ptr<Audio::Stream> stream;
+
+    if (audio) {
+        stream.reset(new Audio::Stream(&wavWriter, Audio::Stream::Mode::LOSSLESS, nes.getAPU()->getSampleRate()));
+    }
+
+    const auto start = std::chrono::steady_clock::now();
+
+    while (player.step() == Movie::Player::Status::PLAYING) {
+        if (record) {
+            Movie::Frame frame = player.getLastFrame();
+            frame.hasHash = true;
+            frame.hash = Movie::hashState(nes, scratch);
+            writer.write(frame);
+        }
+
+        if (audio) {
+            stream->writeFrame(nes.getAPU());
+        }
+    }
+
+    const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    if ((record && !writer.close()) || (checkpoints && !checkpointWriter.close()) ||
+        (audio && !(stream->close() && wavWriter.close()))) {
+        std::cerr << "Couldn't write " << argv[4] << "\n";
+        return EXIT_FAILURE;
+    }
+
+    std::cout << player.getFrame() << " frames in " << std::fixed << std::setprecision(2) << seconds << " s ("
+              << std::setprecision(0) << (seconds > 0 ? player.getFrame() / seconds : 0) << " frames/s)\n";
+
+    if (player.getStatus() == Movie::Player::Status::DESYNCED) {
+        std::cout << "Desynced on frame " << player.getFrame() - 1 << ": expected state hash " << std::hex
+                  << std::setfill('0') << std::setw(8) << player.getLastFrame().hash << ", got " << std::setw(8)
+                  << player.getLastHash() << "\n";
+        return EXIT_FAILURE;
+    }
+
+    if (reader->hasHashes()) {
+        std::cout << "In sync\n";
+    }
+
+    return EXIT_SUCCESS;
+}
\ No newline at end of file
@@ -0,0 +1,158 @@
+#include "../ines.h"
+#include "../romdb.h"
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <map>
+#include <cstdlib>
+#include <cstring>
+
+/*
+ * Builds a ROM database from nes20db's XML (https://github.com/ZimM-LostPolygon/nes20db):
+ *
+ *     nesulator_romdb nes20db.xml nes20db.ndb
+ *
+ * Only what the database needs is parsed, with a simple tag scanner rather than a full XML parser.
+ */
+
+typedef std::map<std::string, std::string> Attributes;
+
+static Attributes parseAttributes(const std::string &tag) {
+    Attributes attributes;
+    size_t position = tag.find_first_of(" \t\r\n");
+
+    while (position != std::string::npos) {
+        const size_t nameStart = tag.find_first_not_of(" \t\r\n/", position);
+
+        if (nameStart == std::string::npos) {
+            break;
+        }
+
+        const size_t equals = tag.find('=', nameStart);
+        const size_t valueStart = equals == std::string::npos ? std::string::npos : tag.find('"', equals);
+        const size_t valueEnd = valueStart == std::string::npos ? std::string::npos : tag.find('"', valueStart + 1);
+
+        if (valueEnd == std::string::npos) {
+            break;
+        }
+
+        attributes[tag.substr(nameStart, equals - nameStart)] = tag.substr(valueStart + 1, valueEnd - valueStart - 1);
+        position = valueEnd + 1;
+    }
+
+    return attributes;
+}
+
+static size_t getNumber(const Attributes &attributes, const char *name, int base = 10) {
+    auto it = attributes.find(name);
+    return it != attributes.end() ? (size_t)std::strtoull(it->second.c_str(), nullptr, base) : 0;
+}
+
+static bool parseSHA1(const std::string &text, uint8_t *outSHA1) {
+    if (text.size() != 40) {
+        return false;
+    }
+
+    for (size_t i = 0; i < 20; i++) {
+        outSHA1[i] = (uint8_t)std::strtoul(text.substr(i * 2, 2).c_str(), nullptr, 16);
+    }
+
+    return true;
+}
+
+int main(int argc, char **argv) {
+    if (argc != 3) {
+        std::cerr << "Usage: " << argv[0] << " <nes20db.xml> <output.ndb>\n";
+        return EXIT_FAILURE;
+    }
+
+    std::ifstream in(argv[1], std::ios::in | std::ios::binary);
+
+    if (!in) {
+        std::cerr << "Couldn't open " << argv[1] << "\n";
+        return EXIT_FAILURE;
+    }
+
+    std::stringstream buffer;
+    buffer << in.rdbuf();
+    const std::string xml = buffer.str();
+
+    std::vector<ROMDatabase::Entry> entries;
+    size_t skipped = 0;
+
+    ROMDatabase::Entry entry = {};
+    iNES::HeaderInfo info = {};
+    bool valid = false;
+
+    for (size_t position = xml.find('<'); position != std::string::npos; position = xml.find('<', position)) {
+        if (xml.compare(position, 4, "<!--") == 0) {
+            position = xml.find("-->", position);
+            continue;
+        }
+
+        const size_t end = xml.find('>', position);
+
+        if (end == std::string::npos) {
+            break;
+        }
+
+        const std::string tag = xml.substr(position + 1, end - position - 1);
+        const std::string name = tag.substr(0, tag.find_first_of(" \t\r\n/", 1));
+        const Attributes attributes = parseAttributes(tag);
+
+        position = end + 1;
+
+        if (name == "game") {
+            entry = {};
+            info = {};
+            valid = false;
+        } else if (name == "rom") {
+            entry.crc32 = (uint32_t)getNumber(attributes, "crc32", 16);
+            valid = attributes.count("sha1") != 0 && parseSHA1(attributes.at("sha1"), entry.sha1);
+        } else if (name == "prgrom") {
+            info.prgROMSize = getNumber(attributes, "size");
+        } else if (name == "chrrom") {
+            info.chrROMSize = getNumber(attributes, "size");
+        } else if (name == "prgram") {
+            info.prgRAMSize = getNumber(attributes, "size");
+        } else if (name == "prgnvram") {
+            info.prgNVRAMSize = getNumber(attributes, "size");
+        } else if (name == "chrram") {
+            info.chrRAMSize = getNumber(attributes, "size");
+        } else if (name == "chrnvram") {
+            info.chrNVRAMSize = getNumber(attributes, "size");
+        } else if (name == "trainer" || name == "miscrom") {
+            // The database is keyed on PRG-ROM and CHR-ROM only, which these games' hashes don't cover.
+            info.trainer = true;
+        } else if (name == "pcb") {
+            const std::string mirroring = attributes.count("mirroring") != 0 ? attributes.at("mirroring") : "";
+
+            info.mapper = (uint16_t)getNumber(attributes, "mapper");
+            info.submapper = (uint8_t)getNumber(attributes, "submapper");
+            info.battery = getNumber(attributes, "battery") != 0;
+            info.mirroring = mirroring == "V" ? Mirroring::VERTICAL :
+                             mirroring == "4" ? Mirroring::FOUR_SCREEN : Mirroring::HORIZONTAL;
+        } else if (name == "console") {
+            info.timing = (iNES::Timing)(getNumber(attributes, "region") & 0x3);
+        } else if (name == "/game") {
+            if (valid && !info.trainer) {
+                info.nes20 = true;
+                entry.header = iNES::makeHeader(info);
+                entries.push_back(entry);
+            } else {
+                skipped++;
+            }
+        }
+    }
+
+    if (!ROMDatabase::write(argv[2], entries)) {
+        std::cerr << "Couldn't write " << argv[2] << "\n";
+        return EXIT_FAILURE;
+    }
+
+    std::cout << "Wrote " << entries.size() << " games, skipped " << skipped << "\n";
+
+    return EXIT_SUCCESS;
+}
\ No newline at end of file
@@ -0,0 +1,216 @@
+#include "library.h"
+
+#include "../ines.h"
+#include "../nes.h"
+#include "../rom.h"
+#include "../romdb.h"
+#include "../mappers.h"
+#include "../hash.h"
+#include "../op.h"
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <cstdlib>
+#include <cstring>
+
+/*
+ * Scans a ROM library and writes a compatibility report:
+ *
+ *     nesulator_scan [-j threads] [-f frames] [-d romdb.ndb] [-o report.jsonl] <file or directory>...
+ *
+ * Every ROM gets one line of JSON with its header, hashes and mapper. Games whose mapper is supported also run
+ * headless for the given number of frames, recording which unsupported opcodes they hit, how many accesses went to
+ * unmapped addresses and how fast they ran. ROMs are handed out to the workers one at a time from a shared counter
+ * and each worker only touches its own emulator and its own slot in the results, so the scan scales with the number
+ * of cores.
+ */
+
+struct ScanOptions {
+    unsigned int threads = std::max(1u, std::thread::hardware_concurrency());
+    unsigned int frames = 600;
+    std::string database;
+    std::string output;
+    std::vector<std::string> paths;
+};
+
+static void writeHex(std::ostream &out, const uint8_t *data, size_t size) {
+    out << std::hex << std::setfill('0');
+
+    for (size_t i = 0; i < size; i++) {
+        out << std::setw(2) << (unsigned int)data[i];
+    }
+
+    out << std::dec;
+}
+
+static std::string scanROM(const std::string &path, const ScanOptions &options, const ROMDatabase *database) {
+    std::ostringstream report;
+
+    report << "{\"path\":";
+    Library::writeJSONString(report, path);
+
+    std::shared_ptr<const iNES::MappedFile> file;
+    const iNES::LoadError error = iNES::mapFile(path, file);
+
+    if (error != iNES::LoadError::NO_ERROR) {
+        report << ",\"error\":";
+        Library::writeJSONString(report, iNES::getLoadErrorMessage(error));
+        report << "}";
+        return report.str();
+    }
+
+    std::shared_ptr<const ROMImage> rom = ROMImage::create(file, database);
+
+    uint32_t crc32;
+    uint8_t sha1[Hash::SHA1_SIZE];
+    ROMDatabase::hash(rom->getPRGROM(), rom->getPRGROMSize(), rom->getCHRROM(), rom->getCHRROMSize(), crc32, sha1);
+
+    const bool supported = Mappers::isSupported(rom->getMapperNumber());
+
+    report << ",\"nes20\":" << (iNES::isNES20(*file->getHeader()) ? "true" : "false")
+           << ",\"crc32\":\"" << std::hex << std::setw(8) << std::setfill('0') << crc32 << std::dec << "\""
+           << ",\"sha1\":\"";
+    writeHex(report, sha1, sizeof(sha1));
+    report << "\",\"prgROMSize\":" << rom->getPRGROMSize()
+           << ",\"chrROMSize\":" << rom->getCHRROMSize()
+           << ",\"inDatabase\":" << (rom->isFromDatabase() ? "true" : "false")
+           << ",\"databaseSizeMismatch\":" << (rom->hasDatabaseSizeMismatch() ? "true" : "false")
+           << ",\"mapper\":" << rom->getMapperNumber()
+           << ",\"submapper\":" << (unsigned int)rom->getSubmapper()
+           << ",\"mapperSupported\":" << (supported ? "true" : "false");
+
+    if (supported && options.frames > 0) {
+        Cartridge cartridge(rom);
+        NES nes(cartridge);
+        Diagnostics *diagnostics = nes.getDiagnostics();
+
+        diagnostics->verbose = false;
+
+        const auto start = std::chrono::steady_clock::now();
+
+        for (unsigned int i = 0; i < options.frames; i++) {
+            nes.runFrame();
+        }
+
+        const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+        report << ",\"frames\":" << options.frames
+               << ",\"fps\":" << std::fixed << std::setprecision(1) << (seconds > 0 ? options.frames / seconds : 0.0)
+               << ",\"unsupportedOpcodeCount\":" << diagnostics->unsupportedOpcodeCount
+               << ",\"unsupportedOpcodes\":[";
+
+        bool first = true;
+
+        for (size_t code = 0; code < diagnostics->unsupportedOpcodes.size(); code++) {
+            if (diagnostics->unsupportedOpcodes.test(code)) {
+                const Op::Opcode *opcode = Op::decode((uint8_t)code);
+
+                report << (first ? "" : ",") << "{\"code\":" << code << ",\"name\":";
+                Library::writeJSONString(report, opcode != nullptr ? opcode->name : "???");
+                report << "}";
+                first = false;
+            }
+        }
+
+        report << "],\"unmappedReads\":" << diagnostics->unmappedReads
+               << ",\"unmappedWrites\":" << diagnostics->unmappedWrites;
+    }
+
+    report << "}";
+    return report.str();
+}
+
+static bool parseOptions(int argc, char **argv, ScanOptions &options) {
+    for (int i = 1; i < argc; i++) {
+        const bool hasValue = i + 1 < argc;
+
+        if (std::strcmp(argv[i], "-j") == 0 && hasValue) {
+            options.threads = std::max(1, std::atoi(argv[++i]));
+        } else if (std::strcmp(argv[i], "-f") == 0 && hasValue) {
+            options.frames = (unsigned int)std::max(0, std::atoi(argv[++i]));
+        } else if (std::strcmp(argv[i], "-d") == 0 && hasValue) {
+            options.database = argv[++i];
+        } else if (std::strcmp(argv[i], "-o") == 0 && hasValue) {
+            options.output = argv[++i];
+        } else if (argv[i][0] == '-') {
+            return false;
+        } else {
+            options.paths.push_back(argv[i]);
+        }
+    }
+
+    return !options.paths.empty();
+}
+
+int main(int argc, char **argv) {
+    ScanOptions options;
+
+    if (!parseOptions(argc, argv, options)) {
+        std::cerr << "Usage: " << argv[0] << " [-j threads] [-f frames] [-d romdb.ndb] [-o report.jsonl] "
+                  << "<file or directory>...\n";
+        return EXIT_FAILURE;
+    }
+
+    ROMDatabase database;
+
+    if (!options.database.empty()) {
+        const iNES::LoadError error = database.load(options.database);
+
+        if (error != iNES::LoadError::NO_ERROR) {
+            std::cerr << "ROM Database Load Error: " << iNES::getLoadErrorMessage(error) << "\n";
+            return EXIT_FAILURE;
+        }
+    }
+
+    const std::vector<std::string> roms = Library::findROMs(options.paths);
+    std::vector<std::string> reports(roms.size());
+    std::atomic<size_t> next(0);
+
+    const auto start = std::chrono::steady_clock::now();
+
+    std::vector<std::thread> workers;
+    const unsigned int threads = (unsigned int)std::min<size_t>(options.threads, std::max<size_t>(roms.size(), 1));
+
+    for (unsigned int i = 0; i < threads; i++) {
+        workers.emplace_back([&]() {
+            for (size_t index = next++; index < roms.size(); index = next++) {
+                reports[index] = scanROM(roms[index], options, options.database.empty() ? nullptr : &database);
+            }
+        });
+    }
+
+    for (std::thread &worker : workers) {
+        worker.join();
+    }
+
+    const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    std::ofstream file;
+
+    if (!options.output.empty()) {
+        file.open(options.output, std::ios::out | std::ios::trunc);
+
+        if (!file) {
+            std::cerr << "Couldn't write " << options.output << "\n";
+            return EXIT_FAILURE;
+        }
+    }
+
+    std::ostream &out = options.output.empty() ? std::cout : file;
+
+    for (const std::string &report : reports) {
+        out << report << "\n";
+    }
+
+    std::cerr << "Scanned " << roms.size() << " ROMs on " << threads << " threads in " << seconds << "s\n";
+
+    return EXIT_SUCCESS;
+}
\ No newline at end of file
@@ -0,0 +1,51 @@
+#include "../synthrom.h"
+
+#include <iostream>
+#include <string>
+#include <cstdlib>
+
+/*
+ * Writes a synthetic workload ROM, for running in other emulators or on hardware what nesulator_bench runs:
+ *
+ *     nesulator_synth <workload> <output.nes> [seed]
+ *     nesulator_synth list
+ */
+
+static void printUsage(const char *program) {
+    std::cerr << "Usage: " << program << " <workload> <output.nes> [seed]\n"
+              << "       " << program << " list\n";
+}
+
+int main(int argc, char **argv) {
+    if (argc == 2 && std::string(argv[1]) == "list") {
+        for (size_t i = 0; i < (size_t)SynthROM::Workload::COUNT; i++) {
+            std::cout << SynthROM::getWorkloadName((SynthROM::Workload)i) << "\n";
+        }
+
+        return EXIT_SUCCESS;
+    }
+
+    if (argc != 3 && argc != 4) {
+        printUsage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    SynthROM::Workload workload;
+
+    if (!SynthROM::findWorkload(argv[1], workload)) {
+        std::cerr << "Unknown workload " << argv[1] << "; " << argv[0] << " list shows them all\n";
+        return EXIT_FAILURE;
+    }
+
+    const uint64_t seed = argc == 4 ? std::strtoull(argv[3], nullptr, 0) : 1;
+
+    iNES::File file;
+    SynthROM::generate(workload, seed, file);
+
+    if (!SynthROM::writeFile(file, argv[2])) {
+        std::cerr << "Couldn't write " << argv[2] << "\n";
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
\ No newline at end of file
@@ -0,0 +1,307 @@
+#include "library.h"
+
+#include "../ines.h"
+#include "../nes.h"
+#include "../rom.h"
+#include "../mappers.h"
+#include "../testrom.h"
+
+#include <iostream>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <filesystem>
+#include <cstdlib>
+#include <cstring>
+
+/*
+ * Runs a directory of test ROMs that report through the $6000 protocol (see TestROM) and summarises the results:
+ *
+ *     nesulator_testroms [-j threads] [-t seconds] [-o results.json] [-x junit.xml] <file or directory>...
+ *
+ * Every ROM runs headless, with the PPU's output suppressed, for at most the given number of seconds of emulated
+ * time (30 by default), which takes a fraction of that in real time. ROMs are handed out to the workers from a shared
+ * counter, as in nesulator_scan. Exits with 0 if every ROM passed.
+ */
+
+namespace fs = std::filesystem;
+
+// Frames per second of emulated time, for the timeouts.
+static const unsigned int FRAME_RATE = 60;
+
+struct FarmOptions {
+    unsigned int threads = std::max(1u, std::thread::hardware_concurrency());
+    unsigned int timeout = 30;
+    std::string output;
+    std::string junit;
+    std::vector<std::string> paths;
+};
+
+struct ROMResult {
+    std::string path;
+    std::string error;      // Why the ROM couldn't be run, if it couldn't.
+    TestROM::Result result;
+    double seconds = 0.0;
+};
+
+static void writeXMLString(std::ostream &out, const std::string &text) {
+    for (char c : text) {
+        switch (c) {
+            case '&': out << "&amp;"; break;
+            case '<': out << "&lt;"; break;
+            case '>': out << "&gt;"; break;
+            case '"': out << "&quot;"; break;
+            default:
+                // XML 1.0 has no way of writing the other control characters.
+                if ((unsigned char)c >= 0x20 || c == '\n' || c == '\t') {
+                    out << c;
+                }
+        }
+    }
+}
+
+static void runROM(const std::string &path, const FarmOptions &options, ROMResult &outResult) {
+    outResult.path = path;
+
+    std::shared_ptr<const iNES::MappedFile> file;
+    const iNES::LoadError error = iNES::mapFile(path, file);
+
+    if (error != iNES::LoadError::NO_ERROR) {
+        outResult.error = iNES::getLoadErrorMessage(error);
+        return;
+    }
+
+    std::shared_ptr<const ROMImage> rom = ROMImage::create(file);
+
+    if (!Mappers::isSupported(rom->getMapperNumber())) {
+        outResult.error = "Mapper " + std::to_string(rom->getMapperNumber()) + " is not supported";
+        return;
+    }
+
+    const auto start = std::chrono::steady_clock::now();
+
+    Cartridge cartridge(rom);
+    NES nes(cartridge);
+    nes.getDiagnostics()->verbose = false;
+    nes.getPPU()->setOutputSuppressed(true);
+
+    outResult.result = TestROM::run(nes, (uint64_t)options.timeout * FRAME_RATE);
+    outResult.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+static bool isPassed(const ROMResult &result) {
+    return result.error.empty() && result.result.status == TestROM::Status::PASSED;
+}
+
+static void writeJSON(std::ostream &out, const std::vector<ROMResult> &results, double seconds) {
+    const size_t passed = (size_t)std::count_if(results.begin(), results.end(), isPassed);
+
+    out << "{\n  \"passed\": " << passed << ",\n  \"total\": " << results.size() << ",\n  \"seconds\": "
+        << seconds << ",\n  \"roms\": [";
+
+    for (size_t i = 0; i < results.size(); i++) {
+        const ROMResult &result = results[i];
+
+        out << (i == 0 ? "\n" : ",\n") << "    { \"path\": ";
+        Library::writeJSONString(out, result.path);
+
+        if (!result.error.empty()) {
+            out << ", \"status\": \"error\", \"error\": ";
+            Library::writeJSONString(out, result.error);
+        } else {
+            out << ", \"status\": ";
+            Library::writeJSONString(out, TestROM::getStatusName(result.result.status));
+
+            if (result.result.signature) {
+                out << ", \"code\": " << (unsigned int)result.result.code;
+            }
+
+            out << ", \"text\": ";
+            Library::writeJSONString(out, result.result.text);
+            out << ", \"frames\": " << result.result.frames << ", \"seconds\": " << result.seconds;
+        }
+
+        out << " }";
+    }
+
+    out << "\n  ]\n}\n";
+}
+
+static void writeJUnit(std::ostream &out, const std::vector<ROMResult> &results, double seconds) {
+    size_t failures = 0, errors = 0;
+
+    for (const ROMResult &result : results) {
+        if (!result.error.empty() || result.result.status == TestROM::Status::TIMED_OUT) {
+            errors++;
+        } else if (result.result.status == TestROM::Status::FAILED) {
+            failures++;
+        }
+    }
+
+    out << "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n<testsuites>\n  <testsuite name=\"nesulator_testroms\" tests=\""
+        << results.size() << "\" failures=\"" << failures << "\" errors=\"" << errors << "\" time=\"" << seconds
+        << "\">\n";
+
+    for (const ROMResult &result : results) {
+        const fs::path path(result.path);
+
+        out << "    <testcase classname=\"";
+        writeXMLString(out, path.parent_path().string());
+        out << "\" name=\"";
+        writeXMLString(out, path.filename().string());
+        out << "\" time=\"" << result.seconds << "\"";
+
+        if (isPassed(result)) {
+            out << "/>\n";
+            continue;
+        }
+
+        out << ">\n";
+
+        if (!result.error.empty()) {
+            out << "      <error message=\"";
+            writeXMLString(out, result.error);
+            out << "\"/>\n";
+        } else {
+            const bool failed = result.result.status == TestROM::Status::FAILED;
+
+            out << (failed ? "      <failure" : "      <error") << " message=\"";
+
+            if (failed) {
+                out << "Result code " << (unsigned int)result.result.code;
+            } else {
+                out << "Timed out after " << result.result.frames << " frames"
+                    << (result.result.signature ? "" : " without writing the $6000 signature");
+            }
+
+            out << "\">";
+            writeXMLString(out, result.result.text);
+            out << (failed ? "</failure>\n" : "</error>\n");
+        }
+
+        out << "    </testcase>\n";
+    }
+
+    out << "  </testsuite>\n</testsuites>\n";
+}
+
+static bool writeFile(const std::string &path, void (*write)(std::ostream &, const std::vector<ROMResult> &, double),
+                      const std::vector<ROMResult> &results, double seconds) {
+    std::ofstream out(path, std::ios::out | std::ios::trunc);
+    write(out, results, seconds);
+    out.close();
+
+    if (out.fail()) {
+        std::cerr << "Couldn't write " << path << "\n";
+        return false;
+    }
+
+    return true;
+}
+
+static bool parseOptions(int argc, char **argv, FarmOptions &options) {
+    for (int i = 1; i < argc; i++) {
+        const bool hasValue = i + 1 < argc;
+
+        if (std::strcmp(argv[i], "-j") == 0 && hasValue) {
+            options.threads = std::max(1, std::atoi(argv[++i]));
+        } else if (std::strcmp(argv[i], "-t") == 0 && hasValue) {
+            options.timeout = (unsigned int)std::max(1, std::atoi(argv[++i]));
+        } else if (std::strcmp(argv[i], "-o") == 0 && hasValue) {
+            options.output = argv[++i];
+        } else if (std::strcmp(argv[i], "-x") == 0 && hasValue) {
+            options.junit = argv[++i];
+        } else if (argv[i][0] == '-') {
+            return false;
+        } else {
+            options.paths.push_back(argv[i]);
+        }
+    }
+
+    return !options.paths.empty();
+}
+
+int main(int argc, char **argv) {
+    FarmOptions options;
+
+    if (!parseOptions(argc, argv, options)) {
+        std::cerr << "Usage: " << argv[0] << " [-j threads] [-t seconds] [-o results.json] [-x junit.xml] "
+                  << "<file or directory>...\n";
+        return EXIT_FAILURE;
+    }
+
+    const std::vector<std::string> roms = Library::findROMs(options.paths);
+
+    if (roms.empty()) {
+        std::cerr << "No ROMs found\n";
+        return EXIT_FAILURE;
+    }
+
+    std::vector<ROMResult> results(roms.size());
+    std::atomic<size_t> next(0);
+
+    const auto start = std::chrono::steady_clock::now();
+
+    std::vector<std::thread> workers;
+    const unsigned int threads = (unsigned int)std::min<size_t>(options.threads, roms.size());
+
+    for (unsigned int i = 0; i < threads; i++) {
+        workers.emplace_back([&]() {
+            for (size_t index = next++; index < roms.size(); index = next++) {
+                runROM(roms[index], options, results[index]);
+            }
+        });
+    }
+
+    for (std::thread &worker : workers) {
+        worker.join();
+    }
+
+    const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    for (const ROMResult &result : results) {
+        if (isPassed(result)) {
+            continue;
+        }
+
+        std::cout << result.path << ": ";
+
+        if (!result.error.empty()) {
+            std::cout << result.error << "\n";
+            continue;
+        }
+
+        std::cout << TestROM::getStatusName(result.result.status);
+
+        if (result.result.signature) {
+            std::cout << " with code " << (unsigned int)result.result.code;
+        }
+
+        std::cout << "\n";
+
+        // What the test printed, indented under its path.
+        std::string line;
+        std::istringstream text(result.result.text);
+
+        while (std::getline(text, line)) {
+            std::cout << "    " << line << "\n";
+        }
+    }
+
+    const size_t passed = (size_t)std::count_if(results.begin(), results.end(), isPassed);
+    std::cout << passed << " of " << results.size() << " ROMs passed, on " << threads << " threads in " << seconds
+              << "s\n";
+
+    if ((!options.output.empty() && !writeFile(options.output, writeJSON, results, seconds)) ||
+        (!options.junit.empty() && !writeFile(options.junit, writeJUnit, results, seconds))) {
+        return EXIT_FAILURE;
+    }
+
+    return passed == results.size() ? EXIT_SUCCESS : EXIT_FAILURE;
+}
\ No newline at end of file
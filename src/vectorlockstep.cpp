@@ -0,0 +1,1115 @@
+#include "vectorlockstep.h"
+
+#include "nes.h"
+#include "mapper.h"
+#include "op.h"
+#include "op/irq.h"
+#include "op/loads.h"
+#include "op/stores.h"
+#include "op/transfers.h"
+#include "op/flags.h"
+#include "op/control.h"
+#include "op/stack.h"
+#include "op/arith.h"
+#include "utils.h"
+
+#include <algorithm>
+
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+using AM = Op::AddressingMode;
+
+const size_t VectorLockstep::MAX_LANES;
+
+static const size_t LANES = VectorLockstep::MAX_LANES;
+
+// How far ahead a lane's budget reaches at most, in dots. The PPU has an event on every scanline, so it is never hit
+// in practice; it only keeps the budget in range.
+static const int32_t MAX_BUDGET = 1 << 28;
+
+static_assert(LANES == 32, "A lane mask is a uint32_t");
+
+static size_t lowestLane(uint32_t lanes) {
+#ifdef _MSC_VER
+    unsigned long index;
+    _BitScanForward(&index, lanes);
+    return index;
+#else
+    return (size_t)__builtin_ctz(lanes);
+#endif
+}
+
+static size_t countLanes(uint32_t lanes) {
+    size_t count = 0;
+
+    for (; lanes != 0; lanes &= lanes - 1) {
+        count++;
+    }
+
+    return count;
+}
+
+/*
+ * Operations on a byte of every lane. A mask has all bits of a lane's byte set or clear.
+ */
+namespace {
+#ifdef __AVX2__
+    typedef __m256i Bytes;
+
+    inline Bytes load(const uint8_t *lanes) {
+        return _mm256_loadu_si256((const __m256i *)lanes);
+    }
+
+    inline void store(uint8_t *lanes, Bytes value) {
+        _mm256_storeu_si256((__m256i *)lanes, value);
+    }
+
+    inline Bytes splat(uint8_t value) {
+        return _mm256_set1_epi8((char)value);
+    }
+
+    inline Bytes add(Bytes a, Bytes b) {
+        return _mm256_add_epi8(a, b);
+    }
+
+    inline Bytes sub(Bytes a, Bytes b) {
+        return _mm256_sub_epi8(a, b);
+    }
+
+    inline Bytes bitAnd(Bytes a, Bytes b) {
+        return _mm256_and_si256(a, b);
+    }
+
+    inline Bytes bitOr(Bytes a, Bytes b) {
+        return _mm256_or_si256(a, b);
+    }
+
+    inline Bytes bitXor(Bytes a, Bytes b) {
+        return _mm256_xor_si256(a, b);
+    }
+
+    // ~a & b
+    inline Bytes andNot(Bytes a, Bytes b) {
+        return _mm256_andnot_si256(a, b);
+    }
+
+    inline Bytes equal(Bytes a, Bytes b) {
+        return _mm256_cmpeq_epi8(a, b);
+    }
+
+    // Unsigned a >= b.
+    inline Bytes atLeast(Bytes a, Bytes b) {
+        return _mm256_cmpeq_epi8(_mm256_max_epu8(a, b), a);
+    }
+
+    inline Bytes select(Bytes mask, Bytes a, Bytes b) {
+        return _mm256_blendv_epi8(b, a, mask);
+    }
+
+    inline Bytes shiftRight1(Bytes a) {
+        return _mm256_and_si256(_mm256_srli_epi16(a, 1), _mm256_set1_epi8(0x7F));
+    }
+
+    inline Bytes toMask(uint32_t lanes) {
+        const __m256i spread = _mm256_shuffle_epi8(_mm256_set1_epi32((int)lanes),
+            _mm256_setr_epi8(0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 1, 1, 1, 1,
+                             2, 2, 2, 2, 2, 2, 2, 2, 3, 3, 3, 3, 3, 3, 3, 3));
+        const __m256i bits = _mm256_set1_epi64x((long long)0x8040201008040201ull);
+        return _mm256_cmpeq_epi8(_mm256_and_si256(spread, bits), bits);
+    }
+
+    inline uint32_t toLanes(Bytes mask) {
+        return (uint32_t)_mm256_movemask_epi8(mask);
+    }
+#else
+    struct Bytes {
+        uint8_t lane[LANES];
+    };
+
+    template <typename F>
+    inline Bytes map(Bytes a, Bytes b, F f) {
+        Bytes result;
+
+        for (size_t i = 0; i < LANES; i++) {
+            result.lane[i] = (uint8_t)f(a.lane[i], b.lane[i]);
+        }
+
+        return result;
+    }
+
+    inline Bytes load(const uint8_t *lanes) {
+        Bytes result;
+        std::copy(lanes, lanes + LANES, result.lane);
+        return result;
+    }
+
+    inline void store(uint8_t *lanes, Bytes value) {
+        std::copy(value.lane, value.lane + LANES, lanes);
+    }
+
+    inline Bytes splat(uint8_t value) {
+        Bytes result;
+        std::fill(result.lane, result.lane + LANES, value);
+        return result;
+    }
+
+    inline Bytes add(Bytes a, Bytes b) {
+        return map(a, b, [](uint8_t x, uint8_t y) { return x + y; });
+    }
+
+    inline Bytes sub(Bytes a, Bytes b) {
+        return map(a, b, [](uint8_t x, uint8_t y) { return x - y; });
+    }
+
+    inline Bytes bitAnd(Bytes a, Bytes b) {
+        return map(a, b, [](uint8_t x, uint8_t y) { return x & y; });
+    }
+
+    inline Bytes bitOr(Bytes a, Bytes b) {
+        return map(a, b, [](uint8_t x, uint8_t y) { return x | y; });
+    }
+
+    inline Bytes bitXor(Bytes a, Bytes b) {
+        return map(a, b, [](uint8_t x, uint8_t y) { return x ^ y; });
+    }
+
+    inline Bytes andNot(Bytes a, Bytes b) {
+        return map(a, b, [](uint8_t x, uint8_t y) { return ~x & y; });
+    }
+
+    inline Bytes equal(Bytes a, Bytes b) {
+        return map(a, b, [](uint8_t x, uint8_t y) { return x == y ? 0xFF : 0x00; });
+    }
+
+    inline Bytes atLeast(Bytes a, Bytes b) {
+        return map(a, b, [](uint8_t x, uint8_t y) { return x >= y ? 0xFF : 0x00; });
+    }
+
+    inline Bytes select(Bytes mask, Bytes a, Bytes b) {
+        return bitOr(bitAnd(mask, a), andNot(mask, b));
+    }
+
+    inline Bytes shiftRight1(Bytes a) {
+        return map(a, a, [](uint8_t x, uint8_t) { return x >> 1; });
+    }
+
+    inline Bytes toMask(uint32_t lanes) {
+        Bytes result;
+
+        for (size_t i = 0; i < LANES; i++) {
+            result.lane[i] = (lanes >> i) & 1 ? 0xFF : 0x00;
+        }
+
+        return result;
+    }
+
+    inline uint32_t toLanes(Bytes mask) {
+        uint32_t lanes = 0;
+
+        for (size_t i = 0; i < LANES; i++) {
+            lanes |= (uint32_t)(mask.lane[i] >> 7) << i;
+        }
+
+        return lanes;
+    }
+#endif
+
+    /*
+     * Operations on the PCs (a word per lane) and times (a dword per lane) of the lanes in a mask.
+     */
+
+#ifdef __AVX2__
+    inline __m256i toWordMask(uint32_t lanes) {
+        const __m256i bits = _mm256_setr_epi16(0x0001, 0x0002, 0x0004, 0x0008, 0x0010, 0x0020, 0x0040, 0x0080,
+                                               0x0100, 0x0200, 0x0400, 0x0800, 0x1000, 0x2000, 0x4000,
+                                               (short)0x8000);
+        return _mm256_cmpeq_epi16(_mm256_and_si256(_mm256_set1_epi16((short)lanes), bits), bits);
+    }
+
+    inline __m256i toDwordMask(uint32_t lanes) {
+        const __m256i bits = _mm256_setr_epi32(0x01, 0x02, 0x04, 0x08, 0x10, 0x20, 0x40, 0x80);
+        return _mm256_cmpeq_epi32(_mm256_and_si256(_mm256_set1_epi32((int)lanes), bits), bits);
+    }
+
+    inline void setWords(uint16_t *words, uint32_t lanes, uint16_t value) {
+        for (size_t half = 0; half < 2; half++) {
+            __m256i *vector = (__m256i *)(words + 16 * half);
+            _mm256_storeu_si256(vector, _mm256_blendv_epi8(_mm256_loadu_si256(vector), _mm256_set1_epi16((short)value),
+                                                           toWordMask(lanes >> (16 * half))));
+        }
+    }
+
+    inline uint16_t findLowestWord(const uint16_t *words, uint32_t lanes) {
+        const __m256i none = _mm256_set1_epi16(-1);
+        const __m256i low = _mm256_blendv_epi8(none, _mm256_loadu_si256((const __m256i *)words), toWordMask(lanes));
+        const __m256i high = _mm256_blendv_epi8(none, _mm256_loadu_si256((const __m256i *)(words + 16)),
+                                                toWordMask(lanes >> 16));
+        const __m256i lowest = _mm256_min_epu16(low, high);
+        const __m128i half = _mm_min_epu16(_mm256_castsi256_si128(lowest), _mm256_extracti128_si256(lowest, 1));
+        return (uint16_t)_mm_cvtsi128_si32(_mm_minpos_epu16(half));
+    }
+
+    inline uint32_t findWord(const uint16_t *words, uint32_t lanes, uint16_t value) {
+        const __m256i wanted = _mm256_set1_epi16((short)value);
+        const __m256i low = _mm256_cmpeq_epi16(_mm256_loadu_si256((const __m256i *)words), wanted);
+        const __m256i high = _mm256_cmpeq_epi16(_mm256_loadu_si256((const __m256i *)(words + 16)), wanted);
+
+        // Packing works within 128-bit halves, so the quarters come out as lanes 0-7, 16-23, 8-15, 24-31.
+        const __m256i packed = _mm256_permute4x64_epi64(_mm256_packs_epi16(low, high), 0xD8);
+        return (uint32_t)_mm256_movemask_epi8(packed) & lanes;
+    }
+
+    inline void addDwords(int32_t *dwords, uint32_t lanes, int32_t value) {
+        for (size_t quarter = 0; quarter < 4; quarter++) {
+            __m256i *vector = (__m256i *)(dwords + 8 * quarter);
+            const __m256i added = _mm256_and_si256(_mm256_set1_epi32(value), toDwordMask(lanes >> (8 * quarter)));
+            _mm256_storeu_si256(vector, _mm256_add_epi32(_mm256_loadu_si256(vector), added));
+        }
+    }
+
+    // The lanes where a >= b.
+    inline uint32_t findAtLeast(const int32_t *a, const int32_t *b, uint32_t lanes) {
+        uint32_t below = 0;
+
+        for (size_t quarter = 0; quarter < 4; quarter++) {
+            const __m256i greater = _mm256_cmpgt_epi32(_mm256_loadu_si256((const __m256i *)(b + 8 * quarter)),
+                                                       _mm256_loadu_si256((const __m256i *)(a + 8 * quarter)));
+            below |= (uint32_t)_mm256_movemask_ps(_mm256_castsi256_ps(greater)) << (8 * quarter);
+        }
+
+        return ~below & lanes;
+    }
+#else
+    inline void setWords(uint16_t *words, uint32_t lanes, uint16_t value) {
+        for (uint32_t rest = lanes; rest != 0; rest &= rest - 1) {
+            words[lowestLane(rest)] = value;
+        }
+    }
+
+    inline uint16_t findLowestWord(const uint16_t *words, uint32_t lanes) {
+        uint16_t lowest = 0xFFFF;
+
+        for (uint32_t rest = lanes; rest != 0; rest &= rest - 1) {
+            lowest = std::min(lowest, words[lowestLane(rest)]);
+        }
+
+        return lowest;
+    }
+
+    inline uint32_t findWord(const uint16_t *words, uint32_t lanes, uint16_t value) {
+        uint32_t found = 0;
+
+        for (uint32_t rest = lanes; rest != 0; rest &= rest - 1) {
+            const size_t lane = lowestLane(rest);
+            found |= words[lane] == value ? 1u << lane : 0;
+        }
+
+        return found;
+    }
+
+    inline void addDwords(int32_t *dwords, uint32_t lanes, int32_t value) {
+        for (uint32_t rest = lanes; rest != 0; rest &= rest - 1) {
+            dwords[lowestLane(rest)] += value;
+        }
+    }
+
+    inline uint32_t findAtLeast(const int32_t *a, const int32_t *b, uint32_t lanes) {
+        uint32_t found = 0;
+
+        for (uint32_t rest = lanes; rest != 0; rest &= rest - 1) {
+            const size_t lane = lowestLane(rest);
+            found |= a[lane] >= b[lane] ? 1u << lane : 0;
+        }
+
+        return found;
+    }
+#endif
+
+    inline Bytes isFlagSet(Bytes p, CPUFlag flag) {
+        return equal(bitAnd(p, splat((uint8_t)flag)), splat((uint8_t)flag));
+    }
+
+    inline Bytes setFlag(Bytes p, CPUFlag flag, Bytes set) {
+        return bitOr(andNot(splat((uint8_t)flag), p), bitAnd(set, splat((uint8_t)flag)));
+    }
+
+    inline Bytes setNZFlags(Bytes p, Bytes value) {
+        const Bytes zero = bitAnd(equal(value, splat(0)), splat((uint8_t)CPUFlag::ZERO));
+        const Bytes negative = bitAnd(value, splat((uint8_t)CPUFlag::NEGATIVE));
+        return bitOr(andNot(splat((uint8_t)CPUFlag::NEGATIVE | (uint8_t)CPUFlag::ZERO), p), bitOr(zero, negative));
+    }
+
+    // Whether bit 7 is set.
+    inline Bytes isNegative(Bytes value) {
+        return equal(bitAnd(value, splat(0x80)), splat(0x80));
+    }
+
+    /**
+     * The instructions VectorLockstep executes itself. Everything else goes to the lanes' own CPUs.
+     */
+    enum class Operation : uint8_t {
+        SCALAR,
+        NOP,
+        LDA, LDX, LDY, STA, STX, STY,
+        AND, ORA, EOR, ADC, SBC, CMP, CPX, CPY, BIT,
+        ASL, LSR, ROL, ROR, INC, DEC,
+        INX, INY, DEX, DEY,
+        TAX, TAY, TXA, TYA, TSX, TXS,
+        CLC, CLD, CLI, CLV, SEC, SED, SEI,
+        BCC, BCS, BEQ, BNE, BMI, BPL, BVC, BVS,
+        JMP, JSR, RTS, RTI,
+        PHA, PHP, PLA, PLP
+    };
+
+    /**
+     * @return What each opcode is, found by its handler in the CPU's opcode table, so exactly the opcodes the CPU
+     * supports are executed here, with the same addressing modes and cycle counts.
+     */
+    const Operation *getOperations() {
+        static const struct {
+            Op::Handler handler;
+            Operation operation;
+        } HANDLERS[] = {
+            { Op::lda, Operation::LDA }, { Op::ldx, Operation::LDX }, { Op::ldy, Operation::LDY },
+            { Op::sta, Operation::STA }, { Op::stx, Operation::STX }, { Op::sty, Operation::STY },
+            { Op::_and, Operation::AND }, { Op::ora, Operation::ORA }, { Op::eor, Operation::EOR },
+            { Op::adc, Operation::ADC }, { Op::sbc, Operation::SBC }, { Op::cmp, Operation::CMP },
+            { Op::cpx, Operation::CPX }, { Op::cpy, Operation::CPY }, { Op::bit, Operation::BIT },
+            { Op::asl, Operation::ASL }, { Op::lsr, Operation::LSR }, { Op::rol, Operation::ROL },
+            { Op::ror, Operation::ROR }, { Op::inc, Operation::INC }, { Op::dec, Operation::DEC },
+            { Op::inx, Operation::INX }, { Op::iny, Operation::INY }, { Op::dex, Operation::DEX },
+            { Op::dey, Operation::DEY }, { Op::tax, Operation::TAX }, { Op::tay, Operation::TAY },
+            { Op::txa, Operation::TXA }, { Op::tya, Operation::TYA }, { Op::tsx, Operation::TSX },
+            { Op::txs, Operation::TXS }, { Op::clc, Operation::CLC }, { Op::cld, Operation::CLD },
+            { Op::cli, Operation::CLI }, { Op::clv, Operation::CLV }, { Op::sec, Operation::SEC },
+            { Op::sed, Operation::SED }, { Op::sei, Operation::SEI }, { Op::bcc, Operation::BCC },
+            { Op::bcs, Operation::BCS }, { Op::beq, Operation::BEQ }, { Op::bne, Operation::BNE },
+            { Op::bmi, Operation::BMI }, { Op::bpl, Operation::BPL }, { Op::bvc, Operation::BVC },
+            { Op::bvs, Operation::BVS }, { Op::jmp, Operation::JMP }, { Op::jsr, Operation::JSR },
+            { Op::rts, Operation::RTS }, { Op::rti, Operation::RTI }, { Op::pha, Operation::PHA },
+            { Op::php, Operation::PHP }, { Op::pla, Operation::PLA }, { Op::plp, Operation::PLP },
+            // The documented NOP's handler isn't exported; the undocumented NOPs have the unsupported one.
+            { Op::decode(0xEA)->handler, Operation::NOP }
+        };
+
+        static Operation operations[0x100] = {};
+        static bool initialised = false;
+
+        if (!initialised) {
+            for (unsigned int code = 0; code < 0x100; code++) {
+                const Op::Opcode *opcode = Op::decode((uint8_t)code);
+
+                for (const auto &entry : HANDLERS) {
+                    if (opcode != nullptr && opcode->handler == entry.handler) {
+                        operations[code] = entry.operation;
+                        break;
+                    }
+                }
+            }
+
+            initialised = true;
+        }
+
+        return operations;
+    }
+}
+
+VectorLockstep::VectorLockstep(std::shared_ptr<const ROMImage> rom, size_t laneCount)
+    : a(),
+      x(),
+      y(),
+      p(),
+      s(),
+      pc(),
+      ram(),
+      spent(),
+      budget(),
+      lanes(std::min(laneCount, MAX_LANES)),
+      laneMask(0),
+      activeLanes(0),
+      nmiLanes(0),
+      irqLanes(0),
+      stallLanes(0),
+      staleLanes(0),
+      bankMates(),
+      bankChangedLanes(0),
+      statistics()
+{
+    // Built here rather than on the first frame, as the table is shared by every instance and thread.
+    getOperations();
+
+    for (size_t lane = 0; lane < lanes.size(); lane++) {
+        Cartridge cartridge(rom);
+        Lane &l = lanes[lane];
+        l.nes.reset(new NES(cartridge));
+        l.cpu = l.nes->getCPU();
+        l.memory = l.nes->getMemory();
+        l.ppu = l.nes->getPPU();
+        l.scheduler = l.nes->getScheduler();
+        l.frame = 0;
+        l.time = 0;
+        laneMask |= 1u << lane;
+    }
+
+    staleLanes = laneMask;
+}
+
+VectorLockstep::~VectorLockstep() = default;
+
+void VectorLockstep::loadLane(size_t lane) {
+    Lane &l = lanes[lane];
+    const RegisterFile *r = l.cpu->getRegs();
+    a[lane] = r->a;
+    x[lane] = r->x;
+    y[lane] = r->y;
+    p[lane] = (uint8_t)r->p;
+    s[lane] = r->s;
+    pc[lane] = r->pc;
+
+    const uint8_t *memory = l.memory->getInternalMemory();
+
+    for (size_t address = 0; address < NES_INTERNAL_MEMORY_SIZE; address++) {
+        ram[address][lane] = memory[address];
+    }
+
+    // The mapper may have been swapped along with the cartridge.
+    l.mapper = l.nes->getCartridge()->getMapper();
+    bankChangedLanes |= 1u << lane;
+}
+
+void VectorLockstep::storeLane(size_t lane) {
+    Lane &l = lanes[lane];
+    RegisterFile *r = l.cpu->getRegs();
+    r->a = a[lane];
+    r->x = x[lane];
+    r->y = y[lane];
+    r->p = (CPUFlag)p[lane];
+    r->s = s[lane];
+    r->pc = pc[lane];
+
+    uint8_t *memory = l.memory->getInternalMemory();
+
+    for (size_t address = 0; address < NES_INTERNAL_MEMORY_SIZE; address++) {
+        memory[address] = ram[address][lane];
+    }
+}
+
+void VectorLockstep::updateBankMates() {
+    const uint32_t changed = bankChangedLanes;
+    bankChangedLanes = 0;
+
+    for (size_t lane = 0; lane < lanes.size(); lane++) {
+        bankMates[lane] &= ~changed;
+    }
+
+    for (uint32_t rest = changed; rest != 0; rest &= rest - 1) {
+        const size_t lane = lowestLane(rest);
+        const Mapper *mapper = lanes[lane].mapper;
+        uint32_t mates = 1u << lane;
+
+        for (size_t other = 0; other < lanes.size() && mapper != nullptr; other++) {
+            const Mapper *otherMapper = lanes[other].mapper;
+            bool same = otherMapper != nullptr && other != lane;
+
+            for (size_t slot = 0; same && slot < 4; slot++) {
+                same = mapper->getPRGWindow(slot) == otherMapper->getPRGWindow(slot);
+            }
+
+            if (same) {
+                mates |= 1u << other;
+                bankMates[other] |= 1u << lane;
+            }
+        }
+
+        bankMates[lane] = mates;
+    }
+}
+
+void VectorLockstep::syncTime(size_t lane) {
+    Lane &l = lanes[lane];
+    l.scheduler->advance(l.time + (uint64_t)spent[lane] - l.scheduler->getTime());
+}
+
+void VectorLockstep::refreshLane(size_t lane) {
+    Lane &l = lanes[lane];
+    const uint32_t bit = 1u << lane;
+    const uint64_t now = l.scheduler->getTime();
+    const uint64_t eventTime = l.scheduler->getNextEventTime();
+
+    l.time = now;
+    spent[lane] = 0;
+    budget[lane] = eventTime <= now ? 0 : (int32_t)std::min(eventTime - now, (uint64_t)MAX_BUDGET);
+
+    nmiLanes = l.cpu->isNMIPending() ? nmiLanes | bit : nmiLanes & ~bit;
+    irqLanes = l.cpu->isIRQLineAsserted() ? irqLanes | bit : irqLanes & ~bit;
+    stallLanes |= bit;
+
+    if (l.ppu->getFrame() != l.frame) {
+        activeLanes &= ~bit;
+    }
+}
+
+void VectorLockstep::handleEvents(uint32_t group) {
+    for (uint32_t rest = findAtLeast(spent, budget, group); rest != 0; rest &= rest - 1) {
+        const size_t lane = lowestLane(rest);
+        syncTime(lane);
+        lanes[lane].nes->handleDueEvents();
+        refreshLane(lane);
+    }
+}
+
+void VectorLockstep::stepScalar(size_t lane, bool interrupt) {
+    Lane &l = lanes[lane];
+    RegisterFile *r = l.cpu->getRegs();
+    uint8_t *memory = l.memory->getInternalMemory();
+
+    // An interrupt only pushes onto the stack; anything else may touch all of RAM.
+    const size_t first = interrupt ? NES_STACK_ADDRESS : 0;
+    const size_t end = interrupt ? NES_STACK_ADDRESS + NES_PAGE_SIZE : NES_INTERNAL_MEMORY_SIZE;
+
+    syncTime(lane);
+    r->a = a[lane];
+    r->x = x[lane];
+    r->y = y[lane];
+    r->p = (CPUFlag)p[lane];
+    r->s = s[lane];
+    r->pc = pc[lane];
+
+    for (size_t address = first; address < end; address++) {
+        memory[address] = ram[address][lane];
+    }
+
+    l.nes->step();
+
+    a[lane] = r->a;
+    x[lane] = r->x;
+    y[lane] = r->y;
+    p[lane] = (uint8_t)r->p;
+    s[lane] = r->s;
+    pc[lane] = r->pc;
+
+    for (size_t address = first; address < end; address++) {
+        ram[address][lane] = memory[address];
+    }
+
+    refreshLane(lane);
+
+    if (!interrupt) {
+        bankChangedLanes |= 1u << lane;
+    }
+
+    statistics.scalarSteps++;
+}
+
+uint8_t VectorLockstep::readLane(size_t lane, Address address) {
+    if (address < 0x2000) {
+        return ram[address & 0x7FF][lane];
+    }
+
+    const Mapper *mapper = lanes[lane].mapper;
+
+    if (address >= 0x6000 && mapper != nullptr && !mapper->isHooked(MapperHook::CPU_READ)) {
+        return address >= 0x8000 ? mapper->readPRG(address) : mapper->readPRGRAM(address);
+    }
+
+    syncTime(lane);
+    const uint8_t value = lanes[lane].memory->readCPU(address);
+    refreshLane(lane);
+    return value;
+}
+
+void VectorLockstep::writeLane(size_t lane, Address address, uint8_t value) {
+    if (address < 0x2000) {
+        ram[address & 0x7FF][lane] = value;
+        return;
+    }
+
+    Lane &l = lanes[lane];
+
+    if (address == 0x4014 && value < 0x20) {
+        // OAM DMA reads the page through the lane's Memory, so it has to hold the lane's RAM there.
+        uint8_t *memory = l.memory->getInternalMemory();
+        const size_t page = (value << 8) & 0x7FF;
+
+        for (size_t offset = 0; offset < NES_PAGE_SIZE; offset++) {
+            memory[page + offset] = ram[page + offset][lane];
+        }
+    }
+
+    syncTime(lane);
+    l.memory->writeCPU(address, value);
+    refreshLane(lane);
+
+    if (address >= 0x4020) {
+        bankChangedLanes |= 1u << lane;
+    }
+}
+
+bool VectorLockstep::stepGroup(uint32_t group) {
+    const size_t leader = lowestLane(group);
+    const Address address = pc[leader];
+    const Mapper *mapper = lanes[leader].mapper;
+
+    // The lanes share their PRG banks, so the leader's bytes are everyone's.
+    const uint8_t code = mapper->readPRG(address);
+    const Operation operation = getOperations()[code];
+
+    if (operation == Operation::SCALAR || address > 0xFFFD) {
+        return false;
+    }
+
+    const Op::Opcode *opcode = Op::decode(code);
+    const AM mode = opcode->mode;
+    const size_t operandCount = Op::getAddressingModeOperandCount(mode);
+    const uint8_t operands[2] = {
+        operandCount >= 1 ? mapper->readPRG((Address)(address + 1)) : (uint8_t)0,
+        operandCount >= 2 ? mapper->readPRG((Address)(address + 2)) : (uint8_t)0
+    };
+    const Address absolute = Utils::combineUint8sLE(operands[0], operands[1]);
+    const Address next = (Address)(address + 1 + operandCount);
+    const Bytes mask = toMask(group);
+
+    // The operand's location, for the instructions that have one in memory: one RAM row for the whole group when the
+    // address doesn't depend on the lane, or an address per lane otherwise. Worked out like Op::getAddress().
+    uint8_t *row = nullptr;
+    Address addresses[LANES];
+    bool located = false;
+
+    auto locate = [&]() {
+        located = true;
+
+        if (mode == AM::ZERO_PAGE || (mode == AM::ABSOLUTE && absolute < 0x2000)) {
+            row = ram[absolute & 0x7FF];
+            return;
+        }
+
+        for (uint32_t rest = group; rest != 0; rest &= rest - 1) {
+            const size_t lane = lowestLane(rest);
+
+            switch (mode) {
+                case AM::ZERO_PAGE_X:
+                    addresses[lane] = (Address)(operands[0] + x[lane]);
+                    break;
+
+                case AM::ZERO_PAGE_Y:
+                    addresses[lane] = (Address)(operands[0] + y[lane]);
+                    break;
+
+                case AM::ABSOLUTE_X:
+                    addresses[lane] = (Address)(absolute + x[lane]);
+                    break;
+
+                case AM::ABSOLUTE_Y:
+                    addresses[lane] = (Address)(absolute + y[lane]);
+                    break;
+
+                case AM::INDIRECT:
+                    addresses[lane] = Utils::combineUint8sLE(readLane(lane, absolute),
+                                                             readLane(lane, (Address)(absolute + 1)));
+                    break;
+
+                case AM::INDEXED_INDIRECT:
+                    addresses[lane] = readLane(lane, (Address)(operands[0] + x[lane]));
+                    break;
+
+                case AM::INDIRECT_INDEXED: {
+                    const Address pointer = (Address)(readLane(lane, operands[0]) + y[lane]);
+                    addresses[lane] = Utils::combineUint8sLE(readLane(lane, pointer),
+                                                             readLane(lane, (Address)(pointer + 1)));
+                    break;
+                }
+
+                default:
+                    addresses[lane] = absolute;
+                    break;
+            }
+        }
+    };
+
+    auto read = [&]() -> Bytes {
+        switch (mode) {
+            case AM::IMMEDIATE:
+                return splat(operands[0]);
+
+            case AM::ACCUMULATOR:
+                return load(a);
+
+            default:
+                break;
+        }
+
+        locate();
+
+        if (row != nullptr) {
+            return load(row);
+        } else if (mode == AM::ABSOLUTE && absolute >= 0x8000 && !mapper->isHooked(MapperHook::CPU_READ)) {
+            return splat(mapper->readPRG(absolute));
+        }
+
+        uint8_t values[LANES] = {};
+
+        for (uint32_t rest = group; rest != 0; rest &= rest - 1) {
+            const size_t lane = lowestLane(rest);
+            values[lane] = readLane(lane, addresses[lane]);
+        }
+
+        return load(values);
+    };
+
+    // After read(), or on its own for a store.
+    auto write = [&](Bytes value) {
+        if (mode == AM::ACCUMULATOR) {
+            store(a, select(mask, value, load(a)));
+            return;
+        }
+
+        if (!located) {
+            locate();
+        }
+
+        if (row != nullptr) {
+            store(row, select(mask, value, load(row)));
+            return;
+        }
+
+        uint8_t values[LANES];
+        store(values, value);
+
+        for (uint32_t rest = group; rest != 0; rest &= rest - 1) {
+            const size_t lane = lowestLane(rest);
+            writeLane(lane, addresses[lane], values[lane]);
+        }
+    };
+
+    auto update = [&](uint8_t *lanes, Bytes value) {
+        store(lanes, select(mask, value, load(lanes)));
+    };
+
+    auto updateNZ = [&](uint8_t *lanes, Bytes value) {
+        update(lanes, value);
+        update(p, setNZFlags(load(p), value));
+    };
+
+    auto compare = [&](const uint8_t *lanes) {
+        const Bytes reg = load(lanes);
+        const Bytes value = read();
+        Bytes flags = setFlag(load(p), CPUFlag::CARRY, atLeast(reg, value));
+        flags = setFlag(flags, CPUFlag::ZERO, equal(reg, value));
+        flags = setFlag(flags, CPUFlag::NEGATIVE, isNegative(sub(reg, value)));
+        update(p, flags);
+    };
+
+    // Like computeADC(): SBC adds the two's complement of its operand, carry and all.
+    auto addWithCarry = [&](Bytes value) {
+        const Bytes accumulator = load(a);
+        const Bytes flags = load(p);
+        const Bytes carry = bitAnd(flags, splat((uint8_t)CPUFlag::CARRY));
+        const Bytes sum = add(add(accumulator, value), carry);
+        const Bytes carryOut = bitOr(bitAnd(accumulator, value), andNot(sum, bitOr(accumulator, value)));
+        const Bytes overflow = andNot(bitXor(accumulator, value), bitXor(accumulator, sum));
+
+        Bytes result = setFlag(flags, CPUFlag::CARRY, isNegative(carryOut));
+        result = setFlag(result, CPUFlag::OVER_FLOW, isNegative(overflow));
+        update(p, setNZFlags(result, sum));
+        update(a, sum);
+    };
+
+    // ASL, LSR, ROL, ROR, INC and DEC, on A or in memory.
+    auto modify = [&](Operation op) {
+        const Bytes value = read();
+        const Bytes flags = load(p);
+        const Bytes carry = isFlagSet(flags, CPUFlag::CARRY);
+        Bytes result;
+        Bytes carryOut = carry;
+
+        switch (op) {
+            case Operation::ASL:
+                result = add(value, value);
+                carryOut = isNegative(value);
+                break;
+
+            case Operation::LSR:
+                result = shiftRight1(value);
+                carryOut = equal(bitAnd(value, splat(1)), splat(1));
+                break;
+
+            case Operation::ROL:
+                result = bitOr(add(value, value), bitAnd(carry, splat(0x01)));
+                carryOut = isNegative(value);
+                break;
+
+            case Operation::ROR:
+                result = bitOr(shiftRight1(value), bitAnd(carry, splat(0x80)));
+                carryOut = equal(bitAnd(value, splat(1)), splat(1));
+                break;
+
+            case Operation::INC:
+                result = add(value, splat(1));
+                break;
+
+            default:
+                result = sub(value, splat(1));
+                break;
+        }
+
+        update(p, setNZFlags(setFlag(flags, CPUFlag::CARRY, carryOut), result));
+        write(result);
+    };
+
+    auto branch = [&](CPUFlag flag, bool set) {
+        const Bytes flagSet = isFlagSet(load(p), flag);
+        const uint32_t taken = group & (set ? toLanes(flagSet) : ~toLanes(flagSet));
+        setWords(pc, taken, (Address)(next + (int8_t)operands[0]));
+        setWords(pc, group & ~taken, next);
+    };
+
+    auto push = [&](size_t lane, uint8_t value) {
+        ram[NES_STACK_ADDRESS + s[lane]][lane] = value;
+        s[lane]--;
+    };
+
+    auto pull = [&](size_t lane) -> uint8_t {
+        s[lane]++;
+        return ram[NES_STACK_ADDRESS + s[lane]][lane];
+    };
+
+    bool jumped = false;
+
+    switch (operation) {
+        case Operation::SCALAR:
+        case Operation::NOP:
+            break;
+
+        case Operation::LDA: updateNZ(a, read()); break;
+        case Operation::LDX: updateNZ(x, read()); break;
+        case Operation::LDY: updateNZ(y, read()); break;
+
+        case Operation::STA: write(load(a)); break;
+        case Operation::STX: write(load(x)); break;
+        case Operation::STY: write(load(y)); break;
+
+        case Operation::AND: updateNZ(a, bitAnd(load(a), read())); break;
+        case Operation::ORA: updateNZ(a, bitOr(load(a), read())); break;
+        case Operation::EOR: updateNZ(a, bitXor(load(a), read())); break;
+        case Operation::ADC: addWithCarry(read()); break;
+        case Operation::SBC: addWithCarry(sub(splat(0), read())); break;
+
+        case Operation::CMP: compare(a); break;
+        case Operation::CPX: compare(x); break;
+        case Operation::CPY: compare(y); break;
+
+        case Operation::BIT: {
+            const Bytes value = read();
+            Bytes flags = setFlag(load(p), CPUFlag::ZERO, equal(bitAnd(load(a), value), splat(0)));
+            flags = setFlag(flags, CPUFlag::NEGATIVE, isNegative(value));
+            flags = setFlag(flags, CPUFlag::OVER_FLOW, isNegative(add(value, value)));
+            update(p, flags);
+            break;
+        }
+
+        case Operation::ASL:
+        case Operation::LSR:
+        case Operation::ROL:
+        case Operation::ROR:
+        case Operation::INC:
+        case Operation::DEC:
+            modify(operation);
+            break;
+
+        case Operation::INX: updateNZ(x, add(load(x), splat(1))); break;
+        case Operation::INY: updateNZ(y, add(load(y), splat(1))); break;
+        case Operation::DEX: updateNZ(x, sub(load(x), splat(1))); break;
+        case Operation::DEY: updateNZ(y, sub(load(y), splat(1))); break;
+
+        // Like the CPU's, every transfer sets N and Z, TXS included.
+        case Operation::TAX: updateNZ(x, load(a)); break;
+        case Operation::TAY: updateNZ(y, load(a)); break;
+        case Operation::TXA: updateNZ(a, load(x)); break;
+        case Operation::TYA: updateNZ(a, load(y)); break;
+        case Operation::TSX: updateNZ(x, load(s)); break;
+        case Operation::TXS: updateNZ(s, load(x)); break;
+
+        case Operation::CLC: update(p, setFlag(load(p), CPUFlag::CARRY, splat(0))); break;
+        case Operation::CLD: update(p, setFlag(load(p), CPUFlag::DECIMAL_MODE, splat(0))); break;
+        case Operation::CLI: update(p, setFlag(load(p), CPUFlag::IRQ_DISABLE, splat(0))); break;
+        case Operation::CLV: update(p, setFlag(load(p), CPUFlag::OVER_FLOW, splat(0))); break;
+        case Operation::SEC: update(p, setFlag(load(p), CPUFlag::CARRY, splat(0xFF))); break;
+        case Operation::SED: update(p, setFlag(load(p), CPUFlag::DECIMAL_MODE, splat(0xFF))); break;
+        case Operation::SEI: update(p, setFlag(load(p), CPUFlag::IRQ_DISABLE, splat(0xFF))); break;
+
+        case Operation::BCC: branch(CPUFlag::CARRY, false); jumped = true; break;
+        case Operation::BCS: branch(CPUFlag::CARRY, true); jumped = true; break;
+        case Operation::BNE: branch(CPUFlag::ZERO, false); jumped = true; break;
+        case Operation::BEQ: branch(CPUFlag::ZERO, true); jumped = true; break;
+        case Operation::BPL: branch(CPUFlag::NEGATIVE, false); jumped = true; break;
+        case Operation::BMI: branch(CPUFlag::NEGATIVE, true); jumped = true; break;
+        case Operation::BVC: branch(CPUFlag::OVER_FLOW, false); jumped = true; break;
+        case Operation::BVS: branch(CPUFlag::OVER_FLOW, true); jumped = true; break;
+
+        case Operation::JMP:
+            if (mode == AM::INDIRECT) {
+                locate();
+
+                for (uint32_t rest = group; rest != 0; rest &= rest - 1) {
+                    const size_t lane = lowestLane(rest);
+                    pc[lane] = addresses[lane];
+                }
+
+                jumped = true;
+            }
+            break;
+
+        case Operation::JSR:
+            for (uint32_t rest = group; rest != 0; rest &= rest - 1) {
+                const size_t lane = lowestLane(rest);
+                push(lane, (uint8_t)((next - 1) >> 8));
+                push(lane, (uint8_t)(next - 1));
+            }
+            break;
+
+        case Operation::RTS:
+            for (uint32_t rest = group; rest != 0; rest &= rest - 1) {
+                const size_t lane = lowestLane(rest);
+                const uint8_t low = pull(lane);
+                const uint8_t high = pull(lane);
+                pc[lane] = (Address)(Utils::combineUint8sLE(low, high) + 1);
+            }
+
+            jumped = true;
+            break;
+
+        case Operation::RTI:
+            for (uint32_t rest = group; rest != 0; rest &= rest - 1) {
+                const size_t lane = lowestLane(rest);
+                p[lane] = pull(lane);
+                const uint8_t low = pull(lane);
+                const uint8_t high = pull(lane);
+                pc[lane] = Utils::combineUint8sLE(low, high);
+            }
+
+            jumped = true;
+            break;
+
+        case Operation::PHA:
+        case Operation::PHP:
+            for (uint32_t rest = group; rest != 0; rest &= rest - 1) {
+                const size_t lane = lowestLane(rest);
+                push(lane, operation == Operation::PHA ? a[lane] : p[lane]);
+            }
+            break;
+
+        case Operation::PLA:
+        case Operation::PLP:
+            for (uint32_t rest = group; rest != 0; rest &= rest - 1) {
+                const size_t lane = lowestLane(rest);
+                const uint8_t value = pull(lane);
+
+                if (operation == Operation::PLP) {
+                    p[lane] = value;
+                } else {
+                    a[lane] = value;
+                    p[lane] = (uint8_t)Utils::setFlag8((CPUFlag)p[lane], CPUFlag::ZERO, value == 0);
+                    p[lane] = (uint8_t)Utils::setFlag8((CPUFlag)p[lane], CPUFlag::NEGATIVE, (value & 0x80) != 0);
+                }
+            }
+            break;
+    }
+
+    if (!jumped) {
+        // JMP and JSR with an absolute address go to the same place on every lane.
+        setWords(pc, group, operation == Operation::JMP || operation == Operation::JSR ? absolute : next);
+    }
+
+    // Every supported instruction takes its base cycles, whatever the lane did; stalls (OAM DMA) come on top.
+    addDwords(spent, group, (int32_t)(opcode->baseCycles * PPU::DOTS_PER_CPU_CYCLE));
+
+    for (uint32_t rest = group & stallLanes; rest != 0; rest &= rest - 1) {
+        const size_t lane = lowestLane(rest);
+        spent[lane] += (int32_t)(lanes[lane].cpu->takeStallCycles() * PPU::DOTS_PER_CPU_CYCLE);
+    }
+
+    stallLanes &= ~group;
+    handleEvents(group);
+
+    statistics.groupSteps++;
+    statistics.laneSteps += countLanes(group);
+    return true;
+}
+
+void VectorLockstep::runFrame(const uint8_t *inputs) {
+    for (size_t lane = 0; lane < lanes.size(); lane++) {
+        Lane &l = lanes[lane];
+
+        if ((staleLanes >> lane) & 1) {
+            loadLane(lane);
+        }
+
+        l.frame = l.ppu->getFrame();
+        l.nes->getController(0)->setButtons(inputs[lane]);
+    }
+
+    staleLanes = 0;
+    activeLanes = laneMask;
+
+    for (size_t lane = 0; lane < lanes.size(); lane++) {
+        refreshLane(lane);
+    }
+
+    while (activeLanes != 0) {
+        // Interrupts are taken before the next instruction, by the lane's own CPU.
+        if (((nmiLanes | irqLanes) & activeLanes) != 0) {
+            const uint32_t irqDisabled = toLanes(isFlagSet(load(p), CPUFlag::IRQ_DISABLE));
+            const uint32_t interrupted = activeLanes & (nmiLanes | (irqLanes & ~irqDisabled));
+
+            for (uint32_t rest = interrupted; rest != 0; rest &= rest - 1) {
+                stepScalar(lowestLane(rest), true);
+            }
+
+            if (interrupted != 0) {
+                continue;
+            }
+        }
+
+        if (bankChangedLanes != 0) {
+            updateBankMates();
+        }
+
+        // The lanes with the lowest PC go next.
+        const uint16_t lowest = findLowestWord(pc, activeLanes);
+        const uint32_t candidates = findWord(pc, activeLanes, lowest);
+        const size_t leader = lowestLane(candidates);
+        const uint32_t group = candidates & bankMates[leader];
+
+        const Mapper *mapper = lanes[leader].mapper;
+        const bool inPRGROM = pc[leader] >= 0x8000 && mapper != nullptr && !mapper->isHooked(MapperHook::CPU_READ);
+
+        if (!inPRGROM || !stepGroup(group)) {
+            for (uint32_t rest = group; rest != 0; rest &= rest - 1) {
+                stepScalar(lowestLane(rest), false);
+            }
+        }
+    }
+}
+
+NES *VectorLockstep::getLane(size_t lane) {
+    if (((staleLanes >> lane) & 1) == 0) {
+        storeLane(lane);
+        staleLanes |= 1u << lane;
+    }
+
+    return lanes[lane].nes.get();
+}
+
+size_t VectorLockstep::getLaneCount() const {
+    return lanes.size();
+}
+
+const VectorLockstep::Statistics &VectorLockstep::getStatistics() const {
+    return statistics;
+}
\ No newline at end of file
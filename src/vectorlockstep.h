@@ -0,0 +1,165 @@
+#pragma once
+
+#include "address.h"
+#include "memory.h"
+#include "rom.h"
+
+#include <vector>
+#include <memory>
+#include <cstdint>
+#include <cstddef>
+
+class NES;
+class CPU;
+class Mapper;
+class PPU;
+class Scheduler;
+
+/**
+ * Runs up to MAX_LANES instances ("lanes") of the same game with different inputs, executing the CPUs of the lanes
+ * together while they agree on what to execute.
+ *
+ * The 6502 registers and internal RAM of every lane are kept in structure-of-arrays form: one byte per lane, side by
+ * side, so a register or a RAM address of all lanes fits in one 256-bit vector. The lanes whose PC is the lowest are
+ * picked as a group, and the instruction they share is executed for all of them at once, with AVX2 when the engine
+ * is built with it (NESULATOR_AVX2). Lanes that branch differently simply end up with different PCs and are picked
+ * separately; running the lowest PC first makes the lanes of an if or a loop wait for each other where their paths
+ * meet again.
+ *
+ * Everything else stays scalar. Each lane has a whole NES of its own, whose PPU, APU, mapper, controllers and
+ * scheduler are driven through it: register, PRG-RAM and mapper accesses go to the lane's Memory one lane at a time,
+ * and each lane's events are handled at its own time. Interrupts, BRK and the opcodes the CPU doesn't support, as
+ * well as code outside PRG-ROM, are handed to the lane's own CPU, with its registers and RAM synced around the step.
+ * Every lane therefore goes through exactly the states it would on its own; only the order in which the lanes get
+ * there differs. The output is the same as with NES::runFrame() on each lane, which nesulator_lanecheck checks.
+ *
+ * The gain is in the CPU, so it shows when the CPU is what costs: with the PPU's output suppressed, and the more
+ * the lanes share their PCs. nesulator_bench's "lockstep.vector." benchmarks measure it against the same lanes run
+ * as separate machines. It uses one thread: run one VectorLockstep per core to use more.
+ *
+ * A lane's machine must not be given an input queue or a checkpoint writer: they would see the lane between frames
+ * only.
+ */
+class VectorLockstep {
+public:
+    static const size_t MAX_LANES = 32;
+
+    /**
+     * Counts what the lanes' instructions went through, to see how much of the work was shared.
+     */
+    struct Statistics {
+        uint64_t groupSteps;    // Instructions executed for a group of lanes at once.
+        uint64_t laneSteps;     // The instructions in those, counted once per lane.
+        uint64_t scalarSteps;   // Instructions and interrupts handed to a lane's own CPU.
+    };
+
+    /**
+     * @param rom The game to run. Every lane starts at power-on.
+     * @param lanes How many instances to run, 1 to MAX_LANES.
+     */
+    VectorLockstep(std::shared_ptr<const ROMImage> rom, size_t lanes);
+
+    ~VectorLockstep();
+
+    VectorLockstep(const VectorLockstep &) = delete;
+
+    VectorLockstep &operator=(const VectorLockstep &) = delete;
+
+    /**
+     * Runs one frame on every lane: each lane steps until its PPU has finished the current frame, like
+     * NES::runFrame().
+     * @param inputs The buttons held on controller 1 of each lane, one entry per lane (see ControllerButton).
+     */
+    void runFrame(const uint8_t *inputs);
+
+    /**
+     * @return The machine of a lane, with its registers and RAM brought up to date. It may be read and changed
+     * between frames; the next runFrame() picks up the changes.
+     */
+    NES *getLane(size_t lane);
+
+    size_t getLaneCount() const;
+
+    const Statistics &getStatistics() const;
+
+private:
+    struct Lane {
+        std::unique_ptr<NES> nes;
+        CPU *cpu;
+        Memory *memory;
+        PPU *ppu;
+        Scheduler *scheduler;
+        Mapper *mapper;
+        uint64_t frame;         // The frame the lane is running.
+        uint64_t time;          // The scheduler's time when `spent` was last 0.
+    };
+
+    /*
+     * The lanes' CPU state, one byte (or word) per lane. Lanes beyond the lane count are never picked.
+     */
+    uint8_t a[MAX_LANES];
+    uint8_t x[MAX_LANES];
+    uint8_t y[MAX_LANES];
+    uint8_t p[MAX_LANES];
+    uint8_t s[MAX_LANES];
+    uint16_t pc[MAX_LANES];
+    uint8_t ram[NES_INTERNAL_MEMORY_SIZE][MAX_LANES];
+
+    /*
+     * Each lane's time, as the dots `spent` since Lane::time, and the dots it may spend before an event of its
+     * scheduler is due. The lane's scheduler itself is only brought up to date when the lane accesses a register or
+     * handles an event.
+     */
+    int32_t spent[MAX_LANES];
+    int32_t budget[MAX_LANES];
+
+    std::vector<Lane> lanes;
+    uint32_t laneMask;          // A bit for every lane.
+    uint32_t activeLanes;       // The lanes that haven't finished the frame yet.
+    uint32_t nmiLanes;          // The lanes with an NMI pending.
+    uint32_t irqLanes;          // The lanes with their /IRQ line asserted.
+    uint32_t stallLanes;        // The lanes whose CPU may have been stalled since their last instruction.
+    uint32_t staleLanes;        // The lanes whose machine may have been changed since the last frame.
+
+    // The lanes with the same PRG-ROM banks mapped as each lane, as a mask per lane. Mappers only switch PRG banks on
+    // writes to cartridge space, so only the lanes that wrote there since have to be compared again.
+    uint32_t bankMates[MAX_LANES];
+    uint32_t bankChangedLanes;
+
+    Statistics statistics;
+
+    void loadLane(size_t lane);
+
+    void storeLane(size_t lane);
+
+    void updateBankMates();
+
+    /**
+     * Brings the lane's scheduler up to the lane's time.
+     */
+    void syncTime(size_t lane);
+
+    /**
+     * Picks up what a register access, an event or a step of the lane's own CPU changed: when the next event is
+     * due, the interrupt lines, and whether the frame is over.
+     */
+    void refreshLane(size_t lane);
+
+    void handleEvents(uint32_t group);
+
+    /**
+     * Hands the lane's next instruction or interrupt to its own CPU.
+     * @param interrupt Whether it is an interrupt, which only touches the registers and the stack.
+     */
+    void stepScalar(size_t lane, bool interrupt);
+
+    /**
+     * Executes the instruction at the lanes' shared PC.
+     * @return false if it has to be handed to the lanes' own CPUs instead.
+     */
+    bool stepGroup(uint32_t group);
+
+    uint8_t readLane(size_t lane, Address address);
+
+    void writeLane(size_t lane, Address address, uint8_t value);
+};
\ No newline at end of file